@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "arena.h"
+#include "dexstats.h"
+
+struct ArenaChunk {
+	ArenaChunk	*next;
+	size_t		used;
+	size_t		cap;
+	int			owned;			/* malloc'ed by the arena, not a caller buffer */
+	char		data[];
+};
+
+void arena_init(Arena *arena, int flags)
+{
+	memset(arena, 0, sizeof(*arena));
+	arena->chunk_size = ARENA_CHUNK_SIZE;
+	arena->flags = flags;
+	if(flags & ARENA_SHARED)
+		pthread_mutex_init(&arena->lock, NULL);
+}
+
+/*
+ * a private arena whose first chunk is buffer. The buffer is never
+ * freed by the arena, so it can live on the caller's stack.
+ */
+void arena_init_buffer(Arena *arena, void *buffer, size_t size)
+{
+	ArenaChunk *chunk;
+	size_t skip = (-(uintptr_t)buffer) & (sizeof(void *) - 1);
+
+	arena_init(arena, 0);
+	if(buffer == NULL || size < skip + sizeof(ArenaChunk) + ARENA_ALIGN)
+		return ;
+	chunk = (ArenaChunk *)((char *)buffer + skip);
+	chunk->next = NULL;
+	chunk->used = 0;
+	chunk->cap = size - skip - sizeof(ArenaChunk);
+	chunk->owned = 0;
+	arena->chunks = chunk;
+}
+
+static void free_chunks(ArenaChunk *chunk)
+{
+	ArenaChunk *next;
+
+	for(; chunk != NULL; chunk = next){
+		next = chunk->next;
+		if(chunk->owned)
+			free(chunk);
+	}
+}
+
+void arena_free(Arena *arena)
+{
+	if(arena == NULL)
+		return ;
+	free_chunks(arena->chunks);
+	free_chunks(arena->spare);
+	if(arena->flags & ARENA_SHARED)
+		pthread_mutex_destroy(&arena->lock);
+	memset(arena, 0, sizeof(*arena));
+}
+
+/*
+ * bytes to skip in chunk so that the next allocation is aligned.
+ */
+static size_t align_pad(const ArenaChunk *chunk, size_t align)
+{
+	return (-(uintptr_t)(chunk->data + chunk->used)) & (align - 1);
+}
+
+/*
+ * a chunk with room for size bytes at align: a spare one if one is big
+ * enough, a new one otherwise.
+ */
+static ArenaChunk *new_chunk(Arena *arena, size_t size, size_t align)
+{
+	ArenaChunk *chunk, **link;
+	size_t cap;
+
+	for(link = &arena->spare; (chunk = *link) != NULL; link = &chunk->next){
+		if(chunk->cap >= size + align){
+			*link = chunk->next;
+			chunk->used = 0;
+			return chunk;
+		}
+	}
+
+	if(size > SIZE_MAX - sizeof(ArenaChunk) - align){
+		fprintf(stderr, "new_chunk - allocation of %zu bytes too large.\n", size);
+		return NULL;
+	}
+	cap = size + align > arena->chunk_size ? size + align : arena->chunk_size;
+	chunk = (ArenaChunk *)dex_malloc(sizeof(ArenaChunk) + cap);
+	if(chunk == NULL){
+		fprintf(stderr, "new_chunk - malloc failure out of memory.\n");
+		return NULL;
+	}
+	DEX_STAT_ADD(DEX_STAT_ARENA_BYTES, cap);
+	chunk->used = 0;
+	chunk->cap = cap;
+	chunk->owned = 1;
+	return chunk;
+}
+
+static void *alloc_locked(Arena *arena, size_t size, size_t align)
+{
+	ArenaChunk *chunk = arena->chunks;
+	size_t pad = 0;
+
+	if(chunk != NULL)
+		pad = align_pad(chunk, align);
+	if(chunk == NULL || chunk->cap - chunk->used < size + pad){
+		if((chunk = new_chunk(arena, size, align)) == NULL)
+			return NULL;
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+		pad = align_pad(chunk, align);
+	}
+	chunk->used += pad + size;
+	return chunk->data + chunk->used - size;
+}
+
+/*
+ * size bytes aligned to align, a power of 2. Returns NULL when out of
+ * memory.
+ */
+void *arena_alloc_align(Arena *arena, size_t size, size_t align)
+{
+	void *ptr;
+
+	if(!(arena->flags & ARENA_SHARED))
+		return alloc_locked(arena, size, align);
+	pthread_mutex_lock(&arena->lock);
+	ptr = alloc_locked(arena, size, align);
+	pthread_mutex_unlock(&arena->lock);
+	return ptr;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+	return arena_alloc_align(arena, size, ARENA_ALIGN);
+}
+
+void *arena_calloc(Arena *arena, size_t nmemb, size_t size)
+{
+	void *ptr;
+
+	if(size != 0 && nmemb > SIZE_MAX / size){
+		fprintf(stderr, "arena_calloc - %zu items of %zu bytes too large.\n", nmemb, size);
+		return NULL;
+	}
+	if((ptr = arena_alloc(arena, nmemb * size)) != NULL)
+		memset(ptr, 0, nmemb * size);
+	return ptr;
+}
+
+/*
+ * a NUL terminated copy of the len bytes at str.
+ */
+char *arena_strndup(Arena *arena, const char *str, size_t len)
+{
+	char *copy;
+
+	if(len == SIZE_MAX || (copy = (char *)arena_alloc_align(arena, len + 1, 1)) == NULL)
+		return NULL;
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+/*
+ * remember the current top; arena_release(mark) frees what was allocated
+ * after it. Marks nest, and are not for an arena other threads allocate
+ * from.
+ */
+void arena_mark(Arena *arena, ArenaMark *mark)
+{
+	mark->chunk = arena->chunks;
+	mark->used = arena->chunks != NULL ? arena->chunks->used : 0;
+}
+
+void arena_release(Arena *arena, const ArenaMark *mark)
+{
+	ArenaChunk *chunk;
+
+	// a caller buffer is always the last chunk, it stays put.
+	while((chunk = arena->chunks) != NULL && chunk != mark->chunk && chunk->owned){
+		arena->chunks = chunk->next;
+		chunk->next = arena->spare;
+		arena->spare = chunk;
+	}
+	if(chunk != NULL)
+		chunk->used = chunk == mark->chunk ? mark->used : 0;
+}
+
+/*
+ * drop every allocation, keeping the chunks for the next ones.
+ */
+void arena_reset(Arena *arena)
+{
+	ArenaMark mark = {NULL, 0};
+
+	arena_release(arena, &mark);
+}
+
+/*
+ * bytes the arena holds from malloc, in use or spare.
+ */
+size_t arena_size(const Arena *arena)
+{
+	const ArenaChunk *chunk;
+	size_t size = 0;
+
+	for(chunk = arena->chunks; chunk != NULL; chunk = chunk->next){
+		if(chunk->owned)
+			size += chunk->cap;
+	}
+	for(chunk = arena->spare; chunk != NULL; chunk = chunk->next)
+		size += chunk->cap;
+	return size;
+}
@@ -0,0 +1,53 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+ * Bump allocator over a list of chunks. Nothing is freed on its own: a
+ * mark/release pair drops everything allocated in between (the chunks
+ * are kept for reuse), arena_reset() drops everything, arena_free() gives
+ * the chunks back.
+ *
+ * A DexContext keeps one arena, created with ARENA_SHARED, for the tables
+ * and strings it lives with; allocations then take the arena's lock so
+ * several threads can fill the caches of one context. Scratch arenas are
+ * private to a call and may start out on a caller buffer (on the stack),
+ * so a formatter only mallocs when that buffer runs out.
+ */
+enum {
+	ARENA_SHARED	= 0x1,		/* allocations may come from several threads */
+};
+
+#define ARENA_ALIGN			16
+#define ARENA_CHUNK_SIZE	(64 * 1024)
+
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct {
+	ArenaChunk		*chunks;		/* the one allocated from first */
+	ArenaChunk		*spare;			/* emptied by a release, reused before malloc */
+	size_t			chunk_size;
+	int				flags;
+	pthread_mutex_t	lock;			/* ARENA_SHARED only */
+} Arena;
+
+typedef struct {
+	ArenaChunk	*chunk;
+	size_t		used;
+} ArenaMark;
+
+extern void arena_init(Arena *arena, int flags);
+extern void arena_init_buffer(Arena *arena, void *buffer, size_t size);
+extern void arena_free(Arena *arena);
+extern void arena_reset(Arena *arena);
+extern void *arena_alloc_align(Arena *arena, size_t size, size_t align);
+extern void *arena_alloc(Arena *arena, size_t size);
+extern void *arena_calloc(Arena *arena, size_t nmemb, size_t size);
+extern char *arena_strndup(Arena *arena, const char *str, size_t len);
+extern void arena_mark(Arena *arena, ArenaMark *mark);
+extern void arena_release(Arena *arena, const ArenaMark *mark);
+extern size_t arena_size(const Arena *arena);
+
+#endif	/* __ARENA_H__ */
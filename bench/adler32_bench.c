@@ -0,0 +1,101 @@
+/*
+ * adler32 microbenchmark: the stdio based implementation readex used to
+ * have against every kernel in checksum.c, over the same file.
+ *
+ *   ./adler32_bench [dex_file] [runs]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../deximage.h"
+#include "../checksum.h"
+
+#define DEFAULT_FILE	"classes.dex"
+#define DEFAULT_RUNS	20
+#define CHECK_OFFSET	12		// OFFSETOF(DexHeader, signature)
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the former utils.c adler32(): one fgetc and two modulo per byte. */
+static int adler32_fgetc(FILE *adler, uint32_t *result)
+{
+	int c;
+	uint32_t A = 1;
+	uint32_t B = 0;
+
+	while((c = fgetc(adler)) != EOF){
+		A = (A + c) % 65521;
+		B = (A + B) % 65521;
+	}
+	if(!feof(adler))
+		return -1;
+	*result = (B << 16) | A;
+	return 0;
+}
+
+static void report(const char *name, double secs, int runs, size_t len, uint32_t sum, double base)
+{
+	double mbs = (double)len * runs / secs / (1024.0 * 1024.0);
+	printf(" %-10s %10.3f ms/run %10.1f MB/s %8.1fx   %08X\n",
+			name, secs * 1000.0 / runs, mbs, base > 0 ? base / secs : 1.0, sum);
+}
+
+int main(int argc, char **argv)
+{
+	const char *file = argc > 1 ? argv[1] : DEFAULT_FILE;
+	int runs = argc > 2 ? atoi(argv[2]) : DEFAULT_RUNS;
+	const Adler32Impl *impl;
+	DexImage image;
+	FILE *fp;
+	uint32_t sum = 0, ref;
+	size_t len;
+	double start, base;
+	int i, bad = 0;
+
+	if(runs <= 0)
+		runs = DEFAULT_RUNS;
+	if(dex_image_open(&image, file) == -1)
+		return EXIT_FAILURE;
+	if(image.size <= CHECK_OFFSET){
+		fprintf(stderr, "%s is too small.\n", file);
+		return EXIT_FAILURE;
+	}
+	len = image.size - CHECK_OFFSET;
+
+	fp = fopen(file, "rb");
+	if(fp == NULL){
+		perror(file);
+		return EXIT_FAILURE;
+	}
+
+	printf("adler32 over %s, %zu bytes, %d runs\n", file, len, runs);
+
+	start = now();
+	for(i = 0; i < runs; ++i){
+		fseek(fp, CHECK_OFFSET, SEEK_SET);
+		adler32_fgetc(fp, &sum);
+	}
+	base = now() - start;
+	ref = sum;
+	report("fgetc", base, runs, len, sum, 0);
+
+	for(impl = adler32_impls(); impl->name != NULL; ++impl){
+		start = now();
+		for(i = 0; i < runs; ++i)
+			sum = impl->update(ADLER32_INIT, image.base + CHECK_OFFSET, len);
+		report(impl->name, now() - start, runs, len, sum, base);
+		if(sum != ref){
+			fprintf(stderr, "%s: checksum mismatch %08X != %08X\n", impl->name, sum, ref);
+			bad = 1;
+		}
+	}
+
+	fclose(fp);
+	dex_image_close(&image);
+	return bad ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,925 @@
+/*
+ * synthetic dex generator: writes a valid dex file (checksum, signature,
+ * sorted id tables, map_list) of any size, for benchmarks. When the
+ * methods do not fit the method_ids of one dex they are spread over
+ * classes.dex, classes2.dex, ... of a stored apk.
+ *
+ *   ./gendex [-c classes] [-m methods] [-f fields] [-s strings] [-p protos]
+ *            [-t types] [-u code_units] [-M max_methods] out.dex|out.apk
+ *
+ * Every class gets a constructor chaining to its super class (an earlier
+ * generated class or java.lang.Object), -m methods of about -u code units
+ * each (even ones static, odd ones virtual) made of const-string, const,
+ * arithmetic, sget, invoke-static and if-eqz, and -f fields (even ones
+ * static int). Every third class implements java.lang.Runnable. The -s
+ * literal strings, -p protos and -t extra parameter types are shared by
+ * the classes of a dex.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "../dex.h"
+#include "../strbuf.h"
+#include "../sha1.h"
+
+#define HEADER_SIZE		0x70
+#define ENDIAN_TAG		0x12345678
+#define MAX_IDS			65536
+#define LOCALS			3			/* v0 a string, v1 an int, v2 scratch */
+#define MAX_PARAMS		3
+#define MAX_POOL		1024
+#define MAX_DEXES		99
+
+typedef struct {
+	u4	classes;
+	u4	methods;			/* per class, besides the constructor */
+	u4	fields;				/* per class */
+	u4	strings;			/* literals per dex */
+	u4	protos;
+	u4	types;				/* extra types used in signatures */
+	u4	code_units;			/* per method body */
+	u4	max_methods;		/* method_ids per dex */
+} GenConfig;
+
+typedef struct {
+	char	**v;
+	u4		cnt;
+	u4		cap;
+} Names;
+
+typedef struct {
+	u4	ret;				/* type idx */
+	u4	nparams;
+	u4	params[MAX_PARAMS];
+	u4	shorty;				/* string idx */
+	u4	list_off;			/* type_list, 0 without parameters */
+} Proto;
+
+typedef struct {
+	u4	class_idx;
+	u4	name_idx;
+	u4	type_idx;			/* the proto idx for a method */
+} MemberId;
+
+typedef struct {
+	u4	idx;
+	u4	access_flags;
+	int	j;					/* method number, -1 constructor, -2 run() */
+} Member;
+
+typedef struct {
+	u2	*v;
+	u4	cnt;
+	u4	cap;
+} Insns;
+
+/*
+ * one dex being generated: classes [first, first + cnt) of the config.
+ */
+typedef struct {
+	const GenConfig	*cfg;
+	u4				first;
+	u4				cnt;
+	Names			strings;
+	Names			types;			/* sorted, so type idx order is string idx order */
+	Proto			*protos;
+	u4				proto_cnt;
+	u4				*proto_order;	/* generated proto number -> sorted idx */
+	MemberId		*fields;
+	u4				field_cnt;
+	MemberId		*methods;
+	u4				method_cnt;
+	u4				pool[MAX_POOL];	/* parameter types */
+	u4				pool_cnt;
+	u4				init;			/* string idx of "<init>" */
+	u4				void_proto;		/* ()V */
+} Gen;
+
+static const char *const fixed_types[] = {
+	"I", "Ljava/lang/Object;", "Ljava/lang/Runnable;", "Ljava/lang/String;", "V", "Z",
+};
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "gendex - %s.\n", msg);
+	exit(EXIT_FAILURE);
+}
+
+static void *xcalloc(size_t nmemb, size_t size)
+{
+	void *p = calloc(nmemb ? nmemb : 1, size);
+
+	if(p == NULL)
+		die("out of memory");
+	return p;
+}
+
+static void names_add(Names *names, const char *name)
+{
+	if(names->cnt == names->cap){
+		names->cap = names->cap ? names->cap * 2 : 1024;
+		if((names->v = (char **)realloc(names->v, sizeof(char *) * names->cap)) == NULL)
+			die("out of memory");
+	}
+	if((names->v[names->cnt++] = strdup(name)) == NULL)
+		die("out of memory");
+}
+
+static int compare_names(const void *a, const void *b)
+{
+	// MUTF-8 without NULs or surrogates sorts like the code points.
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void names_sort(Names *names)
+{
+	u4 i, j;
+
+	qsort(names->v, names->cnt, sizeof(char *), compare_names);
+	for(i = j = 0; i < names->cnt; ++i){
+		if(j > 0 && strcmp(names->v[j - 1], names->v[i]) == 0)
+			free(names->v[i]);
+		else
+			names->v[j++] = names->v[i];
+	}
+	names->cnt = j;
+}
+
+static u4 names_find(const Names *names, const char *name)
+{
+	char *const *p = (char *const *)bsearch(&name, names->v, names->cnt, sizeof(char *), compare_names);
+
+	if(p == NULL)
+		die("name not collected");
+	return p - names->v;
+}
+
+static void names_free(Names *names)
+{
+	u4 i;
+
+	for(i = 0; i < names->cnt; ++i)
+		free(names->v[i]);
+	free(names->v);
+}
+
+static void class_name(char *buf, size_t len, u4 n)
+{
+	snprintf(buf, len, "Lgen/p%04u/C%07u;", n / 100, n);
+}
+
+/* literal k, of varying length; now and then with an 'é' and a newline */
+static void literal(char *buf, size_t len, u4 k)
+{
+	static const char filler[] = "the quick brown fox jumps over the lazy dog";
+
+	snprintf(buf, len, "s%07u %.*s%s", k, (int)(k * 7 % 40), filler, k % 97 == 0 ? " \xc3\xa9\n" : "");
+}
+
+static u4 find_string(Gen *gen, const char *fmt, u4 n)
+{
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), fmt, n);
+	return names_find(&gen->strings, buf);
+}
+
+static u4 class_type(Gen *gen, u4 n)
+{
+	char buf[64];
+
+	class_name(buf, sizeof(buf), n);
+	return names_find(&gen->types, buf);
+}
+
+/* the super class of class n, or NO_INDEX for java.lang.Object */
+static u4 super_class(const Gen *gen, u4 n)
+{
+	u4 r = n - gen->first;
+
+	return r % 4 == 0 ? 0xFFFFFFFF : gen->first + (r - 1) / 2;
+}
+
+static int runnable(u4 n)
+{
+	return n % 3 == 0;
+}
+
+/* the generated proto number of method j of class n */
+static u4 method_proto(const Gen *gen, u4 n, u4 j)
+{
+	return (n * 31 + j) % gen->cfg->protos;
+}
+
+static u4 field_type(const Gen *gen, u4 n, u4 j)
+{
+	return j % 2 == 0 ? gen->pool[0] : gen->pool[(n + j) % gen->pool_cnt];
+}
+
+/*
+ * every string and type the dex refers to, sorted.
+ */
+static void collect_names(Gen *gen)
+{
+	const GenConfig *cfg = gen->cfg;
+	char buf[256];
+	u4 i, j, k, n;
+
+	for(i = 0; i < sizeof(fixed_types) / sizeof(fixed_types[0]); ++i)
+		names_add(&gen->types, fixed_types[i]);
+	for(k = 0; k < cfg->types; ++k){
+		snprintf(buf, sizeof(buf), "Lgen/ext/T%05u;", k);
+		names_add(&gen->types, buf);
+	}
+	for(n = gen->first; n < gen->first + gen->cnt; ++n){
+		class_name(buf, sizeof(buf), n);
+		names_add(&gen->types, buf);
+		snprintf(buf, sizeof(buf), "C%07u.java", n);
+		names_add(&gen->strings, buf);
+	}
+	names_sort(&gen->types);
+	for(i = 0; i < gen->types.cnt; ++i)
+		names_add(&gen->strings, gen->types.v[i]);
+
+	names_add(&gen->strings, "<init>");
+	names_add(&gen->strings, "run");
+	for(j = 0; j < cfg->methods; ++j){
+		snprintf(buf, sizeof(buf), "m%u", j);
+		names_add(&gen->strings, buf);
+	}
+	for(j = 0; j < cfg->fields; ++j){
+		snprintf(buf, sizeof(buf), "f%u", j);
+		names_add(&gen->strings, buf);
+	}
+	for(k = 0; k < cfg->strings; ++k){
+		literal(buf, sizeof(buf), k);
+		names_add(&gen->strings, buf);
+	}
+
+	// parameters are int, boolean, String, Object or one of the extra types
+	gen->pool[gen->pool_cnt++] = names_find(&gen->types, "I");
+	gen->pool[gen->pool_cnt++] = names_find(&gen->types, "Z");
+	gen->pool[gen->pool_cnt++] = names_find(&gen->types, "Ljava/lang/String;");
+	gen->pool[gen->pool_cnt++] = names_find(&gen->types, "Ljava/lang/Object;");
+	for(k = 0; k < cfg->types && gen->pool_cnt < MAX_POOL; ++k){
+		snprintf(buf, sizeof(buf), "Lgen/ext/T%05u;", k);
+		gen->pool[gen->pool_cnt++] = names_find(&gen->types, buf);
+	}
+}
+
+static int compare_protos(const void *a, const void *b)
+{
+	const Proto *x = (const Proto *)a, *y = (const Proto *)b;
+	u4 i;
+
+	if(x->ret != y->ret)
+		return x->ret < y->ret ? -1 : 1;
+	for(i = 0; i < x->nparams && i < y->nparams; ++i){
+		if(x->params[i] != y->params[i])
+			return x->params[i] < y->params[i] ? -1 : 1;
+	}
+	return x->nparams < y->nparams ? -1 : x->nparams > y->nparams;
+}
+
+/*
+ * proto k returns void, int or String and takes k % 4 parameters; the
+ * shorties go into the strings before they are sorted.
+ */
+static void collect_protos(Gen *gen)
+{
+	static const char *const returns[] = {"V", "I", "Ljava/lang/String;"};
+	char shorty[MAX_PARAMS + 2];
+	Proto *protos, *proto;
+	u4 k, i, j, cnt = gen->cfg->protos;
+
+	protos = (Proto *)xcalloc(cnt, sizeof(Proto));
+	for(k = 0; k < cnt; ++k){
+		proto = &protos[k];
+		proto->ret = names_find(&gen->types, returns[k % 3]);
+		proto->nparams = k % (MAX_PARAMS + 1);
+		shorty[0] = returns[k % 3][0];
+		for(i = 0; i < proto->nparams; ++i){
+			proto->params[i] = gen->pool[(k / 4 + i * 7) % gen->pool_cnt];
+			shorty[i + 1] = gen->types.v[proto->params[i]][0];
+		}
+		shorty[i + 1] = '\0';
+		names_add(&gen->strings, shorty);
+		proto->list_off = k;
+	}
+	names_sort(&gen->strings);
+
+	// sort and merge duplicates, remembering where each one went
+	qsort(protos, cnt, sizeof(Proto), compare_protos);
+	gen->proto_order = (u4 *)xcalloc(cnt, sizeof(u4));
+	for(k = j = 0; k < cnt; ++k){
+		if(j == 0 || compare_protos(&protos[j - 1], &protos[k]) != 0)
+			protos[j++] = protos[k];
+		gen->proto_order[protos[k].list_off] = j - 1;
+	}
+	for(k = 0; k < j; ++k){
+		proto = &protos[k];
+		shorty[0] = gen->types.v[proto->ret][0];
+		for(i = 0; i < proto->nparams; ++i)
+			shorty[i + 1] = gen->types.v[proto->params[i]][0];
+		shorty[i + 1] = '\0';
+		proto->shorty = names_find(&gen->strings, shorty);
+		proto->list_off = 0;
+	}
+	gen->protos = protos;
+	gen->proto_cnt = j;
+	gen->void_proto = gen->proto_order[0];
+}
+
+static int compare_members(const void *a, const void *b)
+{
+	const MemberId *x = (const MemberId *)a, *y = (const MemberId *)b;
+
+	if(x->class_idx != y->class_idx)
+		return x->class_idx < y->class_idx ? -1 : 1;
+	if(x->name_idx != y->name_idx)
+		return x->name_idx < y->name_idx ? -1 : 1;
+	return x->type_idx < y->type_idx ? -1 : x->type_idx > y->type_idx;
+}
+
+static u4 member_find(const MemberId *members, u4 cnt, u4 class_idx, u4 name_idx, u4 type_idx)
+{
+	MemberId key = {class_idx, name_idx, type_idx};
+	const MemberId *p = (const MemberId *)bsearch(&key, members, cnt, sizeof(MemberId), compare_members);
+
+	if(p == NULL)
+		die("member not collected");
+	return p - members;
+}
+
+static u4 find_method(Gen *gen, u4 n, int j)
+{
+	u4 name, proto = j < 0 ? gen->void_proto : gen->proto_order[method_proto(gen, n, j)];
+
+	if(j == -1)
+		name = gen->init;
+	else if(j == -2)
+		name = names_find(&gen->strings, "run");
+	else
+		name = find_string(gen, "m%u", j);
+	return member_find(gen->methods, gen->method_cnt, class_type(gen, n), name, proto);
+}
+
+static u4 find_field(Gen *gen, u4 n, u4 j)
+{
+	return member_find(gen->fields, gen->field_cnt, class_type(gen, n), find_string(gen, "f%u", j), field_type(gen, n, j));
+}
+
+static void collect_members(Gen *gen)
+{
+	const GenConfig *cfg = gen->cfg;
+	u4 j, n, c, run;
+
+	gen->fields = (MemberId *)xcalloc((size_t)gen->cnt * cfg->fields, sizeof(MemberId));
+	gen->methods = (MemberId *)xcalloc((size_t)gen->cnt * (cfg->methods + 2) + 1, sizeof(MemberId));
+	gen->init = names_find(&gen->strings, "<init>");
+	run = names_find(&gen->strings, "run");
+
+	gen->methods[gen->method_cnt++] = (MemberId){names_find(&gen->types, "Ljava/lang/Object;"), gen->init, gen->void_proto};
+	for(n = gen->first; n < gen->first + gen->cnt; ++n){
+		c = class_type(gen, n);
+		for(j = 0; j < cfg->fields; ++j)
+			gen->fields[gen->field_cnt++] = (MemberId){c, find_string(gen, "f%u", j), field_type(gen, n, j)};
+		gen->methods[gen->method_cnt++] = (MemberId){c, gen->init, gen->void_proto};
+		if(runnable(n))
+			gen->methods[gen->method_cnt++] = (MemberId){c, run, gen->void_proto};
+		for(j = 0; j < cfg->methods; ++j)
+			gen->methods[gen->method_cnt++] = (MemberId){c, find_string(gen, "m%u", j), gen->proto_order[method_proto(gen, n, j)]};
+	}
+	qsort(gen->fields, gen->field_cnt, sizeof(MemberId), compare_members);
+	qsort(gen->methods, gen->method_cnt, sizeof(MemberId), compare_members);
+}
+
+static void put_u4(StrBuf *sb, u4 v)
+{
+	strbuf_append(sb, (const char *)&v, 4);
+}
+
+static void put_u2(StrBuf *sb, u4 v)
+{
+	u2 x = (u2)v;
+
+	strbuf_append(sb, (const char *)&x, 2);
+}
+
+static void put_uleb(StrBuf *sb, u4 v)
+{
+	while(v >= 0x80){
+		strbuf_putc(sb, (char)(v | 0x80));
+		v >>= 7;
+	}
+	strbuf_putc(sb, (char)v);
+}
+
+static void align4(StrBuf *sb)
+{
+	while(sb->len & 3)
+		strbuf_putc(sb, 0);
+}
+
+static void emit(Insns *code, u4 n, ...)
+{
+	va_list ap;
+	u4 i;
+
+	if(code->cnt + n > code->cap){
+		code->cap = (code->cnt + n) * 2;
+		if((code->v = (u2 *)realloc(code->v, sizeof(u2) * code->cap)) == NULL)
+			die("out of memory");
+	}
+	va_start(ap, n);
+	for(i = 0; i < n; ++i)
+		code->v[code->cnt++] = (u2)va_arg(ap, u4);
+	va_end(ap);
+}
+
+/*
+ * the body of method j of class n (-2 for run()), about code_units long.
+ */
+static void method_body(Gen *gen, Insns *code, u4 n, int j, const Proto *proto)
+{
+	const GenConfig *cfg = gen->cfg;
+	char buf[256];
+	u4 units = cfg->code_units > 4 ? cfg->code_units - 1 : 3;
+	u4 step, idx, cls, target;
+
+	for(step = 0; code->cnt < units; ++step){
+		switch(step % 6){
+			case 0:		// const-string v0, the jumbo form past 64k strings
+				if(cfg->strings)
+					literal(buf, sizeof(buf), (n * 7919 + step * 104729) % cfg->strings);
+				else
+					strcpy(buf, "run");
+				idx = names_find(&gen->strings, buf);
+				if(idx <= 0xFFFF)
+					emit(code, 2, 0x001a, idx);
+				else
+					emit(code, 3, 0x001b, idx & 0xFFFF, idx >> 16);
+				break;
+			case 1:		// const/4 v1, #n
+				emit(code, 1, 0x0112 | ((n + step) & 7) << 12);
+				break;
+			case 2:		// add-int/lit8 v1, v1, #3
+				emit(code, 2, 0x01d8, 0x0301);
+				break;
+			case 3:		// sget v2, f0 of this class, or move v2, v1
+				if(cfg->fields)
+					emit(code, 2, 0x0260, find_field(gen, n, 0));
+				else
+					emit(code, 1, 0x1201);
+				break;
+			case 4:		// invoke-static {v0, v1, v2}, a static method of another class
+				if(cfg->methods == 0)
+					break;
+				cls = gen->first + (n * 7 + step) % gen->cnt;
+				target = find_method(gen, cls, ((step * 2 + (j < 0 ? 0 : j)) % cfg->methods) & ~1u);
+				emit(code, 3, 0x0071 | gen->protos[gen->methods[target].type_idx].nparams << 12, target, 0x0210);
+				break;
+			case 5:		// if-eqz v1, +3; add-int/2addr v1, v1
+				emit(code, 3, 0x0138, 3, 0x11b0);
+				break;
+		}
+	}
+	switch(gen->types.v[proto->ret][0]){
+		case 'V':	emit(code, 1, 0x000e);	break;		// return-void
+		case 'L':	emit(code, 1, 0x0011);	break;		// return-object v0
+		default:	emit(code, 1, 0x010f);	break;		// return v1
+	}
+}
+
+static u4 code_item(Gen *gen, StrBuf *codes, u4 codes_off, u4 n, const Member *member)
+{
+	const Proto *proto;
+	Insns code = {NULL, 0, 0};
+	u4 off = codes_off + codes->len, ins, outs, i;
+
+	if(member->j == -1){
+		// invoke-direct {v0}, super.<init>()V; return-void
+		i = super_class(gen, n);
+		if(i == 0xFFFFFFFF)
+			i = member_find(gen->methods, gen->method_cnt, names_find(&gen->types, "Ljava/lang/Object;"), gen->init, gen->void_proto);
+		else
+			i = find_method(gen, i, -1);
+		emit(&code, 3, 0x1070, i, 0);
+		emit(&code, 1, 0x000e);
+		ins = 1;
+		outs = 1;
+		put_u2(codes, 1);
+	}else{
+		proto = &gen->protos[gen->methods[member->idx].type_idx];
+		method_body(gen, &code, n, member->j, proto);
+		ins = proto->nparams + !(member->access_flags & ACC_STATIC);
+		outs = MAX_PARAMS;
+		put_u2(codes, LOCALS + ins);
+	}
+	put_u2(codes, ins);
+	put_u2(codes, outs);
+	put_u2(codes, 0);					// tries
+	put_u4(codes, 0);					// debug_info_off
+	put_u4(codes, code.cnt);
+	strbuf_append(codes, (const char *)code.v, code.cnt * 2);
+	align4(codes);
+	free(code.v);
+	return off;
+}
+
+static int compare_member_idx(const void *a, const void *b)
+{
+	u4 x = ((const Member *)a)->idx, y = ((const Member *)b)->idx;
+	return x < y ? -1 : x > y;
+}
+
+static void put_members(Gen *gen, StrBuf *data, StrBuf *codes, u4 codes_off, u4 n, Member *members, u4 cnt, int has_code)
+{
+	u4 i, prev = 0;
+
+	qsort(members, cnt, sizeof(Member), compare_member_idx);
+	for(i = 0; i < cnt; ++i){
+		put_uleb(data, members[i].idx - prev);
+		put_uleb(data, members[i].access_flags);
+		if(has_code)
+			put_uleb(data, code_item(gen, codes, codes_off, n, &members[i]));
+		prev = members[i].idx;
+	}
+}
+
+/*
+ * class_data of class n, its methods' code items go to codes.
+ */
+static void class_data(Gen *gen, StrBuf *data, StrBuf *codes, u4 codes_off, u4 n)
+{
+	const GenConfig *cfg = gen->cfg;
+	Member *lists[4];
+	u4 cnt[4] = {0, 0, 0, 0};
+	u4 i, j;
+
+	for(i = 0; i < 4; ++i)
+		lists[i] = (Member *)xcalloc(cfg->fields + cfg->methods + 2, sizeof(Member));
+	for(j = 0; j < cfg->fields; ++j){
+		i = j % 2;
+		lists[i][cnt[i]++] = (Member){find_field(gen, n, j), ACC_PUBLIC | (i == 0 ? ACC_STATIC : 0), (int)j};
+	}
+	lists[2][cnt[2]++] = (Member){find_method(gen, n, -1), ACC_PUBLIC | ACC_CONSTRUCTOR, -1};
+	if(runnable(n))
+		lists[3][cnt[3]++] = (Member){find_method(gen, n, -2), ACC_PUBLIC, -2};
+	for(j = 0; j < cfg->methods; ++j){
+		i = 2 + j % 2;
+		lists[i][cnt[i]++] = (Member){find_method(gen, n, j), ACC_PUBLIC | (i == 2 ? ACC_STATIC : 0), (int)j};
+	}
+
+	for(i = 0; i < 4; ++i)
+		put_uleb(data, cnt[i]);
+	for(i = 0; i < 4; ++i){
+		put_members(gen, data, codes, codes_off, n, lists[i], cnt[i], i >= 2);
+		free(lists[i]);
+	}
+}
+
+static void map_item(StrBuf *map, u2 type, u4 cnt, u4 off)
+{
+	if(cnt == 0)
+		return ;
+	put_u2(map, type);
+	put_u2(map, 0);
+	put_u4(map, cnt);
+	put_u4(map, off);
+}
+
+/*
+ * lay the dex out into out: header and id tables, then type lists, code
+ * items, class data, string data and the map.
+ */
+static void write_dex(Gen *gen, StrBuf *out)
+{
+	DexHeader header;
+	StrBuf lists, codes, datas, strs, map;
+	u4 *class_data_offs, *string_offs, runnable_list;
+	u4 i, n, super, lists_off, codes_off, datas_off, strs_off, map_off, map_cnt, end;
+	const char *s;
+	u1 *base;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "dex\n035", 8);
+	header.headerSize = HEADER_SIZE;
+	header.endianTag = ENDIAN_TAG;
+	header.stringIdsSize = gen->strings.cnt;
+	header.stringIdsOff = HEADER_SIZE;
+	header.typeIdsSize = gen->types.cnt;
+	header.typeIdsOff = header.stringIdsOff + 4 * header.stringIdsSize;
+	header.protoIdsSize = gen->proto_cnt;
+	header.protoIdsOff = header.typeIdsOff + 4 * header.typeIdsSize;
+	header.fieldIdsSize = gen->field_cnt;
+	header.fieldIdsOff = gen->field_cnt ? header.protoIdsOff + 12 * header.protoIdsSize : 0;
+	header.methodIdsSize = gen->method_cnt;
+	header.methodIdsOff = header.protoIdsOff + 12 * header.protoIdsSize + 8 * header.fieldIdsSize;
+	header.classDefsSize = gen->cnt;
+	header.classDefsOff = header.methodIdsOff + 8 * header.methodIdsSize;
+	header.dataOff = header.classDefsOff + 32 * header.classDefsSize;
+
+	strbuf_init(&lists);
+	strbuf_init(&codes);
+	strbuf_init(&datas);
+	strbuf_init(&strs);
+	strbuf_init(&map);
+
+	// type lists: the parameters of each proto, then Runnable alone
+	lists_off = header.dataOff;
+	for(i = 0; i < gen->proto_cnt; ++i){
+		if(gen->protos[i].nparams == 0)
+			continue;
+		gen->protos[i].list_off = lists_off + lists.len;
+		put_u4(&lists, gen->protos[i].nparams);
+		for(n = 0; n < gen->protos[i].nparams; ++n)
+			put_u2(&lists, gen->protos[i].params[n]);
+		align4(&lists);
+	}
+	runnable_list = lists_off + lists.len;
+	put_u4(&lists, 1);
+	put_u2(&lists, names_find(&gen->types, "Ljava/lang/Runnable;"));
+	align4(&lists);
+
+	codes_off = lists_off + lists.len;
+	class_data_offs = (u4 *)xcalloc(gen->cnt, sizeof(u4));
+	for(n = 0; n < gen->cnt; ++n){
+		class_data_offs[n] = datas.len;
+		class_data(gen, &datas, &codes, codes_off, gen->first + n);
+	}
+	datas_off = codes_off + codes.len;
+	strs_off = datas_off + datas.len;
+	string_offs = (u4 *)xcalloc(gen->strings.cnt, sizeof(u4));
+	for(i = 0; i < gen->strings.cnt; ++i){
+		string_offs[i] = strs_off + strs.len;
+		s = gen->strings.v[i];
+		// utf-16 length: every byte but the continuation bytes (no surrogates here)
+		for(n = 0; *s != '\0'; ++s)
+			n += ((u1)*s & 0xC0) != 0x80;
+		put_uleb(&strs, n);
+		strbuf_append(&strs, gen->strings.v[i], strlen(gen->strings.v[i]) + 1);
+	}
+	map_off = (strs_off + strs.len + 3) & ~3u;
+
+	map_item(&map, kDexTypeHeaderItem, 1, 0);
+	map_item(&map, kDexTypeStringIdItem, header.stringIdsSize, header.stringIdsOff);
+	map_item(&map, kDexTypeTypeIdItem, header.typeIdsSize, header.typeIdsOff);
+	map_item(&map, kDexTypeProtoIdItem, header.protoIdsSize, header.protoIdsOff);
+	map_item(&map, kDexTypeFieldIdItem, header.fieldIdsSize, header.fieldIdsOff);
+	map_item(&map, kDexTypeMethodIdItem, header.methodIdsSize, header.methodIdsOff);
+	map_item(&map, kDexTypeClassDefItem, header.classDefsSize, header.classDefsOff);
+	for(i = map_cnt = 0; i < gen->proto_cnt; ++i)
+		map_cnt += gen->protos[i].nparams != 0;
+	map_item(&map, kDexTypeTypeList, map_cnt + 1, lists_off);
+	map_item(&map, kDexTypeCodeItem, gen->method_cnt - 1, codes_off);
+	map_item(&map, kDexTypeClassDataItem, gen->cnt, datas_off);
+	map_item(&map, kDexTypeStringDataItem, gen->strings.cnt, strs_off);
+	map_item(&map, kDexTypeMapList, 1, map_off);
+	map_cnt = map.len / 12;
+
+	end = map_off + 4 + map.len;
+	header.mapOff = map_off;
+	header.dataSize = end - header.dataOff;
+	header.fileSize = end;
+
+	strbuf_truncate(out, 0);
+	strbuf_append(out, (const char *)&header, sizeof(header));
+	for(i = 0; i < gen->strings.cnt; ++i)
+		put_u4(out, string_offs[i]);
+	for(i = 0; i < gen->types.cnt; ++i)
+		put_u4(out, names_find(&gen->strings, gen->types.v[i]));
+	for(i = 0; i < gen->proto_cnt; ++i){
+		put_u4(out, gen->protos[i].shorty);
+		put_u4(out, gen->protos[i].ret);
+		put_u4(out, gen->protos[i].list_off);
+	}
+	for(i = 0; i < gen->field_cnt; ++i){
+		put_u2(out, gen->fields[i].class_idx);
+		put_u2(out, gen->fields[i].type_idx);
+		put_u4(out, gen->fields[i].name_idx);
+	}
+	for(i = 0; i < gen->method_cnt; ++i){
+		put_u2(out, gen->methods[i].class_idx);
+		put_u2(out, gen->methods[i].type_idx);
+		put_u4(out, gen->methods[i].name_idx);
+	}
+	for(n = 0; n < gen->cnt; ++n){
+		super = super_class(gen, gen->first + n);
+		put_u4(out, class_type(gen, gen->first + n));
+		put_u4(out, ACC_PUBLIC);
+		put_u4(out, super == 0xFFFFFFFF ? names_find(&gen->types, "Ljava/lang/Object;") : class_type(gen, super));
+		put_u4(out, runnable(gen->first + n) ? runnable_list : 0);
+		put_u4(out, find_string(gen, "C%07u.java", gen->first + n));
+		put_u4(out, 0);
+		put_u4(out, datas_off + class_data_offs[n]);
+		put_u4(out, 0);
+	}
+	strbuf_append(out, lists.data, lists.len);
+	strbuf_append(out, codes.data, codes.len);
+	strbuf_append(out, datas.data, datas.len);
+	strbuf_append(out, strs.data, strs.len);
+	align4(out);
+	put_u4(out, map_cnt);
+	strbuf_append(out, map.data, map.len);
+	if(out->data == NULL || out->len != end)
+		die("layout mismatch");
+
+	// signature covers everything after itself, the checksum also the signature
+	base = (u1 *)out->data;
+	dex_sha1(base + 32, end - 32, base + 12);
+	n = adler32(adler32(0, NULL, 0), base + 12, end - 12);
+	memcpy(base + 8, &n, 4);
+
+	free(class_data_offs);
+	free(string_offs);
+	strbuf_free(&lists);
+	strbuf_free(&codes);
+	strbuf_free(&datas);
+	strbuf_free(&strs);
+	strbuf_free(&map);
+}
+
+static void generate(const GenConfig *cfg, u4 first, u4 cnt, StrBuf *out)
+{
+	Gen gen;
+
+	memset(&gen, 0, sizeof(gen));
+	gen.cfg = cfg;
+	gen.first = first;
+	gen.cnt = cnt;
+	collect_names(&gen);
+	collect_protos(&gen);
+	collect_members(&gen);
+	write_dex(&gen, out);
+
+	names_free(&gen.strings);
+	names_free(&gen.types);
+	free(gen.protos);
+	free(gen.proto_order);
+	free(gen.fields);
+	free(gen.methods);
+}
+
+static void put_zip_u2(StrBuf *sb, u4 v)
+{
+	strbuf_putc(sb, (char)v);
+	strbuf_putc(sb, (char)(v >> 8));
+}
+
+static void put_zip_u4(StrBuf *sb, u4 v)
+{
+	put_zip_u2(sb, v & 0xFFFF);
+	put_zip_u2(sb, v >> 16);
+}
+
+/*
+ * a zip of stored entries, their data 4 byte aligned like zipalign does.
+ */
+static int write_apk(FILE *fp, StrBuf *dexes, u4 cnt)
+{
+	StrBuf local, central;
+	char name[32];
+	u4 i, crc, name_len, pad, off = 0;
+
+	strbuf_init(&local);
+	strbuf_init(&central);
+	for(i = 0; i < cnt; ++i){
+		if(i == 0)
+			snprintf(name, sizeof(name), "classes.dex");
+		else
+			snprintf(name, sizeof(name), "classes%u.dex", i + 1);
+		name_len = strlen(name);
+		crc = crc32(0, (const Bytef *)dexes[i].data, dexes[i].len);
+		pad = (4 - (off + 30 + name_len) % 4) % 4;
+
+		strbuf_truncate(&local, 0);
+		put_zip_u4(&local, 0x04034b50);
+		put_zip_u2(&local, 10);
+		put_zip_u2(&local, 0);
+		put_zip_u2(&local, 0);				// stored
+		put_zip_u4(&local, 0);
+		put_zip_u4(&local, crc);
+		put_zip_u4(&local, dexes[i].len);
+		put_zip_u4(&local, dexes[i].len);
+		put_zip_u2(&local, name_len);
+		put_zip_u2(&local, pad);
+		strbuf_puts(&local, name);
+		strbuf_append(&local, "\0\0\0", pad);
+		if(fwrite(local.data, 1, local.len, fp) != local.len || fwrite(dexes[i].data, 1, dexes[i].len, fp) != dexes[i].len)
+			return -1;
+
+		put_zip_u4(&central, 0x02014b50);
+		put_zip_u2(&central, 10);
+		put_zip_u2(&central, 10);
+		put_zip_u2(&central, 0);
+		put_zip_u2(&central, 0);
+		put_zip_u4(&central, 0);
+		put_zip_u4(&central, crc);
+		put_zip_u4(&central, dexes[i].len);
+		put_zip_u4(&central, dexes[i].len);
+		put_zip_u2(&central, name_len);
+		put_zip_u2(&central, 0);
+		put_zip_u2(&central, 0);
+		put_zip_u2(&central, 0);
+		put_zip_u2(&central, 0);
+		put_zip_u4(&central, 0);
+		put_zip_u4(&central, off);
+		strbuf_puts(&central, name);
+		off += local.len + dexes[i].len;
+	}
+	put_zip_u4(&central, 0x06054b50);
+	put_zip_u2(&central, 0);
+	put_zip_u2(&central, 0);
+	put_zip_u2(&central, cnt);
+	put_zip_u2(&central, cnt);
+	put_zip_u4(&central, central.len - 12);
+	put_zip_u4(&central, off);
+	put_zip_u2(&central, 0);
+	i = fwrite(central.data, 1, central.len, fp) == central.len ? 0 : -1;
+	strbuf_free(&local);
+	strbuf_free(&central);
+	return i;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: gendex [-c classes] [-m methods] [-f fields] [-s strings] [-p protos]\n"
+					"              [-t types] [-u code_units] [-M max_methods] out.dex|out.apk\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	GenConfig cfg = {1000, 10, 4, 5000, 200, 50, 32, MAX_IDS};
+	StrBuf dexes[MAX_DEXES];
+	const char *out;
+	FILE *fp;
+	u4 per_dex, dex_cnt, i, first;
+	size_t len;
+	int opt, apk;
+
+	while((opt = getopt(argc, argv, "c:m:f:s:p:t:u:M:")) != -1){
+		switch(opt){
+			case 'c':	cfg.classes = strtoul(optarg, NULL, 0);		break;
+			case 'm':	cfg.methods = strtoul(optarg, NULL, 0);		break;
+			case 'f':	cfg.fields = strtoul(optarg, NULL, 0);		break;
+			case 's':	cfg.strings = strtoul(optarg, NULL, 0);		break;
+			case 'p':	cfg.protos = strtoul(optarg, NULL, 0);		break;
+			case 't':	cfg.types = strtoul(optarg, NULL, 0);		break;
+			case 'u':	cfg.code_units = strtoul(optarg, NULL, 0);	break;
+			case 'M':	cfg.max_methods = strtoul(optarg, NULL, 0);	break;
+			default:	usage();
+		}
+	}
+	if(optind + 1 != argc || cfg.classes == 0)
+		usage();
+	out = argv[optind];
+	len = strlen(out);
+	apk = len > 4 && strcmp(out + len - 4, ".apk") == 0;
+	if(cfg.protos == 0)
+		cfg.protos = 1;
+	if(cfg.max_methods > MAX_IDS)
+		cfg.max_methods = MAX_IDS;
+
+	// a class takes up to methods + 2 method_ids, plus Object.<init> per dex
+	per_dex = cfg.max_methods > cfg.methods + 3 ? (cfg.max_methods - 1) / (cfg.methods + 2) : 1;
+	if(cfg.fields && per_dex > MAX_IDS / cfg.fields)
+		per_dex = MAX_IDS / cfg.fields;
+	if(per_dex > MAX_IDS - 6 - cfg.types)
+		per_dex = MAX_IDS - 6 - cfg.types;
+	dex_cnt = (cfg.classes + per_dex - 1) / per_dex;
+	if(dex_cnt > MAX_DEXES)
+		die("too many dex files, raise -M or lower -c");
+	if(dex_cnt > 1 && !apk){
+		fprintf(stderr, "gendex - %u classes need %u dex files, write an .apk.\n", cfg.classes, dex_cnt);
+		return EXIT_FAILURE;
+	}
+
+	for(i = 0, first = 0; i < dex_cnt; ++i, first += per_dex){
+		strbuf_init(&dexes[i]);
+		generate(&cfg, first, cfg.classes - first < per_dex ? cfg.classes - first : per_dex, &dexes[i]);
+	}
+
+	if((fp = fopen(out, "wb")) == NULL){
+		perror(out);
+		return EXIT_FAILURE;
+	}
+	if(apk)
+		opt = write_apk(fp, dexes, dex_cnt);
+	else
+		opt = fwrite(dexes[0].data, 1, dexes[0].len, fp) == dexes[0].len ? 0 : -1;
+	if(fclose(fp) != 0 || opt == -1){
+		perror(out);
+		return EXIT_FAILURE;
+	}
+	for(i = 0, len = 0; i < dex_cnt; ++i){
+		len += dexes[i].len;
+		strbuf_free(&dexes[i]);
+	}
+	printf("%s: %u classes in %u dex file%s, %zu bytes\n", out, cfg.classes, dex_cnt, dex_cnt > 1 ? "s" : "", len);
+	return 0;
+}
@@ -0,0 +1,418 @@
+/*
+ * phase benchmark: times each stage of a readex run through the library,
+ * over several runs per file, and reports the best and median times with
+ * the throughput in MB/s (of dex bytes) and classes/s, then the
+ * disassembler alone in instructions/s.
+ *
+ *   ./phase_bench [-r runs] file.dex|file.apk ...
+ *
+ * Every phase but open starts from a freshly opened container, so it pays
+ * for its own string decoding and type rendering like a readex run with
+ * only that option would; the files stay in the page cache between runs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../dexfile.h"
+#include "../dexgrep.h"
+
+#define DEFAULT_RUNS	5
+#define FLUSH_SIZE		(1 << 20)
+
+typedef struct {
+	const char	*name;
+	void		(*run)(DexContainer *dc, StrBuf *out);
+} Phase;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* output is formatted like readex would, then thrown away */
+static void drain(StrBuf *out)
+{
+	if(out->len > FLUSH_SIZE)
+		strbuf_truncate(out, 0);
+}
+
+static void phase_verify(DexContainer *dc, StrBuf *out)
+{
+	u4 i;
+
+	for(i = 0; i < dc->cnt; ++i){
+		if(dex_context_verify(dc->dexes[i]) == -1)
+			strbuf_puts(out, "FAILED\n");
+	}
+}
+
+static void phase_header(DexContainer *dc, StrBuf *out)
+{
+	u4 i;
+
+	for(i = 0; i < dc->cnt; ++i)
+		dex_json_header(dc->dexes[i], out, NULL);
+}
+
+static void phase_map(DexContainer *dc, StrBuf *out)
+{
+	DexMap map;
+	u4 i;
+
+	for(i = 0; i < dc->cnt; ++i)
+		dex_map_parse(&map, &dc->dexes[i]->image, out);
+}
+
+static void phase_strings(DexContainer *dc, StrBuf *out)
+{
+	DexContext *ctx;
+	const char *str;
+	u4 i, j;
+
+	for(j = 0; j < dc->cnt; ++j){
+		ctx = dc->dexes[j];
+		dex_prefetch_section(ctx, kDexTypeStringDataItem);
+		for(i = 0; i < ctx->header->stringIdsSize; ++i){
+			str = dex_string(ctx, i);
+			strbuf_printf(out, " %2d(%8X):       \"%s\"\n", i, ctx->string_ids[i].string_data_off, str == NULL ? "null" : str);
+			drain(out);
+		}
+	}
+}
+
+/* a pattern no string has, so the whole string data is scanned */
+static void phase_grep(DexContainer *dc, StrBuf *out)
+{
+	DexGrepPattern pat;
+	u4 *ids;
+	u4 j, cnt;
+
+	dex_grep_compile(&pat, "http://no.such.host/", 0);
+	for(j = 0; j < dc->cnt; ++j){
+		if((ids = dex_grep(dc->dexes[j], &pat, &cnt)) != NULL)
+			strbuf_printf(out, "%u strings\n", cnt);
+		free(ids);
+	}
+	dex_grep_free(&pat);
+}
+
+static void phase_methods(DexContainer *dc, StrBuf *out)
+{
+	DexContext *ctx;
+	u4 i, j;
+
+	for(j = 0; j < dc->cnt; ++j){
+		ctx = dc->dexes[j];
+		for(i = 0; i < ctx->header->methodIdsSize; ++i){
+			dex_format_method(ctx, out, i, 1);
+			drain(out);
+		}
+	}
+}
+
+static void format_classes(DexContainer *dc, StrBuf *out, int flags)
+{
+	const ClassDefs *class;
+	DexContext *ctx;
+	const char *src;
+	u4 i, j;
+
+	for(j = 0; j < dc->cnt; ++j){
+		ctx = dc->dexes[j];
+		dex_prefetch_section(ctx, kDexTypeClassDataItem);
+		if(flags & DEX_FORMAT_CODE)
+			dex_prefetch_section(ctx, kDexTypeCodeItem);
+		for(i = 0; i < ctx->header->classDefsSize; ++i){
+			class = &ctx->class_defs[i];
+			dex_format_type(ctx, out, class->class_idx);
+			dex_format_access_flags(out, class->access_flags, CLASS);
+			if(class->superclass_idx != 0)
+				dex_format_type(ctx, out, class->superclass_idx);
+			dex_format_interfaces(ctx, out, class);
+			if((src = dex_class_source(ctx, class)) != NULL)
+				strbuf_puts(out, src);
+			dex_format_class_data(ctx, out, class, flags);
+			drain(out);
+		}
+	}
+}
+
+static void phase_classes(DexContainer *dc, StrBuf *out)
+{
+	format_classes(dc, out, 0);
+}
+
+static void phase_code(DexContainer *dc, StrBuf *out)
+{
+	format_classes(dc, out, DEX_FORMAT_CODE);
+}
+
+static void phase_find_class(DexContainer *dc, StrBuf *out)
+{
+	DexContext *ctx;
+	const char *name;
+	u4 i, j, missing = 0;
+
+	for(j = 0; j < dc->cnt; ++j){
+		ctx = dc->dexes[j];
+		for(i = 0; i < ctx->header->classDefsSize; ++i){
+			name = dex_string(ctx, ctx->type_ids[ctx->class_defs[i].class_idx].descriptor_idx);
+			if(name == NULL || dex_container_find_class(dc, name, &ctx) == -1)
+				++missing;
+			ctx = dc->dexes[j];
+		}
+	}
+	if(missing)
+		strbuf_printf(out, "%u classes not found\n", missing);
+}
+
+static void phase_json(DexContainer *dc, StrBuf *out)
+{
+	DexContext *ctx;
+	u4 i, j;
+
+	for(j = 0; j < dc->cnt; ++j){
+		ctx = dc->dexes[j];
+		for(i = 0; i < ctx->header->classDefsSize; ++i){
+			dex_json_class(ctx, out, NULL, i, 0);
+			strbuf_putc(out, '\n');
+			drain(out);
+		}
+	}
+}
+
+/* named after the readex code each one stands for */
+static const Phase phases[] = {
+	{"open",				NULL},
+	{"verify",				phase_verify},
+	{"process_dex_header",	phase_header},
+	{"process_map_list",	phase_map},
+	{"process_string_ids",	phase_strings},
+	{"--grep",				phase_grep},
+	{"process_method_ids",	phase_methods},
+	{"process_class_type",	phase_classes},
+	{"--code",				phase_code},
+	{"-c (every class)",	phase_find_class},
+	{"--format=json -C",	phase_json},
+};
+
+#define PHASE_CNT	(sizeof(phases) / sizeof(phases[0]))
+
+/* the code items of every method, for the disassembler alone */
+typedef struct {
+	DexContext	*ctx;
+	u4			*offs;
+	u4			cnt;
+	u4			cap;
+} CodeList;
+
+static int collect_code(DexContext *ctx, u4 class_idx, const EncodedMember *member, void *arg)
+{
+	CodeList *list = (CodeList *)arg;
+	u4 *offs;
+
+	if(member->code_off == 0)
+		return 0;
+	if(list->cnt == list->cap){
+		list->cap = list->cap ? list->cap * 2 : 1024;
+		if((offs = (u4 *)realloc(list->offs, sizeof(u4) * list->cap)) == NULL){
+			fprintf(stderr, "collect_code - realloc failure out of memory.\n");
+			return -1;
+		}
+		list->offs = offs;
+	}
+	list->offs[list->cnt++] = member->code_off;
+	return 0;
+}
+
+/* instruction lines: the code indent, then the pc and ": " */
+static u4 count_insns(const StrBuf *out)
+{
+	const char *line = out->data, *end = out->data + out->len, *nl;
+	u4 cnt = 0;
+
+	for(; line < end; line = nl + 1){
+		if((nl = memchr(line, '\n', end - line)) == NULL)
+			nl = end;
+		if(nl - line > 12 && memcmp(line, "      ", 6) == 0 && line[6] != ' ' && line[10] == ':')
+			++cnt;
+	}
+	return cnt;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * dex_format_code() over every code item of the container, count_insns()
+ * on the output when insns is not NULL. Returns the seconds it took.
+ */
+static double format_code(DexContainer *dc, StrBuf *out, u4 *insns, u4 *methods)
+{
+	CodeList list;
+	double start, took = 0;
+	u4 i, j;
+
+	for(j = 0; j < dc->cnt; ++j){
+		memset(&list, 0, sizeof(list));
+		list.ctx = dc->dexes[j];
+		for(i = 0; i < list.ctx->header->classDefsSize; ++i){
+			if(dex_class_methods(list.ctx, i, collect_code, &list) == -1)
+				break;
+		}
+		start = now();
+		for(i = 0; i < list.cnt; ++i){
+			dex_format_code(list.ctx, out, list.offs[i]);
+			if(insns != NULL){
+				*insns += count_insns(out);
+				strbuf_truncate(out, 0);
+			}else{
+				drain(out);
+			}
+		}
+		took += now() - start;
+		if(methods != NULL)
+			*methods += list.cnt;
+		free(list.offs);
+	}
+	return took;
+}
+
+static void print_insns(const char *name, double *times, int runs, u4 insns)
+{
+	qsort(times, runs, sizeof(double), compare_doubles);
+	printf(" %-20s %10.3f %10.3f %10.1f M insns/s\n", name, times[0] * 1000.0, times[runs / 2] * 1000.0,
+			insns / times[0] / 1e6);
+}
+
+/*
+ * the disassembler alone, in instructions per second: over a freshly
+ * opened container, where each referenced name is rendered once, then
+ * again over the same one with every name cached. The code items are
+ * found before the clock starts.
+ */
+static int bench_code(const char *file, int runs, double *times)
+{
+	DexContainer *dc;
+	StrBuf out;
+	double *again;
+	u4 insns = 0, methods = 0;
+	int r;
+
+	if((again = (double *)malloc(sizeof(double) * runs)) == NULL){
+		fprintf(stderr, "bench_code - malloc failure out of memory.\n");
+		return -1;
+	}
+	strbuf_init(&out);
+	if((dc = dex_container_open(file, DEX_OPEN_NO_VERIFY, 1)) == NULL)
+		goto fail;
+	format_code(dc, &out, &insns, &methods);
+	dex_container_close(dc);
+	for(r = 0; r < runs; ++r){
+		if((dc = dex_container_open(file, DEX_OPEN_NO_VERIFY, 1)) == NULL)
+			goto fail;
+		times[r] = format_code(dc, &out, NULL, NULL);
+		again[r] = format_code(dc, &out, NULL, NULL);
+		dex_container_close(dc);
+		strbuf_truncate(&out, 0);
+	}
+	printf(" %u instructions in %u methods:\n", insns, methods);
+	print_insns("dex_format_code", times, runs, insns);
+	print_insns("  names cached", again, runs, insns);
+	strbuf_free(&out);
+	free(again);
+	return 0;
+
+fail:
+	strbuf_free(&out);
+	free(again);
+	return -1;
+}
+
+static int bench_file(const char *file, int runs)
+{
+	DexContainer *dc;
+	StrBuf out;
+	double *times, start, best, median;
+	size_t bytes = 0;
+	u4 classes = 0, i, p;
+	int r;
+
+	if((dc = dex_container_open(file, DEX_OPEN_NO_VERIFY, 1)) == NULL)
+		return -1;
+	for(i = 0; i < dc->cnt; ++i){
+		bytes += dc->dexes[i]->image.size;
+		classes += dc->dexes[i]->header->classDefsSize;
+	}
+	printf("%s: %u dex, %zu bytes, %u classes, %d runs\n", file, dc->cnt, bytes, classes, runs);
+	printf(" %-20s %10s %10s %10s %12s\n", "phase", "best ms", "median ms", "MB/s", "classes/s");
+	dex_container_close(dc);
+
+	times = (double *)malloc(sizeof(double) * runs);
+	if(times == NULL){
+		fprintf(stderr, "bench_file - malloc failure out of memory.\n");
+		return -1;
+	}
+	strbuf_init(&out);
+	for(p = 0; p < PHASE_CNT; ++p){
+		for(r = 0; r < runs; ++r){
+			start = now();
+			if((dc = dex_container_open(file, DEX_OPEN_NO_VERIFY, 1)) == NULL)
+				goto fail;
+			if(phases[p].run != NULL){
+				start = now();
+				phases[p].run(dc, &out);
+			}
+			times[r] = now() - start;
+			dex_container_close(dc);
+			strbuf_truncate(&out, 0);
+		}
+		qsort(times, runs, sizeof(double), compare_doubles);
+		best = times[0];
+		median = times[runs / 2];
+		printf(" %-20s %10.3f %10.3f %10.1f %12.0f\n", phases[p].name, best * 1000.0, median * 1000.0,
+				bytes / best / (1024.0 * 1024.0), classes / best);
+	}
+	strbuf_free(&out);
+	r = bench_code(file, runs, times);
+	free(times);
+	return r;
+
+fail:
+	strbuf_free(&out);
+	free(times);
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	int runs = DEFAULT_RUNS;
+	int opt, ret = 0;
+
+	while((opt = getopt(argc, argv, "r:")) != -1){
+		if(opt == 'r' && atoi(optarg) > 0){
+			runs = atoi(optarg);
+		}else{
+			fprintf(stderr, "usage: phase_bench [-r runs] file.dex|file.apk ...\n");
+			return EXIT_FAILURE;
+		}
+	}
+	if(optind == argc){
+		fprintf(stderr, "usage: phase_bench [-r runs] file.dex|file.apk ...\n");
+		return EXIT_FAILURE;
+	}
+	for(; optind < argc; ++optind){
+		if(bench_file(argv[optind], runs) == -1)
+			ret = EXIT_FAILURE;
+		if(optind + 1 < argc)
+			printf("\n");
+	}
+	return ret;
+}
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "checksum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS	1
+#include <immintrin.h>
+#endif
+
+#define ADLER_MOD		65521U
+/*
+ * largest n such that 255n(n+1)/2 + (n+1)(ADLER_MOD-1) <= 2^32-1, i.e. the
+ * number of bytes that can be summed before the modulo has to be applied.
+ */
+#define ADLER_NMAX		5552
+
+/*
+ * the fused adler32/sha1 pass works on chunks small enough to still be
+ * in L2 when the second algorithm reads them.
+ */
+#define FUSED_CHUNK		(64 * 1024)
+
+uint32_t adler32_update_scalar(uint32_t adler, const uint8_t *buf, size_t len)
+{
+	uint32_t A = adler & 0xffff;
+	uint32_t B = adler >> 16;
+	size_t n;
+
+	while(len > 0){
+		n = len < ADLER_NMAX ? len : ADLER_NMAX;
+		len -= n;
+		while(n >= 8){
+			A += buf[0]; B += A;
+			A += buf[1]; B += A;
+			A += buf[2]; B += A;
+			A += buf[3]; B += A;
+			A += buf[4]; B += A;
+			A += buf[5]; B += A;
+			A += buf[6]; B += A;
+			A += buf[7]; B += A;
+			buf += 8;
+			n -= 8;
+		}
+		while(n-- > 0){
+			A += *buf++;
+			B += A;
+		}
+		A %= ADLER_MOD;
+		B %= ADLER_MOD;
+	}
+
+	return (B << 16) | A;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+static inline uint32_t hsum_epi32(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+/*
+ * 16 bytes per step. s1 is gathered with psadbw, the position weighted sum
+ * for s2 with pmaddwd over the bytes widened to 16 bits (SSE2 has no
+ * pmaddubsw). prev accumulates s1 before every step, its weight (16) is
+ * applied once per block.
+ */
+__attribute__((target("sse2")))
+static uint32_t adler32_update_sse2(uint32_t adler, const uint8_t *buf, size_t len)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i w_lo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+	const __m128i w_hi = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+	uint32_t A = adler & 0xffff;
+	uint32_t B = adler >> 16;
+	size_t blocks, n;
+
+	while(len >= 16){
+		__m128i v_s1 = zero, v_s2 = zero, v_prev = zero;
+
+		n = len < ADLER_NMAX ? len : ADLER_NMAX;
+		blocks = n / 16;
+		len -= blocks * 16;
+		B += A * (uint32_t)(blocks * 16);
+
+		while(blocks-- > 0){
+			__m128i v = _mm_loadu_si128((const __m128i *)buf);
+			v_prev = _mm_add_epi32(v_prev, v_s1);
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(v, zero));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), w_lo));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), w_hi));
+			buf += 16;
+		}
+
+		A += hsum_epi32(v_s1);
+		B += hsum_epi32(_mm_slli_epi32(v_prev, 4)) + hsum_epi32(v_s2);
+		A %= ADLER_MOD;
+		B %= ADLER_MOD;
+	}
+
+	return adler32_update_scalar((B << 16) | A, buf, len);
+}
+
+/*
+ * same scheme with 32 bytes per step, the weighted sum is done on bytes
+ * directly with pmaddubsw and folded to 32 bits with pmaddwd.
+ */
+__attribute__((target("avx2")))
+static uint32_t adler32_update_avx2(uint32_t adler, const uint8_t *buf, size_t len)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_set1_epi16(1);
+	const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+											24, 23, 22, 21, 20, 19, 18, 17,
+											16, 15, 14, 13, 12, 11, 10, 9,
+											8, 7, 6, 5, 4, 3, 2, 1);
+	uint32_t A = adler & 0xffff;
+	uint32_t B = adler >> 16;
+	size_t blocks, n;
+
+	while(len >= 32){
+		__m256i v_s1 = zero, v_s2 = zero, v_prev = zero;
+		__m128i lo;
+
+		n = len < ADLER_NMAX ? len : ADLER_NMAX;
+		blocks = n / 32;
+		len -= blocks * 32;
+		B += A * (uint32_t)(blocks * 32);
+
+		while(blocks-- > 0){
+			__m256i v = _mm256_loadu_si256((const __m256i *)buf);
+			v_prev = _mm256_add_epi32(v_prev, v_s1);
+			v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(v, zero));
+			v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(v, weights), ones));
+			buf += 32;
+		}
+
+		lo = _mm_add_epi32(_mm256_castsi256_si128(v_s1), _mm256_extracti128_si256(v_s1, 1));
+		A += hsum_epi32(lo);
+		v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(v_prev, 5));
+		lo = _mm_add_epi32(_mm256_castsi256_si128(v_s2), _mm256_extracti128_si256(v_s2, 1));
+		B += hsum_epi32(lo);
+		A %= ADLER_MOD;
+		B %= ADLER_MOD;
+	}
+
+	return adler32_update_scalar((B << 16) | A, buf, len);
+}
+
+#endif	/* HAVE_X86_KERNELS */
+
+static Adler32Impl impls[4];
+static pthread_once_t impls_once = PTHREAD_ONCE_INIT;
+
+static void adler32_probe(void)
+{
+	int n = 0;
+
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")){
+		impls[n].name = "avx2";
+		impls[n++].update = adler32_update_avx2;
+	}
+	if(__builtin_cpu_supports("sse2")){
+		impls[n].name = "sse2";
+		impls[n++].update = adler32_update_sse2;
+	}
+#endif
+	impls[n].name = "scalar";
+	impls[n++].update = adler32_update_scalar;
+	impls[n].name = NULL;
+}
+
+/*
+ * the kernels this cpu can run, probed once however many threads ask.
+ */
+const Adler32Impl *adler32_impls(void)
+{
+	pthread_once(&impls_once, adler32_probe);
+	return impls;
+}
+
+/*
+ * the best kernel available, adler32_impls() lists them best first.
+ */
+static Adler32Func adler32_kernel(void)
+{
+	return adler32_impls()[0].update;
+}
+
+const char *adler32_impl_name(void)
+{
+	return adler32_impls()[0].name;
+}
+
+uint32_t adler32_update(uint32_t adler, const uint8_t *buf, size_t len)
+{
+	return adler32_kernel()(adler, buf, len);
+}
+
+int dex_adler32(const uint8_t *buf, size_t len, uint32_t *result)
+{
+	if(buf == NULL || result == NULL){
+		fprintf(stderr, "invalid function parameter.\n");
+		return -1;
+	}
+
+	*result = adler32_update(ADLER32_INIT, buf, len);
+	return 0;
+}
+
+/*
+ * Update a running adler32 and a sha1 context over the same bytes in a
+ * single pass over memory: each chunk is checksummed and then hashed
+ * while it is still cache resident.
+ */
+uint32_t adler32_sha1_update(uint32_t adler, Sha1Ctx *ctx, const uint8_t *buf, size_t len)
+{
+	Adler32Func kernel = adler32_kernel();
+	size_t n;
+
+	while(len > 0){
+		n = len < FUSED_CHUNK ? len : FUSED_CHUNK;
+		adler = kernel(adler, buf, n);
+		sha1_update(ctx, buf, n);
+		buf += n;
+		len -= n;
+	}
+
+	return adler;
+}
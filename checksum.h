@@ -0,0 +1,30 @@
+#ifndef __CHECKSUM_H__
+#define __CHECKSUM_H__
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "sha1.h"
+
+#define ADLER32_INIT	1U
+
+/*
+ * adler32_update() continues a running checksum (start from ADLER32_INIT)
+ * with the kernel picked for this cpu at the first call. The per-kernel
+ * entries are exported for benchmarking, a kernel is NULL when it is not
+ * compiled in or not supported by the running cpu.
+ */
+typedef uint32_t (*Adler32Func)(uint32_t adler, const uint8_t *buf, size_t len);
+
+typedef struct {
+	const char *name;
+	Adler32Func update;
+} Adler32Impl;
+
+extern uint32_t adler32_update(uint32_t adler, const uint8_t *buf, size_t len);
+extern uint32_t adler32_update_scalar(uint32_t adler, const uint8_t *buf, size_t len);
+extern const Adler32Impl *adler32_impls(void);
+extern const char *adler32_impl_name(void);
+extern int dex_adler32(const uint8_t *buf, size_t len, uint32_t *result);
+extern uint32_t adler32_sha1_update(uint32_t adler, Sha1Ctx *ctx, const uint8_t *buf, size_t len);
+
+#endif /* __CHECKSUM_H__ */
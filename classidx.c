@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "classidx.h"
+#include "dexstats.h"
+
+/* FNV-1a, descriptors are short and this is cheap enough. */
+static u4 hash_descriptor(const char *str, size_t len)
+{
+	u4 hash = 2166136261U;
+	size_t i;
+
+	for(i = 0; i < len; ++i){
+		hash ^= (u1)str[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static int class_descriptor(const ClassIndex *index, u4 class_idx, StrView *view)
+{
+	u4 type_idx = index->class_defs[class_idx].class_idx;
+
+	if(type_idx >= index->type_ids_size)
+		return -1;
+	return string_pool_view(index->pool, index->type_ids[type_idx].descriptor_idx, view);
+}
+
+int class_index_build(ClassIndex *index, Arena *arena, StringPool *pool, const TypeIdIndex *type_ids, u4 type_ids_size,
+						const ClassDefs *class_defs, u4 class_defs_size)
+{
+	StrView view;
+	u4 cap = 16;
+	u4 i, hash, slot;
+
+	if(index == NULL || arena == NULL || pool == NULL || (class_defs_size != 0 && (type_ids == NULL || class_defs == NULL))){
+		fprintf(stderr, "class_index_build - invalid parameter.\n");
+		return -1;
+	}
+
+	memset(index, 0, sizeof(*index));
+	index->pool = pool;
+	index->type_ids = type_ids;
+	index->type_ids_size = type_ids_size;
+	index->class_defs = class_defs;
+
+	// keep the load factor at or below 1/2.
+	while(cap < class_defs_size * 2)
+		cap <<= 1;
+	index->slots = (ClassSlot *)arena_calloc(arena, cap, sizeof(ClassSlot));
+	if(index->slots == NULL){
+		fprintf(stderr, "class_index_build - out of memory.\n");
+		return -1;
+	}
+	index->mask = cap - 1;
+
+	for(i = 0; i < class_defs_size; ++i){
+		if(class_descriptor(index, i, &view) == -1){
+			fprintf(stderr, "class_index_build - bad class name for class %u.\n", i);
+			continue;
+		}
+		hash = hash_descriptor(view.data, view.len);
+		for(slot = hash & index->mask; index->slots[slot].idx != 0; slot = (slot + 1) & index->mask)
+			;
+		index->slots[slot].hash = hash;
+		index->slots[slot].idx = i + 1;
+	}
+
+	return 0;
+}
+
+/*
+ * forget the slots, their memory is the arena's (or the index cache's).
+ */
+void class_index_free(ClassIndex *index)
+{
+	if(index == NULL)
+		return ;
+	memset(index, 0, sizeof(*index));
+}
+
+/*
+ * returns the class_def index of descriptor, or -1 if it is not defined
+ * in this file.
+ */
+int class_index_find(const ClassIndex *index, const char *descriptor, size_t len)
+{
+	StrView view;
+	u4 hash, slot;
+
+	if(index == NULL || index->slots == NULL || descriptor == NULL)
+		return -1;
+
+	hash = hash_descriptor(descriptor, len);
+	DEX_STAT_ADD(DEX_STAT_CLASS_LOOKUPS, 1);
+	for(slot = hash & index->mask; index->slots[slot].idx != 0; slot = (slot + 1) & index->mask){
+		DEX_STAT_ADD(DEX_STAT_CLASS_PROBES, 1);
+		if(index->slots[slot].hash != hash)
+			continue;
+		if(class_descriptor(index, index->slots[slot].idx - 1, &view) == -1)
+			continue;
+		if(view.len == len && memcmp(view.data, descriptor, len) == 0)
+			return index->slots[slot].idx - 1;
+	}
+	return -1;
+}
+
+/*
+ * turn a java class name ("com.foo.Bar", "com.foo.Bar$Inner") into its
+ * descriptor ("Lcom/foo/Bar;"). names that already are descriptors are
+ * copied as is. returns the descriptor length or -1 if it does not fit.
+ */
+int class_name_to_descriptor(const char *name, char *buffer, size_t len)
+{
+	size_t n = strlen(name);
+	size_t i;
+
+	if(n >= 2 && name[0] == 'L' && name[n - 1] == ';'){
+		if(n + 1 > len)
+			return -1;
+		memcpy(buffer, name, n + 1);
+		return n;
+	}
+
+	if(n + 3 > len)
+		return -1;
+	buffer[0] = 'L';
+	for(i = 0; i < n; ++i)
+		buffer[i + 1] = name[i] == '.' ? '/' : name[i];
+	buffer[n + 1] = ';';
+	buffer[n + 2] = '\0';
+	return n + 2;
+}
@@ -0,0 +1,36 @@
+#ifndef __CLASSIDX_H__
+#define __CLASSIDX_H__
+
+#include <stddef.h>
+#include "dex.h"
+#include "strpool.h"
+#include "arena.h"
+
+/*
+ * Open addressing hash table from a class descriptor ("Lcom/foo/Bar;")
+ * to its class_def index. Slots keep the full hash so probing compares
+ * descriptors only on a hash match; the descriptors themselves are not
+ * copied, they are looked up in the string pool. The slots live in the
+ * arena given to class_index_build(), or in an index cache mapping.
+ */
+typedef struct {
+	u4	hash;
+	u4	idx;				/* class_def index + 1, 0 marks an empty slot */
+} ClassSlot;
+
+typedef struct {
+	ClassSlot			*slots;
+	u4					mask;		/* slot count - 1, slot count is a power of 2 */
+	StringPool			*pool;
+	const TypeIdIndex	*type_ids;
+	u4					type_ids_size;
+	const ClassDefs		*class_defs;
+} ClassIndex;
+
+extern int class_index_build(ClassIndex *index, Arena *arena, StringPool *pool, const TypeIdIndex *type_ids, u4 type_ids_size,
+								const ClassDefs *class_defs, u4 class_defs_size);
+extern void class_index_free(ClassIndex *index);
+extern int class_index_find(const ClassIndex *index, const char *descriptor, size_t len);
+extern int class_name_to_descriptor(const char *name, char *buffer, size_t len);
+
+#endif	/* __CLASSIDX_H__ */
@@ -134,6 +134,12 @@ typedef struct {
 	u4 annotated_parameters_size;
 }AnnotationsDirItem;
 
+// field_annotation, method_annotation and parameter_annotation entries
+typedef struct {
+	u4 idx;					// field_idx or method_idx
+	u4 annotations_off;
+}MemberAnnotation;
+
 typedef struct {
 	int static_fields_size;
 	int instance_fields_size;
@@ -152,6 +158,22 @@ typedef struct {
 	u4 static_value_off;
 }ClassDefs;
 
+typedef struct {
+	u2	registers_size;
+	u2	ins_size;
+	u2	outs_size;
+	u2	tries_size;
+	u4	debug_info_off;
+	u4	insns_size;			// in 16-bit code units
+	u2	insns[1];
+} DexCodeItem;
+
+typedef struct {
+	u4	start_addr;
+	u2	insn_count;
+	u2	handler_off;		// from the start of the encoded_catch_handler_list
+} DexTryItem;
+
 typedef struct {
 	u2	type;
 	u2	unused;				// unused, for paddings
@@ -0,0 +1,658 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dexanno.h"
+#include "dexstats.h"
+
+#define MEMBER_CHUNK	64
+#define MAX_DEPTH		32				// arrays and annotations nested in a value
+
+/* encoded_value types */
+enum {
+	VALUE_BYTE			= 0x00,
+	VALUE_SHORT			= 0x02,
+	VALUE_CHAR			= 0x03,
+	VALUE_INT			= 0x04,
+	VALUE_LONG			= 0x06,
+	VALUE_FLOAT			= 0x10,
+	VALUE_DOUBLE		= 0x11,
+	VALUE_METHOD_TYPE	= 0x15,
+	VALUE_METHOD_HANDLE	= 0x16,
+	VALUE_STRING		= 0x17,
+	VALUE_TYPE			= 0x18,
+	VALUE_FIELD			= 0x19,
+	VALUE_METHOD		= 0x1a,
+	VALUE_ENUM			= 0x1b,
+	VALUE_ARRAY			= 0x1c,
+	VALUE_ANNOTATION	= 0x1d,
+	VALUE_NULL			= 0x1e,
+	VALUE_BOOLEAN		= 0x1f,
+};
+
+static const char *const target_names[DEX_ANNO_TARGETS] = {
+	"class", "field", "method", "parameter",
+};
+
+static const char *const visibility_names[] = {
+	"build", "runtime", "system",
+};
+
+/*
+ * the annotations collected by dex_anno_index_build(), before they are
+ * sorted by type.
+ */
+typedef struct {
+	DexAnnotation	*items;
+	size_t			cnt;
+	size_t			cap;
+	int				failed;			/* out of memory */
+} AnnoList;
+
+static int format_value(DexContext *ctx, StrBuf *out, const u1 **data, const u1 *end, int depth);
+
+/*
+ * call fn for each annotation of the annotation_set_item at set_off, with
+ * anno's target filled in by the caller.
+ */
+static int visit_set(DexContext *ctx, u4 set_off, DexAnnotation *anno, DexAnnotationFn fn, void *arg)
+{
+	const u4 *size, *entries;
+	const u1 *data, *end;
+	u4 i;
+	int okay;
+
+	if(set_off == 0)
+		return 0;
+	if((size = (const u4 *)dex_image_ptr_aligned(&ctx->image, set_off, 4, sizeof(u4), 1)) == NULL){
+		fprintf(stderr, "visit_set - invalid annotation set offset %x.\n", set_off);
+		return -1;
+	}
+	if(*size == 0)
+		return 0;
+	if((entries = (const u4 *)dex_image_ptr(&ctx->image, set_off + sizeof(u4), sizeof(u4), *size)) == NULL){
+		fprintf(stderr, "visit_set - annotation set out of file bounds at %x.\n", set_off);
+		return -1;
+	}
+	end = dex_image_end(&ctx->image);
+	for(i = 0; i < *size; ++i){
+		if((data = (const u1 *)dex_image_ptr(&ctx->image, entries[i], 1, 1)) == NULL){
+			fprintf(stderr, "visit_set - invalid annotation offset %x.\n", entries[i]);
+			return -1;
+		}
+		anno->off = entries[i];
+		anno->visibility = *data++;
+		anno->type_idx = readAndVerifyUnsignedLeb128(&data, end, &okay);
+		if(!okay){
+			fprintf(stderr, "visit_set - bad annotation at %x.\n", entries[i]);
+			return -1;
+		}
+		if(fn(ctx, anno, arg) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * call fn for every annotation of class class_idx: the class's own, then
+ * those of its fields, methods and method parameters, in directory
+ * order. Only the visibility and type of each are read. Returns -1 on a
+ * bad directory or as soon as fn does.
+ */
+int dex_class_annotations(DexContext *ctx, u4 class_idx, DexAnnotationFn fn, void *arg)
+{
+	const ClassDefs *class;
+	const AnnotationsDirItem *dir;
+	const MemberAnnotation *items = NULL;
+	const u4 *size, *refs;
+	DexAnnotation anno;
+	size_t cnt;
+	u4 i, j;
+
+	if(class_idx >= ctx->header->classDefsSize)
+		return -1;
+	class = &ctx->class_defs[class_idx];
+	if(class->annotations_off == 0)
+		return 0;
+	dir = (const AnnotationsDirItem *)dex_image_ptr_aligned(&ctx->image, class->annotations_off, 4, sizeof(AnnotationsDirItem), 1);
+	if(dir == NULL){
+		fprintf(stderr, "dex_class_annotations - invalid annotations directory offset %x.\n", class->annotations_off);
+		return -1;
+	}
+	cnt = (size_t)dir->fields_size + dir->annotated_methods_size + dir->annotated_parameters_size;
+	if(cnt != 0 && (items = (const MemberAnnotation *)dex_image_ptr(&ctx->image, (size_t)class->annotations_off
+									+ sizeof(AnnotationsDirItem), sizeof(MemberAnnotation), cnt)) == NULL){
+		fprintf(stderr, "dex_class_annotations - annotations directory out of file bounds at %x.\n", class->annotations_off);
+		return -1;
+	}
+
+	anno.class_idx = class_idx;
+	anno.target = DEX_ANNO_CLASS;
+	anno.member = NO_INDEX;
+	anno.param = 0;
+	if(visit_set(ctx, dir->class_annotations_off, &anno, fn, arg) == -1)
+		return -1;
+	for(i = 0; i < cnt; ++i){
+		anno.member = items[i].idx;
+		if(i < dir->fields_size){
+			anno.target = DEX_ANNO_FIELD;
+		}else if(i < dir->fields_size + dir->annotated_methods_size){
+			anno.target = DEX_ANNO_METHOD;
+		}else{
+			// an annotation_set_ref_list, a set (or 0) per parameter
+			anno.target = DEX_ANNO_PARAMETER;
+			size = (const u4 *)dex_image_ptr_aligned(&ctx->image, items[i].annotations_off, 4, sizeof(u4), 1);
+			refs = size == NULL || *size == 0 ? NULL : (const u4 *)dex_image_ptr(&ctx->image,
+															items[i].annotations_off + sizeof(u4), sizeof(u4), *size);
+			if(size == NULL || (*size != 0 && refs == NULL)){
+				fprintf(stderr, "dex_class_annotations - invalid parameter annotations offset %x.\n", items[i].annotations_off);
+				return -1;
+			}
+			for(j = 0; j < *size; ++j){
+				anno.param = j;
+				if(visit_set(ctx, refs[j], &anno, fn, arg) == -1)
+					return -1;
+			}
+			continue;
+		}
+		if(visit_set(ctx, items[i].annotations_off, &anno, fn, arg) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+static int add_annotation(DexContext *ctx, const DexAnnotation *anno, void *arg)
+{
+	AnnoList *list = (AnnoList *)arg;
+	DexAnnotation *tmp;
+	size_t cap;
+
+	if(list->cnt == list->cap){
+		cap = list->cap ? list->cap * 2 : 1024;
+		tmp = (DexAnnotation *)dex_realloc(list->items, cap * sizeof(DexAnnotation));
+		if(tmp == NULL){
+			list->failed = 1;
+			return -1;
+		}
+		list->items = tmp;
+		list->cap = cap;
+	}
+	list->items[list->cnt++] = *anno;
+	return 0;
+}
+
+/*
+ * the annotation index of ctx, built on first use. Like dex_find_class(),
+ * call it before sharing the context. Returns NULL when out of memory.
+ */
+DexAnnoIndex *dex_anno_index_build(DexContext *ctx)
+{
+	DexStatsTimer timer;
+	DexAnnoIndex *index;
+	AnnoList list;
+	const DexAnnotation *anno, *end;
+	u4 size = ctx->header->typeIdsSize;
+	u4 i, total = 0;
+
+	if(ctx->annotations != NULL)
+		return ctx->annotations;
+
+	dex_stats_begin(&timer);
+	memset(&list, 0, sizeof(list));
+	index = (DexAnnoIndex *)arena_calloc(&ctx->arena, 1, sizeof(DexAnnoIndex));
+	if(index == NULL)
+		goto oom;
+	for(i = 0; i < ctx->header->classDefsSize && !list.failed; ++i){
+		if(ctx->class_defs[i].annotations_off == 0)
+			continue;
+		++index->classes;
+		// a bad directory keeps the annotations read before it.
+		if(dex_class_annotations(ctx, i, add_annotation, &list) == -1)
+			++index->bad;
+	}
+	if(list.failed)
+		goto oom;
+
+	// counting sort by type, the offsets shifted back as in dexxref.c.
+	index->size = size;
+	if((index->offsets = (u4 *)arena_calloc(&ctx->arena, (size_t)size + 1, sizeof(u4))) == NULL)
+		goto oom;
+	for(anno = list.items, end = anno + list.cnt; anno < end; ++anno){
+		if(anno->type_idx < size)
+			++index->offsets[anno->type_idx + 1];
+		else
+			++index->bad;
+	}
+	for(i = 0; i < size; ++i){
+		index->offsets[i + 1] += index->offsets[i];
+		total = index->offsets[i + 1];
+	}
+	index->annotations = (DexAnnotation *)arena_alloc(&ctx->arena, (size_t)(total ? total : 1) * sizeof(DexAnnotation));
+	if(index->annotations == NULL)
+		goto oom;
+	for(anno = list.items; anno < end; ++anno){
+		if(anno->type_idx < size)
+			index->annotations[index->offsets[anno->type_idx]++] = *anno;
+	}
+	for(i = size; i > 0; --i)
+		index->offsets[i] = index->offsets[i - 1];
+	index->offsets[0] = 0;
+
+	free(list.items);
+	dex_stats_end(&timer, DEX_PHASE_ANNOTATIONS);
+	ctx->annotations = index;
+	return index;
+
+oom:
+	fprintf(stderr, "dex_anno_index_build - out of memory.\n");
+	free(list.items);
+	dex_stats_end(&timer, DEX_PHASE_ANNOTATIONS);
+	return NULL;
+}
+
+/*
+ * the annotations of type type_idx, *cnt of them.
+ */
+const DexAnnotation *dex_anno_find(const DexAnnoIndex *index, u4 type_idx, u4 *cnt)
+{
+	if(type_idx >= index->size){
+		*cnt = 0;
+		return NULL;
+	}
+	*cnt = index->offsets[type_idx + 1] - index->offsets[type_idx];
+	return index->annotations + index->offsets[type_idx];
+}
+
+/*
+ * size little endian bytes at *data.
+ */
+static int read_bytes(const u1 **data, const u1 *end, u4 size, u8 *value)
+{
+	u4 i;
+
+	if(size > 8 || (size_t)(end - *data) < size)
+		return -1;
+	*value = 0;
+	for(i = 0; i < size; ++i)
+		*value |= (u8)(*data)[i] << (i * 8);
+	*data += size;
+	return 0;
+}
+
+/*
+ * the shortest of %.Ng with N from digits up to max that reads back as
+ * value.
+ */
+static int put_real(StrBuf *out, double value, int digits, int max, int is_float)
+{
+	char buf[64];
+
+	for(; digits < max; ++digits){
+		snprintf(buf, sizeof(buf), "%.*g", digits, value);
+		if(is_float ? (float)strtod(buf, NULL) == (float)value : strtod(buf, NULL) == value)
+			break;
+	}
+	snprintf(buf, sizeof(buf), "%.*g", digits, value);
+	// 1.0 rather than 1, as java writes it
+	if(strpbrk(buf, ".eni") == NULL)
+		strcat(buf, ".0");
+	return strbuf_puts(out, buf);
+}
+
+static int put_char(StrBuf *out, u4 c)
+{
+	if(c >= 0x20 && c < 0x7f && c != '\'' && c != '\\')
+		return strbuf_printf(out, "'%c'", c);
+	return strbuf_printf(out, "'\\u%04x'", c);
+}
+
+static int put_proto(DexContext *ctx, StrBuf *out, u4 proto_idx)
+{
+	const ProtoIds *proto;
+	const u4 *size;
+	const TypeListItem *items = NULL;
+	u4 i;
+
+	if(proto_idx >= ctx->header->protoIdsSize){
+		fprintf(stderr, "put_proto - invalid proto index %u.\n", proto_idx);
+		return -1;
+	}
+	proto = &ctx->proto_ids[proto_idx];
+	if(strbuf_putc(out, '(') == -1)
+		return -1;
+	if(proto->parameters_off != 0){
+		size = (const u4 *)dex_image_ptr_aligned(&ctx->image, proto->parameters_off, 4, sizeof(u4), 1);
+		if(size != NULL && *size != 0)
+			items = (const TypeListItem *)dex_image_ptr(&ctx->image, proto->parameters_off + sizeof(u4), sizeof(TypeListItem), *size);
+		if(size == NULL || (*size != 0 && items == NULL)){
+			fprintf(stderr, "put_proto - parameters out of file bounds at %x.\n", proto->parameters_off);
+			return -1;
+		}
+		for(i = 0; i < *size; ++i){
+			if((i != 0 && strbuf_append(out, ", ", 2) == -1) || dex_format_type(ctx, out, items[i].type_idx) == -1)
+				return -1;
+		}
+	}
+	if(strbuf_putc(out, ')') == -1)
+		return -1;
+	return dex_format_type(ctx, out, proto->return_type_idx);
+}
+
+/*
+ * "com.foo.Kind.VALUE", an enum constant without its type.
+ */
+static int put_enum(DexContext *ctx, StrBuf *out, u4 field_idx)
+{
+	const char *name;
+
+	if(field_idx >= ctx->header->fieldIdsSize || (name = dex_string(ctx, ctx->field_ids[field_idx].name_idx)) == NULL){
+		fprintf(stderr, "put_enum - invalid field index %u.\n", field_idx);
+		return -1;
+	}
+	if(dex_format_type(ctx, out, ctx->field_ids[field_idx].class_idx) == -1 || strbuf_putc(out, '.') == -1)
+		return -1;
+	return strbuf_puts(out, name);
+}
+
+/*
+ * an encoded_array: "{value, value}".
+ */
+static int format_array(DexContext *ctx, StrBuf *out, const u1 **data, const u1 *end, int depth)
+{
+	u4 size, i;
+	int okay;
+
+	size = readAndVerifyUnsignedLeb128(data, end, &okay);
+	if(!okay){
+		fprintf(stderr, "format_array - bad array size.\n");
+		return -1;
+	}
+	if(strbuf_putc(out, '{') == -1)
+		return -1;
+	for(i = 0; i < size; ++i){
+		if((i != 0 && strbuf_append(out, ", ", 2) == -1) || format_value(ctx, out, data, end, depth + 1) == -1)
+			return -1;
+	}
+	return strbuf_putc(out, '}');
+}
+
+/*
+ * an encoded_annotation: "@com.foo.Anno(name=value, ...)", without the
+ * parentheses when it has no elements.
+ */
+static int format_annotation(DexContext *ctx, StrBuf *out, const u1 **data, const u1 *end, int depth)
+{
+	const char *name;
+	u4 type_idx, size, name_idx, i;
+	int okay;
+
+	type_idx = readAndVerifyUnsignedLeb128(data, end, &okay);
+	size = okay ? readAndVerifyUnsignedLeb128(data, end, &okay) : 0;
+	if(!okay){
+		fprintf(stderr, "format_annotation - bad annotation header.\n");
+		return -1;
+	}
+	if(strbuf_putc(out, '@') == -1 || dex_format_type(ctx, out, type_idx) == -1)
+		return -1;
+	if(size == 0)
+		return 0;
+	if(strbuf_putc(out, '(') == -1)
+		return -1;
+	for(i = 0; i < size; ++i){
+		name_idx = readAndVerifyUnsignedLeb128(data, end, &okay);
+		if(!okay || (name = dex_string(ctx, name_idx)) == NULL){
+			fprintf(stderr, "format_annotation - bad element name.\n");
+			return -1;
+		}
+		if((i != 0 && strbuf_append(out, ", ", 2) == -1) || strbuf_puts(out, name) == -1 || strbuf_putc(out, '=') == -1)
+			return -1;
+		if(format_value(ctx, out, data, end, depth + 1) == -1)
+			return -1;
+	}
+	return strbuf_putc(out, ')');
+}
+
+/*
+ * one encoded_value at *data, Java style: numbers, 'c', "string",
+ * com.foo.Bar.class, member references, {arrays} and @annotations.
+ */
+static int format_value(DexContext *ctx, StrBuf *out, const u1 **data, const u1 *end, int depth)
+{
+	const char *str;
+	u4 type, arg, shift;
+	u8 raw;
+	union { u4 bits; float value; } f;
+	union { u8 bits; double value; } d;
+
+	if(*data >= end || depth > MAX_DEPTH){
+		fprintf(stderr, "format_value - value out of file bounds or nested too deep.\n");
+		return -1;
+	}
+	type = **data & 0x1f;
+	arg = **data >> 5;
+	++*data;
+
+	switch(type){
+		case VALUE_BYTE:
+		case VALUE_SHORT:
+		case VALUE_INT:
+		case VALUE_LONG:
+			if(read_bytes(data, end, arg + 1, &raw) == -1)
+				break;
+			// sign extend from the bytes given
+			shift = 64 - (arg + 1) * 8;
+			return strbuf_putdec(out, (long long)(raw << shift) >> shift);
+		case VALUE_CHAR:
+			if(read_bytes(data, end, arg + 1, &raw) == -1 || raw > 0xffff)
+				break;
+			return put_char(out, (u4)raw);
+		case VALUE_FLOAT:
+			// zero extended to the right: the bytes given are the high ones
+			if(arg > 3 || read_bytes(data, end, arg + 1, &raw) == -1)
+				break;
+			f.bits = (u4)(raw << ((3 - arg) * 8));
+			if(put_real(out, f.value, 6, 9, 1) == -1)
+				return -1;
+			return strbuf_putc(out, 'f');
+		case VALUE_DOUBLE:
+			if(read_bytes(data, end, arg + 1, &raw) == -1)
+				break;
+			d.bits = raw << ((7 - arg) * 8);
+			return put_real(out, d.value, 15, 17, 0);
+		case VALUE_METHOD_TYPE:
+		case VALUE_METHOD_HANDLE:
+		case VALUE_STRING:
+		case VALUE_TYPE:
+		case VALUE_FIELD:
+		case VALUE_METHOD:
+		case VALUE_ENUM:
+			if(arg > 3 || read_bytes(data, end, arg + 1, &raw) == -1)
+				break;
+			if(type == VALUE_METHOD_TYPE)
+				return put_proto(ctx, out, (u4)raw);
+			if(type == VALUE_METHOD_HANDLE)
+				return strbuf_printf(out, "method_handle@%u", (u4)raw);
+			if(type == VALUE_STRING){
+				if((str = dex_string(ctx, (u4)raw)) == NULL)
+					break;
+				return strbuf_printf(out, "\"%s\"", str);
+			}
+			if(type == VALUE_TYPE)
+				return dex_format_type(ctx, out, (u4)raw) == -1 ? -1 : strbuf_append(out, ".class", 6);
+			if(type == VALUE_FIELD)
+				return dex_format_field_ref(ctx, out, (u4)raw);
+			if(type == VALUE_METHOD)
+				return dex_format_method_ref(ctx, out, (u4)raw);
+			return put_enum(ctx, out, (u4)raw);
+		case VALUE_ARRAY:
+			if(arg != 0)
+				break;
+			return format_array(ctx, out, data, end, depth);
+		case VALUE_ANNOTATION:
+			if(arg != 0)
+				break;
+			return format_annotation(ctx, out, data, end, depth);
+		case VALUE_NULL:
+			return arg != 0 ? -1 : strbuf_append(out, "null", 4);
+		case VALUE_BOOLEAN:
+			if(arg > 1)
+				break;
+			return strbuf_puts(out, arg ? "true" : "false");
+	}
+	fprintf(stderr, "format_value - bad encoded value of type %x.\n", type);
+	return -1;
+}
+
+/*
+ * the encoded_value at *data, which is moved past it.
+ */
+int dex_format_encoded_value(DexContext *ctx, StrBuf *out, const u1 **data, const u1 *end)
+{
+	return format_value(ctx, out, data, end, 0);
+}
+
+/*
+ * the annotation_item at off, "@Type(name=value, ...)"; its visibility
+ * is left out.
+ */
+int dex_format_annotation(DexContext *ctx, StrBuf *out, u4 off)
+{
+	const u1 *data;
+
+	if((data = (const u1 *)dex_image_ptr(&ctx->image, off, 1, 2)) == NULL){
+		fprintf(stderr, "dex_format_annotation - invalid annotation offset %x.\n", off);
+		return -1;
+	}
+	++data;			// visibility
+	return format_annotation(ctx, out, &data, dex_image_end(&ctx->image), 0);
+}
+
+/*
+ * what anno is on: "class name", "field ref", "method ref" or
+ * "parameter N of method ref".
+ */
+int dex_format_annotation_target(DexContext *ctx, StrBuf *out, const DexAnnotation *anno)
+{
+	switch(anno->target){
+		case DEX_ANNO_CLASS:
+			if(anno->class_idx >= ctx->header->classDefsSize || strbuf_puts(out, "class ") == -1)
+				return -1;
+			return dex_format_type(ctx, out, ctx->class_defs[anno->class_idx].class_idx);
+		case DEX_ANNO_FIELD:
+			if(strbuf_puts(out, "field ") == -1)
+				return -1;
+			return dex_format_field_ref(ctx, out, anno->member);
+		case DEX_ANNO_METHOD:
+			if(strbuf_puts(out, "method ") == -1)
+				return -1;
+			return dex_format_method_ref(ctx, out, anno->member);
+		case DEX_ANNO_PARAMETER:
+			if(strbuf_printf(out, "parameter %u of ", anno->param) == -1)
+				return -1;
+			return dex_format_method_ref(ctx, out, anno->member);
+	}
+	return -1;
+}
+
+static int format_line(DexContext *ctx, const DexAnnotation *anno, void *arg)
+{
+	StrBuf *out = (StrBuf *)arg;
+
+	if(strbuf_append(out, "  ", 2) == -1 || dex_format_annotation_target(ctx, out, anno) == -1
+			|| strbuf_putc(out, ' ') == -1 || dex_format_annotation(ctx, out, anno->off) == -1)
+		return -1;
+	if(anno->visibility != DEX_ANNO_RUNTIME
+			&& strbuf_printf(out, " (%s)", anno->visibility <= DEX_ANNO_SYSTEM ? visibility_names[anno->visibility] : "?") == -1)
+		return -1;
+	return strbuf_putc(out, '\n');
+}
+
+/*
+ * every annotation of class class_idx, "  target @Type(...)" a line, the
+ * visibility added when it is not runtime.
+ */
+int dex_format_annotations(DexContext *ctx, StrBuf *out, u4 class_idx)
+{
+	return dex_class_annotations(ctx, class_idx, format_line, out);
+}
+
+/*
+ * call fn for each static field of class class_idx that static_value_off
+ * gives a value, in class data order, with *value at its encoded_value;
+ * fn must move it past the value, as dex_format_encoded_value() does.
+ * Fields past the end of the array keep their default value and are
+ * left out.
+ */
+int dex_class_static_values(DexContext *ctx, u4 class_idx, DexStaticValueFn fn, void *arg)
+{
+	const ClassDefs *class;
+	EncodedMember members[MEMBER_CHUNK];
+	const u1 *data, *values, *end;
+	u4 fields, size, idx = 0, n, i;
+	int okay;
+
+	if(class_idx >= ctx->header->classDefsSize)
+		return -1;
+	class = &ctx->class_defs[class_idx];
+	if(class->static_value_off == 0 || class->class_data_off == 0)
+		return 0;
+	values = (const u1 *)dex_image_ptr(&ctx->image, class->static_value_off, 1, 1);
+	data = (const u1 *)dex_image_ptr(&ctx->image, class->class_data_off, 1, 1);
+	if(values == NULL || data == NULL){
+		fprintf(stderr, "dex_class_static_values - invalid static values or class data offset %x.\n", class->static_value_off);
+		return -1;
+	}
+	end = dex_image_end(&ctx->image);
+	size = readAndVerifyUnsignedLeb128(&values, end, &okay);
+	// the static fields come first in the class data.
+	fields = okay ? readAndVerifyUnsignedLeb128(&data, end, &okay) : 0;
+	for(i = 0; okay && i < 3; ++i)
+		readAndVerifyUnsignedLeb128(&data, end, &okay);
+	if(!okay){
+		fprintf(stderr, "dex_class_static_values - bad static values or class data at %x.\n", class->static_value_off);
+		return -1;
+	}
+
+	if(size > fields)
+		size = fields;
+	while(size > 0){
+		n = size < MEMBER_CHUNK ? size : MEMBER_CHUNK;
+		if(readEncodedMembers(&data, end, members, n, &idx, 0) == -1){
+			fprintf(stderr, "dex_class_static_values - bad class data at %x.\n", class->class_data_off);
+			return -1;
+		}
+		for(i = 0; i < n; ++i){
+			if(fn(ctx, members[i].idx, &values, end, arg) == -1)
+				return -1;
+		}
+		size -= n;
+	}
+	return 0;
+}
+
+static int format_static_value(DexContext *ctx, u4 field_idx, const u1 **value, const u1 *end, void *arg)
+{
+	StrBuf *out = (StrBuf *)arg;
+
+	if(strbuf_append(out, "  ", 2) == -1 || dex_format_field_ref(ctx, out, field_idx) == -1
+			|| strbuf_append(out, " = ", 3) == -1 || format_value(ctx, out, value, end, 0) == -1)
+		return -1;
+	return strbuf_putc(out, '\n');
+}
+
+/*
+ * the static values of class class_idx, "  field ref = value" a line.
+ */
+int dex_format_static_values(DexContext *ctx, StrBuf *out, u4 class_idx)
+{
+	return dex_class_static_values(ctx, class_idx, format_static_value, out);
+}
+
+const char *dex_anno_target_name(u4 target)
+{
+	return target < DEX_ANNO_TARGETS ? target_names[target] : NULL;
+}
+
+const char *dex_anno_visibility_name(u4 visibility)
+{
+	return visibility <= DEX_ANNO_SYSTEM ? visibility_names[visibility] : NULL;
+}
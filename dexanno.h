@@ -0,0 +1,68 @@
+#ifndef __DEXANNO_H__
+#define __DEXANNO_H__
+
+#include "dexfile.h"
+
+/*
+ * Annotations and static field values, read only when asked for: a class
+ * dump without them never touches annotations_off or static_value_off.
+ * dex_class_annotations() walks the annotations_directory_item of a
+ * class and reads just the visibility and type of each annotation_item;
+ * its elements are decoded by dex_format_annotation() when the
+ * annotation is shown. The annotation index lists every annotation of a
+ * dex by type, from one pass over the directories, in compressed sparse
+ * row form like the cross references: those of type t are
+ * annotations[offsets[t]] up to annotations[offsets[t + 1]], in class
+ * order. It lives in the context's arena.
+ */
+enum {
+	DEX_ANNO_CLASS,
+	DEX_ANNO_FIELD,
+	DEX_ANNO_METHOD,
+	DEX_ANNO_PARAMETER,
+	DEX_ANNO_TARGETS,
+};
+
+enum {
+	DEX_ANNO_BUILD		= 0,
+	DEX_ANNO_RUNTIME	= 1,
+	DEX_ANNO_SYSTEM		= 2,
+};
+
+typedef struct {
+	u4	class_idx;			/* class_def */
+	u4	target;				/* DEX_ANNO_CLASS ... */
+	u4	member;				/* field or method id, NO_INDEX for the class */
+	u4	param;				/* parameter number of a DEX_ANNO_PARAMETER */
+	u4	off;				/* annotation_item */
+	u4	type_idx;
+	u4	visibility;			/* DEX_ANNO_BUILD ... */
+} DexAnnotation;
+
+struct DexAnnoIndex {
+	u4				size;			/* type_ids */
+	u4				*offsets;		/* size + 1 */
+	DexAnnotation	*annotations;
+	u4				classes;		/* with an annotations directory */
+	u4				bad;			/* directories or annotations that could not be read */
+};
+
+typedef int (*DexAnnotationFn)(DexContext *ctx, const DexAnnotation *anno, void *arg);
+typedef int (*DexStaticValueFn)(DexContext *ctx, u4 field_idx, const u1 **value, const u1 *end, void *arg);
+
+extern int dex_class_annotations(DexContext *ctx, u4 class_idx, DexAnnotationFn fn, void *arg);
+extern DexAnnoIndex *dex_anno_index_build(DexContext *ctx);
+extern const DexAnnotation *dex_anno_find(const DexAnnoIndex *index, u4 type_idx, u4 *cnt);
+extern int dex_class_static_values(DexContext *ctx, u4 class_idx, DexStaticValueFn fn, void *arg);
+extern int dex_format_encoded_value(DexContext *ctx, StrBuf *out, const u1 **data, const u1 *end);
+extern int dex_format_annotation(DexContext *ctx, StrBuf *out, u4 off);
+extern int dex_format_annotation_target(DexContext *ctx, StrBuf *out, const DexAnnotation *anno);
+extern int dex_format_annotations(DexContext *ctx, StrBuf *out, u4 class_idx);
+extern int dex_format_static_values(DexContext *ctx, StrBuf *out, u4 class_idx);
+extern const char *dex_anno_target_name(u4 target);
+extern const char *dex_anno_visibility_name(u4 visibility);
+
+/* JSON record (dexjson.c) of one annotation, with its text */
+extern int dex_json_annotation(DexContext *ctx, StrBuf *out, const char *kind, const char *prefix, const DexAnnotation *anno);
+
+#endif	/* __DEXANNO_H__ */
@@ -0,0 +1,930 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dexfile.h"
+
+/*
+ * Dalvik bytecode disassembler. Every opcode maps to its instruction
+ * format and the kind of constant pool index it carries; the decoder is a
+ * switch over the formats, so adding an opcode is one table line.
+ */
+
+#define CODE_INDENT		"      "
+#define CODE_HEADER		16				// code_item bytes before insns
+
+#define PAYLOAD_PACKED	0x0100
+#define PAYLOAD_SPARSE	0x0200
+#define PAYLOAD_ARRAY	0x0300
+
+#define ARRAY_PER_LINE	8
+#define SCRATCH_SIZE	512				// on the stack, room for a few dozen switches
+
+enum {
+	F10x, F12x, F11n, F11x, F10t, F20t, F22x, F21t, F21s, F21h, F21c, F23x,
+	F22b, F22t, F22s, F22c, F32x, F30t, F31t, F31i, F31c, F35c, F3rc, F51l,
+	FORMAT_CNT,
+};
+
+// IDX_STRING on follow the DEX_REF_* order, one apart.
+enum {
+	IDX_NONE, IDX_STRING, IDX_TYPE, IDX_FIELD, IDX_METHOD,
+};
+
+typedef struct {
+	const char	*name;
+	u1			format;
+	u1			index;
+} OpcodeInfo;
+
+// code units taken by each format, the digit after the format's first.
+static const u1 format_units[FORMAT_CNT] = {
+	[F10x] = 1, [F12x] = 1, [F11n] = 1, [F11x] = 1, [F10t] = 1,
+	[F20t] = 2, [F22x] = 2, [F21t] = 2, [F21s] = 2, [F21h] = 2, [F21c] = 2,
+	[F23x] = 2, [F22b] = 2, [F22t] = 2, [F22s] = 2, [F22c] = 2,
+	[F32x] = 3, [F30t] = 3, [F31t] = 3, [F31i] = 3, [F31c] = 3, [F35c] = 3, [F3rc] = 3,
+	[F51l] = 5,
+};
+
+static const char *const index_names[] = {
+	"", "string@", "type@", "field@", "method@",
+};
+
+static const OpcodeInfo opcodes[256] = {
+	{"nop", F10x, IDX_NONE},			/* 00 */
+	{"move", F12x, IDX_NONE},			/* 01 */
+	{"move/from16", F22x, IDX_NONE},	/* 02 */
+	{"move/16", F32x, IDX_NONE},		/* 03 */
+	{"move-wide", F12x, IDX_NONE},		/* 04 */
+	{"move-wide/from16", F22x, IDX_NONE},	/* 05 */
+	{"move-wide/16", F32x, IDX_NONE},	/* 06 */
+	{"move-object", F12x, IDX_NONE},	/* 07 */
+	{"move-object/from16", F22x, IDX_NONE},	/* 08 */
+	{"move-object/16", F32x, IDX_NONE},	/* 09 */
+	{"move-result", F11x, IDX_NONE},	/* 0a */
+	{"move-result-wide", F11x, IDX_NONE},	/* 0b */
+	{"move-result-object", F11x, IDX_NONE},	/* 0c */
+	{"move-exception", F11x, IDX_NONE},	/* 0d */
+	{"return-void", F10x, IDX_NONE},	/* 0e */
+	{"return", F11x, IDX_NONE},			/* 0f */
+	{"return-wide", F11x, IDX_NONE},	/* 10 */
+	{"return-object", F11x, IDX_NONE},	/* 11 */
+	{"const/4", F11n, IDX_NONE},		/* 12 */
+	{"const/16", F21s, IDX_NONE},		/* 13 */
+	{"const", F31i, IDX_NONE},			/* 14 */
+	{"const/high16", F21h, IDX_NONE},	/* 15 */
+	{"const-wide/16", F21s, IDX_NONE},	/* 16 */
+	{"const-wide/32", F31i, IDX_NONE},	/* 17 */
+	{"const-wide", F51l, IDX_NONE},		/* 18 */
+	{"const-wide/high16", F21h, IDX_NONE},	/* 19 */
+	{"const-string", F21c, IDX_STRING},	/* 1a */
+	{"const-string/jumbo", F31c, IDX_STRING},	/* 1b */
+	{"const-class", F21c, IDX_TYPE},	/* 1c */
+	{"monitor-enter", F11x, IDX_NONE},	/* 1d */
+	{"monitor-exit", F11x, IDX_NONE},	/* 1e */
+	{"check-cast", F21c, IDX_TYPE},		/* 1f */
+	{"instance-of", F22c, IDX_TYPE},	/* 20 */
+	{"array-length", F12x, IDX_NONE},	/* 21 */
+	{"new-instance", F21c, IDX_TYPE},	/* 22 */
+	{"new-array", F22c, IDX_TYPE},		/* 23 */
+	{"filled-new-array", F35c, IDX_TYPE},	/* 24 */
+	{"filled-new-array/range", F3rc, IDX_TYPE},	/* 25 */
+	{"fill-array-data", F31t, IDX_NONE},	/* 26 */
+	{"throw", F11x, IDX_NONE},			/* 27 */
+	{"goto", F10t, IDX_NONE},			/* 28 */
+	{"goto/16", F20t, IDX_NONE},		/* 29 */
+	{"goto/32", F30t, IDX_NONE},		/* 2a */
+	{"packed-switch", F31t, IDX_NONE},	/* 2b */
+	{"sparse-switch", F31t, IDX_NONE},	/* 2c */
+	{"cmpl-float", F23x, IDX_NONE},		/* 2d */
+	{"cmpg-float", F23x, IDX_NONE},		/* 2e */
+	{"cmpl-double", F23x, IDX_NONE},	/* 2f */
+	{"cmpg-double", F23x, IDX_NONE},	/* 30 */
+	{"cmp-long", F23x, IDX_NONE},		/* 31 */
+	{"if-eq", F22t, IDX_NONE},			/* 32 */
+	{"if-ne", F22t, IDX_NONE},			/* 33 */
+	{"if-lt", F22t, IDX_NONE},			/* 34 */
+	{"if-ge", F22t, IDX_NONE},			/* 35 */
+	{"if-gt", F22t, IDX_NONE},			/* 36 */
+	{"if-le", F22t, IDX_NONE},			/* 37 */
+	{"if-eqz", F21t, IDX_NONE},			/* 38 */
+	{"if-nez", F21t, IDX_NONE},			/* 39 */
+	{"if-ltz", F21t, IDX_NONE},			/* 3a */
+	{"if-gez", F21t, IDX_NONE},			/* 3b */
+	{"if-gtz", F21t, IDX_NONE},			/* 3c */
+	{"if-lez", F21t, IDX_NONE},			/* 3d */
+	{"unused-3e", F10x, IDX_NONE},		/* 3e */
+	{"unused-3f", F10x, IDX_NONE},		/* 3f */
+	{"unused-40", F10x, IDX_NONE},		/* 40 */
+	{"unused-41", F10x, IDX_NONE},		/* 41 */
+	{"unused-42", F10x, IDX_NONE},		/* 42 */
+	{"unused-43", F10x, IDX_NONE},		/* 43 */
+	{"aget", F23x, IDX_NONE},			/* 44 */
+	{"aget-wide", F23x, IDX_NONE},		/* 45 */
+	{"aget-object", F23x, IDX_NONE},	/* 46 */
+	{"aget-boolean", F23x, IDX_NONE},	/* 47 */
+	{"aget-byte", F23x, IDX_NONE},		/* 48 */
+	{"aget-char", F23x, IDX_NONE},		/* 49 */
+	{"aget-short", F23x, IDX_NONE},		/* 4a */
+	{"aput", F23x, IDX_NONE},			/* 4b */
+	{"aput-wide", F23x, IDX_NONE},		/* 4c */
+	{"aput-object", F23x, IDX_NONE},	/* 4d */
+	{"aput-boolean", F23x, IDX_NONE},	/* 4e */
+	{"aput-byte", F23x, IDX_NONE},		/* 4f */
+	{"aput-char", F23x, IDX_NONE},		/* 50 */
+	{"aput-short", F23x, IDX_NONE},		/* 51 */
+	{"iget", F22c, IDX_FIELD},			/* 52 */
+	{"iget-wide", F22c, IDX_FIELD},		/* 53 */
+	{"iget-object", F22c, IDX_FIELD},	/* 54 */
+	{"iget-boolean", F22c, IDX_FIELD},	/* 55 */
+	{"iget-byte", F22c, IDX_FIELD},		/* 56 */
+	{"iget-char", F22c, IDX_FIELD},		/* 57 */
+	{"iget-short", F22c, IDX_FIELD},	/* 58 */
+	{"iput", F22c, IDX_FIELD},			/* 59 */
+	{"iput-wide", F22c, IDX_FIELD},		/* 5a */
+	{"iput-object", F22c, IDX_FIELD},	/* 5b */
+	{"iput-boolean", F22c, IDX_FIELD},	/* 5c */
+	{"iput-byte", F22c, IDX_FIELD},		/* 5d */
+	{"iput-char", F22c, IDX_FIELD},		/* 5e */
+	{"iput-short", F22c, IDX_FIELD},	/* 5f */
+	{"sget", F21c, IDX_FIELD},			/* 60 */
+	{"sget-wide", F21c, IDX_FIELD},		/* 61 */
+	{"sget-object", F21c, IDX_FIELD},	/* 62 */
+	{"sget-boolean", F21c, IDX_FIELD},	/* 63 */
+	{"sget-byte", F21c, IDX_FIELD},		/* 64 */
+	{"sget-char", F21c, IDX_FIELD},		/* 65 */
+	{"sget-short", F21c, IDX_FIELD},	/* 66 */
+	{"sput", F21c, IDX_FIELD},			/* 67 */
+	{"sput-wide", F21c, IDX_FIELD},		/* 68 */
+	{"sput-object", F21c, IDX_FIELD},	/* 69 */
+	{"sput-boolean", F21c, IDX_FIELD},	/* 6a */
+	{"sput-byte", F21c, IDX_FIELD},		/* 6b */
+	{"sput-char", F21c, IDX_FIELD},		/* 6c */
+	{"sput-short", F21c, IDX_FIELD},	/* 6d */
+	{"invoke-virtual", F35c, IDX_METHOD},	/* 6e */
+	{"invoke-super", F35c, IDX_METHOD},	/* 6f */
+	{"invoke-direct", F35c, IDX_METHOD},	/* 70 */
+	{"invoke-static", F35c, IDX_METHOD},	/* 71 */
+	{"invoke-interface", F35c, IDX_METHOD},	/* 72 */
+	{"unused-73", F10x, IDX_NONE},		/* 73 */
+	{"invoke-virtual/range", F3rc, IDX_METHOD},	/* 74 */
+	{"invoke-super/range", F3rc, IDX_METHOD},	/* 75 */
+	{"invoke-direct/range", F3rc, IDX_METHOD},	/* 76 */
+	{"invoke-static/range", F3rc, IDX_METHOD},	/* 77 */
+	{"invoke-interface/range", F3rc, IDX_METHOD},	/* 78 */
+	{"unused-79", F10x, IDX_NONE},		/* 79 */
+	{"unused-7a", F10x, IDX_NONE},		/* 7a */
+	{"neg-int", F12x, IDX_NONE},		/* 7b */
+	{"not-int", F12x, IDX_NONE},		/* 7c */
+	{"neg-long", F12x, IDX_NONE},		/* 7d */
+	{"not-long", F12x, IDX_NONE},		/* 7e */
+	{"neg-float", F12x, IDX_NONE},		/* 7f */
+	{"neg-double", F12x, IDX_NONE},		/* 80 */
+	{"int-to-long", F12x, IDX_NONE},	/* 81 */
+	{"int-to-float", F12x, IDX_NONE},	/* 82 */
+	{"int-to-double", F12x, IDX_NONE},	/* 83 */
+	{"long-to-int", F12x, IDX_NONE},	/* 84 */
+	{"long-to-float", F12x, IDX_NONE},	/* 85 */
+	{"long-to-double", F12x, IDX_NONE},	/* 86 */
+	{"float-to-int", F12x, IDX_NONE},	/* 87 */
+	{"float-to-long", F12x, IDX_NONE},	/* 88 */
+	{"float-to-double", F12x, IDX_NONE},	/* 89 */
+	{"double-to-int", F12x, IDX_NONE},	/* 8a */
+	{"double-to-long", F12x, IDX_NONE},	/* 8b */
+	{"double-to-float", F12x, IDX_NONE},	/* 8c */
+	{"int-to-byte", F12x, IDX_NONE},	/* 8d */
+	{"int-to-char", F12x, IDX_NONE},	/* 8e */
+	{"int-to-short", F12x, IDX_NONE},	/* 8f */
+	{"add-int", F23x, IDX_NONE},		/* 90 */
+	{"sub-int", F23x, IDX_NONE},		/* 91 */
+	{"mul-int", F23x, IDX_NONE},		/* 92 */
+	{"div-int", F23x, IDX_NONE},		/* 93 */
+	{"rem-int", F23x, IDX_NONE},		/* 94 */
+	{"and-int", F23x, IDX_NONE},		/* 95 */
+	{"or-int", F23x, IDX_NONE},			/* 96 */
+	{"xor-int", F23x, IDX_NONE},		/* 97 */
+	{"shl-int", F23x, IDX_NONE},		/* 98 */
+	{"shr-int", F23x, IDX_NONE},		/* 99 */
+	{"ushr-int", F23x, IDX_NONE},		/* 9a */
+	{"add-long", F23x, IDX_NONE},		/* 9b */
+	{"sub-long", F23x, IDX_NONE},		/* 9c */
+	{"mul-long", F23x, IDX_NONE},		/* 9d */
+	{"div-long", F23x, IDX_NONE},		/* 9e */
+	{"rem-long", F23x, IDX_NONE},		/* 9f */
+	{"and-long", F23x, IDX_NONE},		/* a0 */
+	{"or-long", F23x, IDX_NONE},		/* a1 */
+	{"xor-long", F23x, IDX_NONE},		/* a2 */
+	{"shl-long", F23x, IDX_NONE},		/* a3 */
+	{"shr-long", F23x, IDX_NONE},		/* a4 */
+	{"ushr-long", F23x, IDX_NONE},		/* a5 */
+	{"add-float", F23x, IDX_NONE},		/* a6 */
+	{"sub-float", F23x, IDX_NONE},		/* a7 */
+	{"mul-float", F23x, IDX_NONE},		/* a8 */
+	{"div-float", F23x, IDX_NONE},		/* a9 */
+	{"rem-float", F23x, IDX_NONE},		/* aa */
+	{"add-double", F23x, IDX_NONE},		/* ab */
+	{"sub-double", F23x, IDX_NONE},		/* ac */
+	{"mul-double", F23x, IDX_NONE},		/* ad */
+	{"div-double", F23x, IDX_NONE},		/* ae */
+	{"rem-double", F23x, IDX_NONE},		/* af */
+	{"add-int/2addr", F12x, IDX_NONE},	/* b0 */
+	{"sub-int/2addr", F12x, IDX_NONE},	/* b1 */
+	{"mul-int/2addr", F12x, IDX_NONE},	/* b2 */
+	{"div-int/2addr", F12x, IDX_NONE},	/* b3 */
+	{"rem-int/2addr", F12x, IDX_NONE},	/* b4 */
+	{"and-int/2addr", F12x, IDX_NONE},	/* b5 */
+	{"or-int/2addr", F12x, IDX_NONE},	/* b6 */
+	{"xor-int/2addr", F12x, IDX_NONE},	/* b7 */
+	{"shl-int/2addr", F12x, IDX_NONE},	/* b8 */
+	{"shr-int/2addr", F12x, IDX_NONE},	/* b9 */
+	{"ushr-int/2addr", F12x, IDX_NONE},	/* ba */
+	{"add-long/2addr", F12x, IDX_NONE},	/* bb */
+	{"sub-long/2addr", F12x, IDX_NONE},	/* bc */
+	{"mul-long/2addr", F12x, IDX_NONE},	/* bd */
+	{"div-long/2addr", F12x, IDX_NONE},	/* be */
+	{"rem-long/2addr", F12x, IDX_NONE},	/* bf */
+	{"and-long/2addr", F12x, IDX_NONE},	/* c0 */
+	{"or-long/2addr", F12x, IDX_NONE},	/* c1 */
+	{"xor-long/2addr", F12x, IDX_NONE},	/* c2 */
+	{"shl-long/2addr", F12x, IDX_NONE},	/* c3 */
+	{"shr-long/2addr", F12x, IDX_NONE},	/* c4 */
+	{"ushr-long/2addr", F12x, IDX_NONE},	/* c5 */
+	{"add-float/2addr", F12x, IDX_NONE},	/* c6 */
+	{"sub-float/2addr", F12x, IDX_NONE},	/* c7 */
+	{"mul-float/2addr", F12x, IDX_NONE},	/* c8 */
+	{"div-float/2addr", F12x, IDX_NONE},	/* c9 */
+	{"rem-float/2addr", F12x, IDX_NONE},	/* ca */
+	{"add-double/2addr", F12x, IDX_NONE},	/* cb */
+	{"sub-double/2addr", F12x, IDX_NONE},	/* cc */
+	{"mul-double/2addr", F12x, IDX_NONE},	/* cd */
+	{"div-double/2addr", F12x, IDX_NONE},	/* ce */
+	{"rem-double/2addr", F12x, IDX_NONE},	/* cf */
+	{"add-int/lit16", F22s, IDX_NONE},	/* d0 */
+	{"rsub-int", F22s, IDX_NONE},		/* d1 */
+	{"mul-int/lit16", F22s, IDX_NONE},	/* d2 */
+	{"div-int/lit16", F22s, IDX_NONE},	/* d3 */
+	{"rem-int/lit16", F22s, IDX_NONE},	/* d4 */
+	{"and-int/lit16", F22s, IDX_NONE},	/* d5 */
+	{"or-int/lit16", F22s, IDX_NONE},	/* d6 */
+	{"xor-int/lit16", F22s, IDX_NONE},	/* d7 */
+	{"add-int/lit8", F22b, IDX_NONE},	/* d8 */
+	{"rsub-int/lit8", F22b, IDX_NONE},	/* d9 */
+	{"mul-int/lit8", F22b, IDX_NONE},	/* da */
+	{"div-int/lit8", F22b, IDX_NONE},	/* db */
+	{"rem-int/lit8", F22b, IDX_NONE},	/* dc */
+	{"and-int/lit8", F22b, IDX_NONE},	/* dd */
+	{"or-int/lit8", F22b, IDX_NONE},	/* de */
+	{"xor-int/lit8", F22b, IDX_NONE},	/* df */
+	{"shl-int/lit8", F22b, IDX_NONE},	/* e0 */
+	{"shr-int/lit8", F22b, IDX_NONE},	/* e1 */
+	{"ushr-int/lit8", F22b, IDX_NONE},	/* e2 */
+	{"unused-e3", F10x, IDX_NONE},		/* e3 */
+	{"unused-e4", F10x, IDX_NONE},		/* e4 */
+	{"unused-e5", F10x, IDX_NONE},		/* e5 */
+	{"unused-e6", F10x, IDX_NONE},		/* e6 */
+	{"unused-e7", F10x, IDX_NONE},		/* e7 */
+	{"unused-e8", F10x, IDX_NONE},		/* e8 */
+	{"unused-e9", F10x, IDX_NONE},		/* e9 */
+	{"unused-ea", F10x, IDX_NONE},		/* ea */
+	{"unused-eb", F10x, IDX_NONE},		/* eb */
+	{"unused-ec", F10x, IDX_NONE},		/* ec */
+	{"unused-ed", F10x, IDX_NONE},		/* ed */
+	{"unused-ee", F10x, IDX_NONE},		/* ee */
+	{"unused-ef", F10x, IDX_NONE},		/* ef */
+	{"unused-f0", F10x, IDX_NONE},		/* f0 */
+	{"unused-f1", F10x, IDX_NONE},		/* f1 */
+	{"unused-f2", F10x, IDX_NONE},		/* f2 */
+	{"unused-f3", F10x, IDX_NONE},		/* f3 */
+	{"unused-f4", F10x, IDX_NONE},		/* f4 */
+	{"unused-f5", F10x, IDX_NONE},		/* f5 */
+	{"unused-f6", F10x, IDX_NONE},		/* f6 */
+	{"unused-f7", F10x, IDX_NONE},		/* f7 */
+	{"unused-f8", F10x, IDX_NONE},		/* f8 */
+	{"unused-f9", F10x, IDX_NONE},		/* f9 */
+	{"unused-fa", F10x, IDX_NONE},		/* fa */
+	{"unused-fb", F10x, IDX_NONE},		/* fb */
+	{"unused-fc", F10x, IDX_NONE},		/* fc */
+	{"unused-fd", F10x, IDX_NONE},		/* fd */
+	{"unused-fe", F10x, IDX_NONE},		/* fe */
+	{"unused-ff", F10x, IDX_NONE},		/* ff */
+};
+
+/*
+ * switch payloads list their targets relative to the switch instruction,
+ * so the decoder remembers which instruction points at which payload.
+ */
+typedef struct {
+	u4	payload;
+	u4	source;
+} PayloadRef;
+
+typedef struct {
+	DexContext	*ctx;
+	StrBuf		*out;
+	const u2	*insns;
+	u4			size;
+	Arena		scratch;
+	PayloadRef	*refs;
+	u4			refs_cnt;
+	u4			refs_cap;
+} Decoder;
+
+static s4 get_s4(const u2 *p)
+{
+	return (s4)(p[0] | (u4)p[1] << 16);
+}
+
+static void add_payload_ref(Decoder *dec, u4 payload, u4 source)
+{
+	PayloadRef *refs;
+	u4 cap;
+
+	if(dec->refs_cnt == dec->refs_cap){
+		// the old table stays in the scratch arena until the method is done.
+		cap = dec->refs_cap ? dec->refs_cap * 2 : 8;
+		refs = (PayloadRef *)arena_alloc(&dec->scratch, cap * sizeof(PayloadRef));
+		if(refs == NULL)
+			return ;
+		if(dec->refs_cnt != 0)
+			memcpy(refs, dec->refs, dec->refs_cnt * sizeof(PayloadRef));
+		dec->refs = refs;
+		dec->refs_cap = cap;
+	}
+	dec->refs[dec->refs_cnt].payload = payload;
+	dec->refs[dec->refs_cnt].source = source;
+	++dec->refs_cnt;
+}
+
+/*
+ * address of the switch using the payload at pc, or pc itself if none
+ * was seen (the targets then print relative to the payload).
+ */
+static u4 payload_source(const Decoder *dec, u4 pc)
+{
+	u4 i;
+
+	for(i = 0; i < dec->refs_cnt; ++i){
+		if(dec->refs[i].payload == pc)
+			return dec->refs[i].source;
+	}
+	return pc;
+}
+
+/*
+ * an instruction line up to its constant pool index is formatted in place
+ * (strbuf_tail), with room for the longest: indent, pc, the longest name
+ * and five registers or a 64 bit literal. Only the index goes through the
+ * StrBuf calls, copied from the name cache after its first use.
+ */
+#define INSN_LINE		128
+
+static char *put_udec(char *p, unsigned long long value)
+{
+	char digits[20];
+	int n = sizeof(digits);
+
+	// registers and most literals take one or two digits
+	if(value < 10){
+		*p = '0' + value;
+		return p + 1;
+	}
+	if(value < 100){
+		p[0] = '0' + value / 10;
+		p[1] = '0' + value % 10;
+		return p + 2;
+	}
+	do{
+		digits[--n] = '0' + value % 10;
+		value /= 10;
+	}while(value != 0);
+	memcpy(p, digits + n, sizeof(digits) - n);
+	return p + sizeof(digits) - n;
+}
+
+static char *put_hex(char *p, unsigned long long value, int digits)
+{
+	static const char hex[] = "0123456789abcdef";
+	char buf[16];
+	int n = sizeof(buf);
+
+	// every pc and branch target of a method up to 64K units
+	if(digits == 4 && value <= 0xffff){
+		p[0] = hex[value >> 12];
+		p[1] = hex[(value >> 8) & 0xf];
+		p[2] = hex[(value >> 4) & 0xf];
+		p[3] = hex[value & 0xf];
+		return p + 4;
+	}
+	do{
+		buf[--n] = hex[value & 0xf];
+		value >>= 4;
+	}while(n > 0 && (value != 0 || (int)sizeof(buf) - n < digits));
+	memcpy(p, buf + n, sizeof(buf) - n);
+	return p + sizeof(buf) - n;
+}
+
+static char *put_str(char *p, const char *str)
+{
+	while(*str != '\0')
+		*p++ = *str++;
+	return p;
+}
+
+static char *put_sep(char *p)
+{
+	p[0] = ',';
+	p[1] = ' ';
+	return p + 2;
+}
+
+static char *put_reg(char *p, u4 reg)
+{
+	*p++ = 'v';
+	return put_udec(p, reg);
+}
+
+static char *put_target(char *p, u4 pc, s4 offset)
+{
+	return put_hex(p, (u4)(pc + offset), 4);
+}
+
+static char *put_literal(char *p, long long value)
+{
+	*p++ = '#';
+	if(value < 0){
+		*p++ = '-';
+		return put_udec(p, 0ULL - (unsigned long long)value);
+	}
+	return put_udec(p, value);
+}
+
+/*
+ * a constant pool reference resolved to its name, or kind@idx when the
+ * index is bad.
+ */
+static void put_index(Decoder *dec, int kind, u4 idx)
+{
+	StrBuf *out = dec->out;
+	size_t mark = out->len;
+	const char *str;
+	int ret = -1;
+
+	switch(kind){
+		case IDX_STRING:
+			if((str = dex_string(dec->ctx, idx)) != NULL){
+				strbuf_putc(out, '"');
+				strbuf_puts(out, str);
+				ret = strbuf_putc(out, '"');
+			}
+			break;
+		case IDX_TYPE:
+			ret = dex_format_type(dec->ctx, out, idx);
+			break;
+		case IDX_FIELD:
+			ret = dex_format_field_ref(dec->ctx, out, idx);
+			break;
+		case IDX_METHOD:
+			ret = dex_format_method_ref(dec->ctx, out, idx);
+			break;
+	}
+
+	if(ret == -1){
+		strbuf_truncate(out, mark);
+		strbuf_puts(out, index_names[kind]);
+		strbuf_putdec(out, idx);
+	}
+}
+
+/*
+ * the constant pool index of an instruction that has one: every indexed
+ * format has it in its second unit, F31c has 32 bits of it.
+ */
+static u4 insn_index(const u2 *p, const OpcodeInfo *info)
+{
+	return info->format == F31c ? (u4)get_s4(p + 1) : p[1];
+}
+
+/*
+ * one instruction at pc, written at line up to its constant pool index
+ * (the separator before it included). Returns the end of what it wrote.
+ */
+static char *decode_insn(Decoder *dec, u4 pc, const OpcodeInfo *info, char *line)
+{
+	const u2 *p = dec->insns + pc;
+	u4 inst = p[0];
+	u4 a = (inst >> 8) & 0xf;
+	u4 b = inst >> 12;
+	u4 aa = inst >> 8;
+	u4 i, cnt;
+	u4 regs[5];
+
+	line = put_str(line, info->name);
+	if(info->format == F10x)
+		return line;
+	*line++ = ' ';
+
+	switch(info->format){
+		case F12x:
+			line = put_reg(line, a);
+			line = put_reg(put_sep(line), b);
+			break;
+		case F11n:
+			line = put_reg(line, a);
+			line = put_literal(put_sep(line), (s4)(b << 28) >> 28);
+			break;
+		case F11x:
+			line = put_reg(line, aa);
+			break;
+		case F10t:
+			line = put_target(line, pc, (s1)aa);
+			break;
+		case F20t:
+			line = put_target(line, pc, (s2)p[1]);
+			break;
+		case F22x:
+			line = put_reg(line, aa);
+			line = put_reg(put_sep(line), p[1]);
+			break;
+		case F21t:
+			line = put_reg(line, aa);
+			line = put_target(put_sep(line), pc, (s2)p[1]);
+			break;
+		case F21s:
+			line = put_reg(line, aa);
+			line = put_literal(put_sep(line), (s2)p[1]);
+			break;
+		case F21h:
+			line = put_sep(put_reg(line, aa));
+			// const/high16 fills the top of an int, const-wide/high16 of a long
+			if((inst & 0xff) == 0x15)
+				line = put_literal(line, (s4)((u4)p[1] << 16));
+			else
+				line = put_literal(line, (long long)((unsigned long long)p[1] << 48));
+			break;
+		case F21c:
+		case F31c:
+			line = put_sep(put_reg(line, aa));
+			break;
+		case F23x:
+			line = put_reg(line, aa);
+			line = put_reg(put_sep(line), p[1] & 0xff);
+			line = put_reg(put_sep(line), p[1] >> 8);
+			break;
+		case F22b:
+			line = put_reg(line, aa);
+			line = put_reg(put_sep(line), p[1] & 0xff);
+			line = put_literal(put_sep(line), (s1)(p[1] >> 8));
+			break;
+		case F22t:
+			line = put_reg(line, a);
+			line = put_reg(put_sep(line), b);
+			line = put_target(put_sep(line), pc, (s2)p[1]);
+			break;
+		case F22s:
+			line = put_reg(line, a);
+			line = put_reg(put_sep(line), b);
+			line = put_literal(put_sep(line), (s2)p[1]);
+			break;
+		case F22c:
+			line = put_reg(line, a);
+			line = put_sep(put_reg(put_sep(line), b));
+			break;
+		case F32x:
+			line = put_reg(line, p[1]);
+			line = put_reg(put_sep(line), p[2]);
+			break;
+		case F30t:
+			line = put_target(line, pc, get_s4(p + 1));
+			break;
+		case F31t:
+			line = put_reg(line, aa);
+			line = put_target(put_sep(line), pc, get_s4(p + 1));
+			add_payload_ref(dec, pc + get_s4(p + 1), pc);
+			break;
+		case F31i:
+			line = put_reg(line, aa);
+			line = put_literal(put_sep(line), get_s4(p + 1));
+			break;
+		case F35c:
+			// A|G|op BBBB F|E|D|C
+			cnt = b > 5 ? 5 : b;
+			regs[0] = p[2] & 0xf;
+			regs[1] = (p[2] >> 4) & 0xf;
+			regs[2] = (p[2] >> 8) & 0xf;
+			regs[3] = p[2] >> 12;
+			regs[4] = a;
+			*line++ = '{';
+			for(i = 0; i < cnt; ++i){
+				if(i != 0)
+					line = put_sep(line);
+				line = put_reg(line, regs[i]);
+			}
+			*line++ = '}';
+			line = put_sep(line);
+			break;
+		case F3rc:
+			// AA|op BBBB CCCC, registers CCCC .. CCCC+AA-1
+			*line++ = '{';
+			if(aa != 0){
+				line = put_reg(line, p[2]);
+				if(aa > 1){
+					memcpy(line, " .. ", 4);
+					line = put_reg(line + 4, p[2] + aa - 1);
+				}
+			}
+			*line++ = '}';
+			line = put_sep(line);
+			break;
+		case F51l:
+			line = put_reg(line, aa);
+			line = put_literal(put_sep(line), (long long)((unsigned long long)(u4)get_s4(p + 1)
+											| (unsigned long long)(u4)get_s4(p + 3) << 32));
+			break;
+	}
+	return line;
+}
+
+/*
+ * code units taken by the payload at pc, 0 if it does not fit.
+ */
+static u4 payload_units(const Decoder *dec, u4 pc)
+{
+	const u2 *p = dec->insns + pc;
+	u4 left = dec->size - pc;
+	unsigned long long units;
+
+	if(left < 2)
+		return 0;
+	switch(p[0]){
+		case PAYLOAD_PACKED:
+			units = 4 + (unsigned long long)p[1] * 2;
+			break;
+		case PAYLOAD_SPARSE:
+			units = 2 + (unsigned long long)p[1] * 4;
+			break;
+		case PAYLOAD_ARRAY:
+			// elements are 1, 2, 4 or 8 bytes, anything else is not a payload
+			if(left < 4 || (p[1] != 1 && p[1] != 2 && p[1] != 4 && p[1] != 8))
+				return 0;
+			units = 4 + ((unsigned long long)p[1] * (u4)get_s4(p + 2) + 1) / 2;
+			break;
+		default:
+			return 0;
+	}
+	return units <= left ? (u4)units : 0;
+}
+
+static void decode_payload(Decoder *dec, u4 pc, u4 units)
+{
+	StrBuf *out = dec->out;
+	const u2 *p = dec->insns + pc;
+	const u1 *data;
+	u4 source = payload_source(dec, pc);
+	u4 i, j, n = p[1], width;
+	unsigned long long value;
+
+	switch(p[0]){
+		case PAYLOAD_PACKED:
+			strbuf_puts(out, "packed-switch-data (");
+			strbuf_putdec(out, units);
+			strbuf_puts(out, " units)\n");
+			for(i = 0; i < n; ++i){
+				strbuf_puts(out, CODE_INDENT "    ");
+				strbuf_putdec(out, (long long)get_s4(p + 2) + i);
+				strbuf_append(out, ": ", 2);
+				strbuf_puthex(out, (u4)(source + get_s4(p + 4 + 2 * i)), 4);
+				strbuf_putc(out, '\n');
+			}
+			break;
+		case PAYLOAD_SPARSE:
+			strbuf_puts(out, "sparse-switch-data (");
+			strbuf_putdec(out, units);
+			strbuf_puts(out, " units)\n");
+			for(i = 0; i < n; ++i){
+				strbuf_puts(out, CODE_INDENT "    ");
+				strbuf_putdec(out, get_s4(p + 2 + 2 * i));
+				strbuf_append(out, ": ", 2);
+				strbuf_puthex(out, (u4)(source + get_s4(p + 2 + 2 * n + 2 * i)), 4);
+				strbuf_putc(out, '\n');
+			}
+			break;
+		case PAYLOAD_ARRAY:
+			width = p[1];
+			n = (u4)get_s4(p + 2);
+			data = (const u1 *)(p + 4);
+			strbuf_puts(out, "array-data (");
+			strbuf_putdec(out, units);
+			strbuf_puts(out, " units, ");
+			strbuf_putdec(out, n);
+			strbuf_puts(out, " x ");
+			strbuf_putdec(out, width);
+			strbuf_puts(out, " bytes)\n");
+			for(i = 0; i < n; ++i){
+				if(i % ARRAY_PER_LINE == 0)
+					strbuf_puts(out, CODE_INDENT "    ");
+				for(value = 0, j = 0; j < width; ++j)
+					value |= (unsigned long long)data[i * width + j] << (8 * j);
+				strbuf_append(out, "0x", 2);
+				strbuf_puthex(out, value, width * 2);
+				strbuf_putc(out, i % ARRAY_PER_LINE == ARRAY_PER_LINE - 1 || i == n - 1 ? '\n' : ' ');
+			}
+			break;
+	}
+}
+
+/*
+ * the try blocks and their handlers, which follow the insns.
+ */
+static int decode_tries(Decoder *dec, u4 code_off, const DexCodeItem *code)
+{
+	DexContext *ctx = dec->ctx;
+	StrBuf *out = dec->out;
+	const DexTryItem *tries;
+	const u1 *list, *data, *end;
+	size_t tries_off;
+	s4 size;
+	u4 i, n, type_idx, addr;
+	int okay;
+
+	tries_off = (size_t)code_off + CODE_HEADER + (size_t)code->insns_size * 2;
+	if(code->insns_size & 1)
+		tries_off += 2;			// padding to 4 bytes
+	tries = (const DexTryItem *)dex_image_ptr(&ctx->image, tries_off, sizeof(DexTryItem), code->tries_size);
+	list = (const u1 *)dex_image_ptr(&ctx->image, tries_off + sizeof(DexTryItem) * code->tries_size, 1, 1);
+	if(tries == NULL || list == NULL){
+		fprintf(stderr, "decode_tries - try items out of file bounds at %x.\n", code_off);
+		return -1;
+	}
+	end = dex_image_end(&ctx->image);
+
+	strbuf_puts(out, CODE_INDENT "catches: ");
+	strbuf_putdec(out, code->tries_size);
+	strbuf_putc(out, '\n');
+	for(i = 0; i < code->tries_size; ++i){
+		strbuf_puts(out, CODE_INDENT "  0x");
+		strbuf_puthex(out, tries[i].start_addr, 4);
+		strbuf_append(out, " - 0x", 5);
+		strbuf_puthex(out, tries[i].start_addr + tries[i].insn_count, 4);
+		strbuf_putc(out, '\n');
+
+		data = list + tries[i].handler_off;
+		size = readAndVerifySignedLeb128(&data, end, &okay);
+		if(!okay){
+			fprintf(stderr, "decode_tries - bad catch handler at %x.\n", code_off);
+			return -1;
+		}
+		// size <= 0 means a catch-all follows the typed handlers
+		for(n = size < 0 ? -size : size; n > 0; --n){
+			type_idx = readAndVerifyUnsignedLeb128(&data, end, &okay);
+			addr = okay ? readAndVerifyUnsignedLeb128(&data, end, &okay) : 0;
+			if(!okay){
+				fprintf(stderr, "decode_tries - bad catch handler at %x.\n", code_off);
+				return -1;
+			}
+			strbuf_puts(out, CODE_INDENT "    ");
+			put_index(dec, IDX_TYPE, type_idx);
+			strbuf_append(out, " -> 0x", 6);
+			strbuf_puthex(out, addr, 4);
+			strbuf_putc(out, '\n');
+		}
+		if(size <= 0){
+			addr = readAndVerifyUnsignedLeb128(&data, end, &okay);
+			if(!okay){
+				fprintf(stderr, "decode_tries - bad catch handler at %x.\n", code_off);
+				return -1;
+			}
+			strbuf_puts(out, CODE_INDENT "    <any> -> 0x");
+			strbuf_puthex(out, addr, 4);
+			strbuf_putc(out, '\n');
+		}
+	}
+	return 0;
+}
+
+/*
+ * the code_item at code_off: its header, every instruction and payload,
+ * then the try blocks.
+ */
+int dex_format_code(DexContext *ctx, StrBuf *out, u4 code_off)
+{
+	const DexCodeItem *code;
+	const OpcodeInfo *info;
+	Decoder dec;
+	char scratch[SCRATCH_SIZE];
+	char *line;
+	u4 pc, units;
+	int ret = 0;
+
+	code = (const DexCodeItem *)dex_image_ptr_aligned(&ctx->image, code_off, 4, CODE_HEADER, 1);
+	if(code == NULL){
+		fprintf(stderr, "dex_format_code - invalid code offset %x.\n", code_off);
+		return -1;
+	}
+	dec.insns = (const u2 *)dex_image_ptr(&ctx->image, (size_t)code_off + CODE_HEADER, sizeof(u2), code->insns_size);
+	if(dec.insns == NULL){
+		fprintf(stderr, "dex_format_code - insns out of file bounds at %x.\n", code_off);
+		return -1;
+	}
+	dec.ctx = ctx;
+	dec.out = out;
+	dec.size = code->insns_size;
+	dec.refs = NULL;
+	dec.refs_cnt = 0;
+	dec.refs_cap = 0;
+	arena_init_buffer(&dec.scratch, scratch, sizeof(scratch));
+
+	if((line = strbuf_tail(out, INSN_LINE)) == NULL){
+		arena_free(&dec.scratch);
+		return -1;
+	}
+	line = put_str(line, CODE_INDENT "registers: ");
+	line = put_udec(line, code->registers_size);
+	line = put_udec(put_str(line, ", ins: "), code->ins_size);
+	line = put_udec(put_str(line, ", outs: "), code->outs_size);
+	line = put_udec(put_str(line, ", insns: "), code->insns_size);
+	*line++ = '\n';
+	strbuf_commit(out, line);
+
+	for(pc = 0; pc < dec.size; pc += units){
+		if((line = strbuf_tail(out, INSN_LINE)) == NULL){
+			ret = -1;
+			break;
+		}
+		memcpy(line, CODE_INDENT, sizeof(CODE_INDENT) - 1);
+		line = put_hex(line + sizeof(CODE_INDENT) - 1, pc, 4);
+		*line++ = ':';
+		*line++ = ' ';
+
+		// a nop with a non zero high byte is a payload pseudo-instruction
+		if((dec.insns[pc] & 0xff) == 0 && dec.insns[pc] != 0 && (units = payload_units(&dec, pc)) != 0){
+			strbuf_commit(out, line);
+			decode_payload(&dec, pc, units);
+			continue;
+		}
+
+		info = &opcodes[dec.insns[pc] & 0xff];
+		units = format_units[info->format];
+		if(units > dec.size - pc){
+			strbuf_commit(out, line);
+			strbuf_puts(out, "(truncated instruction)\n");
+			fprintf(stderr, "dex_format_code - instruction at %04x runs past insns at %x.\n", pc, code_off);
+			ret = -1;
+			break;
+		}
+		line = decode_insn(&dec, pc, info, line);
+		if(info->index == IDX_NONE){
+			*line++ = '\n';
+			strbuf_commit(out, line);
+		}else{
+			strbuf_commit(out, line);
+			put_index(&dec, info->index, insn_index(dec.insns + pc, info));
+			strbuf_putc(out, '\n');
+		}
+	}
+
+	if(ret == 0 && code->tries_size != 0)
+		ret = decode_tries(&dec, code_off, code);
+	arena_free(&dec.scratch);
+	return ret;
+}
+
+/*
+ * call fn for every constant pool index the instructions of the code_item
+ * at code_off refer to, with the kind (DEX_REF_*) and the instruction's
+ * pc. Payloads are skipped. Returns -1 on a bad code item, after the
+ * references before the bad instruction were reported.
+ */
+int dex_code_refs(DexContext *ctx, u4 code_off, DexRefFn fn, void *arg)
+{
+	const DexCodeItem *code;
+	const OpcodeInfo *info;
+	const u2 *p;
+	Decoder dec;
+	u4 pc, units;
+
+	code = (const DexCodeItem *)dex_image_ptr_aligned(&ctx->image, code_off, 4, CODE_HEADER, 1);
+	if(code == NULL){
+		fprintf(stderr, "dex_code_refs - invalid code offset %x.\n", code_off);
+		return -1;
+	}
+	dec.insns = (const u2 *)dex_image_ptr(&ctx->image, (size_t)code_off + CODE_HEADER, sizeof(u2), code->insns_size);
+	if(dec.insns == NULL){
+		fprintf(stderr, "dex_code_refs - insns out of file bounds at %x.\n", code_off);
+		return -1;
+	}
+	dec.size = code->insns_size;
+
+	for(pc = 0; pc < dec.size; pc += units){
+		p = dec.insns + pc;
+		if((p[0] & 0xff) == 0 && p[0] != 0 && (units = payload_units(&dec, pc)) != 0)
+			continue;
+		info = &opcodes[p[0] & 0xff];
+		units = format_units[info->format];
+		if(units > dec.size - pc){
+			fprintf(stderr, "dex_code_refs - instruction at %04x runs past insns at %x.\n", pc, code_off);
+			return -1;
+		}
+		if(info->index != IDX_NONE)
+			fn(info->index - IDX_STRING, insn_index(p, info), pc, arg);
+	}
+	return 0;
+}
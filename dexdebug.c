@@ -0,0 +1,483 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dexdebug.h"
+#include "dexstats.h"
+
+#define CODE_HEADER		16				// code_item bytes before insns
+#define CODE_INDENT		"      "
+
+/* debug_info_item opcodes */
+enum {
+	DBG_END_SEQUENCE		= 0x00,
+	DBG_ADVANCE_PC			= 0x01,
+	DBG_ADVANCE_LINE		= 0x02,
+	DBG_START_LOCAL			= 0x03,
+	DBG_START_LOCAL_EXTENDED	= 0x04,
+	DBG_END_LOCAL			= 0x05,
+	DBG_RESTART_LOCAL		= 0x06,
+	DBG_SET_PROLOGUE_END	= 0x07,
+	DBG_SET_EPILOGUE_BEGIN	= 0x08,
+	DBG_SET_FILE			= 0x09,
+	DBG_FIRST_SPECIAL		= 0x0a,
+};
+
+#define DBG_LINE_BASE	(-4)
+#define DBG_LINE_RANGE	15
+
+/*
+ * the registers of a method while its debug info is run: the local each
+ * holds, live when live is set.
+ */
+typedef struct {
+	DexLocal	local;
+	u1			live;
+	u1			known;			/* local was started once, for DBG_RESTART_LOCAL */
+} DebugReg;
+
+/* the methods of a class being indexed */
+typedef struct {
+	u4				source_idx;		/* the class's source file */
+	DexLineRange	*ranges;
+	u4				cnt;
+	u4				cap;
+	DexLineRange	cur;			/* lines of the method being decoded */
+	int				failed;			/* out of memory */
+} LineBuild;
+
+/* dex_find_line() confirming a candidate */
+typedef struct {
+	u4	source_idx;
+	u4	line;
+	u4	pc;
+} LineProbe;
+
+/*
+ * whether pos is in the class's own source file: no DBG_SET_FILE, or one
+ * naming that file again.
+ */
+static int same_source(const DexPosition *pos, u4 source_idx)
+{
+	return pos->source_idx == NO_INDEX || pos->source_idx == source_idx;
+}
+
+/*
+ * end the local in regs[reg] at pc and report it.
+ */
+static int end_local(DexContext *ctx, DebugReg *regs, u4 reg, u4 pc, DexLocalFn local, void *arg)
+{
+	if(!regs[reg].live)
+		return 0;
+	regs[reg].live = 0;
+	regs[reg].local.end_pc = pc;
+	return local(ctx, &regs[reg].local, arg);
+}
+
+/*
+ * start the parameters as locals at pc 0: this, unless the method is
+ * static, then one per parameter_names entry, in the last ins registers.
+ */
+static int start_params(DexContext *ctx, const EncodedMember *method, const DexCodeItem *code, DebugReg *regs,
+						const u1 **data, const u1 *end, u4 names)
+{
+	const MethodIds *mid = &ctx->method_ids[method->idx];
+	const ProtoIds *proto;
+	const u4 *size = NULL;
+	const TypeListItem *types = NULL;
+	StrView view;
+	u4 reg, name, params = 0, i;
+	int okay;
+
+	if(mid->proto_idx >= ctx->header->protoIdsSize)
+		return -1;
+	proto = &ctx->proto_ids[mid->proto_idx];
+	if(proto->parameters_off != 0){
+		size = (const u4 *)dex_image_ptr_aligned(&ctx->image, proto->parameters_off, 4, sizeof(u4), 1);
+		if(size == NULL || (*size != 0 && (types = (const TypeListItem *)dex_image_ptr(&ctx->image,
+								proto->parameters_off + sizeof(u4), sizeof(TypeListItem), *size)) == NULL))
+			return -1;
+		params = *size;
+	}
+
+	reg = code->registers_size - code->ins_size;
+	if((method->access_flags & ACC_STATIC) == 0){
+		if(reg >= code->registers_size)
+			return -1;
+		regs[reg].local.reg = reg;
+		regs[reg].local.start_pc = 0;
+		regs[reg].local.name_idx = NO_INDEX;
+		regs[reg].local.type_idx = mid->class_idx;
+		regs[reg].local.sig_idx = NO_INDEX;
+		regs[reg].live = regs[reg].known = 1;
+		++reg;
+	}
+	for(i = 0; i < names; ++i){
+		name = (u4)readAndVerifyUnsignedLeb128(data, end, &okay) - 1;
+		if(!okay)
+			return -1;
+		if(i >= params || reg >= code->registers_size)
+			continue;
+		if(name != NO_INDEX){
+			regs[reg].local.reg = reg;
+			regs[reg].local.start_pc = 0;
+			regs[reg].local.name_idx = name;
+			regs[reg].local.type_idx = types[i].type_idx;
+			regs[reg].local.sig_idx = NO_INDEX;
+			regs[reg].live = regs[reg].known = 1;
+		}
+		// long and double take a register pair
+		if(types[i].type_idx >= ctx->header->typeIdsSize
+				|| string_pool_view(&ctx->strings, ctx->type_ids[types[i].type_idx].descriptor_idx, &view) == -1)
+			return -1;
+		reg += view.len > 0 && (view.data[0] == 'J' || view.data[0] == 'D') ? 2 : 1;
+	}
+	return 0;
+}
+
+/*
+ * run the debug_info state machine of method: position is called for
+ * every line table entry in address order, local for every local
+ * variable when its scope ends, the parameters included. Either may be
+ * NULL. Returns 0 for a method without debug info, -1 on bad debug info
+ * or as soon as a callback does.
+ */
+int dex_debug_info(DexContext *ctx, const EncodedMember *method, DexPositionFn position, DexLocalFn local, void *arg)
+{
+	const DexCodeItem *code;
+	const u1 *data, *end;
+	DebugReg *regs = NULL;
+	DexPosition pos;
+	u4 names, reg, op, adjusted, i;
+	int okay, ret = -1;
+
+	if(method->code_off == 0)
+		return 0;
+	if(method->idx >= ctx->header->methodIdsSize
+			|| (code = (const DexCodeItem *)dex_image_ptr_aligned(&ctx->image, method->code_off, 4, CODE_HEADER, 1)) == NULL){
+		fprintf(stderr, "dex_debug_info - invalid method %u or code offset %x.\n", method->idx, method->code_off);
+		return -1;
+	}
+	if(code->debug_info_off == 0)
+		return 0;
+	if((data = (const u1 *)dex_image_ptr(&ctx->image, code->debug_info_off, 1, 1)) == NULL){
+		fprintf(stderr, "dex_debug_info - invalid debug info offset %x.\n", code->debug_info_off);
+		return -1;
+	}
+	end = dex_image_end(&ctx->image);
+
+	pos.pc = 0;
+	pos.source_idx = NO_INDEX;
+	pos.line = readAndVerifyUnsignedLeb128(&data, end, &okay);
+	names = okay ? readAndVerifyUnsignedLeb128(&data, end, &okay) : 0;
+	if(!okay)
+		goto bad;
+	if(local != NULL){
+		if((regs = (DebugReg *)dex_calloc(code->registers_size ? code->registers_size : 1, sizeof(DebugReg))) == NULL){
+			fprintf(stderr, "dex_debug_info - out of memory.\n");
+			return -1;
+		}
+		if(start_params(ctx, method, code, regs, &data, end, names) == -1)
+			goto bad;
+	}else{
+		for(i = 0; okay && i < names; ++i)
+			readAndVerifyUnsignedLeb128(&data, end, &okay);
+		if(!okay)
+			goto bad;
+	}
+
+	for(;;){
+		if(data >= end)
+			goto bad;
+		op = *data++;
+		switch(op){
+			case DBG_END_SEQUENCE:
+				ret = 0;
+				for(reg = 0; regs != NULL && reg < code->registers_size && ret == 0; ++reg)
+					ret = end_local(ctx, regs, reg, code->insns_size, local, arg);
+				free(regs);
+				return ret;
+			case DBG_ADVANCE_PC:
+				pos.pc += readAndVerifyUnsignedLeb128(&data, end, &okay);
+				break;
+			case DBG_ADVANCE_LINE:
+				pos.line += readAndVerifySignedLeb128(&data, end, &okay);
+				break;
+			case DBG_START_LOCAL:
+			case DBG_START_LOCAL_EXTENDED:
+				reg = readAndVerifyUnsignedLeb128(&data, end, &okay);
+				if(!okay || regs == NULL){
+					// not asked for: just step over the operands
+					for(i = 0; okay && i < (op == DBG_START_LOCAL ? 2u : 3u); ++i)
+						readAndVerifyUnsignedLeb128(&data, end, &okay);
+					break;
+				}
+				if(reg >= code->registers_size || end_local(ctx, regs, reg, pos.pc, local, arg) == -1)
+					goto bad;
+				regs[reg].local.reg = reg;
+				regs[reg].local.start_pc = pos.pc;
+				regs[reg].local.name_idx = (u4)readAndVerifyUnsignedLeb128(&data, end, &okay) - 1;
+				regs[reg].local.type_idx = okay ? (u4)readAndVerifyUnsignedLeb128(&data, end, &okay) - 1 : NO_INDEX;
+				regs[reg].local.sig_idx = NO_INDEX;
+				if(okay && op == DBG_START_LOCAL_EXTENDED)
+					regs[reg].local.sig_idx = (u4)readAndVerifyUnsignedLeb128(&data, end, &okay) - 1;
+				regs[reg].live = regs[reg].known = 1;
+				break;
+			case DBG_END_LOCAL:
+			case DBG_RESTART_LOCAL:
+				reg = readAndVerifyUnsignedLeb128(&data, end, &okay);
+				if(!okay || regs == NULL)
+					break;
+				if(reg >= code->registers_size)
+					goto bad;
+				if(op == DBG_END_LOCAL){
+					if(end_local(ctx, regs, reg, pos.pc, local, arg) == -1)
+						goto bad;
+				}else if(regs[reg].known && !regs[reg].live){
+					regs[reg].local.start_pc = pos.pc;
+					regs[reg].live = 1;
+				}
+				break;
+			case DBG_SET_PROLOGUE_END:
+			case DBG_SET_EPILOGUE_BEGIN:
+				break;
+			case DBG_SET_FILE:
+				pos.source_idx = (u4)readAndVerifyUnsignedLeb128(&data, end, &okay) - 1;
+				break;
+			default:
+				adjusted = op - DBG_FIRST_SPECIAL;
+				pos.pc += adjusted / DBG_LINE_RANGE;
+				pos.line += DBG_LINE_BASE + (int)(adjusted % DBG_LINE_RANGE);
+				if(position != NULL && position(ctx, &pos, arg) == -1)
+					goto bad;
+				break;
+		}
+		if(!okay)
+			goto bad;
+	}
+
+bad:
+	fprintf(stderr, "dex_debug_info - bad debug info at %x.\n", code->debug_info_off);
+	free(regs);
+	return -1;
+}
+
+static int widen_range(DexContext *ctx, const DexPosition *pos, void *arg)
+{
+	LineBuild *build = (LineBuild *)arg;
+
+	if(!same_source(pos, build->source_idx))
+		return 0;
+	if(pos->line < build->cur.first_line)
+		build->cur.first_line = pos->line;
+	if(build->cur.last_line == NO_INDEX || pos->line > build->cur.last_line)
+		build->cur.last_line = pos->line;
+	return 0;
+}
+
+static int add_method_range(DexContext *ctx, u4 class_idx, const EncodedMember *method, void *arg)
+{
+	LineBuild *build = (LineBuild *)arg;
+	DexLineRange *tmp;
+	u4 cap;
+
+	build->cur.first_line = NO_INDEX;
+	build->cur.last_line = NO_INDEX;
+	build->cur.method_idx = method->idx;
+	build->cur.code_off = method->code_off;
+	// a method with bad debug info keeps the lines read before it.
+	dex_debug_info(ctx, method, widen_range, NULL, build);
+	if(build->cur.last_line == NO_INDEX)
+		return 0;
+	if(build->cnt == build->cap){
+		cap = build->cap ? build->cap * 2 : 16;
+		if((tmp = (DexLineRange *)dex_realloc(build->ranges, cap * sizeof(DexLineRange))) == NULL){
+			build->failed = 1;
+			return -1;
+		}
+		build->ranges = tmp;
+		build->cap = cap;
+	}
+	build->ranges[build->cnt++] = build->cur;
+	return 0;
+}
+
+static int compare_ranges(const void *a, const void *b)
+{
+	const DexLineRange *x = (const DexLineRange *)a, *y = (const DexLineRange *)b;
+
+	if(x->first_line != y->first_line)
+		return x->first_line < y->first_line ? -1 : 1;
+	return x->method_idx < y->method_idx ? -1 : x->method_idx > y->method_idx;
+}
+
+/*
+ * the line index of class class_idx, built the first time it is asked
+ * for. Like dex_find_class(), not to be called from several threads at
+ * once. Returns NULL when out of memory.
+ */
+const DexLineIndex *dex_line_index(DexContext *ctx, u4 class_idx)
+{
+	DexStatsTimer timer;
+	DexLineIndex *index;
+	LineBuild build;
+
+	if(class_idx >= ctx->header->classDefsSize)
+		return NULL;
+	if(ctx->lines == NULL
+			&& (ctx->lines = (DexLineIndex *)arena_calloc(&ctx->arena, ctx->header->classDefsSize, sizeof(DexLineIndex))) == NULL)
+		goto oom;
+	index = &ctx->lines[class_idx];
+	if(index->built)
+		return index;
+
+	dex_stats_begin(&timer);
+	memset(&build, 0, sizeof(build));
+	build.source_idx = ctx->class_defs[class_idx].source_file_idx;
+	// bad class data keeps the methods read before it.
+	dex_class_methods(ctx, class_idx, add_method_range, &build);
+	if(build.failed){
+		free(build.ranges);
+		dex_stats_end(&timer, DEX_PHASE_LINES);
+		goto oom;
+	}
+	if(build.cnt > 1)
+		qsort(build.ranges, build.cnt, sizeof(DexLineRange), compare_ranges);
+	if(build.cnt != 0){
+		index->ranges = (DexLineRange *)arena_alloc(&ctx->arena, build.cnt * sizeof(DexLineRange));
+		if(index->ranges == NULL){
+			free(build.ranges);
+			dex_stats_end(&timer, DEX_PHASE_LINES);
+			goto oom;
+		}
+		memcpy(index->ranges, build.ranges, build.cnt * sizeof(DexLineRange));
+	}
+	index->cnt = build.cnt;
+	index->built = 1;
+	free(build.ranges);
+	dex_stats_end(&timer, DEX_PHASE_LINES);
+	return index;
+
+oom:
+	fprintf(stderr, "dex_line_index - out of memory.\n");
+	return NULL;
+}
+
+static int probe_line(DexContext *ctx, const DexPosition *pos, void *arg)
+{
+	LineProbe *probe = (LineProbe *)arg;
+
+	if(pos->line == probe->line && same_source(pos, probe->source_idx) && pos->pc < probe->pc)
+		probe->pc = pos->pc;
+	return 0;
+}
+
+/*
+ * append to *hits (*cnt of them, realloc'ed; the caller frees it) every
+ * method of ctx that has line line of source file source, with the pc
+ * the line starts at. Only classes whose source file is source are
+ * looked at, each through its line index.
+ */
+int dex_find_line(DexContext *ctx, const char *source, u4 line, DexLineHit **hits, u4 *cnt)
+{
+	const DexLineIndex *index;
+	const DexLineRange *range, *last;
+	const char *src;
+	DexLineHit *tmp;
+	EncodedMember method;
+	LineProbe probe;
+	u4 i;
+
+	for(i = 0; i < ctx->header->classDefsSize; ++i){
+		src = dex_class_source(ctx, &ctx->class_defs[i]);
+		if(src == NULL || strcmp(src, source) != 0)
+			continue;
+		if((index = dex_line_index(ctx, i)) == NULL)
+			return -1;
+		// sorted by first line: stop at the first range starting after it.
+		for(range = index->ranges, last = range + index->cnt; range < last && range->first_line <= line; ++range){
+			if(range->last_line < line)
+				continue;
+			probe.source_idx = ctx->class_defs[i].source_file_idx;
+			probe.line = line;
+			probe.pc = NO_INDEX;
+			method.idx = range->method_idx;
+			method.access_flags = 0;		// only needed for the locals
+			method.code_off = range->code_off;
+			dex_debug_info(ctx, &method, probe_line, NULL, &probe);
+			if(probe.pc == NO_INDEX)
+				continue;
+			if((tmp = (DexLineHit *)dex_realloc(*hits, (*cnt + 1) * sizeof(DexLineHit))) == NULL){
+				fprintf(stderr, "dex_find_line - out of memory.\n");
+				return -1;
+			}
+			*hits = tmp;
+			tmp[*cnt].ctx = ctx;
+			tmp[*cnt].class_idx = i;
+			tmp[*cnt].method_idx = range->method_idx;
+			tmp[*cnt].pc = probe.pc;
+			++*cnt;
+		}
+	}
+	return 0;
+}
+
+static int format_position(DexContext *ctx, const DexPosition *pos, void *arg)
+{
+	StrBuf *out = (StrBuf *)arg;
+	const char *src;
+
+	if(strbuf_append(out, CODE_INDENT "  ", sizeof(CODE_INDENT) + 1) == -1 || strbuf_puthex(out, pos->pc, 4) == -1
+			|| strbuf_printf(out, " line %u", pos->line) == -1)
+		return -1;
+	if(pos->source_idx != NO_INDEX && (src = dex_string(ctx, pos->source_idx)) != NULL
+			&& strbuf_printf(out, " (%s)", src) == -1)
+		return -1;
+	return strbuf_putc(out, '\n');
+}
+
+static int format_local(DexContext *ctx, const DexLocal *local, void *arg)
+{
+	StrBuf *out = (StrBuf *)arg;
+	const char *str;
+
+	if(strbuf_append(out, CODE_INDENT "  ", sizeof(CODE_INDENT) + 1) == -1 || strbuf_puthex(out, local->start_pc, 4) == -1
+			|| strbuf_putc(out, '-') == -1 || strbuf_puthex(out, local->end_pc, 4) == -1
+			|| strbuf_printf(out, " v%u ", local->reg) == -1)
+		return -1;
+	str = local->name_idx == NO_INDEX ? "this" : dex_string(ctx, local->name_idx);
+	if(strbuf_puts(out, str != NULL ? str : "?") == -1 || strbuf_putc(out, ' ') == -1)
+		return -1;
+	if(local->type_idx != NO_INDEX && dex_format_type(ctx, out, local->type_idx) == -1)
+		return -1;
+	if(local->sig_idx != NO_INDEX && (str = dex_string(ctx, local->sig_idx)) != NULL
+			&& strbuf_printf(out, " (%s)", str) == -1)
+		return -1;
+	return strbuf_putc(out, '\n');
+}
+
+/*
+ * the line table and the locals of method, indented like the code
+ * listing: "positions:" with "pc line N" a line, "locals:" with
+ * "start-end vR name type" a line. Nothing for a method without debug
+ * info.
+ */
+int dex_format_lines(DexContext *ctx, StrBuf *out, const EncodedMember *method)
+{
+	const DexCodeItem *code;
+	size_t mark;
+
+	if(method->code_off == 0)
+		return 0;
+	code = (const DexCodeItem *)dex_image_ptr_aligned(&ctx->image, method->code_off, 4, CODE_HEADER, 1);
+	if(code == NULL || code->debug_info_off == 0)
+		return 0;
+	if(strbuf_puts(out, CODE_INDENT "positions:\n") == -1 || dex_debug_info(ctx, method, format_position, NULL, out) == -1)
+		return -1;
+	mark = out->len;
+	if(strbuf_puts(out, CODE_INDENT "locals:\n") == -1 || dex_debug_info(ctx, method, NULL, format_local, out) == -1)
+		return -1;
+	// no locals, no heading
+	if(out->len == mark + sizeof(CODE_INDENT "locals:\n") - 1)
+		strbuf_truncate(out, mark);
+	return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef __DEXDEBUG_H__
+#define __DEXDEBUG_H__
+
+#include "dexfile.h"
+
+/*
+ * Line tables and local variables of a method, from the debug_info_item
+ * its code_item points to. dex_debug_info() runs the debug_info state
+ * machine for one method when asked and keeps nothing, so a dump without
+ * them never follows debug_info_off. The line index answers which
+ * methods a source line belongs to: per class, built the first time the
+ * class is asked about, one interval [first_line, last_line] per method
+ * with code, sorted by first line; a method whose interval holds the
+ * line is confirmed against its line table, since the interval of an
+ * enclosing method can hold lines it does not have.
+ */
+typedef struct {
+	u4	pc;					/* in code units */
+	u4	line;
+	u4	source_idx;			/* string id from DBG_SET_FILE, NO_INDEX for the class's source file */
+} DexPosition;
+
+typedef struct {
+	u4	reg;
+	u4	start_pc;
+	u4	end_pc;				/* exclusive, insns_size when live to the end */
+	u4	name_idx;			/* string id, NO_INDEX for this (or a local without a name) */
+	u4	type_idx;
+	u4	sig_idx;			/* string id of its generic signature, or NO_INDEX */
+} DexLocal;
+
+typedef struct {
+	u4	first_line;
+	u4	last_line;
+	u4	method_idx;
+	u4	code_off;
+} DexLineRange;
+
+/* the line index of one class */
+struct DexLineIndex {
+	u4				built;
+	u4				cnt;
+	DexLineRange	*ranges;
+};
+
+typedef struct {
+	DexContext	*ctx;
+	u4			class_idx;		/* class_def */
+	u4			method_idx;
+	u4			pc;				/* the first instruction of the line */
+} DexLineHit;
+
+typedef int (*DexPositionFn)(DexContext *ctx, const DexPosition *pos, void *arg);
+typedef int (*DexLocalFn)(DexContext *ctx, const DexLocal *local, void *arg);
+
+extern int dex_debug_info(DexContext *ctx, const EncodedMember *method, DexPositionFn position, DexLocalFn local, void *arg);
+extern const DexLineIndex *dex_line_index(DexContext *ctx, u4 class_idx);
+extern int dex_find_line(DexContext *ctx, const char *source, u4 line, DexLineHit **hits, u4 *cnt);
+extern int dex_format_lines(DexContext *ctx, StrBuf *out, const EncodedMember *method);
+
+/* JSON record (dexjson.c) of a dex_find_line() hit */
+extern int dex_json_line_hit(const DexLineHit *hit, StrBuf *out, const char *prefix);
+
+#endif	/* __DEXDEBUG_H__ */
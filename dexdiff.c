@@ -0,0 +1,988 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dexdiff.h"
+#include "dexstats.h"
+
+#define MEMBER_CHUNK	64
+#define CODE_HEADER		16				// code_item bytes before insns
+#define OFFSETOF(type, member)		(size_t)&(((type *)0)->member)
+#define FNV64_BASIS		14695981039346656037ULL
+#define FNV64_PRIME		1099511628211ULL
+
+static const char *const change_names[DEX_DIFF_CHANGES] = {
+	"added", "removed", "changed",
+};
+
+/* by bit, DEX_DIFF_FLAGS first */
+static const char *const what_names[] = {
+	"flags", "super", "interfaces", "members", "code",
+};
+
+/*
+ * an id, class or member of one side, as it is sorted and joined.
+ */
+typedef struct {
+	DexContext	*ctx;
+	u4			idx;			/* string, type, method, field or class_def */
+	u4			dex;			/* its dex in the container */
+	u4			flags;			/* access flags of a member */
+	u4			code_off;
+} DiffItem;
+
+typedef struct {
+	DiffItem	*items;
+	size_t		cnt;
+	size_t		cap;
+} DiffItems;
+
+typedef struct {
+	DexDiff			*diff;
+	int				table;			/* DEX_DIFF_* being joined */
+	DexDiffClass	*cls;			/* the class whose members are joined */
+	u4				classes_cap;
+	u4				members_cap;
+	DiffItems		old_members;
+	DiffItems		new_members;
+	u2				*code;			/* copy of the insns being hashed */
+	u4				code_cap;
+	int				failed;			/* out of memory */
+} DiffState;
+
+/*
+ * the insns of a code_item with its index operands zeroed, and a hash of
+ * what those named, in pc order.
+ */
+typedef struct {
+	DexContext	*ctx;
+	u2			*insns;
+	u8			hash;
+} CodeHash;
+
+typedef int (*CompareFn)(const void *a, const void *b);
+typedef void (*JoinFn)(DiffState *st, const DiffItem *old_item, const DiffItem *new_item);
+
+static void string_view(DexContext *ctx, u4 idx, StrView *view)
+{
+	if(idx >= ctx->header->stringIdsSize || string_pool_view(&ctx->strings, idx, view) == -1){
+		view->data = "";
+		view->len = 0;
+		view->utf16_len = 0;
+	}
+}
+
+/*
+ * the descriptor of type_idx, empty for NO_INDEX or a type the file
+ * cannot name.
+ */
+static void type_view(DexContext *ctx, u4 type_idx, StrView *view)
+{
+	if(type_idx >= ctx->header->typeIdsSize){
+		view->data = "";
+		view->len = 0;
+		view->utf16_len = 0;
+		return ;
+	}
+	string_view(ctx, ctx->type_ids[type_idx].descriptor_idx, view);
+}
+
+static const TypeListItem *type_list(DexContext *ctx, u4 offset, u4 *size)
+{
+	const u4 *cnt;
+
+	*size = 0;
+	if(offset == 0)
+		return NULL;
+	if((cnt = (const u4 *)dex_image_ptr_aligned(&ctx->image, offset, 4, sizeof(u4), 1)) == NULL)
+		return NULL;
+	*size = *cnt;
+	return (const TypeListItem *)dex_image_ptr(&ctx->image, offset + sizeof(u4), sizeof(TypeListItem), *cnt);
+}
+
+/*
+ * MUTF-8 strings in the utf-16 code unit order of string_ids. Byte order
+ * is that order but for the NUL, encoded as C0 80 and sorting first.
+ */
+static int compare_views(const StrView *a, const StrView *b)
+{
+	const u1 *p = (const u1 *)a->data, *q = (const u1 *)b->data;
+	u4 n = a->len < b->len ? a->len : b->len;
+	u4 i;
+
+	for(i = 0; i < n && p[i] == q[i]; ++i)
+		;
+	if(i == n)
+		return a->len < b->len ? -1 : a->len > b->len;
+	if(p[i] == 0xc0 && i + 1 < a->len && p[i + 1] == 0x80)
+		return -1;
+	if(q[i] == 0xc0 && i + 1 < b->len && q[i + 1] == 0x80)
+		return 1;
+	return p[i] < q[i] ? -1 : 1;
+}
+
+static int compare_string_ids(DexContext *actx, u4 a, DexContext *bctx, u4 b)
+{
+	StrView u, v;
+
+	string_view(actx, a, &u);
+	string_view(bctx, b, &v);
+	return compare_views(&u, &v);
+}
+
+static int compare_types(DexContext *actx, u4 a, DexContext *bctx, u4 b)
+{
+	StrView u, v;
+
+	type_view(actx, a, &u);
+	type_view(bctx, b, &v);
+	return compare_views(&u, &v);
+}
+
+/*
+ * type lists element by element, a shorter one first, as proto_ids are
+ * sorted by their parameters.
+ */
+static int compare_type_lists(DexContext *actx, u4 a, DexContext *bctx, u4 b)
+{
+	const TypeListItem *u, *v;
+	u4 ucnt, vcnt, i;
+	int cmp;
+
+	u = type_list(actx, a, &ucnt);
+	v = type_list(bctx, b, &vcnt);
+	if(u == NULL)
+		ucnt = 0;
+	if(v == NULL)
+		vcnt = 0;
+	for(i = 0; i < ucnt && i < vcnt; ++i){
+		if((cmp = compare_types(actx, u[i].type_idx, bctx, v[i].type_idx)) != 0)
+			return cmp;
+	}
+	return ucnt < vcnt ? -1 : ucnt > vcnt;
+}
+
+/* the return type, then the parameters */
+static int compare_protos(DexContext *actx, u4 a, DexContext *bctx, u4 b)
+{
+	const ProtoIds *u, *v;
+	int cmp;
+
+	if(a >= actx->header->protoIdsSize || b >= bctx->header->protoIdsSize)
+		return (a >= actx->header->protoIdsSize) - (b >= bctx->header->protoIdsSize);
+	u = &actx->proto_ids[a];
+	v = &bctx->proto_ids[b];
+	if((cmp = compare_types(actx, u->return_type_idx, bctx, v->return_type_idx)) != 0)
+		return cmp;
+	return compare_type_lists(actx, u->parameters_off, bctx, v->parameters_off);
+}
+
+static int compare_strings(const void *a, const void *b)
+{
+	const DiffItem *x = (const DiffItem *)a, *y = (const DiffItem *)b;
+
+	return compare_string_ids(x->ctx, x->idx, y->ctx, y->idx);
+}
+
+static int compare_type_ids(const void *a, const void *b)
+{
+	const DiffItem *x = (const DiffItem *)a, *y = (const DiffItem *)b;
+
+	return compare_types(x->ctx, x->idx, y->ctx, y->idx);
+}
+
+/*
+ * methods by class, name and proto, fields by class, name and type: the
+ * order of method_ids and field_ids. Ids out of range sort last.
+ */
+static int compare_methods(const void *a, const void *b)
+{
+	const DiffItem *x = (const DiffItem *)a, *y = (const DiffItem *)b;
+	const MethodIds *u, *v;
+	int xbad = x->idx >= x->ctx->header->methodIdsSize;
+	int ybad = y->idx >= y->ctx->header->methodIdsSize;
+	int cmp;
+
+	if(xbad || ybad)
+		return xbad - ybad;
+	u = &x->ctx->method_ids[x->idx];
+	v = &y->ctx->method_ids[y->idx];
+	if((cmp = compare_types(x->ctx, u->class_idx, y->ctx, v->class_idx)) != 0)
+		return cmp;
+	if((cmp = compare_string_ids(x->ctx, u->name_idx, y->ctx, v->name_idx)) != 0)
+		return cmp;
+	return compare_protos(x->ctx, u->proto_idx, y->ctx, v->proto_idx);
+}
+
+static int compare_fields(const void *a, const void *b)
+{
+	const DiffItem *x = (const DiffItem *)a, *y = (const DiffItem *)b;
+	const FieldIds *u, *v;
+	int xbad = x->idx >= x->ctx->header->fieldIdsSize;
+	int ybad = y->idx >= y->ctx->header->fieldIdsSize;
+	int cmp;
+
+	if(xbad || ybad)
+		return xbad - ybad;
+	u = &x->ctx->field_ids[x->idx];
+	v = &y->ctx->field_ids[y->idx];
+	if((cmp = compare_types(x->ctx, u->class_idx, y->ctx, v->class_idx)) != 0)
+		return cmp;
+	if((cmp = compare_string_ids(x->ctx, u->name_idx, y->ctx, v->name_idx)) != 0)
+		return cmp;
+	return compare_types(x->ctx, u->type_idx, y->ctx, v->type_idx);
+}
+
+static int compare_class_keys(const void *a, const void *b)
+{
+	const DiffItem *x = (const DiffItem *)a, *y = (const DiffItem *)b;
+
+	return compare_types(x->ctx, x->ctx->class_defs[x->idx].class_idx, y->ctx, y->ctx->class_defs[y->idx].class_idx);
+}
+
+/* a class defined in more than one dex: the first dex's one first */
+static int compare_classes(const void *a, const void *b)
+{
+	const DiffItem *x = (const DiffItem *)a, *y = (const DiffItem *)b;
+	int cmp;
+
+	if((cmp = compare_class_keys(a, b)) != 0)
+		return cmp;
+	if(x->dex != y->dex)
+		return x->dex < y->dex ? -1 : 1;
+	return x->idx < y->idx ? -1 : x->idx > y->idx;
+}
+
+/*
+ * sort items, unless they are in order already as the id tables of a
+ * valid dex are: one pass to check.
+ */
+static void sort_items(DiffItem *items, size_t cnt, CompareFn compare)
+{
+	size_t i;
+
+	for(i = 1; i < cnt && compare(&items[i - 1], &items[i]) <= 0; ++i)
+		;
+	if(i < cnt)
+		qsort(items, cnt, sizeof(DiffItem), compare);
+}
+
+/*
+ * merge join of two sorted lists: fn gets each key with the item of
+ * either side holding it, NULL for the side without. Of equal items on
+ * one side only the first is taken.
+ */
+static void join(DiffState *st, const DiffItem *a, size_t na, const DiffItem *b, size_t nb, CompareFn same, JoinFn fn)
+{
+	const DiffItem *x = NULL, *y = NULL;
+	size_t i = 0, j = 0;
+	int cmp;
+
+	while(i < na || j < nb){
+		if(i == na)
+			cmp = 1;
+		else if(j == nb)
+			cmp = -1;
+		else
+			cmp = same(&a[i], &b[j]);
+		if(cmp <= 0){
+			x = &a[i];
+			while(++i < na && same(x, &a[i]) == 0)
+				;
+		}
+		if(cmp >= 0){
+			y = &b[j];
+			while(++j < nb && same(y, &b[j]) == 0)
+				;
+		}
+		fn(st, cmp <= 0 ? x : NULL, cmp >= 0 ? y : NULL);
+	}
+}
+
+static int push_item(DiffItems *items, DexContext *ctx, u4 idx, u4 dex, u4 flags, u4 code_off)
+{
+	DiffItem *tmp;
+	size_t cap;
+
+	if(items->cnt == items->cap){
+		cap = items->cap ? items->cap * 2 : 256;
+		tmp = (DiffItem *)dex_realloc(items->items, cap * sizeof(DiffItem));
+		if(tmp == NULL)
+			return -1;
+		items->items = tmp;
+		items->cap = cap;
+	}
+	items->items[items->cnt].ctx = ctx;
+	items->items[items->cnt].idx = idx;
+	items->items[items->cnt].dex = dex;
+	items->items[items->cnt].flags = flags;
+	items->items[items->cnt].code_off = code_off;
+	++items->cnt;
+	return 0;
+}
+
+static u8 hash_bytes(u8 hash, const void *data, size_t len)
+{
+	const u1 *p = (const u1 *)data;
+	size_t i;
+
+	for(i = 0; i < len; ++i){
+		hash ^= p[i];
+		hash *= FNV64_PRIME;
+	}
+	return hash;
+}
+
+static u8 hash_u4(u8 hash, u4 value)
+{
+	return hash_bytes(hash, &value, sizeof(value));
+}
+
+static u8 hash_string(DexContext *ctx, u4 idx, u8 hash)
+{
+	StrView view;
+
+	string_view(ctx, idx, &view);
+	return hash_u4(hash_bytes(hash, view.data, view.len), view.len);
+}
+
+static u8 hash_type(DexContext *ctx, u4 type_idx, u8 hash)
+{
+	StrView view;
+
+	type_view(ctx, type_idx, &view);
+	return hash_u4(hash_bytes(hash, view.data, view.len), view.len);
+}
+
+static u8 hash_proto(DexContext *ctx, u4 proto_idx, u8 hash)
+{
+	const ProtoIds *proto;
+	const TypeListItem *items;
+	u4 cnt, i;
+
+	if(proto_idx >= ctx->header->protoIdsSize)
+		return hash_u4(hash, proto_idx);
+	proto = &ctx->proto_ids[proto_idx];
+	hash = hash_type(ctx, proto->return_type_idx, hash);
+	if((items = type_list(ctx, proto->parameters_off, &cnt)) == NULL)
+		cnt = 0;
+	for(i = 0; i < cnt; ++i)
+		hash = hash_type(ctx, items[i].type_idx, hash);
+	return hash_u4(hash, cnt);
+}
+
+/*
+ * what id idx of kind names, the same in any file naming the same thing.
+ */
+static u8 hash_target(DexContext *ctx, int kind, u4 idx, u8 hash)
+{
+	const FieldIds *field;
+	const MethodIds *method;
+
+	hash = hash_u4(hash, kind);
+	switch(kind){
+		case DEX_REF_STRING:
+			return hash_string(ctx, idx, hash);
+		case DEX_REF_TYPE:
+			return hash_type(ctx, idx, hash);
+		case DEX_REF_FIELD:
+			if(idx >= ctx->header->fieldIdsSize)
+				break;
+			field = &ctx->field_ids[idx];
+			hash = hash_type(ctx, field->class_idx, hash);
+			hash = hash_string(ctx, field->name_idx, hash);
+			return hash_type(ctx, field->type_idx, hash);
+		case DEX_REF_METHOD:
+			if(idx >= ctx->header->methodIdsSize)
+				break;
+			method = &ctx->method_ids[idx];
+			hash = hash_type(ctx, method->class_idx, hash);
+			hash = hash_string(ctx, method->name_idx, hash);
+			return hash_proto(ctx, method->proto_idx, hash);
+	}
+	return hash_u4(hash, idx);
+}
+
+static void hash_ref(int kind, u4 idx, u4 pc, void *arg)
+{
+	CodeHash *ch = (CodeHash *)arg;
+
+	// the index is the second unit, const-string/jumbo has 32 bits of it.
+	if((ch->insns[pc] & 0xff) == 0x1b)
+		ch->insns[pc + 2] = 0;
+	ch->insns[pc + 1] = 0;
+	ch->hash = hash_target(ch->ctx, kind, idx, hash_u4(ch->hash, pc));
+}
+
+/*
+ * the try blocks and their catch handlers, the exception types by
+ * descriptor.
+ */
+static u8 hash_tries(DiffState *st, DexContext *ctx, u4 code_off, const DexCodeItem *code, u8 hash)
+{
+	const DexTryItem *tries;
+	const u1 *list, *data, *end;
+	size_t tries_off;
+	s4 size;
+	u4 i, n, type_idx, addr;
+	int okay = 1;
+
+	tries_off = (size_t)code_off + CODE_HEADER + (size_t)code->insns_size * 2;
+	if(code->insns_size & 1)
+		tries_off += 2;			// padding to 4 bytes
+	tries = (const DexTryItem *)dex_image_ptr(&ctx->image, tries_off, sizeof(DexTryItem), code->tries_size);
+	list = (const u1 *)dex_image_ptr(&ctx->image, tries_off + sizeof(DexTryItem) * code->tries_size, 1, 1);
+	if(tries == NULL || list == NULL){
+		fprintf(stderr, "hash_tries - try items out of file bounds at %x.\n", code_off);
+		++st->diff->bad;
+		return hash;
+	}
+	end = dex_image_end(&ctx->image);
+
+	for(i = 0; i < code->tries_size && okay; ++i){
+		hash = hash_u4(hash_u4(hash, tries[i].start_addr), tries[i].insn_count);
+		data = list + tries[i].handler_off;
+		size = readAndVerifySignedLeb128(&data, end, &okay);
+		// size <= 0 means a catch-all follows the typed handlers
+		for(n = size < 0 ? -size : size; n > 0 && okay; --n){
+			type_idx = readAndVerifyUnsignedLeb128(&data, end, &okay);
+			addr = okay ? readAndVerifyUnsignedLeb128(&data, end, &okay) : 0;
+			hash = hash_u4(hash_type(ctx, type_idx, hash), addr);
+		}
+		if(size <= 0 && okay)
+			hash = hash_u4(hash, readAndVerifyUnsignedLeb128(&data, end, &okay));
+		hash = hash_u4(hash, size);
+	}
+	if(!okay){
+		fprintf(stderr, "hash_tries - bad catch handler at %x.\n", code_off);
+		++st->diff->bad;
+	}
+	return hash;
+}
+
+/*
+ * the code_item at code_off without its debug info, its index operands
+ * replaced by what they name.
+ */
+static u8 hash_code(DiffState *st, DexContext *ctx, u4 code_off)
+{
+	const DexCodeItem *code;
+	const u2 *insns;
+	CodeHash ch;
+	u2 *tmp;
+	u8 hash = FNV64_BASIS;
+
+	code = (const DexCodeItem *)dex_image_ptr_aligned(&ctx->image, code_off, 4, CODE_HEADER, 1);
+	insns = code == NULL ? NULL : (const u2 *)dex_image_ptr(&ctx->image, (size_t)code_off + CODE_HEADER,
+																sizeof(u2), code->insns_size);
+	if(insns == NULL){
+		fprintf(stderr, "hash_code - code item out of file bounds at %x.\n", code_off);
+		++st->diff->bad;
+		return hash_u4(hash, code_off);
+	}
+	if(code->insns_size > st->code_cap){
+		tmp = (u2 *)dex_realloc(st->code, (size_t)code->insns_size * sizeof(u2));
+		if(tmp == NULL){
+			st->failed = 1;
+			return hash;
+		}
+		st->code = tmp;
+		st->code_cap = code->insns_size;
+	}
+	memcpy(st->code, insns, (size_t)code->insns_size * sizeof(u2));
+
+	ch.ctx = ctx;
+	ch.insns = st->code;
+	ch.hash = FNV64_BASIS;
+	if(dex_code_refs(ctx, code_off, hash_ref, &ch) == -1)
+		++st->diff->bad;
+
+	hash = hash_bytes(hash, code, OFFSETOF(DexCodeItem, debug_info_off));
+	hash = hash_u4(hash, code->insns_size);
+	hash = hash_bytes(hash, st->code, (size_t)code->insns_size * sizeof(u2));
+	hash = hash_bytes(hash, &ch.hash, sizeof(ch.hash));
+	if(code->tries_size != 0)
+		hash = hash_tries(st, ctx, code_off, code, hash);
+	return hash;
+}
+
+static u4 code_units(DiffState *st, DexContext *ctx, u4 code_off)
+{
+	const DexCodeItem *code;
+
+	if(code_off == 0)
+		return 0;
+	if((code = (const DexCodeItem *)dex_image_ptr_aligned(&ctx->image, code_off, 4, CODE_HEADER, 1)) == NULL){
+		fprintf(stderr, "code_units - invalid code offset %x.\n", code_off);
+		++st->diff->bad;
+		return 0;
+	}
+	return code->insns_size;
+}
+
+static int code_differs(DiffState *st, const DiffItem *o, const DiffItem *n, u4 old_units, u4 new_units)
+{
+	if(o->code_off == 0 || n->code_off == 0)
+		return o->code_off != n->code_off;
+	if(old_units != new_units)
+		return 1;
+	return hash_code(st, o->ctx, o->code_off) != hash_code(st, n->ctx, n->code_off);
+}
+
+static void add_member(DiffState *st, const DexDiffMember *member)
+{
+	DexDiff *diff = st->diff;
+	DexDiffMember *tmp;
+	u4 cap;
+
+	if(diff->member_cnt == st->members_cap){
+		cap = st->members_cap ? st->members_cap * 2 : 256;
+		tmp = (DexDiffMember *)dex_realloc(diff->members, cap * sizeof(DexDiffMember));
+		if(tmp == NULL){
+			st->failed = 1;
+			return ;
+		}
+		diff->members = tmp;
+		st->members_cap = cap;
+	}
+	diff->members[diff->member_cnt++] = *member;
+}
+
+static void add_class(DiffState *st, const DexDiffClass *cls)
+{
+	DexDiff *diff = st->diff;
+	DexDiffClass *tmp;
+	u4 cap;
+
+	if(diff->cnt == st->classes_cap){
+		cap = st->classes_cap ? st->classes_cap * 2 : 256;
+		tmp = (DexDiffClass *)dex_realloc(diff->classes, cap * sizeof(DexDiffClass));
+		if(tmp == NULL){
+			st->failed = 1;
+			return ;
+		}
+		diff->classes = tmp;
+		st->classes_cap = cap;
+	}
+	diff->classes[diff->cnt++] = *cls;
+}
+
+/*
+ * join callback: a field or method of the class in st->cls.
+ */
+static void diff_members(DiffState *st, const DiffItem *o, const DiffItem *n)
+{
+	DexDiffMember member;
+
+	member.kind = st->table == DEX_DIFF_METHODS ? DEX_REF_METHOD : DEX_REF_FIELD;
+	member.what = 0;
+	member.old_idx = o != NULL ? o->idx : NO_INDEX;
+	member.new_idx = n != NULL ? n->idx : NO_INDEX;
+	member.old_flags = o != NULL ? o->flags : 0;
+	member.new_flags = n != NULL ? n->flags : 0;
+	member.old_units = o != NULL ? code_units(st, o->ctx, o->code_off) : 0;
+	member.new_units = n != NULL ? code_units(st, n->ctx, n->code_off) : 0;
+	st->cls->old_units += member.old_units;
+	st->cls->new_units += member.new_units;
+
+	if(o != NULL && n != NULL){
+		if(o->flags != n->flags)
+			member.what |= DEX_DIFF_FLAGS;
+		if(member.kind == DEX_REF_METHOD && code_differs(st, o, n, member.old_units, member.new_units))
+			member.what |= DEX_DIFF_CODE;
+		if(member.what == 0)
+			return ;
+		member.change = DEX_DIFF_CHANGED;
+	}else{
+		member.change = o != NULL ? DEX_DIFF_REMOVED : DEX_DIFF_ADDED;
+	}
+	++st->diff->counts[st->table][member.change];
+	add_member(st, &member);
+}
+
+/*
+ * the fields (has_code == 0) or methods of class class_idx into items.
+ */
+static int collect_members(DexContext *ctx, u4 class_idx, int has_code, DiffItems *items)
+{
+	const ClassDefs *class = &ctx->class_defs[class_idx];
+	EncodedMember members[MEMBER_CHUNK];
+	const u1 *data, *end;
+	u4 sizes[4], idx, n, i, j;
+	int okay;
+
+	items->cnt = 0;
+	if(class->class_data_off == 0)
+		return 0;
+	data = (const u1 *)dex_image_ptr(&ctx->image, class->class_data_off, 1, 1);
+	if(data == NULL){
+		fprintf(stderr, "collect_members - invalid class data offset %x.\n", class->class_data_off);
+		return -1;
+	}
+	end = dex_image_end(&ctx->image);
+	for(i = 0; i < 4; ++i){
+		sizes[i] = readAndVerifyUnsignedLeb128(&data, end, &okay);
+		if(!okay){
+			fprintf(stderr, "collect_members - bad class data header at %x.\n", class->class_data_off);
+			return -1;
+		}
+	}
+
+	// the fields are decoded even for the methods, to get past them.
+	for(i = 0; i < (has_code ? 4 : 2); ++i){
+		idx = 0;
+		while(sizes[i] > 0){
+			n = sizes[i] < MEMBER_CHUNK ? sizes[i] : MEMBER_CHUNK;
+			if(readEncodedMembers(&data, end, members, n, &idx, i >= 2) == -1){
+				fprintf(stderr, "collect_members - bad class data at %x.\n", class->class_data_off);
+				return -1;
+			}
+			for(j = 0; (i >= 2) == has_code && j < n; ++j){
+				if(push_item(items, ctx, members[j].idx, 0, members[j].access_flags, members[j].code_off) == -1)
+					return -1;
+			}
+			sizes[i] -= n;
+		}
+	}
+	return 0;
+}
+
+/*
+ * a class on both sides: its flags, supertypes and members.
+ */
+static void diff_class(DiffState *st, DexDiffClass *cls)
+{
+	static const CompareFn compares[] = {compare_fields, compare_methods};
+	const ClassDefs *o = &cls->old_ctx->class_defs[cls->old_class];
+	const ClassDefs *n = &cls->new_ctx->class_defs[cls->new_class];
+	int has_code;
+
+	if(o->access_flags != n->access_flags)
+		cls->what |= DEX_DIFF_FLAGS;
+	if(compare_types(cls->old_ctx, o->superclass_idx, cls->new_ctx, n->superclass_idx) != 0)
+		cls->what |= DEX_DIFF_SUPER;
+	if(compare_type_lists(cls->old_ctx, o->interfaces_off, cls->new_ctx, n->interfaces_off) != 0)
+		cls->what |= DEX_DIFF_INTERFACES;
+
+	st->cls = cls;
+	for(has_code = 0; has_code < 2; ++has_code){
+		st->table = has_code ? DEX_DIFF_METHODS : DEX_DIFF_FIELDS;
+		if(collect_members(cls->old_ctx, cls->old_class, has_code, &st->old_members) == -1
+				|| collect_members(cls->new_ctx, cls->new_class, has_code, &st->new_members) == -1){
+			++st->diff->bad;
+			continue;
+		}
+		sort_items(st->old_members.items, st->old_members.cnt, compares[has_code]);
+		sort_items(st->new_members.items, st->new_members.cnt, compares[has_code]);
+		join(st, st->old_members.items, st->old_members.cnt, st->new_members.items, st->new_members.cnt,
+				compares[has_code], diff_members);
+	}
+	cls->cnt = st->diff->member_cnt - cls->first;
+	if(cls->cnt != 0)
+		cls->what |= DEX_DIFF_MEMBERS;
+}
+
+/*
+ * join callback: a class of either side, kept if it differs.
+ */
+static void diff_classes(DiffState *st, const DiffItem *o, const DiffItem *n)
+{
+	DexDiff *diff = st->diff;
+	DexDiffClass cls;
+	DexClassSummary summary;
+	const DiffItem *item = o != NULL ? o : n;
+
+	memset(&cls, 0, sizeof(cls));
+	cls.old_ctx = o != NULL ? o->ctx : NULL;
+	cls.old_class = o != NULL ? o->idx : NO_INDEX;
+	cls.new_ctx = n != NULL ? n->ctx : NULL;
+	cls.new_class = n != NULL ? n->idx : NO_INDEX;
+	cls.first = diff->member_cnt;
+
+	if(o != NULL && n != NULL){
+		diff_class(st, &cls);
+		diff->old_units += cls.old_units;
+		diff->new_units += cls.new_units;
+		if(cls.what == 0)
+			return ;
+		cls.change = DEX_DIFF_CHANGED;
+	}else{
+		cls.change = o != NULL ? DEX_DIFF_REMOVED : DEX_DIFF_ADDED;
+		if(dex_class_summary(item->ctx, item->idx, &summary) == -1){
+			memset(&summary, 0, sizeof(summary));
+			++diff->bad;
+		}
+		cls.fields = summary.static_fields + summary.instance_fields;
+		cls.methods = summary.direct_methods + summary.virtual_methods;
+		if(o != NULL){
+			cls.old_units = summary.code_units;
+			diff->old_units += summary.code_units;
+		}else{
+			cls.new_units = summary.code_units;
+			diff->new_units += summary.code_units;
+		}
+		diff->counts[DEX_DIFF_FIELDS][cls.change] += cls.fields;
+		diff->counts[DEX_DIFF_METHODS][cls.change] += cls.methods;
+	}
+	++diff->counts[DEX_DIFF_CLASSES][cls.change];
+	add_class(st, &cls);
+}
+
+/*
+ * join callback of the id tables, which are only counted.
+ */
+static void count_ids(DiffState *st, const DiffItem *o, const DiffItem *n)
+{
+	if(o == NULL)
+		++st->diff->counts[st->table][DEX_DIFF_ADDED];
+	else if(n == NULL)
+		++st->diff->counts[st->table][DEX_DIFF_REMOVED];
+}
+
+static u4 table_size(DexContext *ctx, int table)
+{
+	switch(table){
+		case DEX_DIFF_STRINGS:
+			return ctx->header->stringIdsSize;
+		case DEX_DIFF_TYPES:
+			return ctx->header->typeIdsSize;
+		case DEX_DIFF_METHOD_IDS:
+			return ctx->header->methodIdsSize;
+		case DEX_DIFF_CLASSES:
+			return ctx->header->classDefsSize;
+	}
+	return 0;
+}
+
+/*
+ * every entry of table of every dex of dc, sorted.
+ */
+static int collect_table(DexContainer *dc, int table, CompareFn compare, DiffItems *items)
+{
+	u4 i, j, size;
+
+	items->cnt = 0;
+	for(j = 0; j < dc->cnt; ++j){
+		size = table_size(dc->dexes[j], table);
+		for(i = 0; i < size; ++i){
+			if(push_item(items, dc->dexes[j], i, j, 0, 0) == -1)
+				return -1;
+		}
+	}
+	sort_items(items->items, items->cnt, compare);
+	return 0;
+}
+
+static int diff_table(DiffState *st, DexContainer *old_dc, DexContainer *new_dc, int table)
+{
+	static const CompareFn sorts[] = {compare_strings, compare_type_ids, compare_methods, compare_classes};
+	static const CompareFn keys[] = {compare_strings, compare_type_ids, compare_methods, compare_class_keys};
+	DiffItems a, b;
+	int ret = -1;
+
+	memset(&a, 0, sizeof(a));
+	memset(&b, 0, sizeof(b));
+	if(collect_table(old_dc, table, sorts[table], &a) == 0 && collect_table(new_dc, table, sorts[table], &b) == 0){
+		st->table = table;
+		join(st, a.items, a.cnt, b.items, b.cnt, keys[table], table == DEX_DIFF_CLASSES ? diff_classes : count_ids);
+		ret = st->failed ? -1 : 0;
+	}
+	free(a.items);
+	free(b.items);
+	return ret;
+}
+
+/*
+ * what changed from old_dc to new_dc. Returns NULL when out of memory.
+ */
+DexDiff *dex_diff(DexContainer *old_dc, DexContainer *new_dc)
+{
+	DexStatsTimer timer;
+	DiffState st;
+	int table, ret = 0;
+
+	dex_stats_begin(&timer);
+	memset(&st, 0, sizeof(st));
+	if((st.diff = (DexDiff *)dex_calloc(1, sizeof(DexDiff))) == NULL){
+		fprintf(stderr, "dex_diff - out of memory.\n");
+		return NULL;
+	}
+	for(table = DEX_DIFF_STRINGS; table <= DEX_DIFF_CLASSES && ret == 0; ++table)
+		ret = diff_table(&st, old_dc, new_dc, table);
+
+	free(st.old_members.items);
+	free(st.new_members.items);
+	free(st.code);
+	dex_stats_end(&timer, DEX_PHASE_DIFF);
+	if(ret == -1 || st.failed){
+		fprintf(stderr, "dex_diff - out of memory.\n");
+		dex_diff_free(st.diff);
+		return NULL;
+	}
+	return st.diff;
+}
+
+void dex_diff_free(DexDiff *diff)
+{
+	if(diff == NULL)
+		return ;
+	free(diff->classes);
+	free(diff->members);
+	free(diff);
+}
+
+const char *dex_diff_change_name(int change)
+{
+	return change >= 0 && change < DEX_DIFF_CHANGES ? change_names[change] : NULL;
+}
+
+/*
+ * the name of one DEX_DIFF_FLAGS ... bit.
+ */
+const char *dex_diff_what_name(u4 what)
+{
+	u4 i;
+
+	for(i = 0; i < sizeof(what_names) / sizeof(what_names[0]); ++i){
+		if(what == 1U << i)
+			return what_names[i];
+	}
+	return NULL;
+}
+
+/*
+ * ": flags, code" for the bits of what.
+ */
+static int format_what(StrBuf *out, u4 what)
+{
+	u4 i, n = 0;
+
+	for(i = 0; i < sizeof(what_names) / sizeof(what_names[0]); ++i){
+		if((what & (1U << i)) == 0)
+			continue;
+		if(strbuf_puts(out, n++ == 0 ? ": " : ", ") == -1 || strbuf_puts(out, what_names[i]) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * "old -> new" access flags, "none" for none.
+ */
+static int format_flags(StrBuf *out, u4 old_flags, u4 new_flags, int type)
+{
+	u4 flags[2] = {old_flags, new_flags};
+	size_t start;
+	int i;
+
+	for(i = 0; i < 2; ++i){
+		if(i == 1 && strbuf_append(out, " -> ", 4) == -1)
+			return -1;
+		start = out->len;
+		if(dex_format_access_flags(out, flags[i], type) == -1){
+			strbuf_truncate(out, start);
+			if(strbuf_append(out, "0x", 2) == -1 || strbuf_puthex(out, flags[i], 4) == -1)
+				return -1;
+		}else if(out->len == start){
+			if(strbuf_puts(out, "none") == -1)
+				return -1;
+		}else{
+			strbuf_truncate(out, out->len - 1);		// the space after the last name
+		}
+	}
+	return 0;
+}
+
+static int format_member(const DexDiffClass *cls, const DexDiffMember *member, StrBuf *out)
+{
+	static const char marks[] = "+-~";
+	DexContext *ctx = member->new_idx != NO_INDEX ? cls->new_ctx : cls->old_ctx;
+	u4 idx = member->new_idx != NO_INDEX ? member->new_idx : member->old_idx;
+	int ret;
+
+	if(strbuf_append(out, "    ", 4) == -1 || strbuf_putc(out, marks[member->change]) == -1)
+		return -1;
+	if(member->kind == DEX_REF_METHOD)
+		ret = strbuf_puts(out, " method ") == -1 ? -1 : dex_format_method_ref(ctx, out, idx);
+	else
+		ret = strbuf_puts(out, " field ") == -1 ? -1 : dex_format_field_ref(ctx, out, idx);
+	if(ret == -1 || format_what(out, member->what) == -1)
+		return -1;
+	if(member->what & DEX_DIFF_FLAGS){
+		if(strbuf_append(out, " (", 2) == -1
+				|| format_flags(out, member->old_flags, member->new_flags, member->kind == DEX_REF_METHOD ? METHOD : FIELD) == -1
+				|| strbuf_putc(out, ')') == -1)
+			return -1;
+	}
+	if((member->what & DEX_DIFF_CODE) && strbuf_printf(out, " (%u -> %u units)", member->old_units, member->new_units) == -1)
+		return -1;
+	return strbuf_putc(out, '\n');
+}
+
+/*
+ * the interfaces of class, "none" for none.
+ */
+static int format_interfaces(DexContext *ctx, StrBuf *out, const ClassDefs *class)
+{
+	size_t start = out->len;
+
+	if(dex_format_interfaces(ctx, out, class) == -1)
+		return -1;
+	return out->len == start ? strbuf_puts(out, "none") : 0;
+}
+
+/*
+ * classes[i] of diff as text: "+ name" or "- name" with its size, or
+ * "~ name: what" followed by what differs, one line each.
+ */
+int dex_diff_format_class(const DexDiff *diff, StrBuf *out, u4 i)
+{
+	static const char marks[] = "+-~";
+	const DexDiffClass *cls;
+	const ClassDefs *o, *n;
+	DexContext *ctx;
+	u4 class_idx, j;
+
+	if(i >= diff->cnt){
+		fprintf(stderr, "dex_diff_format_class - invalid class %u.\n", i);
+		return -1;
+	}
+	cls = &diff->classes[i];
+	ctx = cls->new_ctx != NULL ? cls->new_ctx : cls->old_ctx;
+	class_idx = cls->new_ctx != NULL ? cls->new_class : cls->old_class;
+	if(strbuf_putc(out, marks[cls->change]) == -1 || strbuf_putc(out, ' ') == -1
+			|| dex_format_type(ctx, out, ctx->class_defs[class_idx].class_idx) == -1)
+		return -1;
+	if(cls->change != DEX_DIFF_CHANGED)
+		return strbuf_printf(out, " (%u fields, %u methods, %u code units)\n", cls->fields, cls->methods,
+								cls->change == DEX_DIFF_ADDED ? cls->new_units : cls->old_units) == -1 ? -1 : 0;
+
+	if(format_what(out, cls->what) == -1
+			|| strbuf_printf(out, " (%u -> %u code units)\n", cls->old_units, cls->new_units) == -1)
+		return -1;
+	o = &cls->old_ctx->class_defs[cls->old_class];
+	n = &cls->new_ctx->class_defs[cls->new_class];
+	if(cls->what & DEX_DIFF_FLAGS){
+		if(strbuf_puts(out, "    flags: ") == -1 || format_flags(out, o->access_flags, n->access_flags, CLASS) == -1
+				|| strbuf_putc(out, '\n') == -1)
+			return -1;
+	}
+	if(cls->what & DEX_DIFF_SUPER){
+		if(strbuf_puts(out, "    super: ") == -1
+				|| (o->superclass_idx == NO_INDEX ? strbuf_puts(out, "none") : dex_format_type(cls->old_ctx, out, o->superclass_idx)) == -1
+				|| strbuf_append(out, " -> ", 4) == -1
+				|| (n->superclass_idx == NO_INDEX ? strbuf_puts(out, "none") : dex_format_type(cls->new_ctx, out, n->superclass_idx)) == -1
+				|| strbuf_putc(out, '\n') == -1)
+			return -1;
+	}
+	if(cls->what & DEX_DIFF_INTERFACES){
+		if(strbuf_puts(out, "    interfaces: ") == -1 || format_interfaces(cls->old_ctx, out, o) == -1
+				|| strbuf_append(out, " -> ", 4) == -1 || format_interfaces(cls->new_ctx, out, n) == -1
+				|| strbuf_putc(out, '\n') == -1)
+			return -1;
+	}
+	for(j = 0; j < cls->cnt; ++j){
+		if(format_member(cls, &diff->members[cls->first + j], out) == -1)
+			return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef __DEXDIFF_H__
+#define __DEXDIFF_H__
+
+#include "dexfile.h"
+
+/*
+ * What changed from one container to another. The string, type and
+ * method_id tables and the class_defs of each side are sorted by their
+ * descriptors (string_ids, type_ids and method_ids of a valid dex are in
+ * that order already, so a single dex only has its order checked) and
+ * merge joined in one pass. Classes on both sides have their fields and
+ * methods joined the same way; a method body is compared by a hash of
+ * its code_item in which every index operand stands for the descriptor
+ * it names, so renumbered tables and debug info do not count as changes.
+ * Only the classes that differ are kept, by descriptor; the members that
+ * differ of class c are members[c.first] up to members[c.first + c.cnt].
+ */
+enum {
+	DEX_DIFF_ADDED,
+	DEX_DIFF_REMOVED,
+	DEX_DIFF_CHANGED,
+	DEX_DIFF_CHANGES,
+};
+
+/* what differs of a changed class or member */
+enum {
+	DEX_DIFF_FLAGS		= 0x01,
+	DEX_DIFF_SUPER		= 0x02,
+	DEX_DIFF_INTERFACES	= 0x04,
+	DEX_DIFF_MEMBERS	= 0x08,		/* a field or method was added, removed or changed */
+	DEX_DIFF_CODE		= 0x10,		/* the method body */
+};
+
+/* the tables counted in DexDiff.counts */
+enum {
+	DEX_DIFF_STRINGS,
+	DEX_DIFF_TYPES,
+	DEX_DIFF_METHOD_IDS,			/* methods defined or referred to */
+	DEX_DIFF_CLASSES,
+	DEX_DIFF_METHODS,				/* of the classes, those of added and removed ones included */
+	DEX_DIFF_FIELDS,
+	DEX_DIFF_TABLES,
+};
+
+typedef struct {
+	int			change;			/* DEX_DIFF_ADDED ... */
+	u4			what;			/* DEX_DIFF_FLAGS ..., of a changed class */
+	DexContext	*old_ctx;		/* NULL for an added class */
+	u4			old_class;		/* class_def in old_ctx */
+	DexContext	*new_ctx;		/* NULL for a removed class */
+	u4			new_class;
+	u4			old_units;		/* insns of all its methods */
+	u4			new_units;
+	u4			fields;			/* of an added or removed class */
+	u4			methods;
+	u4			first;			/* its members that differ */
+	u4			cnt;
+} DexDiffClass;
+
+typedef struct {
+	int			kind;			/* DEX_REF_FIELD or DEX_REF_METHOD */
+	int			change;
+	u4			what;			/* DEX_DIFF_FLAGS, DEX_DIFF_CODE */
+	u4			old_idx;		/* field or method id in the class's old_ctx, or NO_INDEX */
+	u4			new_idx;
+	u4			old_flags;
+	u4			new_flags;
+	u4			old_units;
+	u4			new_units;
+} DexDiffMember;
+
+typedef struct {
+	DexDiffClass	*classes;
+	u4				cnt;
+	DexDiffMember	*members;
+	u4				member_cnt;
+	u4				counts[DEX_DIFF_TABLES][DEX_DIFF_CHANGES];
+	u8				old_units;		/* code units of all classes */
+	u8				new_units;
+	u4				bad;			/* class data or code items that could not be read */
+} DexDiff;
+
+extern DexDiff *dex_diff(DexContainer *old_dc, DexContainer *new_dc);
+extern void dex_diff_free(DexDiff *diff);
+extern int dex_diff_format_class(const DexDiff *diff, StrBuf *out, u4 i);
+extern const char *dex_diff_change_name(int change);
+extern const char *dex_diff_what_name(u4 what);
+
+/* JSON record (dexjson.c) of classes[i] with the members that differ */
+extern int dex_json_diff_class(const DexDiff *diff, StrBuf *out, const char *prefix, u4 i);
+
+#endif	/* __DEXDIFF_H__ */
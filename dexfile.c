@@ -0,0 +1,1117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dexfile.h"
+#include "checksum.h"
+#include "ziparchive.h"
+#include "threadpool.h"
+#include "idxcache.h"
+#include "dexstats.h"
+#include "dexhier.h"
+#include "dexdebug.h"
+
+#define BUFFLEN			1024
+#define MEMBER_CHUNK	64
+
+#define OFFSETOF(type, member)		(size_t)&(((type *)0)->member)
+
+static const AccessFlags afs[] = {
+	{ACC_PUBLIC, CLASS|FIELD|METHOD, "public"},
+	{ACC_PRIVATE, FIELD|METHOD, "private"},
+	{ACC_PROTECTED, FIELD|METHOD, "protected"},
+	{ACC_STATIC, FIELD|METHOD, "static"},
+	{ACC_FINAL, CLASS|FIELD|METHOD, "final"},
+	{ACC_SYNCHRONIZED, METHOD, "synchronized"},
+	{ACC_SUPER, CLASS, "super"},
+	{ACC_VOLATILE, FIELD, "volatile"},
+	{ACC_BRIDGE, METHOD, "bridge"},
+	{ACC_TRANSIENT, FIELD, "transient"},
+	{ACC_VARARGS, METHOD, "varargs"},
+	{ACC_NATIVE, METHOD, "native"},
+	{ACC_INTERFACE, CLASS, "interface"},
+	{ACC_ABSTRACT, CLASS|METHOD, "abstract"},
+	{ACC_STRICT, METHOD, "strict"},
+	{ACC_SYNTHETIC, FIELD|METHOD, "synthetic"},
+	{ACC_ANNOTATION, CLASS, "annotation"},
+	{ACC_ENUM, CLASS|FIELD, "enum"},
+	{ACC_CONSTRUCTOR, METHOD, "constructor"},
+	{ACC_DECLARED_SYNCHRONIZED, METHOD, "declared synchronized"},
+	{0, 0, 0},
+};
+
+/*
+ * compare a computed digest with the signature recorded in the header.
+ * returns 0 if they match.
+ */
+static int check_sha1(const DexHeader *header, const u1 *digest)
+{
+	return memcmp(header->signature, digest, kSHA1DigestLen);
+}
+
+static int check_magic(const DexImage *image)
+{
+	const DexHeader *header;
+
+	header = (const DexHeader *)dex_image_ptr(image, 0, sizeof(DexHeader), 1);
+	if(header == NULL){
+		fprintf(stderr, "check_magic - file too small for a dex header.\n");
+		return -1;
+	}
+
+	if(strncmp((const char *)(header->magic), DEX_MAGIC, sizeof(DEX_MAGIC)) != 0){
+		fprintf(stderr, "check_magic - wrong magic bytes not a dex file\n");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * check the magic, the adler32 checksum and the sha1 signature of an
+ * image. adler32 covers everything after the checksum field, sha1
+ * everything after the signature, so the bytes between the two go to
+ * adler32 alone and the rest is read once for both.
+ * returns 0 if the file looks sane, -1 otherwise.
+ */
+static int verify_image(const DexImage *image)
+{
+	uint32_t adler;
+	const u1 *checked;
+	const u1 *signed_data;
+	const DexHeader *header;
+	u1 digest[kSHA1DigestLen];
+	Sha1Ctx sha;
+
+	if(check_magic(image) == -1)
+		return -1;
+
+	header = (const DexHeader *)image->base;
+	checked = (const u1 *)dex_image_ptr(image, OFFSETOF(DexHeader, signature), 1, 1);
+	signed_data = (const u1 *)dex_image_ptr(image, OFFSETOF(DexHeader, fileSize), 1, 1);
+
+	adler = adler32_update(ADLER32_INIT, checked, signed_data - checked);
+	sha1_init(&sha);
+	adler = adler32_sha1_update(adler, &sha, signed_data, dex_image_end(image) - signed_data);
+	sha1_final(&sha, digest);
+
+	if(header->checksum != adler){
+		fprintf(stderr, "dex_verify_image - adler32 checksum check failure.\n");
+		return -1;
+	}
+
+	if(check_sha1(header, digest) != 0){
+		fprintf(stderr, "dex_verify_image - sha1 signature check failure.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * the adler32 half of verify_image(): what an image whose index matched
+ * still gets, so a file changed in place since the index was written is
+ * not trusted on its header alone.
+ */
+static int check_adler32(const DexImage *image)
+{
+	DexStatsTimer timer;
+	const u1 *checked;
+	uint32_t adler;
+
+	dex_stats_begin(&timer);
+	checked = (const u1 *)dex_image_ptr(image, OFFSETOF(DexHeader, signature), 1, 1);
+	adler = adler32_update(ADLER32_INIT, checked, dex_image_end(image) - checked);
+	dex_stats_end(&timer, DEX_PHASE_VERIFY);
+
+	if(((const DexHeader *)image->base)->checksum != adler){
+		fprintf(stderr, "check_adler32 - adler32 checksum check failure.\n");
+		return -1;
+	}
+	return 0;
+}
+
+int dex_verify_image(const DexImage *image)
+{
+	DexStatsTimer timer;
+	int ret;
+
+	dex_stats_begin(&timer);
+	ret = verify_image(image);
+	dex_stats_end(&timer, DEX_PHASE_VERIFY);
+	return ret;
+}
+
+int dex_context_verify(DexContext *ctx)
+{
+	if(ctx == NULL)
+		return -1;
+	return dex_verify_image(&ctx->image);
+}
+
+/*
+ * point every id table into the image, checking it fits and is 4 byte
+ * aligned as the format requires.
+ */
+static int load_tables(DexContext *ctx)
+{
+	const DexHeader *header = ctx->header;
+	const DexImage *image = &ctx->image;
+
+	ctx->string_ids = (const StringIdItem *)dex_image_ptr_aligned(image, header->stringIdsOff, 4, sizeof(StringIdItem), header->stringIdsSize);
+	ctx->type_ids = (const TypeIdIndex *)dex_image_ptr_aligned(image, header->typeIdsOff, 4, sizeof(TypeIdIndex), header->typeIdsSize);
+	ctx->proto_ids = (const ProtoIds *)dex_image_ptr_aligned(image, header->protoIdsOff, 4, sizeof(ProtoIds), header->protoIdsSize);
+	ctx->field_ids = (const FieldIds *)dex_image_ptr_aligned(image, header->fieldIdsOff, 4, sizeof(FieldIds), header->fieldIdsSize);
+	ctx->method_ids = (const MethodIds *)dex_image_ptr_aligned(image, header->methodIdsOff, 4, sizeof(MethodIds), header->methodIdsSize);
+	ctx->class_defs = (const ClassDefs *)dex_image_ptr_aligned(image, header->classDefsOff, 4, sizeof(ClassDefs), header->classDefsSize);
+
+	if(ctx->string_ids == NULL || ctx->type_ids == NULL || ctx->proto_ids == NULL
+			|| ctx->field_ids == NULL || ctx->method_ids == NULL || ctx->class_defs == NULL){
+		fprintf(stderr, "load_tables - id table misaligned or out of file bounds.\n");
+		return -1;
+	}
+
+	// strings are only decoded when they are asked for.
+	if(string_pool_init(&ctx->strings, &ctx->arena, image, ctx->string_ids, header->stringIdsSize) == -1){
+		fprintf(stderr, "load_tables - string pool init failure.\n");
+		return -1;
+	}
+	if(name_cache_init(&ctx->names, &ctx->arena, header->typeIdsSize, header->protoIdsSize,
+			header->fieldIdsSize, header->methodIdsSize) == -1){
+		fprintf(stderr, "load_tables - name cache init failure.\n");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * a context over image, which it takes over: the caller's DexImage is
+ * cleared and, on failure, closed. With a cache_dir the file's index is
+ * taken from there when one matches (and the file, already verified when
+ * the index was written, only gets its adler32 checked again), or written
+ * there after the file checked out.
+ */
+DexContext *dex_context_open_cached(DexImage *image, int flags, const char *cache_dir)
+{
+	DexStatsTimer timer;
+	DexContext *ctx;
+	int cached = 0;
+
+	ctx = (DexContext *)dex_calloc(1, sizeof(DexContext));
+	if(ctx == NULL){
+		fprintf(stderr, "dex_context_open_cached - calloc failure out of memory.\n");
+		dex_image_close(image);
+		return NULL;
+	}
+	ctx->image = *image;
+	memset(image, 0, sizeof(*image));
+	arena_init(&ctx->arena, ARENA_SHARED);
+
+	if(check_magic(&ctx->image) == -1)
+		goto fail;
+	// offsets the format aligns are only aligned in memory on an aligned base.
+	if(((uintptr_t)ctx->image.base & 3) != 0){
+		fprintf(stderr, "dex_context_open_cached - image not 4 byte aligned in memory.\n");
+		goto fail;
+	}
+	ctx->header = (const DexHeader *)ctx->image.base;
+	// the index is matched against the header, but loaded into the tables.
+	if(cache_dir != NULL){
+		if(load_tables(ctx) == -1)
+			goto fail;
+		dex_stats_begin(&timer);
+		cached = index_cache_load(ctx, cache_dir) == 0;
+		dex_stats_end(&timer, DEX_PHASE_INDEX_CACHE);
+		DEX_STAT_ADD(cached ? DEX_STAT_INDEX_CACHE_HITS : DEX_STAT_INDEX_CACHE_MISSES, 1);
+	}
+	if(!(flags & DEX_OPEN_NO_VERIFY)){
+		if(cached ? check_adler32(&ctx->image) == -1 : dex_verify_image(&ctx->image) == -1)
+			goto fail;
+	}
+	if(cache_dir == NULL && load_tables(ctx) == -1)
+		goto fail;
+	// a bad map only costs the section directory, --map tells what is wrong.
+	dex_map_parse(&ctx->map, &ctx->image, NULL);
+
+	// an index of an unverified file could outlive a corrupt copy of it.
+	if(cache_dir != NULL && !cached && !(flags & DEX_OPEN_NO_VERIFY)){
+		dex_stats_begin(&timer);
+		index_cache_store(ctx, cache_dir);
+		dex_stats_end(&timer, DEX_PHASE_INDEX_CACHE);
+	}
+	return ctx;
+
+fail:
+	dex_context_close(ctx);
+	return NULL;
+}
+
+DexContext *dex_context_open_image(DexImage *image, int flags)
+{
+	return dex_context_open_cached(image, flags, NULL);
+}
+
+DexContext *dex_context_open(const char *file, int flags)
+{
+	DexImage image;
+
+	if(dex_image_open(&image, file) == -1)
+		return NULL;
+	return dex_context_open_image(&image, flags);
+}
+
+void dex_context_close(DexContext *ctx)
+{
+	if(ctx == NULL)
+		return ;
+	class_index_free(&ctx->classes);
+	name_cache_free(&ctx->names);
+	string_pool_free(&ctx->strings);
+	arena_free(&ctx->arena);
+	dex_image_close(&ctx->image);
+	dex_image_close(&ctx->index);
+	free(ctx);
+}
+
+/*
+ * number of a multidex entry: 1 for "classes.dex", N for "classesN.dex"
+ * with N >= 2, 0 for anything else.
+ */
+static u4 multidex_number(const ZipEntry *entry)
+{
+	const char *name = entry->name;
+	u4 len = entry->name_len;
+	u4 i, n = 0;
+
+	if(len < 11 || memcmp(name, "classes", 7) != 0 || memcmp(name + len - 4, ".dex", 4) != 0)
+		return 0;
+	if(len == 11)
+		return 1;
+	if(name[7] == '0')
+		return 0;
+	for(i = 7; i < len - 4; ++i){
+		if(name[i] < '0' || name[i] > '9' || n > 100000)
+			return 0;
+		n = n * 10 + (name[i] - '0');
+	}
+	return n >= 2 ? n : 0;
+}
+
+typedef struct {
+	const ZipEntry	*entry;
+	u4				number;
+	const u1		*stored;		/* the bytes of a stored entry */
+	size_t			arena_off;
+} DexEntry;
+
+typedef struct {
+	DexContainer	*dc;
+	ZipArchive		*zip;
+	DexEntry		*entries;
+	int				flags;
+	const char		*cache_dir;
+} ContainerJob;
+
+static int compare_entries(const void *a, const void *b)
+{
+	u4 x = ((const DexEntry *)a)->number, y = ((const DexEntry *)b)->number;
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * pool job: get entry job's bytes, inflating them when needed, and open a
+ * context over them.
+ */
+static void open_entry(size_t job, int worker, void *arg)
+{
+	ContainerJob *cj = (ContainerJob *)arg;
+	const ZipEntry *entry = cj->entries[job].entry;
+	const u1 *data = cj->entries[job].stored;
+	u1 *out = cj->dc->arena + cj->entries[job].arena_off;
+	DexContext *ctx;
+	DexImage image;
+
+	if(entry->method == ZIP_STORED){
+		if(data == NULL)
+			goto fail;
+		if(((uintptr_t)data & 3) != 0)
+			data = (const u1 *)memcpy(out, data, entry->uncomp_size);
+		dex_image_borrow(&image, data, entry->uncomp_size);
+	}else{
+		if(zip_inflate(cj->zip, entry, out) == -1)
+			goto fail;
+		dex_image_borrow(&image, out, entry->uncomp_size);
+	}
+
+	if((ctx = dex_context_open_cached(&image, cj->flags, cj->cache_dir)) == NULL)
+		goto fail;
+	if((ctx->entry = arena_strndup(&ctx->arena, entry->name, entry->name_len)) == NULL){
+		fprintf(stderr, "open_entry - out of memory.\n");
+		dex_context_close(ctx);
+		goto fail;
+	}
+	cj->dc->dexes[job] = ctx;
+	return ;
+
+fail:
+	fprintf(stderr, "open_entry - bad entry '%.*s'.\n", entry->name_len, entry->name);
+}
+
+/*
+ * the classes*.dex entries of an apk, in multidex order.
+ */
+static int open_archive(DexContainer *dc, int flags, int threads, const char *cache_dir)
+{
+	ZipArchive zip;
+	ContainerJob cj;
+	DexEntry *entries;
+	size_t arena_size = 0;
+	u4 i, cnt = 0, number;
+	int ret = 0;
+
+	if(zip_open(&zip, &dc->archive) == -1)
+		return -1;
+
+	entries = (DexEntry *)dex_calloc(zip.cnt ? zip.cnt : 1, sizeof(DexEntry));
+	if(entries == NULL){
+		fprintf(stderr, "open_archive - calloc failure out of memory.\n");
+		zip_close(&zip);
+		return -1;
+	}
+	for(i = 0; i < zip.cnt; ++i){
+		if((number = multidex_number(&zip.entries[i])) == 0)
+			continue;
+		entries[cnt].entry = &zip.entries[i];
+		entries[cnt].number = number;
+		// a stored dex is read in place when zipalign left it 4 byte aligned,
+		// as its items need; otherwise it is copied like an inflated one.
+		if(zip.entries[i].method == ZIP_STORED){
+			if(zip.entries[i].comp_size != zip.entries[i].uncomp_size
+					|| (entries[cnt].stored = zip_entry_data(&zip, &zip.entries[i])) == NULL
+					|| ((uintptr_t)entries[cnt].stored & 3) == 0){
+				++cnt;
+				continue;
+			}
+		}
+		entries[cnt].arena_off = arena_size;
+		arena_size += ((size_t)zip.entries[i].uncomp_size + 7) & ~(size_t)7;
+		++cnt;
+	}
+	if(cnt == 0){
+		fprintf(stderr, "open_archive - no classes.dex in archive.\n");
+		ret = -1;
+		goto out;
+	}
+	qsort(entries, cnt, sizeof(DexEntry), compare_entries);
+
+	dc->dexes = (DexContext **)dex_calloc(cnt, sizeof(DexContext *));
+	dc->arena = arena_size ? (u1 *)dex_malloc(arena_size) : NULL;
+	if(dc->dexes == NULL || (arena_size && dc->arena == NULL)){
+		fprintf(stderr, "open_archive - out of memory.\n");
+		ret = -1;
+		goto out;
+	}
+	dc->cnt = cnt;
+
+	cj.dc = dc;
+	cj.zip = &zip;
+	cj.entries = entries;
+	cj.flags = flags;
+	cj.cache_dir = cache_dir;
+	pool_run(threads, cnt, open_entry, &cj);
+
+	for(i = 0; i < cnt; ++i){
+		if(dc->dexes[i] == NULL)
+			ret = -1;
+	}
+
+out:
+	free(entries);
+	zip_close(&zip);
+	return ret;
+}
+
+static DexContainer *open_container(const char *file, int flags, int threads, const char *cache_dir)
+{
+	DexContainer *dc;
+
+	dc = (DexContainer *)dex_calloc(1, sizeof(DexContainer));
+	if(dc == NULL){
+		fprintf(stderr, "open_container - calloc failure out of memory.\n");
+		return NULL;
+	}
+
+	if(dex_image_open(&dc->archive, file) == -1){
+		free(dc);
+		return NULL;
+	}
+
+	if(zip_is_archive(&dc->archive)){
+		if(open_archive(dc, flags, threads, cache_dir) == -1)
+			goto fail;
+		return dc;
+	}
+
+	// a plain dex file, the context takes the image over.
+	dc->dexes = (DexContext **)dex_calloc(1, sizeof(DexContext *));
+	if(dc->dexes == NULL){
+		fprintf(stderr, "open_container - calloc failure out of memory.\n");
+		goto fail;
+	}
+	if((dc->dexes[0] = dex_context_open_cached(&dc->archive, flags, cache_dir)) == NULL)
+		goto fail;
+	dc->cnt = 1;
+	return dc;
+
+fail:
+	dex_container_close(dc);
+	return NULL;
+}
+
+DexContainer *dex_container_open_cached(const char *file, int flags, int threads, const char *cache_dir)
+{
+	DexStatsTimer timer;
+	DexContainer *dc;
+
+	dex_stats_begin(&timer);
+	dc = open_container(file, flags, threads, cache_dir);
+	dex_stats_end(&timer, DEX_PHASE_OPEN);
+	return dc;
+}
+
+DexContainer *dex_container_open(const char *file, int flags, int threads)
+{
+	return dex_container_open_cached(file, flags, threads, NULL);
+}
+
+void dex_container_close(DexContainer *dc)
+{
+	u4 i;
+
+	if(dc == NULL)
+		return ;
+	dex_hierarchy_free(dc->hierarchy);
+	if(dc->dexes != NULL){
+		for(i = 0; i < dc->cnt; ++i)
+			dex_context_close(dc->dexes[i]);
+		free(dc->dexes);
+	}
+	free(dc->arena);
+	dex_image_close(&dc->archive);
+	free(dc);
+}
+
+/*
+ * look a class up in every dex of the container, the first one defining
+ * it wins like it does for the runtime's class loader. returns the
+ * class_def index in *ctx, or -1.
+ */
+int dex_container_find_class(DexContainer *dc, const char *name, DexContext **ctx)
+{
+	u4 i;
+	int idx;
+
+	for(i = 0; i < dc->cnt; ++i){
+		if((idx = dex_find_class(dc->dexes[i], name)) != -1){
+			*ctx = dc->dexes[i];
+			return idx;
+		}
+	}
+	return -1;
+}
+
+const char *dex_string(DexContext *ctx, u4 idx)
+{
+	return string_pool_get(&ctx->strings, idx);
+}
+
+/*
+ * class_def index of a class given by java name or descriptor, -1 if the
+ * class is not defined in this file.
+ */
+int dex_find_class(DexContext *ctx, const char *name)
+{
+	char descriptor[BUFFLEN];
+	DexStatsTimer timer;
+	int len, ret;
+
+	if(ctx->classes.slots == NULL){
+		dex_stats_begin(&timer);
+		ret = class_index_build(&ctx->classes, &ctx->arena, &ctx->strings, ctx->type_ids, ctx->header->typeIdsSize,
+								ctx->class_defs, ctx->header->classDefsSize);
+		dex_stats_end(&timer, DEX_PHASE_CLASS_INDEX);
+		if(ret == -1){
+			fprintf(stderr, "dex_find_class - build class index failure.\n");
+			return -1;
+		}
+	}
+
+	len = class_name_to_descriptor(name, descriptor, sizeof(descriptor));
+	if(len == -1)
+		return -1;
+	return class_index_find(&ctx->classes, descriptor, len);
+}
+
+const DexSection *dex_section(DexContext *ctx, u2 type)
+{
+	return dex_map_find(&ctx->map, type);
+}
+
+/*
+ * ask for a whole section to be paged in before walking it.
+ */
+void dex_prefetch_section(DexContext *ctx, u2 type)
+{
+	const DexSection *section = dex_map_find(&ctx->map, type);
+
+	if(section != NULL)
+		dex_image_prefetch(&ctx->image, section->off, section->len);
+}
+
+static const char *trans_dex_type_name(char sht)
+{
+	switch(sht){
+		case 'V':
+			return "void";
+			break;
+		case 'Z':
+			return "boolean";
+			break;
+		case 'B':
+			return "byte";
+			break;
+		case 'S':
+			return "short";
+			break;
+		case 'C':
+			return "char";
+			break;
+		case 'I':
+			return "int";
+			break;
+		case 'J':
+			return "long";		// 64bits
+			break;
+		case 'F':
+			return "float";
+			break;
+		case 'D':
+			return "double";	// 64bits
+			break;
+		default:
+			// array
+			// objects
+			// bad characters
+			return NULL;
+			break;
+	}
+}
+
+static int process_type(DexContext *ctx, StrBuf *out, u4 idx)
+{
+	// idx is string ids index which contains type strings.
+	const char *type;
+	const char *desc;
+	char *dst;
+	size_t n;
+	int str_idx = 0;
+	int array_depth = 0;
+
+	if((desc = dex_string(ctx, idx)) == NULL){
+		fprintf(stderr, "process_type - invalid type string index %u.\n", idx);
+		return -1;
+	}
+
+	if(desc[str_idx] == '['){
+		// array
+		do{
+			++array_depth;
+		}while(desc[++str_idx] == '[');
+	}
+
+	if(desc[str_idx] == 'L'){
+		// objects, drop the 'L' and ';' and change '/' to '.'
+		++str_idx;
+		for(n = 0; desc[str_idx + n] != '\0' && desc[str_idx + n] != ';'; ++n)
+			;
+		if(strbuf_reserve(out, n + 2 * array_depth) == -1)
+			return -1;
+		dst = out->data + out->len;
+		for(; n > 0; --n, ++str_idx)
+			*dst++ = desc[str_idx] == '/' ? '.' : desc[str_idx];
+		out->len = dst - out->data;
+	}else{
+		if((type = trans_dex_type_name(desc[str_idx])) == NULL){
+			fprintf(stderr, "process_type - bad type character '%c'.\n", desc[str_idx]);
+			return -1;
+		}
+		if(strbuf_reserve(out, strlen(type) + 2 * array_depth) == -1)
+			return -1;
+		n = strlen(type);
+		memcpy(out->data + out->len, type, n);
+		out->len += n;
+	}
+
+	for(; array_depth > 0; --array_depth){
+		out->data[out->len++] = '[';
+		out->data[out->len++] = ']';
+	}
+	out->data[out->len] = '\0';
+
+	return 0;
+}
+
+/*
+ * a type is rendered from its descriptor once, then copied from the cache.
+ */
+int dex_format_type(DexContext *ctx, StrBuf *out, u4 type_idx)
+{
+	const char *name;
+	size_t mark = out->len;
+	u4 len;
+
+	if(type_idx >= ctx->header->typeIdsSize){
+		fprintf(stderr, "dex_format_type - invalid type index %u.\n", type_idx);
+		return -1;
+	}
+	if((name = name_cache_get(&ctx->names, NAME_TYPE, type_idx, &len)) != NULL)
+		return strbuf_append(out, name, len);
+
+	if(process_type(ctx, out, ctx->type_ids[type_idx].descriptor_idx) == -1)
+		return -1;
+	name_cache_put(&ctx->names, NAME_TYPE, type_idx, out->data + mark, out->len - mark);
+	return 0;
+}
+
+/*
+ * the type_list at offset, formatted as "type, type, ...".
+ */
+static int _get_type_list(DexContext *ctx, StrBuf *out, u4 offset)
+{
+	u4 i;
+	const u4 *size;
+	const TypeListItem *items;
+
+	if((size = (const u4 *)dex_image_ptr_aligned(&ctx->image, offset, 4, sizeof(u4), 1)) == NULL){
+		fprintf(stderr, "_get_type_list - get type item size failure.\n");
+		return -1;
+	}
+
+	if(*size == 0)
+		return 0;
+
+	items = (const TypeListItem *)dex_image_ptr(&ctx->image, offset+sizeof(u4), sizeof(TypeListItem), *size);
+	if(items == NULL){
+		fprintf(stderr, "_get_type_list - get data type list failure.\n");
+		return -1;
+	}
+
+	for(i = 0; i < *size; ++i){
+		if(dex_format_type(ctx, out, items[i].type_idx) == -1)
+			return -1;
+		if(i != *size - 1 && strbuf_append(out, ", ", 2) == -1)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * the parameters of proto_idx as "type, type, ...", from the cache once
+ * the first method with that proto has been formatted.
+ */
+static int format_parameters(DexContext *ctx, StrBuf *out, u4 proto_idx)
+{
+	const ProtoIds *proto = &ctx->proto_ids[proto_idx];
+	const char *name;
+	size_t mark = out->len;
+	u4 len;
+
+	if((name = name_cache_get(&ctx->names, NAME_PROTO, proto_idx, &len)) != NULL)
+		return strbuf_append(out, name, len);
+
+	// if parameters_off equal to 0, means no parameter.
+	if(proto->parameters_off != 0 && _get_type_list(ctx, out, proto->parameters_off) == -1)
+		return -1;
+	name_cache_put(&ctx->names, NAME_PROTO, proto_idx, out->data + mark, out->len - mark);
+	return 0;
+}
+
+int dex_format_access_flags(StrBuf *out, u4 flags, int type)
+{
+	int i;
+
+	for(i = 0; (afs[i].value != 0) && (flags != 0); ++i){
+		if((flags & afs[i].value) != 0){
+			if((type & afs[i].field) != 0){
+				if(strbuf_puts(out, afs[i].name) == -1 || strbuf_putc(out, ' ') == -1)
+					return -1;
+			}else{
+				continue;
+			}
+			flags &= ~afs[i].value;
+		}
+	}
+
+	if(flags != 0){
+		fprintf(stderr, "dex_format_access_flags - invalid access flag value.\n");
+		return -1;
+	}
+	return 0;
+}
+
+int dex_format_field(DexContext *ctx, StrBuf *out, u4 field_idx)
+{
+	const FieldIds *field;
+	const char *name;
+
+	if(field_idx >= ctx->header->fieldIdsSize){
+		fprintf(stderr, "dex_format_field - invalid field index %u.\n", field_idx);
+		return -1;
+	}
+	field = &ctx->field_ids[field_idx];
+
+	if((name = dex_string(ctx, field->name_idx)) == NULL){
+		fprintf(stderr, "dex_format_field - invalid index for field's name.\n");
+		return -1;
+	}
+	// field type
+	if(dex_format_type(ctx, out, field->type_idx) == -1)
+		return -1;
+	// field name
+	if(strbuf_putc(out, ' ') == -1 || strbuf_puts(out, name) == -1)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * "return_type[class->] name(para, para)\n"
+ */
+int dex_format_method(DexContext *ctx, StrBuf *out, u4 method_idx, int has_class_name)
+{
+	const MethodIds *method;
+	const ProtoIds *proto;
+	const char *name;
+
+	if(method_idx >= ctx->header->methodIdsSize){
+		fprintf(stderr, "dex_format_method - invalid method index %u.\n", method_idx);
+		return -1;
+	}
+	method = &ctx->method_ids[method_idx];
+
+	if(method->proto_idx >= ctx->header->protoIdsSize){
+		fprintf(stderr, "dex_format_method - invalid method proto index '%d'.\n", method->proto_idx);
+		return -1;
+	}
+	proto = &ctx->proto_ids[method->proto_idx];
+
+	// process method return type
+	if(dex_format_type(ctx, out, proto->return_type_idx) == -1)
+		return -1;
+
+	if(has_class_name){
+		if(dex_format_type(ctx, out, method->class_idx) == -1 || strbuf_append(out, "->", 2) == -1)
+			return -1;
+	}
+
+	// process method name
+	if((name = dex_string(ctx, method->name_idx)) == NULL){
+		fprintf(stderr, "dex_format_method - invalid method name index '%d'.\n", method->name_idx);
+		return -1;
+	}
+	if(strbuf_putc(out, ' ') == -1 || strbuf_puts(out, name) == -1 || strbuf_putc(out, '(') == -1)
+		return -1;
+
+	// process method parameters
+	if(format_parameters(ctx, out, method->proto_idx) == -1){
+		fprintf(stderr, "dex_format_method - get type list failure.\n");
+		return -1;
+	}
+
+	return strbuf_append(out, ")\n", 2);
+}
+
+/*
+ * "class.name:type", the way instructions refer to a field.
+ */
+int dex_format_field_ref(DexContext *ctx, StrBuf *out, u4 field_idx)
+{
+	const FieldIds *field;
+	const char *name;
+	size_t mark = out->len;
+	u4 len;
+
+	if((name = name_cache_get(&ctx->names, NAME_FIELD, field_idx, &len)) != NULL)
+		return strbuf_append(out, name, len);
+	if(field_idx >= ctx->header->fieldIdsSize){
+		fprintf(stderr, "dex_format_field_ref - invalid field index %u.\n", field_idx);
+		return -1;
+	}
+	field = &ctx->field_ids[field_idx];
+	if((name = dex_string(ctx, field->name_idx)) == NULL){
+		fprintf(stderr, "dex_format_field_ref - invalid index for field's name.\n");
+		return -1;
+	}
+
+	if(dex_format_type(ctx, out, field->class_idx) == -1 || strbuf_putc(out, '.') == -1
+			|| strbuf_puts(out, name) == -1 || strbuf_putc(out, ':') == -1
+			|| dex_format_type(ctx, out, field->type_idx) == -1)
+		return -1;
+	name_cache_put(&ctx->names, NAME_FIELD, field_idx, out->data + mark, out->len - mark);
+	return 0;
+}
+
+/*
+ * "class.name(para, para)return_type", the way instructions refer to a
+ * method. Like field references, rendered once and then copied from the
+ * name cache.
+ */
+int dex_format_method_ref(DexContext *ctx, StrBuf *out, u4 method_idx)
+{
+	const MethodIds *method;
+	const ProtoIds *proto;
+	const char *name;
+	size_t mark = out->len;
+	u4 len;
+
+	if((name = name_cache_get(&ctx->names, NAME_METHOD, method_idx, &len)) != NULL)
+		return strbuf_append(out, name, len);
+	if(method_idx >= ctx->header->methodIdsSize){
+		fprintf(stderr, "dex_format_method_ref - invalid method index %u.\n", method_idx);
+		return -1;
+	}
+	method = &ctx->method_ids[method_idx];
+	if(method->proto_idx >= ctx->header->protoIdsSize){
+		fprintf(stderr, "dex_format_method_ref - invalid method proto index '%d'.\n", method->proto_idx);
+		return -1;
+	}
+	proto = &ctx->proto_ids[method->proto_idx];
+	if((name = dex_string(ctx, method->name_idx)) == NULL){
+		fprintf(stderr, "dex_format_method_ref - invalid method name index '%d'.\n", method->name_idx);
+		return -1;
+	}
+
+	if(dex_format_type(ctx, out, method->class_idx) == -1 || strbuf_putc(out, '.') == -1
+			|| strbuf_puts(out, name) == -1 || strbuf_putc(out, '(') == -1)
+		return -1;
+	if(format_parameters(ctx, out, method->proto_idx) == -1 || strbuf_putc(out, ')') == -1
+			|| dex_format_type(ctx, out, proto->return_type_idx) == -1)
+		return -1;
+	name_cache_put(&ctx->names, NAME_METHOD, method_idx, out->data + mark, out->len - mark);
+	return 0;
+}
+
+int dex_format_interfaces(DexContext *ctx, StrBuf *out, const ClassDefs *class)
+{
+	if(class->interfaces_off == 0){
+		// no interface
+		return 0;
+	}
+	return _get_type_list(ctx, out, class->interfaces_off);
+}
+
+const char *dex_class_source(DexContext *ctx, const ClassDefs *class)
+{
+	if(class->source_file_idx == NO_INDEX){
+		return NULL;
+	}
+	return dex_string(ctx, class->source_file_idx);
+}
+
+/*
+ * the member lists of a class_data_item, in file order.
+ */
+enum {
+	STATIC_FIELDS, INSTANCE_FIELDS, DIRECT_METHODS, VIRTUAL_METHODS, MEMBER_LISTS,
+};
+
+/*
+ * one member for walk_class_data(): list is its member list, pos its
+ * position in there.
+ */
+typedef int (*ClassMemberFn)(DexContext *ctx, int list, u4 pos, const EncodedMember *member, void *arg);
+
+/*
+ * decode the class_data of class and call fn for every field and method
+ * in it, in file order. Returns -1 on bad class data or as soon as fn does.
+ */
+static int walk_class_data(DexContext *ctx, const ClassDefs *class, ClassMemberFn fn, void *arg)
+{
+	EncodedMember members[MEMBER_CHUNK];
+	const u1 *data, *end;
+	u4 sizes[MEMBER_LISTS], idx, pos, n, j;
+	int okay;
+	int i;
+
+	if(class->class_data_off == 0){
+		// no class data, maybe a marker interface
+		return 0;
+	}
+	data = (const u1 *)dex_image_ptr(&ctx->image, class->class_data_off, 1, 1);
+	if(data == NULL){
+		fprintf(stderr, "walk_class_data - invalid class data offset %x.\n", class->class_data_off);
+		return -1;
+	}
+	end = dex_image_end(&ctx->image);
+	for(i = 0; i < MEMBER_LISTS; ++i){
+		sizes[i] = readAndVerifyUnsignedLeb128(&data, end, &okay);
+		if(!okay){
+			fprintf(stderr, "walk_class_data - bad class data header at %x.\n", class->class_data_off);
+			return -1;
+		}
+	}
+
+	for(i = 0; i < MEMBER_LISTS; ++i){
+		idx = 0;
+		for(pos = 0; pos < sizes[i]; pos += n){
+			n = sizes[i] - pos < MEMBER_CHUNK ? sizes[i] - pos : MEMBER_CHUNK;
+			if(readEncodedMembers(&data, end, members, n, &idx, i >= DIRECT_METHODS) == -1){
+				fprintf(stderr, "walk_class_data - bad encoded %s list at %x.\n", i >= DIRECT_METHODS ? "method" : "field",
+						class->class_data_off);
+				return -1;
+			}
+			for(j = 0; j < n; ++j){
+				if(fn(ctx, i, pos + j, &members[j], arg) == -1)
+					return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+static int process_encode_field(DexContext *ctx, StrBuf *out, const EncodedMember *member)
+{
+	if(dex_format_access_flags(out, member->access_flags, FIELD) == -1)
+		return -1;
+	if(dex_format_field(ctx, out, member->idx) == -1)
+		return -1;
+	return strbuf_append(out, ";\n", 2);
+}
+
+static int process_encode_method(DexContext *ctx, StrBuf *out, const EncodedMember *member, int flags)
+{
+	if(dex_format_access_flags(out, member->access_flags, METHOD) == -1)
+		return -1;
+	if(dex_format_method(ctx, out, member->idx, 0) == -1)
+		return -1;
+	if((flags & DEX_FORMAT_CODE) && member->code_off != 0 && dex_format_code(ctx, out, member->code_off) == -1)
+		return -1;
+	if(flags & DEX_FORMAT_LINES)
+		return dex_format_lines(ctx, out, member);
+	return 0;
+}
+
+typedef struct {
+	StrBuf	*out;
+	int		flags;
+} MemberFormat;
+
+/*
+ * a member of dex_format_class_data(), after its list's title if it is
+ * the first one.
+ */
+static int process_encoded_member(DexContext *ctx, int list, u4 pos, const EncodedMember *member, void *arg)
+{
+	static const char *const titles[MEMBER_LISTS] = {
+		"  Static Field:\n", "  Instance Field:\n", "  Direct Method:\n", "  Virtual Method:\n",
+	};
+	MemberFormat *format = (MemberFormat *)arg;
+
+	if(pos == 0 && strbuf_puts(format->out, titles[list]) == -1)
+		return -1;
+	if(strbuf_append(format->out, "    ", 4) == -1)
+		return -1;
+	if(list >= DIRECT_METHODS)
+		return process_encode_method(ctx, format->out, member, format->flags);
+	return process_encode_field(ctx, format->out, member);
+}
+
+int dex_format_class_data(DexContext *ctx, StrBuf *out, const ClassDefs *class, int flags)
+{
+	MemberFormat format;
+
+	format.out = out;
+	format.flags = flags;
+	return walk_class_data(ctx, class, process_encoded_member, &format);
+}
+
+/*
+ * a member for dex_class_summary(): counted in its list, methods add up
+ * their code items.
+ */
+static int count_member(DexContext *ctx, int list, u4 pos, const EncodedMember *member, void *arg)
+{
+	DexClassSummary *summary = (DexClassSummary *)arg;
+	const DexCodeItem *code;
+
+	switch(list){
+		case STATIC_FIELDS:
+			++summary->static_fields;
+			return 0;
+		case INSTANCE_FIELDS:
+			++summary->instance_fields;
+			return 0;
+		case DIRECT_METHODS:
+			++summary->direct_methods;
+			break;
+		default:
+			++summary->virtual_methods;
+			break;
+	}
+	if(member->code_off == 0)
+		return 0;
+	code = (const DexCodeItem *)dex_image_ptr_aligned(&ctx->image, member->code_off, 4, OFFSETOF(DexCodeItem, insns), 1);
+	if(code == NULL){
+		fprintf(stderr, "count_member - invalid code offset %x.\n", member->code_off);
+		return -1;
+	}
+	summary->code_units += code->insns_size;
+	return 0;
+}
+
+/*
+ * member counts and code size of class class_idx, from the index cache
+ * when there is one, else worked out from its class_data and code items.
+ */
+int dex_class_summary(DexContext *ctx, u4 class_idx, DexClassSummary *summary)
+{
+	if(class_idx >= ctx->header->classDefsSize)
+		return -1;
+	if(ctx->summaries != NULL){
+		*summary = ctx->summaries[class_idx];
+		return 0;
+	}
+
+	memset(summary, 0, sizeof(*summary));
+	return walk_class_data(ctx, &ctx->class_defs[class_idx], count_member, summary);
+}
+
+typedef struct {
+	u4			class_idx;
+	DexMethodFn	fn;
+	void		*arg;
+} MethodWalk;
+
+static int call_method(DexContext *ctx, int list, u4 pos, const EncodedMember *member, void *arg)
+{
+	MethodWalk *walk = (MethodWalk *)arg;
+
+	if(list < DIRECT_METHODS)
+		return 0;
+	return walk->fn(ctx, walk->class_idx, member, walk->arg);
+}
+
+/*
+ * call fn for the direct, then the virtual methods of class class_idx.
+ * Returns -1 on bad class data or as soon as fn does.
+ */
+int dex_class_methods(DexContext *ctx, u4 class_idx, DexMethodFn fn, void *arg)
+{
+	MethodWalk walk;
+
+	if(class_idx >= ctx->header->classDefsSize)
+		return -1;
+	walk.class_idx = class_idx;
+	walk.fn = fn;
+	walk.arg = arg;
+	return walk_class_data(ctx, &ctx->class_defs[class_idx], call_method, &walk);
+}
@@ -0,0 +1,151 @@
+#ifndef __DEXFILE_H__
+#define __DEXFILE_H__
+
+#include <stddef.h>
+#include "dex.h"
+#include "deximage.h"
+#include "strpool.h"
+#include "classidx.h"
+#include "dexmap.h"
+#include "namecache.h"
+#include "strbuf.h"
+#include "arena.h"
+
+/*
+ * libreadex public interface.
+ *
+ * A DexContext owns everything parsed out of one dex file: the image,
+ * the id tables (pointers into the image), the section directory from
+ * the map_list, the string pool, the rendered type and proto names and
+ * the class index, all allocated from its arena and released in one go
+ * by dex_context_close(). There is no global state, so any number of
+ * contexts can be open at the same time. dex_string() and the formatters
+ * may also be called from several threads on one context;
+ * dex_find_class() builds its index on first use, so call it once before
+ * sharing the context. Per call scratch (dex_format_code()'s switch
+ * table, JSON code listings) comes from arenas on the stack. The
+ * formatters append to a caller supplied StrBuf and return 0, or -1 on
+ * bad data, in which case part of the text may already be appended.
+ */
+
+#define DEX_MAGIC		"dex\n035"
+#define NO_INDEX		0xFFFFFFFF
+
+enum {
+	DEX_OPEN_NO_VERIFY	= 0x1,		/* skip the adler32 and sha1 checks */
+};
+
+enum {
+	DEX_FORMAT_CODE		= 0x1,		/* dex_format_class_data(): disassemble method bodies */
+	DEX_FORMAT_ANNOTATIONS	= 0x2,	/* dex_json_class(): annotations and static values, see dexanno.h */
+	DEX_FORMAT_LINES	= 0x4,		/* line tables and locals of every method, see dexdebug.h */
+};
+
+/*
+ * the id tables an instruction can index, see dex_code_refs().
+ */
+enum {
+	DEX_REF_STRING,
+	DEX_REF_TYPE,
+	DEX_REF_FIELD,
+	DEX_REF_METHOD,
+	DEX_REF_KINDS,
+};
+
+/*
+ * what a class holds, from its class_data and code items.
+ */
+typedef struct {
+	u4	static_fields;
+	u4	instance_fields;
+	u4	direct_methods;
+	u4	virtual_methods;
+	u4	code_units;			/* insns of all its methods */
+} DexClassSummary;
+
+typedef struct DexXref DexXref;
+typedef struct DexHierarchy DexHierarchy;
+typedef struct DexAnnoIndex DexAnnoIndex;
+typedef struct DexLineIndex DexLineIndex;
+
+typedef struct {
+	DexImage			image;
+	Arena				arena;			/* the tables and strings below */
+	const DexHeader		*header;
+	const StringIdItem	*string_ids;
+	const TypeIdIndex	*type_ids;
+	const ProtoIds		*proto_ids;
+	const FieldIds		*field_ids;
+	const MethodIds		*method_ids;
+	const ClassDefs		*class_defs;
+	StringPool			strings;
+	NameCache			names;			/* type and proto names, rendered once */
+	ClassIndex			classes;		/* built by the first dex_find_class() */
+	DexMap				map;			/* sections, valid only if the map_list checks out */
+	char				*entry;			/* archive entry name, NULL for a plain dex file */
+	DexImage			index;			/* mapped index cache file, if one was loaded */
+	const DexClassSummary	*summaries;	/* per class, from the index cache, or NULL */
+	DexXref				*xref;			/* built by dex_xref_build(), or NULL */
+	DexAnnoIndex		*annotations;	/* built by dex_anno_index_build(), or NULL */
+	DexLineIndex		*lines;			/* per class_def, see dex_line_index(), or NULL */
+} DexContext;
+
+typedef void (*DexRefFn)(int kind, u4 idx, u4 pc, void *arg);
+typedef int (*DexMethodFn)(DexContext *ctx, u4 class_idx, const EncodedMember *method, void *arg);
+
+/*
+ * All dex files of one input as one multidex view: a plain dex file is a
+ * container of one, an apk holds classes.dex, classes2.dex, ... in that
+ * order. Stored entries are used in place from the apk mapping, deflated
+ * ones are inflated into one arena, on up to threads threads.
+ */
+typedef struct {
+	DexImage			archive;		/* the apk, unused for a plain dex file */
+	u1					*arena;			/* inflated entries, back to back */
+	DexContext			**dexes;
+	u4					cnt;
+	DexHierarchy		*hierarchy;		/* built by dex_container_hierarchy(), or NULL */
+} DexContainer;
+
+extern DexContext *dex_context_open(const char *file, int flags);
+extern DexContext *dex_context_open_image(DexImage *image, int flags);
+extern DexContext *dex_context_open_cached(DexImage *image, int flags, const char *cache_dir);
+extern void dex_context_close(DexContext *ctx);
+extern int dex_context_verify(DexContext *ctx);
+extern int dex_verify_image(const DexImage *image);
+
+extern DexContainer *dex_container_open(const char *file, int flags, int threads);
+extern DexContainer *dex_container_open_cached(const char *file, int flags, int threads, const char *cache_dir);
+extern void dex_container_close(DexContainer *dc);
+extern int dex_container_find_class(DexContainer *dc, const char *name, DexContext **ctx);
+
+extern const char *dex_string(DexContext *ctx, u4 idx);
+extern int dex_find_class(DexContext *ctx, const char *name);
+extern const DexSection *dex_section(DexContext *ctx, u2 type);
+extern void dex_prefetch_section(DexContext *ctx, u2 type);
+
+extern int dex_format_type(DexContext *ctx, StrBuf *out, u4 type_idx);
+extern int dex_format_access_flags(StrBuf *out, u4 flags, int type);
+extern int dex_format_field(DexContext *ctx, StrBuf *out, u4 field_idx);
+extern int dex_format_method(DexContext *ctx, StrBuf *out, u4 method_idx, int has_class_name);
+extern int dex_format_field_ref(DexContext *ctx, StrBuf *out, u4 field_idx);
+extern int dex_format_method_ref(DexContext *ctx, StrBuf *out, u4 method_idx);
+extern int dex_format_interfaces(DexContext *ctx, StrBuf *out, const ClassDefs *class);
+extern int dex_format_class_data(DexContext *ctx, StrBuf *out, const ClassDefs *class, int flags);
+extern int dex_format_code(DexContext *ctx, StrBuf *out, u4 code_off);
+extern const char *dex_class_source(DexContext *ctx, const ClassDefs *class);
+extern int dex_class_summary(DexContext *ctx, u4 class_idx, DexClassSummary *summary);
+extern int dex_class_methods(DexContext *ctx, u4 class_idx, DexMethodFn fn, void *arg);
+extern int dex_code_refs(DexContext *ctx, u4 code_off, DexRefFn fn, void *arg);
+
+/*
+ * JSON records (dexjson.c): each appends one object, {"kind":..., then
+ * the members in prefix when not NULL, then the record's own fields.
+ */
+extern int dex_json_header(DexContext *ctx, StrBuf *out, const char *prefix);
+extern int dex_json_string(DexContext *ctx, StrBuf *out, const char *prefix, u4 idx);
+extern int dex_json_method(DexContext *ctx, StrBuf *out, const char *prefix, u4 method_idx);
+extern int dex_json_class(DexContext *ctx, StrBuf *out, const char *prefix, u4 class_idx, int flags);
+extern int dex_json_map(DexContext *ctx, StrBuf *out, const char *prefix);
+
+#endif	/* __DEXFILE_H__ */
@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dexgrep.h"
+#include "dexstats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS	1
+#include <immintrin.h>
+#endif
+
+/*
+ * a string_data_item by where it is in the file.
+ */
+typedef struct {
+	u4	off;
+	u4	idx;
+} GrepString;
+
+typedef struct {
+	u4		*ids;
+	u4		cnt;
+	u4		cap;
+	int		failed;			/* out of memory */
+} GrepHits;
+
+/*
+ * memchr for the first byte, then compare the rest.
+ */
+static const u1 *find_scalar(const u1 *hay, size_t len, const u1 *needle, size_t n)
+{
+	const u1 *end = hay + len;
+	const u1 *p;
+
+	if(n == 0)
+		return hay;
+	for(p = hay; (size_t)(end - p) >= n; ++p){
+		if((p = (const u1 *)memchr(p, needle[0], end - p - n + 1)) == NULL)
+			return NULL;
+		if(memcmp(p + 1, needle + 1, n - 1) == 0)
+			return p;
+	}
+	return NULL;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+/*
+ * 16 candidate positions per step: those whose first byte matches the
+ * needle's first byte and whose byte n - 1 further on matches its last
+ * byte are compared in full. Two bytes far apart rule out most positions
+ * even when the first byte is common.
+ */
+__attribute__((target("sse2")))
+static const u1 *find_sse2(const u1 *hay, size_t len, const u1 *needle, size_t n)
+{
+	const __m128i first = _mm_set1_epi8((char)needle[0]);
+	const __m128i last = _mm_set1_epi8((char)needle[n ? n - 1 : 0]);
+	size_t i;
+	u4 mask;
+
+	if(n == 0 || len < n)
+		return n == 0 ? hay : NULL;
+	for(i = 0; i + n - 1 + 16 <= len; i += 16){
+		__m128i a = _mm_loadu_si128((const __m128i *)(hay + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(hay + i + n - 1));
+		mask = (u4)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+		for(; mask != 0; mask &= mask - 1){
+			if(memcmp(hay + i + __builtin_ctz(mask), needle, n) == 0)
+				return hay + i + __builtin_ctz(mask);
+		}
+	}
+	return find_scalar(hay + i, len - i, needle, n);
+}
+
+/*
+ * same filter over 32 positions per step.
+ */
+__attribute__((target("avx2")))
+static const u1 *find_avx2(const u1 *hay, size_t len, const u1 *needle, size_t n)
+{
+	const __m256i first = _mm256_set1_epi8((char)needle[0]);
+	const __m256i last = _mm256_set1_epi8((char)needle[n ? n - 1 : 0]);
+	size_t i;
+	u4 mask;
+
+	if(n == 0 || len < n)
+		return n == 0 ? hay : NULL;
+	for(i = 0; i + n - 1 + 32 <= len; i += 32){
+		__m256i a = _mm256_loadu_si256((const __m256i *)(hay + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(hay + i + n - 1));
+		mask = (u4)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+		for(; mask != 0; mask &= mask - 1){
+			if(memcmp(hay + i + __builtin_ctz(mask), needle, n) == 0)
+				return hay + i + __builtin_ctz(mask);
+		}
+	}
+	return find_sse2(hay + i, len - i, needle, n);
+}
+
+#endif	/* HAVE_X86_KERNELS */
+
+static DexFindImpl impls[4];
+static pthread_once_t impls_once = PTHREAD_ONCE_INIT;
+
+static void find_probe(void)
+{
+	int n = 0;
+
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")){
+		impls[n].name = "avx2";
+		impls[n++].find = find_avx2;
+	}
+	if(__builtin_cpu_supports("sse2")){
+		impls[n].name = "sse2";
+		impls[n++].find = find_sse2;
+	}
+#endif
+	impls[n].name = "scalar";
+	impls[n++].find = find_scalar;
+	impls[n].name = NULL;
+}
+
+/*
+ * the kernels this cpu can run, probed once however many threads ask.
+ */
+const DexFindImpl *dex_find_impls(void)
+{
+	pthread_once(&impls_once, find_probe);
+	return impls;
+}
+
+/*
+ * pat from text: a leading '^' anchors it at the start of a string, a
+ * trailing '$' at the end; with regex it is a POSIX extended regular
+ * expression. Returns -1 for a regular expression that does not compile.
+ */
+int dex_grep_compile(DexGrepPattern *pat, const char *text, int regex)
+{
+	static const int modes[] = {DEX_GREP_SUBSTRING, DEX_GREP_PREFIX, DEX_GREP_SUFFIX, DEX_GREP_EXACT};
+	char error[256];
+	size_t len = strlen(text);
+	int anchored = 0, ret;
+
+	memset(pat, 0, sizeof(*pat));
+	pat->text = text;
+	if(regex){
+		if((ret = regcomp(&pat->regex, text, REG_EXTENDED | REG_NOSUB)) != 0){
+			regerror(ret, &pat->regex, error, sizeof(error));
+			fprintf(stderr, "dex_grep_compile - bad regular expression '%s': %s.\n", text, error);
+			return -1;
+		}
+		pat->mode = DEX_GREP_REGEX;
+		return 0;
+	}
+	if(text[0] == '^'){
+		anchored |= 1;
+		++text;
+		--len;
+	}
+	if(len > 0 && text[len - 1] == '$'){
+		anchored |= 2;
+		--len;
+	}
+	pat->mode = modes[anchored];
+	pat->needle = text;
+	pat->len = len;
+	return 0;
+}
+
+void dex_grep_free(DexGrepPattern *pat)
+{
+	if(pat->mode == DEX_GREP_REGEX)
+		regfree(&pat->regex);
+	memset(pat, 0, sizeof(*pat));
+}
+
+static void add_hit(GrepHits *hits, u4 idx)
+{
+	u4 *tmp;
+	u4 cap;
+
+	if(hits->cnt == hits->cap){
+		cap = hits->cap ? hits->cap * 2 : 64;
+		if((tmp = (u4 *)dex_realloc(hits->ids, cap * sizeof(u4))) == NULL){
+			hits->failed = 1;
+			return ;
+		}
+		hits->ids = tmp;
+		hits->cap = cap;
+	}
+	hits->ids[hits->cnt++] = idx;
+}
+
+static int compare_offsets(const void *a, const void *b)
+{
+	const GrepString *x = (const GrepString *)a, *y = (const GrepString *)b;
+
+	return x->off < y->off ? -1 : x->off > y->off;
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+	u4 x = *(const u4 *)a, y = *(const u4 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * whether a hit of len bytes at hit lies in view where pat's anchors allow.
+ */
+static int hit_fits(const DexGrepPattern *pat, const StrView *view, const char *hit)
+{
+	const char *end = view->data + view->len;
+
+	if(hit < view->data || hit + pat->len > end)
+		return 0;
+	if((pat->mode == DEX_GREP_PREFIX || pat->mode == DEX_GREP_EXACT) && hit != view->data)
+		return 0;
+	if((pat->mode == DEX_GREP_SUFFIX || pat->mode == DEX_GREP_EXACT) && hit + pat->len != end)
+		return 0;
+	return 1;
+}
+
+/*
+ * find pat's literal in the string data from the first string to the end
+ * of the last, in file order. A hit belongs to the string starting last
+ * before it, if it is inside that string's bytes; after a match the rest
+ * of the string is skipped.
+ */
+static int scan_literal(DexContext *ctx, const DexGrepPattern *pat, DexFindFunc find, GrepHits *hits)
+{
+	const u1 *base = ctx->image.base;
+	const u1 *p, *end, *hit;
+	GrepString *strings;
+	StrView view;
+	u4 cnt = ctx->header->stringIdsSize;
+	u4 i, lo, hi, mid, off;
+	int sorted = 1;
+
+	if(cnt == 0)
+		return 0;
+	strings = (GrepString *)dex_malloc(cnt * sizeof(GrepString));
+	if(strings == NULL){
+		fprintf(stderr, "scan_literal - malloc failure out of memory.\n");
+		return -1;
+	}
+	for(i = 0; i < cnt; ++i){
+		strings[i].off = ctx->string_ids[i].string_data_off;
+		strings[i].idx = i;
+		if(i > 0 && strings[i].off < strings[i - 1].off)
+			sorted = 0;
+	}
+	// writers lay string data out in id order, so this is rarely needed.
+	if(!sorted)
+		qsort(strings, cnt, sizeof(GrepString), compare_offsets);
+
+	end = dex_image_end(&ctx->image);
+	p = strings[0].off < (size_t)(end - base) ? base + strings[0].off : end;
+	for(i = cnt; i > 0; --i){
+		if(string_pool_view(&ctx->strings, strings[i - 1].idx, &view) == 0){
+			end = (const u1 *)view.data + view.len;
+			break;
+		}
+	}
+
+	while(p < end && (hit = find(p, end - p, (const u1 *)pat->needle, pat->len)) != NULL){
+		// the last string starting at or before the hit
+		off = hit - base;
+		for(lo = 0, hi = cnt; hi - lo > 1; ){
+			mid = lo + (hi - lo) / 2;
+			if(strings[mid].off <= off)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		p = hit + 1;
+		if(strings[lo].off > off || string_pool_view(&ctx->strings, strings[lo].idx, &view) == -1)
+			continue;
+		if(hit_fits(pat, &view, (const char *)hit)){
+			add_hit(hits, strings[lo].idx);
+			p = (const u1 *)view.data + view.len;
+		}else if(hit < (const u1 *)view.data || hit >= (const u1 *)view.data + view.len){
+			// in a leb128 length or between strings
+			continue;
+		}else if(view.len < pat->len || pat->mode == DEX_GREP_PREFIX){
+			p = (const u1 *)view.data + view.len;
+		}else if((pat->mode == DEX_GREP_SUFFIX || pat->mode == DEX_GREP_EXACT)
+					&& (const u1 *)view.data + view.len - pat->len > hit){
+			// only the end of the string can match
+			p = (const u1 *)view.data + view.len - pat->len;
+		}
+	}
+	free(strings);
+
+	if(!sorted && hits->cnt > 1)
+		qsort(hits->ids, hits->cnt, sizeof(u4), compare_ids);
+	return 0;
+}
+
+/*
+ * string idx against the ASCII prefix: -1, 0 or 1 as the string sorts
+ * before, starts with or sorts after it, in the utf-16 code unit order of
+ * string_ids; 2 for a string that cannot be read.
+ */
+static int compare_prefix(DexContext *ctx, u4 idx, const char *prefix, size_t len)
+{
+	StrView view;
+	const u1 *data;
+	size_t i;
+
+	if(string_pool_view(&ctx->strings, idx, &view) == -1)
+		return 2;
+	data = (const u1 *)view.data;
+	for(i = 0; i < len; ++i){
+		if(i == view.len)
+			return -1;
+		if(data[i] == (u1)prefix[i])
+			continue;
+		// a lead byte starts a code unit above ASCII, but for the NUL (C0 80).
+		if(data[i] < 0x80)
+			return data[i] < (u1)prefix[i] ? -1 : 1;
+		return data[i] == 0xc0 && i + 1 < view.len && data[i + 1] == 0x80 ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+ * the strings starting with pat's ASCII literal are one run of ids, found
+ * by binary search. Returns -1 if a string on the way cannot be read.
+ */
+static int search_prefix(DexContext *ctx, const DexGrepPattern *pat, GrepHits *hits)
+{
+	StrView view;
+	u4 lo = 0, hi = ctx->header->stringIdsSize, mid, first;
+	int cmp;
+
+	// first string not sorting before the prefix
+	while(lo < hi){
+		mid = lo + (hi - lo) / 2;
+		if((cmp = compare_prefix(ctx, mid, pat->needle, pat->len)) == 2)
+			return -1;
+		if(cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	first = lo;
+	// a string equal to the literal sorts first among those starting with it.
+	if(pat->mode == DEX_GREP_EXACT){
+		if(first < ctx->header->stringIdsSize && compare_prefix(ctx, first, pat->needle, pat->len) == 0
+				&& string_pool_view(&ctx->strings, first, &view) == 0 && view.len == pat->len)
+			add_hit(hits, first);
+		return 0;
+	}
+	hi = ctx->header->stringIdsSize;
+	while(lo < hi){
+		mid = lo + (hi - lo) / 2;
+		if((cmp = compare_prefix(ctx, mid, pat->needle, pat->len)) == 2)
+			return -1;
+		if(cmp <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for(mid = first; mid < lo; ++mid)
+		add_hit(hits, mid);
+	return 0;
+}
+
+static int is_ascii(const char *str, size_t len)
+{
+	size_t i;
+
+	for(i = 0; i < len; ++i){
+		if((u1)str[i] >= 0x80)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * every string when the literal is empty, or every string the regular
+ * expression matches.
+ */
+static void scan_each(DexContext *ctx, const DexGrepPattern *pat, GrepHits *hits)
+{
+	StrView view;
+	u4 i;
+
+	for(i = 0; i < ctx->header->stringIdsSize; ++i){
+		if(string_pool_view(&ctx->strings, i, &view) == -1)
+			continue;
+		// string data is NUL terminated in the image
+		if(pat->mode == DEX_GREP_REGEX ? regexec(&pat->regex, view.data, 0, NULL, 0) == 0
+				: (pat->mode != DEX_GREP_EXACT || view.len == 0))
+			add_hit(hits, i);
+	}
+}
+
+/*
+ * ids of the strings of ctx pat matches, ascending, in a malloc'ed array
+ * of *cnt. Returns NULL on no match or when out of memory.
+ */
+u4 *dex_grep(DexContext *ctx, const DexGrepPattern *pat, u4 *cnt)
+{
+	DexStatsTimer timer;
+	GrepHits hits = {NULL, 0, 0, 0};
+	int ret = 0;
+
+	dex_stats_begin(&timer);
+	dex_prefetch_section(ctx, kDexTypeStringDataItem);
+	if(pat->mode == DEX_GREP_REGEX || pat->len == 0){
+		scan_each(ctx, pat, &hits);
+	}else if(pat->mode == DEX_GREP_SUBSTRING || pat->mode == DEX_GREP_SUFFIX || !is_ascii(pat->needle, pat->len)
+			|| search_prefix(ctx, pat, &hits) == -1){
+		// a string the binary search could not read may hide others.
+		hits.cnt = 0;
+		ret = scan_literal(ctx, pat, dex_find_impls()[0].find, &hits);
+	}
+	dex_stats_end(&timer, DEX_PHASE_GREP);
+
+	if(ret == -1 || hits.failed){
+		if(hits.failed)
+			fprintf(stderr, "dex_grep - out of memory.\n");
+		free(hits.ids);
+		*cnt = 0;
+		return NULL;
+	}
+	*cnt = hits.cnt;
+	return hits.ids;
+}
@@ -0,0 +1,47 @@
+#ifndef __DEXGREP_H__
+#define __DEXGREP_H__
+
+#include <regex.h>
+#include "dexfile.h"
+
+/*
+ * String pool search over the raw MUTF-8 string_data, nothing decoded or
+ * escaped. A literal is found by scanning the string data in file order
+ * with a vector first/last byte filter, each hit mapped back to the string
+ * holding it; a prefix or whole string made of ASCII is looked up by
+ * binary search, string_ids being sorted by contents. A regular
+ * expression (POSIX extended) is tried on every string in turn.
+ */
+enum {
+	DEX_GREP_SUBSTRING,			/* "text" */
+	DEX_GREP_PREFIX,			/* "^text" */
+	DEX_GREP_SUFFIX,			/* "text$" */
+	DEX_GREP_EXACT,				/* "^text$" */
+	DEX_GREP_REGEX,
+};
+
+typedef struct {
+	int			mode;			/* DEX_GREP_* */
+	const char	*text;			/* as given */
+	const char	*needle;		/* the literal, without its anchors */
+	size_t		len;
+	regex_t		regex;			/* DEX_GREP_REGEX only */
+} DexGrepPattern;
+
+/*
+ * the first n byte needle in the len bytes at hay, or NULL. The kernels
+ * this cpu can run are listed best first; dex_grep() uses the first.
+ */
+typedef const u1 *(*DexFindFunc)(const u1 *hay, size_t len, const u1 *needle, size_t n);
+
+typedef struct {
+	const char	*name;
+	DexFindFunc	find;
+} DexFindImpl;
+
+extern int dex_grep_compile(DexGrepPattern *pat, const char *text, int regex);
+extern void dex_grep_free(DexGrepPattern *pat);
+extern u4 *dex_grep(DexContext *ctx, const DexGrepPattern *pat, u4 *cnt);
+extern const DexFindImpl *dex_find_impls(void);
+
+#endif	/* __DEXGREP_H__ */
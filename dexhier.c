@@ -0,0 +1,382 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dexhier.h"
+#include "dexstats.h"
+
+#define HIER_NAME_LEN	1024
+
+/*
+ * a direct supertype edge, before it is sorted into the adjacency arrays.
+ */
+typedef struct {
+	u4	child;
+	u4	parent;
+} HierEdge;
+
+typedef struct {
+	HierEdge	*edges;
+	size_t		cnt;
+	size_t		cap;
+} HierEdges;
+
+/* FNV-1a, like the class index. */
+static u4 hash_descriptor(const char *str, size_t len)
+{
+	u4 hash = 2166136261U;
+	size_t i;
+
+	for(i = 0; i < len; ++i){
+		hash ^= (u1)str[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static u4 find_slot(const DexHierarchy *hier, const char *desc, size_t len)
+{
+	const DexHierNode *node;
+	u4 slot;
+
+	for(slot = hash_descriptor(desc, len) & hier->mask; hier->slots[slot] != 0; slot = (slot + 1) & hier->mask){
+		node = &hier->nodes[hier->slots[slot] - 1];
+		if(node->desc_len == len && memcmp(node->desc, desc, len) == 0)
+			break;
+	}
+	return slot;
+}
+
+/*
+ * the node of type_idx of ctx, added if it is new. Returns NO_INDEX for a
+ * type the file cannot name.
+ */
+static u4 intern_type(DexHierarchy *hier, DexContext *ctx, u4 type_idx)
+{
+	DexHierNode *node;
+	StrView view;
+	u4 slot;
+
+	if(type_idx >= ctx->header->typeIdsSize
+			|| string_pool_view(&ctx->strings, ctx->type_ids[type_idx].descriptor_idx, &view) == -1)
+		return NO_INDEX;
+	slot = find_slot(hier, view.data, view.len);
+	if(hier->slots[slot] != 0)
+		return hier->slots[slot] - 1;
+
+	node = &hier->nodes[hier->cnt];
+	node->ctx = ctx;
+	node->type_idx = type_idx;
+	node->class_idx = NO_INDEX;
+	node->super = NO_INDEX;
+	node->access_flags = 0;
+	node->desc = view.data;
+	node->desc_len = view.len;
+	hier->slots[slot] = ++hier->cnt;
+	return hier->cnt - 1;
+}
+
+static const TypeListItem *type_list(DexContext *ctx, u4 offset, u4 *size)
+{
+	const u4 *cnt;
+
+	*size = 0;
+	if(offset == 0)
+		return NULL;
+	if((cnt = (const u4 *)dex_image_ptr_aligned(&ctx->image, offset, 4, sizeof(u4), 1)) == NULL)
+		return NULL;
+	*size = *cnt;
+	return (const TypeListItem *)dex_image_ptr(&ctx->image, offset + sizeof(u4), sizeof(TypeListItem), *cnt);
+}
+
+static int add_edge(HierEdges *edges, u4 child, u4 parent)
+{
+	HierEdge *tmp;
+	size_t cap;
+
+	if(edges->cnt == edges->cap){
+		cap = edges->cap ? edges->cap * 2 : 1024;
+		tmp = (HierEdge *)dex_realloc(edges->edges, cap * sizeof(HierEdge));
+		if(tmp == NULL)
+			return -1;
+		edges->edges = tmp;
+		edges->cap = cap;
+	}
+	edges->edges[edges->cnt].child = child;
+	edges->edges[edges->cnt].parent = parent;
+	++edges->cnt;
+	return 0;
+}
+
+/*
+ * class class_idx of ctx as a node with its supertype edges, unless an
+ * earlier dex defined it already.
+ */
+static int add_class(DexHierarchy *hier, HierEdges *edges, DexContext *ctx, u4 class_idx)
+{
+	const ClassDefs *class = &ctx->class_defs[class_idx];
+	const TypeListItem *items;
+	DexHierNode *node;
+	u4 n, parent, size, i;
+
+	if((n = intern_type(hier, ctx, class->class_idx)) == NO_INDEX){
+		++hier->bad;
+		return 0;
+	}
+	node = &hier->nodes[n];
+	if(node->class_idx != NO_INDEX){
+		++hier->duplicates;
+		return 0;
+	}
+	// a type another class named first is now defined here.
+	node->ctx = ctx;
+	node->type_idx = class->class_idx;
+	node->class_idx = class_idx;
+	node->access_flags = class->access_flags;
+	++hier->defined;
+
+	if(class->superclass_idx != NO_INDEX){
+		if((parent = intern_type(hier, ctx, class->superclass_idx)) == NO_INDEX)
+			++hier->bad;
+		else if(add_edge(edges, n, parent) == -1)
+			return -1;
+		else
+			hier->nodes[n].super = parent;
+	}
+	items = type_list(ctx, class->interfaces_off, &size);
+	if(items == NULL && class->interfaces_off != 0){
+		++hier->bad;
+		return 0;
+	}
+	for(i = 0; i < size; ++i){
+		if((parent = intern_type(hier, ctx, items[i].type_idx)) == NO_INDEX)
+			++hier->bad;
+		else if(add_edge(edges, n, parent) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * counting sort of the edges into rows of child (up) or of parent (down).
+ * The sort is stable, so a class's superclass stays ahead of its interfaces.
+ */
+static int build_rows(DexHierarchy *hier, const HierEdges *edges, int up, u4 **offsets_out, u4 **rows_out)
+{
+	const HierEdge *edge, *end = edges->edges + edges->cnt;
+	u4 *offsets, *rows;
+	u4 i, from, to;
+
+	offsets = (u4 *)arena_calloc(&hier->arena, (size_t)hier->cnt + 1, sizeof(u4));
+	rows = (u4 *)arena_alloc(&hier->arena, (edges->cnt ? edges->cnt : 1) * sizeof(u4));
+	if(offsets == NULL || rows == NULL)
+		return -1;
+	for(edge = edges->edges; edge < end; ++edge)
+		++offsets[(up ? edge->child : edge->parent) + 1];
+	for(i = 0; i < hier->cnt; ++i)
+		offsets[i + 1] += offsets[i];
+	// offsets[n] walks up to the start of row n + 1, then they shift back.
+	for(edge = edges->edges; edge < end; ++edge){
+		from = up ? edge->child : edge->parent;
+		to = up ? edge->parent : edge->child;
+		rows[offsets[from]++] = to;
+	}
+	for(i = hier->cnt; i > 0; --i)
+		offsets[i] = offsets[i - 1];
+	offsets[0] = 0;
+
+	*offsets_out = offsets;
+	*rows_out = rows;
+	return 0;
+}
+
+/*
+ * Kahn's algorithm: a node is placed once all its supertypes are.
+ */
+static int build_order(DexHierarchy *hier)
+{
+	u4 *pending;
+	u4 n, i, head, tail = 0;
+
+	hier->order = (u4 *)arena_alloc(&hier->arena, (hier->cnt ? hier->cnt : 1) * sizeof(u4));
+	pending = (u4 *)dex_malloc((hier->cnt ? hier->cnt : 1) * sizeof(u4));
+	if(hier->order == NULL || pending == NULL){
+		free(pending);
+		return -1;
+	}
+	for(n = 0; n < hier->cnt; ++n){
+		pending[n] = hier->up_offsets[n + 1] - hier->up_offsets[n];
+		if(pending[n] == 0)
+			hier->order[tail++] = n;
+	}
+	for(head = 0; head < tail; ++head){
+		n = hier->order[head];
+		for(i = hier->down_offsets[n]; i < hier->down_offsets[n + 1]; ++i){
+			if(--pending[hier->down[i]] == 0)
+				hier->order[tail++] = hier->down[i];
+		}
+	}
+	hier->ordered = tail;
+	free(pending);
+	return 0;
+}
+
+/*
+ * the hierarchy of the classes of cnt dex files, earlier ones taking
+ * precedence. Returns NULL when out of memory.
+ */
+DexHierarchy *dex_hierarchy_build(DexContext **dexes, u4 cnt)
+{
+	DexStatsTimer timer;
+	DexHierarchy *hier;
+	HierEdges edges = {NULL, 0, 0};
+	DexContext *ctx;
+	size_t max = 0;
+	u4 cap = 16;
+	u4 i, j, size;
+	int ret = 0;
+
+	dex_stats_begin(&timer);
+	hier = (DexHierarchy *)dex_calloc(1, sizeof(DexHierarchy));
+	if(hier == NULL){
+		fprintf(stderr, "dex_hierarchy_build - calloc failure out of memory.\n");
+		return NULL;
+	}
+	arena_init(&hier->arena, 0);
+
+	// every class and every type it names could be a node of its own.
+	for(i = 0; i < cnt; ++i){
+		ctx = dexes[i];
+		for(j = 0; j < ctx->header->classDefsSize; ++j){
+			if(type_list(ctx, ctx->class_defs[j].interfaces_off, &size) == NULL)
+				size = 0;
+			max += 2 + (size_t)size;
+		}
+	}
+	if(max > NO_INDEX / 4){
+		fprintf(stderr, "dex_hierarchy_build - too many classes.\n");
+		goto fail;
+	}
+	while(cap < max * 2)
+		cap <<= 1;
+	hier->mask = cap - 1;
+	hier->slots = (u4 *)arena_calloc(&hier->arena, cap, sizeof(u4));
+	hier->nodes = (DexHierNode *)arena_alloc(&hier->arena, (max ? max : 1) * sizeof(DexHierNode));
+	if(hier->slots == NULL || hier->nodes == NULL)
+		goto oom;
+
+	for(i = 0; ret == 0 && i < cnt; ++i){
+		for(j = 0; ret == 0 && j < dexes[i]->header->classDefsSize; ++j)
+			ret = add_class(hier, &edges, dexes[i], j);
+	}
+	if(ret == -1 || build_rows(hier, &edges, 1, &hier->up_offsets, &hier->up) == -1
+			|| build_rows(hier, &edges, 0, &hier->down_offsets, &hier->down) == -1
+			|| build_order(hier) == -1)
+		goto oom;
+
+	free(edges.edges);
+	dex_stats_end(&timer, DEX_PHASE_HIERARCHY);
+	return hier;
+
+oom:
+	fprintf(stderr, "dex_hierarchy_build - out of memory.\n");
+fail:
+	free(edges.edges);
+	dex_hierarchy_free(hier);
+	dex_stats_end(&timer, DEX_PHASE_HIERARCHY);
+	return NULL;
+}
+
+/*
+ * the hierarchy of every dex of dc, built on first use.
+ */
+DexHierarchy *dex_container_hierarchy(DexContainer *dc)
+{
+	if(dc->hierarchy == NULL)
+		dc->hierarchy = dex_hierarchy_build(dc->dexes, dc->cnt);
+	return dc->hierarchy;
+}
+
+void dex_hierarchy_free(DexHierarchy *hier)
+{
+	if(hier == NULL)
+		return ;
+	arena_free(&hier->arena);
+	free(hier);
+}
+
+/*
+ * node of a class given by java name or descriptor, NO_INDEX if no class
+ * has or names it.
+ */
+u4 dex_hierarchy_find(const DexHierarchy *hier, const char *name)
+{
+	char descriptor[HIER_NAME_LEN];
+	int len;
+	u4 slot;
+
+	if((len = class_name_to_descriptor(name, descriptor, sizeof(descriptor))) == -1)
+		return NO_INDEX;
+	slot = find_slot(hier, descriptor, len);
+	return hier->slots[slot] != 0 ? hier->slots[slot] - 1 : NO_INDEX;
+}
+
+/*
+ * the nodes related to node by query (DEX_HIER_*), breadth first so the
+ * nearest come first, in a malloc'ed array of *cnt. Returns NULL when out
+ * of memory.
+ */
+u4 *dex_hierarchy_query(const DexHierarchy *hier, u4 node, int query, u4 *cnt)
+{
+	const u4 *offsets, *rows;
+	u1 *seen;
+	u4 *found;
+	u4 head, tail = 0, kept = 0, i, n, next;
+
+	*cnt = 0;
+	if(node >= hier->cnt)
+		return NULL;
+	seen = (u1 *)dex_calloc(hier->cnt, 1);
+	found = (u4 *)dex_malloc(hier->cnt * sizeof(u4));
+	if(seen == NULL || found == NULL){
+		fprintf(stderr, "dex_hierarchy_query - out of memory.\n");
+		free(seen);
+		free(found);
+		return NULL;
+	}
+	offsets = query == DEX_HIER_ANCESTORS ? hier->up_offsets : hier->down_offsets;
+	rows = query == DEX_HIER_ANCESTORS ? hier->up : hier->down;
+
+	// found[] is the queue; the start node is dropped from it at the end.
+	seen[node] = 1;
+	found[tail++] = node;
+	for(head = 0; head < tail; ++head){
+		n = found[head];
+		for(i = offsets[n]; i < offsets[n + 1]; ++i){
+			next = rows[i];
+			if(seen[next] || (query == DEX_HIER_SUBCLASSES && hier->nodes[next].super != n))
+				continue;
+			seen[next] = 1;
+			found[tail++] = next;
+		}
+	}
+	for(i = 1; i < tail; ++i){
+		n = found[i];
+		// in a dex an interface extends java.lang.Object too.
+		if(query != DEX_HIER_ANCESTORS && (hier->nodes[n].access_flags & ACC_INTERFACE))
+			continue;
+		found[kept++] = n;
+	}
+	free(seen);
+	*cnt = kept;
+	return found;
+}
+
+/*
+ * the java name of node.
+ */
+int dex_hierarchy_format(const DexHierarchy *hier, StrBuf *out, u4 node)
+{
+	if(node >= hier->cnt)
+		return -1;
+	return dex_format_type(hier->nodes[node].ctx, out, hier->nodes[node].type_idx);
+}
@@ -0,0 +1,60 @@
+#ifndef __DEXHIER_H__
+#define __DEXHIER_H__
+
+#include "dexfile.h"
+
+/*
+ * The class hierarchy of all dex files of a container. Every class
+ * defined in one of them, and every type named as a superclass or an
+ * interface, is a node; a class defined in more than one dex is taken
+ * from the first, as the class loader would. The direct supertypes of
+ * node n (its superclass first, then its interfaces) are
+ * up[up_offsets[n]] up to, not including, up[up_offsets[n + 1]], and its
+ * direct subtypes likewise from down_offsets and down. order lists the
+ * nodes supertypes first; nodes on a cycle, which only a broken file can
+ * have, are left out of it.
+ */
+typedef struct {
+	DexContext	*ctx;			/* defining dex, or the first naming the type */
+	u4			type_idx;		/* in ctx */
+	u4			class_idx;		/* class_def in ctx, NO_INDEX if no dex defines it */
+	u4			super;			/* superclass node, or NO_INDEX */
+	u4			access_flags;	/* of the class_def, 0 if not defined */
+	const char	*desc;			/* descriptor, not NUL terminated */
+	u4			desc_len;
+} DexHierNode;
+
+struct DexHierarchy {
+	Arena		arena;
+	DexHierNode	*nodes;
+	u4			cnt;
+	u4			defined;		/* nodes with a class_def */
+	u4			duplicates;		/* class_defs hidden by an earlier dex */
+	u4			bad;			/* class_defs or type lists out of bounds, skipped */
+	u4			*up_offsets;	/* cnt + 1 each */
+	u4			*up;
+	u4			*down_offsets;
+	u4			*down;
+	u4			*order;
+	u4			ordered;		/* cnt, unless there is a cycle */
+	u4			*slots;			/* descriptor hash table of node + 1, 0 empty */
+	u4			mask;
+};
+
+enum {
+	DEX_HIER_ANCESTORS,			/* every supertype, nearest first */
+	DEX_HIER_SUBCLASSES,		/* non interface classes extending it, directly or not */
+	DEX_HIER_IMPLEMENTORS,		/* non interface classes it is a supertype of */
+};
+
+extern DexHierarchy *dex_hierarchy_build(DexContext **dexes, u4 cnt);
+extern DexHierarchy *dex_container_hierarchy(DexContainer *dc);
+extern void dex_hierarchy_free(DexHierarchy *hier);
+extern u4 dex_hierarchy_find(const DexHierarchy *hier, const char *name);
+extern u4 *dex_hierarchy_query(const DexHierarchy *hier, u4 node, int query, u4 *cnt);
+extern int dex_hierarchy_format(const DexHierarchy *hier, StrBuf *out, u4 node);
+
+/* JSON record (dexjson.c) of a node with its direct supertypes */
+extern int dex_json_hierarchy(const DexHierarchy *hier, StrBuf *out, const char *kind, const char *prefix, u4 node);
+
+#endif	/* __DEXHIER_H__ */
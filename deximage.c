@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "deximage.h"
+#include "dexstats.h"
+
+#define READ_CHUNK		(64 * 1024)
+
+/*
+ * read the whole file into a malloc'ed buffer, used when the file
+ * can not be mapped (pipes, sockets, empty files...).
+ */
+static int read_whole_fd(DexImage *image, int fd, size_t hint)
+{
+	u1 *buffer = NULL, *tmp;
+	size_t cap = hint > 0 ? hint : READ_CHUNK;
+	size_t len = 0;
+	ssize_t n;
+
+	buffer = (u1 *)dex_malloc(cap);
+	if(buffer == NULL){
+		fprintf(stderr, "read_whole_fd - malloc failure out of memory.\n");
+		return -1;
+	}
+
+	for(;;){
+		if(len == cap){
+			cap *= 2;
+			tmp = (u1 *)dex_realloc(buffer, cap);
+			if(tmp == NULL){
+				fprintf(stderr, "read_whole_fd - realloc failure out of memory.\n");
+				free(buffer);
+				return -1;
+			}
+			buffer = tmp;
+		}
+		n = read(fd, buffer + len, cap - len);
+		DEX_STAT_ADD(DEX_STAT_READ_CALLS, 1);
+		if(n == 0)
+			break;
+		if(n < 0){
+			if(errno == EINTR)
+				continue;
+			perror("read_whole_fd - read failure");
+			free(buffer);
+			return -1;
+		}
+		len += n;
+	}
+	DEX_STAT_ADD(DEX_STAT_READ_BYTES, len);
+
+	image->base = buffer;
+	image->size = len;
+	image->owner = DEX_IMAGE_HEAP;
+	return 0;
+}
+
+int dex_image_open_fd(DexImage *image, int fd)
+{
+	struct stat st;
+	void *map;
+
+	if(image == NULL || fd < 0){
+		fprintf(stderr, "dex_image_open_fd - invalid parameter.\n");
+		return -1;
+	}
+	memset(image, 0, sizeof(*image));
+	DEX_STAT_ADD(DEX_STAT_FILES, 1);
+
+	if(fstat(fd, &st) == -1){
+		perror("dex_image_open_fd - fstat failure");
+		return -1;
+	}
+
+	if(S_ISREG(st.st_mode) && st.st_size > 0){
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map != MAP_FAILED){
+			// tables are walked front to back most of the time.
+			madvise(map, st.st_size, MADV_WILLNEED);
+			image->base = (const u1 *)map;
+			image->size = st.st_size;
+			image->owner = DEX_IMAGE_MAPPED;
+			DEX_STAT_ADD(DEX_STAT_MAPPED_BYTES, st.st_size);
+			return 0;
+		}
+		// fall through to a plain read.
+	}
+
+	return read_whole_fd(image, fd, S_ISREG(st.st_mode) ? (size_t)st.st_size : 0);
+}
+
+int dex_image_open(DexImage *image, const char *file)
+{
+	int fd;
+	int ret;
+
+	if(image == NULL || file == NULL){
+		fprintf(stderr, "dex_image_open - invalid parameter.\n");
+		return -1;
+	}
+
+	if(strcmp(file, "-") == 0)
+		return dex_image_open_fd(image, STDIN_FILENO);
+
+	fd = open(file, O_RDONLY);
+	if(fd == -1){
+		fprintf(stderr, "dex_image_open - open file '%s' failure: %s.\n", file, strerror(errno));
+		return -1;
+	}
+	ret = dex_image_open_fd(image, fd);
+	close(fd);
+	return ret;
+}
+
+/*
+ * an image over memory that outlives it.
+ */
+void dex_image_borrow(DexImage *image, const u1 *base, size_t size)
+{
+	image->base = base;
+	image->size = size;
+	image->owner = DEX_IMAGE_BORROWED;
+}
+
+void dex_image_close(DexImage *image)
+{
+	if(image == NULL || image->base == NULL)
+		return ;
+	if(image->owner == DEX_IMAGE_MAPPED)
+		munmap((void *)image->base, image->size);
+	else if(image->owner == DEX_IMAGE_HEAP)
+		free((void *)image->base);
+	memset(image, 0, sizeof(*image));
+}
+
+/*
+ * return a pointer to nmemb elements of size bytes at offset, or NULL if
+ * the range does not fit into the image.
+ */
+const void *dex_image_ptr(const DexImage *image, size_t offset, size_t size, size_t nmemb)
+{
+	size_t total;
+
+	DEX_STAT_ADD(DEX_STAT_IMAGE_ACCESSES, 1);
+	if(image == NULL || image->base == NULL)
+		return NULL;
+	if(offset > image->size)
+		return NULL;
+	if(size != 0 && nmemb > (image->size - offset) / size)
+		return NULL;
+
+	total = size * nmemb;
+	if(total > image->size - offset)
+		return NULL;
+	return image->base + offset;
+}
+
+/*
+ * dex_image_ptr() for an item the format requires to start on an align
+ * byte boundary (a power of 2): a misaligned offset is rejected like one
+ * out of bounds, so the item's fields can be loaded directly.
+ */
+const void *dex_image_ptr_aligned(const DexImage *image, size_t offset, size_t align, size_t size, size_t nmemb)
+{
+	if(offset & (align - 1))
+		return NULL;
+	return dex_image_ptr(image, offset, size, nmemb);
+}
+
+const u1 *dex_image_end(const DexImage *image)
+{
+	if(image == NULL || image->base == NULL)
+		return NULL;
+	return image->base + image->size;
+}
+
+/*
+ * tell the kernel len bytes at offset are about to be read in order, so
+ * a section can be paged in ahead of a sequential walk. Only a hint: a
+ * heap image or a failing madvise is not an error.
+ */
+void dex_image_prefetch(const DexImage *image, size_t offset, size_t len)
+{
+	uintptr_t start, end;
+	long page;
+
+	if(dex_image_ptr(image, offset, 1, len) == NULL || len == 0 || image->owner == DEX_IMAGE_HEAP)
+		return ;
+	page = sysconf(_SC_PAGESIZE);
+	if(page <= 0)
+		return ;
+	start = (uintptr_t)(image->base + offset) & ~(uintptr_t)(page - 1);
+	end = (uintptr_t)(image->base + offset + len);
+	madvise((void *)start, end - start, MADV_WILLNEED);
+}
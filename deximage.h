@@ -0,0 +1,36 @@
+#ifndef __DEXIMAGE_H__
+#define __DEXIMAGE_H__
+
+#include <stddef.h>
+#include "dextypes.h"
+
+/*
+ * A read-only view of a whole dex file. The file is mmap'ed once when
+ * possible, otherwise (pipes, character devices...) it is read into a
+ * heap buffer. An image can also borrow memory owned by someone else,
+ * such as a dex stored inside a mapped apk. All accesses go through
+ * dex_image_ptr(), which checks that the requested range lies inside the
+ * image.
+ */
+enum {
+	DEX_IMAGE_HEAP		= 0,	/* base is malloc'ed */
+	DEX_IMAGE_MAPPED	= 1,	/* base comes from mmap */
+	DEX_IMAGE_BORROWED	= 2,	/* base is not ours, close leaves it alone */
+};
+
+typedef struct {
+	const u1	*base;
+	size_t		size;
+	int			owner;		/* DEX_IMAGE_* */
+} DexImage;
+
+extern int dex_image_open(DexImage *image, const char *file);
+extern int dex_image_open_fd(DexImage *image, int fd);
+extern void dex_image_borrow(DexImage *image, const u1 *base, size_t size);
+extern void dex_image_close(DexImage *image);
+extern const void *dex_image_ptr(const DexImage *image, size_t offset, size_t size, size_t nmemb);
+extern const void *dex_image_ptr_aligned(const DexImage *image, size_t offset, size_t align, size_t size, size_t nmemb);
+extern const u1 *dex_image_end(const DexImage *image);
+extern void dex_image_prefetch(const DexImage *image, size_t offset, size_t len);
+
+#endif	/* __DEXIMAGE_H__ */
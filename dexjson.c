@@ -0,0 +1,830 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dexfile.h"
+#include "dexxref.h"
+#include "dexhier.h"
+#include "dexdiff.h"
+#include "dexanno.h"
+#include "dexdebug.h"
+#include "json.h"
+
+/*
+ * One JSON object per header, string, method, class, xref, hierarchy
+ * node, diff of a class, annotation or source line, for tools that
+ * would otherwise scrape the text dump. Each record is built straight
+ * into the caller's StrBuf, so a dump can be streamed record by record.
+ */
+
+#define MEMBER_CHUNK	64
+#define CODE_INDENT_LEN	6			// the "      " dex_format_code() puts first
+#define FLAGS_LEN		256
+#define SCRATCH_SIZE	4096			// per class, on the stack: most code listings fit
+
+static const char *const member_keys[] = {
+	"static_fields", "instance_fields", "direct_methods", "virtual_methods",
+};
+
+/*
+ * '{' then "kind" and the caller's prefix members.
+ */
+static int begin_record(StrBuf *out, const char *kind, const char *prefix)
+{
+	if(strbuf_append(out, "{\"kind\":\"", 9) == -1 || strbuf_puts(out, kind) == -1 || strbuf_putc(out, '"') == -1)
+		return -1;
+	if(prefix != NULL && prefix[0] != '\0' && (strbuf_putc(out, ',') == -1 || strbuf_puts(out, prefix) == -1))
+		return -1;
+	return 0;
+}
+
+/*
+ * ,"key":value for a number.
+ */
+static int put_number(StrBuf *out, const char *key, long long value)
+{
+	if(strbuf_putc(out, ',') == -1 || json_put_key(out, key) == -1)
+		return -1;
+	return strbuf_putdec(out, value);
+}
+
+static int put_type(DexContext *ctx, StrBuf *out, u4 type_idx)
+{
+	size_t start;
+
+	if(strbuf_putc(out, '"') == -1)
+		return -1;
+	start = out->len;
+	if(dex_format_type(ctx, out, type_idx) == -1 || json_escape_from(out, start) == -1)
+		return -1;
+	return strbuf_putc(out, '"');
+}
+
+/*
+ * string idx from its raw MUTF-8 bytes, not the printable copy.
+ */
+static int put_string_idx(DexContext *ctx, StrBuf *out, u4 idx)
+{
+	StrView view;
+
+	if(string_pool_view(&ctx->strings, idx, &view) == -1)
+		return -1;
+	return json_put_string(out, view.data, view.len);
+}
+
+/*
+ * the type_list at offset as an array of type names, [] for offset 0.
+ */
+static int put_type_list(DexContext *ctx, StrBuf *out, u4 offset)
+{
+	const u4 *size;
+	const TypeListItem *items;
+	u4 i;
+
+	if(strbuf_putc(out, '[') == -1)
+		return -1;
+	if(offset != 0){
+		size = (const u4 *)dex_image_ptr_aligned(&ctx->image, offset, 4, sizeof(u4), 1);
+		items = size == NULL ? NULL : (const TypeListItem *)dex_image_ptr(&ctx->image, offset + sizeof(u4),
+																				sizeof(TypeListItem), *size);
+		if(items == NULL){
+			fprintf(stderr, "put_type_list - type list out of file bounds at %x.\n", offset);
+			return -1;
+		}
+		for(i = 0; i < *size; ++i){
+			if((i != 0 && strbuf_putc(out, ',') == -1) || put_type(ctx, out, items[i].type_idx) == -1)
+				return -1;
+		}
+	}
+	return strbuf_putc(out, ']');
+}
+
+/*
+ * ,"access_flags":N,"access":["public",...]. Flags the type cannot have
+ * leave the name list empty, the number is still there.
+ */
+static int put_access(StrBuf *out, u4 flags, int type)
+{
+	char names[FLAGS_LEN];
+	size_t start, len, i, word;
+
+	if(put_number(out, "access_flags", flags) == -1 || strbuf_append(out, ",\"access\":[", 11) == -1)
+		return -1;
+	start = out->len;
+	if(dex_format_access_flags(out, flags, type) == -1 || out->len - start >= sizeof(names)){
+		strbuf_truncate(out, start);
+		return strbuf_putc(out, ']');
+	}
+
+	// "public static " -> "public","static"
+	len = out->len - start;
+	memcpy(names, out->data + start, len);
+	strbuf_truncate(out, start);
+	for(word = 0, i = 0; i < len; ++i){
+		if(names[i] != ' ')
+			continue;
+		if(word != 0 && strbuf_putc(out, ',') == -1)
+			return -1;
+		if(json_put_string(out, names + word, i - word) == -1)
+			return -1;
+		word = i + 1;
+	}
+	return strbuf_putc(out, ']');
+}
+
+/*
+ * ,"code":[lines] with the disassembly of the code_item at code_off.
+ */
+static int put_code(DexContext *ctx, StrBuf *out, Arena *scratch, u4 code_off)
+{
+	const char *line, *next, *end;
+	ArenaMark mark;
+	char *text;
+	size_t start, len, n;
+	int ret;
+
+	if(strbuf_append(out, ",\"code\":[", 9) == -1)
+		return -1;
+	start = out->len;
+	if(dex_format_code(ctx, out, code_off) == -1)
+		return -1;
+
+	len = out->len - start;
+	arena_mark(scratch, &mark);
+	if((text = arena_strndup(scratch, out->data + start, len)) == NULL){
+		fprintf(stderr, "put_code - out of memory.\n");
+		return -1;
+	}
+	strbuf_truncate(out, start);
+
+	ret = 0;
+	end = text + len;
+	for(n = 0, line = text; line < end && ret == 0; line = next + 1, ++n){
+		if((next = (const char *)memchr(line, '\n', end - line)) == NULL)
+			next = end;
+		if(next - line >= CODE_INDENT_LEN)
+			line += CODE_INDENT_LEN;
+		if(n != 0 && strbuf_putc(out, ',') == -1)
+			ret = -1;
+		else
+			ret = json_put_string(out, line, next - line);
+	}
+	arena_release(scratch, &mark);
+	if(ret == -1)
+		return -1;
+	return strbuf_putc(out, ']');
+}
+
+static int put_field_member(DexContext *ctx, StrBuf *out, const EncodedMember *member)
+{
+	const FieldIds *field;
+
+	if(member->idx >= ctx->header->fieldIdsSize){
+		fprintf(stderr, "put_field_member - invalid field index %u.\n", member->idx);
+		return -1;
+	}
+	field = &ctx->field_ids[member->idx];
+	if(strbuf_append(out, "{\"name\":", 8) == -1 || put_string_idx(ctx, out, field->name_idx) == -1)
+		return -1;
+	if(strbuf_append(out, ",\"type\":", 8) == -1 || put_type(ctx, out, field->type_idx) == -1)
+		return -1;
+	if(put_access(out, member->access_flags, FIELD) == -1)
+		return -1;
+	return strbuf_putc(out, '}');
+}
+
+/*
+ * "name", "params" and "return" of method_idx, the members a method
+ * record and a class's method entries share.
+ */
+static int put_method_signature(DexContext *ctx, StrBuf *out, u4 method_idx)
+{
+	const MethodIds *method;
+	const ProtoIds *proto;
+
+	if(method_idx >= ctx->header->methodIdsSize){
+		fprintf(stderr, "put_method_signature - invalid method index %u.\n", method_idx);
+		return -1;
+	}
+	method = &ctx->method_ids[method_idx];
+	if(method->proto_idx >= ctx->header->protoIdsSize){
+		fprintf(stderr, "put_method_signature - invalid method proto index %u.\n", method->proto_idx);
+		return -1;
+	}
+	proto = &ctx->proto_ids[method->proto_idx];
+
+	if(json_put_key(out, "name") == -1 || put_string_idx(ctx, out, method->name_idx) == -1)
+		return -1;
+	if(strbuf_append(out, ",\"params\":", 10) == -1 || put_type_list(ctx, out, proto->parameters_off) == -1)
+		return -1;
+	if(strbuf_append(out, ",\"return\":", 10) == -1 || put_type(ctx, out, proto->return_type_idx) == -1)
+		return -1;
+	return 0;
+}
+
+static int put_lines(DexContext *ctx, StrBuf *out, const EncodedMember *member);
+
+static int put_method_member(DexContext *ctx, StrBuf *out, Arena *scratch, const EncodedMember *member, int flags)
+{
+	if(strbuf_putc(out, '{') == -1 || put_method_signature(ctx, out, member->idx) == -1)
+		return -1;
+	if(put_access(out, member->access_flags, METHOD) == -1 || put_number(out, "code_off", member->code_off) == -1)
+		return -1;
+	if((flags & DEX_FORMAT_CODE) && member->code_off != 0 && put_code(ctx, out, scratch, member->code_off) == -1)
+		return -1;
+	if((flags & DEX_FORMAT_LINES) && member->code_off != 0 && put_lines(ctx, out, member) == -1)
+		return -1;
+	return strbuf_putc(out, '}');
+}
+
+/*
+ * the four member arrays of the class_data_item at offset.
+ */
+static int put_class_data(DexContext *ctx, StrBuf *out, Arena *scratch, u4 offset, int flags)
+{
+	EncodedMember members[MEMBER_CHUNK];
+	const u1 *data = NULL, *end;
+	u4 sizes[4] = {0, 0, 0, 0};
+	u4 i, j, n, left, idx;
+	int okay, ret;
+
+	end = dex_image_end(&ctx->image);
+	if(offset != 0){
+		data = (const u1 *)dex_image_ptr(&ctx->image, offset, 1, 1);
+		if(data == NULL){
+			fprintf(stderr, "put_class_data - invalid class data offset %x.\n", offset);
+			return -1;
+		}
+		for(i = 0; i < 4; ++i){
+			sizes[i] = readAndVerifyUnsignedLeb128(&data, end, &okay);
+			if(!okay){
+				fprintf(stderr, "put_class_data - bad class data header at %x.\n", offset);
+				return -1;
+			}
+		}
+	}
+
+	for(i = 0; i < 4; ++i){
+		if(strbuf_putc(out, ',') == -1 || json_put_key(out, member_keys[i]) == -1 || strbuf_putc(out, '[') == -1)
+			return -1;
+		idx = 0;
+		for(left = sizes[i]; left > 0; left -= n){
+			n = left < MEMBER_CHUNK ? left : MEMBER_CHUNK;
+			if(readEncodedMembers(&data, end, members, n, &idx, i >= 2) == -1){
+				fprintf(stderr, "put_class_data - bad encoded member list at %x.\n", offset);
+				return -1;
+			}
+			for(j = 0; j < n; ++j){
+				if(left != sizes[i] || j != 0){
+					if(strbuf_putc(out, ',') == -1)
+						return -1;
+				}
+				if(i >= 2)
+					ret = put_method_member(ctx, out, scratch, &members[j], flags);
+				else
+					ret = put_field_member(ctx, out, &members[j]);
+				if(ret == -1)
+					return -1;
+			}
+		}
+		if(strbuf_putc(out, ']') == -1)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * the header fields. prefix, when not NULL, is a list of JSON members put
+ * at the start of the object (like "file":"a.dex"), as for every record.
+ */
+int dex_json_header(DexContext *ctx, StrBuf *out, const char *prefix)
+{
+	const DexHeader *header = ctx->header;
+	u4 i;
+
+	if(begin_record(out, "header", prefix) == -1)
+		return -1;
+	if(strbuf_append(out, ",\"magic\":", 9) == -1 || json_put_string(out, (const char *)header->magic,
+																			strnlen((const char *)header->magic, sizeof(header->magic))) == -1)
+		return -1;
+	if(put_number(out, "checksum", header->checksum) == -1 || strbuf_append(out, ",\"signature\":\"", 14) == -1)
+		return -1;
+	for(i = 0; i < kSHA1DigestLen; ++i){
+		if(strbuf_puthex(out, header->signature[i], 2) == -1)
+			return -1;
+	}
+	if(strbuf_putc(out, '"') == -1
+			|| put_number(out, "file_size", header->fileSize) == -1
+			|| put_number(out, "header_size", header->headerSize) == -1
+			|| put_number(out, "endian_tag", header->endianTag) == -1
+			|| put_number(out, "link_size", header->linkSize) == -1
+			|| put_number(out, "link_off", header->linkOff) == -1
+			|| put_number(out, "map_off", header->mapOff) == -1
+			|| put_number(out, "string_ids_size", header->stringIdsSize) == -1
+			|| put_number(out, "string_ids_off", header->stringIdsOff) == -1
+			|| put_number(out, "type_ids_size", header->typeIdsSize) == -1
+			|| put_number(out, "type_ids_off", header->typeIdsOff) == -1
+			|| put_number(out, "proto_ids_size", header->protoIdsSize) == -1
+			|| put_number(out, "proto_ids_off", header->protoIdsOff) == -1
+			|| put_number(out, "field_ids_size", header->fieldIdsSize) == -1
+			|| put_number(out, "field_ids_off", header->fieldIdsOff) == -1
+			|| put_number(out, "method_ids_size", header->methodIdsSize) == -1
+			|| put_number(out, "method_ids_off", header->methodIdsOff) == -1
+			|| put_number(out, "class_defs_size", header->classDefsSize) == -1
+			|| put_number(out, "class_defs_off", header->classDefsOff) == -1
+			|| put_number(out, "data_size", header->dataSize) == -1
+			|| put_number(out, "data_off", header->dataOff) == -1)
+		return -1;
+	return strbuf_putc(out, '}');
+}
+
+int dex_json_string(DexContext *ctx, StrBuf *out, const char *prefix, u4 idx)
+{
+	if(idx >= ctx->header->stringIdsSize){
+		fprintf(stderr, "dex_json_string - invalid string index %u.\n", idx);
+		return -1;
+	}
+	if(begin_record(out, "string", prefix) == -1 || put_number(out, "idx", idx) == -1
+			|| put_number(out, "off", ctx->string_ids[idx].string_data_off) == -1)
+		return -1;
+	if(strbuf_append(out, ",\"value\":", 9) == -1 || put_string_idx(ctx, out, idx) == -1)
+		return -1;
+	return strbuf_putc(out, '}');
+}
+
+int dex_json_method(DexContext *ctx, StrBuf *out, const char *prefix, u4 method_idx)
+{
+	if(method_idx >= ctx->header->methodIdsSize){
+		fprintf(stderr, "dex_json_method - invalid method index %u.\n", method_idx);
+		return -1;
+	}
+	if(begin_record(out, "method", prefix) == -1 || put_number(out, "idx", method_idx) == -1)
+		return -1;
+	if(strbuf_append(out, ",\"class\":", 9) == -1 || put_type(ctx, out, ctx->method_ids[method_idx].class_idx) == -1)
+		return -1;
+	if(strbuf_putc(out, ',') == -1 || put_method_signature(ctx, out, method_idx) == -1)
+		return -1;
+	return strbuf_putc(out, '}');
+}
+
+static int put_class_annotations(DexContext *ctx, StrBuf *out, u4 class_idx);
+
+/*
+ * class_idx with its members; flags takes DEX_FORMAT_CODE like
+ * dex_format_class_data(), and DEX_FORMAT_ANNOTATIONS for its
+ * "annotations" and "static_values".
+ */
+int dex_json_class(DexContext *ctx, StrBuf *out, const char *prefix, u4 class_idx, int flags)
+{
+	const ClassDefs *class;
+	Arena scratch;
+	char buffer[SCRATCH_SIZE];
+	int ret;
+
+	if(class_idx >= ctx->header->classDefsSize){
+		fprintf(stderr, "dex_json_class - invalid class index %u.\n", class_idx);
+		return -1;
+	}
+	class = &ctx->class_defs[class_idx];
+
+	if(begin_record(out, "class", prefix) == -1 || put_number(out, "idx", class_idx) == -1)
+		return -1;
+	if(strbuf_append(out, ",\"name\":", 8) == -1 || put_type(ctx, out, class->class_idx) == -1)
+		return -1;
+	if(put_access(out, class->access_flags, CLASS) == -1)
+		return -1;
+	if(class->superclass_idx != NO_INDEX){
+		if(strbuf_append(out, ",\"super\":", 9) == -1 || put_type(ctx, out, class->superclass_idx) == -1)
+			return -1;
+	}
+	if(strbuf_append(out, ",\"interfaces\":", 14) == -1 || put_type_list(ctx, out, class->interfaces_off) == -1)
+		return -1;
+	if(class->source_file_idx != NO_INDEX){
+		if(strbuf_append(out, ",\"source\":", 10) == -1 || put_string_idx(ctx, out, class->source_file_idx) == -1)
+			return -1;
+	}
+	// code listings are copied out of out and back, through the scratch.
+	arena_init_buffer(&scratch, buffer, sizeof(buffer));
+	ret = put_class_data(ctx, out, &scratch, class->class_data_off, flags);
+	arena_free(&scratch);
+	if(ret == -1)
+		return -1;
+	if((flags & DEX_FORMAT_ANNOTATIONS) && put_class_annotations(ctx, out, class_idx) == -1)
+		return -1;
+	return strbuf_putc(out, '}');
+}
+
+/*
+ * the map_list sections, whether they checked out and the problems found.
+ * Unlike the other records the object is complete either way; -1 only
+ * tells the map is bad (or memory ran out).
+ */
+int dex_json_map(DexContext *ctx, StrBuf *out, const char *prefix)
+{
+	StrBuf report;
+	DexMap map;
+	const DexSection *section;
+	const char *line, *next;
+	int ret;
+	u4 i;
+
+	strbuf_init(&report);
+	ret = dex_map_parse(&map, &ctx->image, &report);
+
+	begin_record(out, "map", prefix);
+	put_number(out, "map_off", ctx->header->mapOff);
+	strbuf_puts(out, ret == 0 ? ",\"valid\":true,\"sections\":[" : ",\"valid\":false,\"sections\":[");
+	for(i = 0; i < map.cnt; ++i){
+		section = &map.sections[i];
+		strbuf_puts(out, i == 0 ? "{\"type\":\"" : ",{\"type\":\"");
+		strbuf_puts(out, dex_map_type_name(section->type));
+		strbuf_putc(out, '"');
+		put_number(out, "off", section->off);
+		put_number(out, "items", section->cnt);
+		put_number(out, "bytes", section->len);
+		strbuf_putc(out, '}');
+	}
+	strbuf_append(out, "],\"problems\":[", 14);
+	for(line = report.data; line != NULL && (next = strchr(line, '\n')) != NULL; line = next + 1){
+		if(line != report.data)
+			strbuf_putc(out, ',');
+		json_put_string(out, line, next - line);
+	}
+	strbuf_free(&report);
+	if(strbuf_append(out, "]}", 2) == -1)
+		return -1;
+	return ret;
+}
+
+/*
+ * id idx of kind (DEX_REF_*) as a JSON string, named like the
+ * disassembler names it.
+ */
+static int put_ref(DexContext *ctx, StrBuf *out, int kind, u4 idx)
+{
+	size_t start;
+	int ret = -1;
+
+	if(kind == DEX_REF_STRING)
+		return put_string_idx(ctx, out, idx);
+	if(kind == DEX_REF_TYPE)
+		return put_type(ctx, out, idx);
+	if(strbuf_putc(out, '"') == -1)
+		return -1;
+	start = out->len;
+	if(kind == DEX_REF_FIELD)
+		ret = dex_format_field_ref(ctx, out, idx);
+	else if(kind == DEX_REF_METHOD)
+		ret = dex_format_method_ref(ctx, out, idx);
+	if(ret == -1 || json_escape_from(out, start) == -1)
+		return -1;
+	return strbuf_putc(out, '"');
+}
+
+/*
+ * id idx of kind with every method referring to it and where, from the
+ * index dex_xref_build() made.
+ */
+int dex_json_xref(DexContext *ctx, StrBuf *out, const char *prefix, int kind, u4 idx)
+{
+	const DexXrefSite *sites;
+	u4 i, cnt;
+
+	if(ctx->xref == NULL || idx >= dex_ref_count(ctx, kind)){
+		fprintf(stderr, "dex_json_xref - no index built or invalid index %u.\n", idx);
+		return -1;
+	}
+	sites = dex_xref_sites(ctx->xref, kind, idx, &cnt);
+	if(begin_record(out, "xref", prefix) == -1 || strbuf_append(out, ",\"ref\":\"", 8) == -1
+			|| strbuf_puts(out, dex_ref_kind_name(kind)) == -1 || strbuf_putc(out, '"') == -1
+			|| put_number(out, "idx", idx) == -1)
+		return -1;
+	if(strbuf_append(out, ",\"target\":", 10) == -1 || put_ref(ctx, out, kind, idx) == -1
+			|| strbuf_append(out, ",\"sites\":[", 10) == -1)
+		return -1;
+	for(i = 0; i < cnt; ++i){
+		if(strbuf_puts(out, i == 0 ? "{\"method\":" : ",{\"method\":") == -1
+				|| put_ref(ctx, out, DEX_REF_METHOD, sites[i].method_idx) == -1
+				|| put_number(out, "pc", sites[i].pc) == -1 || strbuf_putc(out, '}') == -1)
+			return -1;
+	}
+	return strbuf_append(out, "]}", 2);
+}
+
+static int put_node(const DexHierarchy *hier, StrBuf *out, u4 node)
+{
+	size_t start;
+
+	if(strbuf_putc(out, '"') == -1)
+		return -1;
+	start = out->len;
+	if(dex_hierarchy_format(hier, out, node) == -1 || json_escape_from(out, start) == -1)
+		return -1;
+	return strbuf_putc(out, '"');
+}
+
+/*
+ * node of the class hierarchy with its direct supertypes: "super" (null
+ * for none) and "interfaces". "defined" is false for a type no dex of
+ * the container defines.
+ */
+int dex_json_hierarchy(const DexHierarchy *hier, StrBuf *out, const char *kind, const char *prefix, u4 node)
+{
+	const DexHierNode *n;
+	u4 i, first;
+
+	if(node >= hier->cnt){
+		fprintf(stderr, "dex_json_hierarchy - invalid node %u.\n", node);
+		return -1;
+	}
+	n = &hier->nodes[node];
+	if(begin_record(out, kind, prefix) == -1 || strbuf_append(out, ",\"class\":", 9) == -1
+			|| put_node(hier, out, node) == -1
+			|| strbuf_puts(out, n->class_idx != NO_INDEX ? ",\"defined\":true" : ",\"defined\":false") == -1
+			|| strbuf_append(out, ",\"super\":", 9) == -1)
+		return -1;
+	if((n->super == NO_INDEX ? strbuf_append(out, "null", 4) : put_node(hier, out, n->super)) == -1
+			|| strbuf_append(out, ",\"interfaces\":[", 15) == -1)
+		return -1;
+	// the superclass is the first supertype, when there is one.
+	first = hier->up_offsets[node] + (n->super != NO_INDEX);
+	for(i = first; i < hier->up_offsets[node + 1]; ++i){
+		if((i != first && strbuf_putc(out, ',') == -1) || put_node(hier, out, hier->up[i]) == -1)
+			return -1;
+	}
+	return strbuf_append(out, "]}", 2);
+}
+
+/*
+ * ,"what":["flags",...] for the DEX_DIFF_* bits of what.
+ */
+static int put_what(StrBuf *out, u4 what)
+{
+	const char *name;
+	u4 bit, n = 0;
+
+	if(strbuf_append(out, ",\"what\":[", 9) == -1)
+		return -1;
+	for(bit = 1; bit != 0 && bit <= what; bit <<= 1){
+		if((what & bit) == 0 || (name = dex_diff_what_name(bit)) == NULL)
+			continue;
+		if((n++ != 0 && strbuf_putc(out, ',') == -1) || json_put_string(out, name, strlen(name)) == -1)
+			return -1;
+	}
+	return strbuf_putc(out, ']');
+}
+
+static int put_diff_member(const DexDiffClass *cls, StrBuf *out, const DexDiffMember *member)
+{
+	const char *change = dex_diff_change_name(member->change);
+	DexContext *ctx = member->new_idx != NO_INDEX ? cls->new_ctx : cls->old_ctx;
+	u4 idx = member->new_idx != NO_INDEX ? member->new_idx : member->old_idx;
+
+	if(strbuf_append(out, "{\"change\":", 10) == -1 || json_put_string(out, change, strlen(change)) == -1
+			|| strbuf_append(out, ",\"ref\":\"", 8) == -1 || strbuf_puts(out, dex_ref_kind_name(member->kind)) == -1
+			|| strbuf_append(out, "\",\"name\":", 9) == -1 || put_ref(ctx, out, member->kind, idx) == -1)
+		return -1;
+	if(member->change == DEX_DIFF_CHANGED && put_what(out, member->what) == -1)
+		return -1;
+	if(member->old_idx != NO_INDEX && put_number(out, "old_access_flags", member->old_flags) == -1)
+		return -1;
+	if(member->new_idx != NO_INDEX && put_number(out, "new_access_flags", member->new_flags) == -1)
+		return -1;
+	if(member->kind == DEX_REF_METHOD && (put_number(out, "old_code_units", member->old_units) == -1
+			|| put_number(out, "new_code_units", member->new_units) == -1))
+		return -1;
+	return strbuf_putc(out, '}');
+}
+
+/*
+ * ,"key":"type", null for NO_INDEX.
+ */
+static int put_super(DexContext *ctx, StrBuf *out, const char *key, u4 type_idx)
+{
+	if(strbuf_putc(out, ',') == -1 || json_put_key(out, key) == -1)
+		return -1;
+	return type_idx == NO_INDEX ? strbuf_append(out, "null", 4) : put_type(ctx, out, type_idx);
+}
+
+/*
+ * classes[i] of a diff: "change", the class, for a changed one "what"
+ * differs with the old and new values and the "members" that differ, for
+ * an added or removed one its member counts. "old_dex" and "new_dex" name
+ * the dex of an apk the class is in.
+ */
+int dex_json_diff_class(const DexDiff *diff, StrBuf *out, const char *prefix, u4 i)
+{
+	const DexDiffClass *cls;
+	const ClassDefs *o = NULL, *n = NULL;
+	const char *change;
+	DexContext *ctx;
+	u4 j;
+
+	if(i >= diff->cnt){
+		fprintf(stderr, "dex_json_diff_class - invalid class %u.\n", i);
+		return -1;
+	}
+	cls = &diff->classes[i];
+	change = dex_diff_change_name(cls->change);
+	if(cls->old_ctx != NULL)
+		o = &cls->old_ctx->class_defs[cls->old_class];
+	if(cls->new_ctx != NULL)
+		n = &cls->new_ctx->class_defs[cls->new_class];
+	ctx = n != NULL ? cls->new_ctx : cls->old_ctx;
+
+	if(begin_record(out, "diff_class", prefix) == -1 || strbuf_append(out, ",\"change\":", 10) == -1
+			|| json_put_string(out, change, strlen(change)) == -1 || strbuf_append(out, ",\"class\":", 9) == -1
+			|| put_type(ctx, out, (n != NULL ? n : o)->class_idx) == -1)
+		return -1;
+	if(o != NULL && cls->old_ctx->entry != NULL && (strbuf_append(out, ",\"old_dex\":", 11) == -1
+			|| json_put_string(out, cls->old_ctx->entry, strlen(cls->old_ctx->entry)) == -1))
+		return -1;
+	if(n != NULL && cls->new_ctx->entry != NULL && (strbuf_append(out, ",\"new_dex\":", 11) == -1
+			|| json_put_string(out, cls->new_ctx->entry, strlen(cls->new_ctx->entry)) == -1))
+		return -1;
+	if(put_number(out, "old_code_units", cls->old_units) == -1 || put_number(out, "new_code_units", cls->new_units) == -1)
+		return -1;
+	if(cls->change != DEX_DIFF_CHANGED){
+		if(put_number(out, "fields", cls->fields) == -1 || put_number(out, "methods", cls->methods) == -1)
+			return -1;
+		return strbuf_putc(out, '}');
+	}
+
+	if(put_what(out, cls->what) == -1)
+		return -1;
+	if((cls->what & DEX_DIFF_FLAGS) && (put_number(out, "old_access_flags", o->access_flags) == -1
+			|| put_number(out, "new_access_flags", n->access_flags) == -1))
+		return -1;
+	if((cls->what & DEX_DIFF_SUPER) && (put_super(cls->old_ctx, out, "old_super", o->superclass_idx) == -1
+			|| put_super(cls->new_ctx, out, "new_super", n->superclass_idx) == -1))
+		return -1;
+	if((cls->what & DEX_DIFF_INTERFACES) && (strbuf_append(out, ",\"old_interfaces\":", 18) == -1
+			|| put_type_list(cls->old_ctx, out, o->interfaces_off) == -1
+			|| strbuf_append(out, ",\"new_interfaces\":", 18) == -1
+			|| put_type_list(cls->new_ctx, out, n->interfaces_off) == -1))
+		return -1;
+	if(strbuf_append(out, ",\"members\":[", 12) == -1)
+		return -1;
+	for(j = 0; j < cls->cnt; ++j){
+		if((j != 0 && strbuf_putc(out, ',') == -1) || put_diff_member(cls, out, &diff->members[cls->first + j]) == -1)
+			return -1;
+	}
+	return strbuf_append(out, "]}", 2);
+}
+
+/*
+ * "target":...,"visibility":...,"type":...,"text":"@Type(...)" of anno,
+ * with the "member" and "parameter" it is on.
+ */
+static int put_annotation(DexContext *ctx, StrBuf *out, const DexAnnotation *anno)
+{
+	const char *target = dex_anno_target_name(anno->target);
+	const char *visibility = dex_anno_visibility_name(anno->visibility);
+	size_t start;
+
+	if(strbuf_append(out, "\"target\":", 9) == -1 || json_put_string(out, target, strlen(target)) == -1)
+		return -1;
+	if(anno->target != DEX_ANNO_CLASS && (strbuf_append(out, ",\"member\":", 10) == -1
+			|| put_ref(ctx, out, anno->target == DEX_ANNO_FIELD ? DEX_REF_FIELD : DEX_REF_METHOD, anno->member) == -1))
+		return -1;
+	if(anno->target == DEX_ANNO_PARAMETER && put_number(out, "parameter", anno->param) == -1)
+		return -1;
+	if(strbuf_append(out, ",\"visibility\":", 14) == -1)
+		return -1;
+	if((visibility != NULL ? json_put_string(out, visibility, strlen(visibility)) : strbuf_putdec(out, anno->visibility)) == -1)
+		return -1;
+	if(strbuf_append(out, ",\"type\":", 8) == -1 || put_type(ctx, out, anno->type_idx) == -1
+			|| strbuf_append(out, ",\"text\":\"", 9) == -1)
+		return -1;
+	start = out->len;
+	if(dex_format_annotation(ctx, out, anno->off) == -1 || json_escape_from(out, start) == -1)
+		return -1;
+	return strbuf_putc(out, '"');
+}
+
+/* an array being filled by a callback */
+typedef struct {
+	StrBuf	*out;
+	u4		cnt;
+} JsonArray;
+
+static int put_annotation_item(DexContext *ctx, const DexAnnotation *anno, void *arg)
+{
+	JsonArray *array = (JsonArray *)arg;
+	StrBuf *out = array->out;
+
+	if(strbuf_puts(out, array->cnt++ == 0 ? "{" : ",{") == -1 || put_annotation(ctx, out, anno) == -1)
+		return -1;
+	return strbuf_putc(out, '}');
+}
+
+static int put_static_value(DexContext *ctx, u4 field_idx, const u1 **value, const u1 *end, void *arg)
+{
+	JsonArray *array = (JsonArray *)arg;
+	StrBuf *out = array->out;
+	size_t start;
+
+	if(strbuf_puts(out, array->cnt++ == 0 ? "{\"field\":" : ",{\"field\":") == -1
+			|| put_ref(ctx, out, DEX_REF_FIELD, field_idx) == -1 || strbuf_append(out, ",\"value\":\"", 10) == -1)
+		return -1;
+	start = out->len;
+	if(dex_format_encoded_value(ctx, out, value, end) == -1 || json_escape_from(out, start) == -1)
+		return -1;
+	return strbuf_append(out, "\"}", 2);
+}
+
+/*
+ * ,"annotations":[...],"static_values":[{"field":...,"value":...}] of
+ * class_idx.
+ */
+static int put_class_annotations(DexContext *ctx, StrBuf *out, u4 class_idx)
+{
+	JsonArray annotations = {out, 0}, values = {out, 0};
+
+	if(strbuf_append(out, ",\"annotations\":[", 16) == -1
+			|| dex_class_annotations(ctx, class_idx, put_annotation_item, &annotations) == -1
+			|| strbuf_append(out, "],\"static_values\":[", 19) == -1
+			|| dex_class_static_values(ctx, class_idx, put_static_value, &values) == -1)
+		return -1;
+	return strbuf_putc(out, ']');
+}
+
+/*
+ * anno with the class it belongs to, for the annotation index queries.
+ */
+int dex_json_annotation(DexContext *ctx, StrBuf *out, const char *kind, const char *prefix, const DexAnnotation *anno)
+{
+	if(anno->class_idx >= ctx->header->classDefsSize){
+		fprintf(stderr, "dex_json_annotation - invalid class index %u.\n", anno->class_idx);
+		return -1;
+	}
+	if(begin_record(out, kind, prefix) == -1 || strbuf_append(out, ",\"class\":", 9) == -1
+			|| put_type(ctx, out, ctx->class_defs[anno->class_idx].class_idx) == -1 || strbuf_putc(out, ',') == -1
+			|| put_annotation(ctx, out, anno) == -1)
+		return -1;
+	return strbuf_putc(out, '}');
+}
+
+static int put_position(DexContext *ctx, const DexPosition *pos, void *arg)
+{
+	JsonArray *array = (JsonArray *)arg;
+	StrBuf *out = array->out;
+
+	if(strbuf_printf(out, array->cnt++ == 0 ? "{\"pc\":%u,\"line\":%u" : ",{\"pc\":%u,\"line\":%u", pos->pc, pos->line) == -1)
+		return -1;
+	if(pos->source_idx != NO_INDEX && (strbuf_append(out, ",\"source\":", 10) == -1
+			|| put_string_idx(ctx, out, pos->source_idx) == -1))
+		return -1;
+	return strbuf_putc(out, '}');
+}
+
+static int put_local(DexContext *ctx, const DexLocal *local, void *arg)
+{
+	JsonArray *array = (JsonArray *)arg;
+	StrBuf *out = array->out;
+
+	if(strbuf_printf(out, array->cnt++ == 0 ? "{\"reg\":%u,\"start_pc\":%u,\"end_pc\":%u,\"name\":"
+						: ",{\"reg\":%u,\"start_pc\":%u,\"end_pc\":%u,\"name\":", local->reg, local->start_pc, local->end_pc) == -1)
+		return -1;
+	if((local->name_idx == NO_INDEX ? strbuf_append(out, "\"this\"", 6) : put_string_idx(ctx, out, local->name_idx)) == -1)
+		return -1;
+	if(local->type_idx != NO_INDEX && (strbuf_append(out, ",\"type\":", 8) == -1 || put_type(ctx, out, local->type_idx) == -1))
+		return -1;
+	if(local->sig_idx != NO_INDEX && (strbuf_append(out, ",\"signature\":", 13) == -1
+			|| put_string_idx(ctx, out, local->sig_idx) == -1))
+		return -1;
+	return strbuf_putc(out, '}');
+}
+
+/*
+ * ,"positions":[{"pc":..,"line":..}],"locals":[...] of a method, both
+ * empty when it has no debug info.
+ */
+static int put_lines(DexContext *ctx, StrBuf *out, const EncodedMember *member)
+{
+	JsonArray positions = {out, 0}, locals = {out, 0};
+
+	if(strbuf_append(out, ",\"positions\":[", 14) == -1 || dex_debug_info(ctx, member, put_position, NULL, &positions) == -1
+			|| strbuf_append(out, "],\"locals\":[", 12) == -1 || dex_debug_info(ctx, member, NULL, put_local, &locals) == -1)
+		return -1;
+	return strbuf_putc(out, ']');
+}
+
+/*
+ * a method dex_find_line() found a source line in, with the pc the line
+ * starts at.
+ */
+int dex_json_line_hit(const DexLineHit *hit, StrBuf *out, const char *prefix)
+{
+	DexContext *ctx = hit->ctx;
+
+	if(hit->class_idx >= ctx->header->classDefsSize){
+		fprintf(stderr, "dex_json_line_hit - invalid class index %u.\n", hit->class_idx);
+		return -1;
+	}
+	if(begin_record(out, "line", prefix) == -1 || strbuf_append(out, ",\"class\":", 9) == -1
+			|| put_type(ctx, out, ctx->class_defs[hit->class_idx].class_idx) == -1
+			|| strbuf_append(out, ",\"method\":", 10) == -1 || put_ref(ctx, out, DEX_REF_METHOD, hit->method_idx) == -1
+			|| put_number(out, "pc", hit->pc) == -1)
+		return -1;
+	return strbuf_putc(out, '}');
+}
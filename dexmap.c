@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include "dexmap.h"
+
+#define PROBLEM_LEN		256
+
+typedef struct {
+	u2			type;
+	u1			align;
+	u1			exact;			/* every item takes min_size bytes */
+	u4			min_size;		/* smallest possible item */
+	const char	*name;
+} SectionKind;
+
+static const SectionKind kinds[DEX_MAP_KINDS] = {
+	{kDexTypeHeaderItem,				4, 1, sizeof(DexHeader),		"header_item"},
+	{kDexTypeStringIdItem,				4, 1, sizeof(StringIdItem),	"string_id_item"},
+	{kDexTypeTypeIdItem,				4, 1, sizeof(TypeIdIndex),		"type_id_item"},
+	{kDexTypeProtoIdItem,				4, 1, sizeof(ProtoIds),		"proto_id_item"},
+	{kDexTypeFieldIdItem,				4, 1, sizeof(FieldIds),		"field_id_item"},
+	{kDexTypeMethodIdItem,				4, 1, sizeof(MethodIds),		"method_id_item"},
+	{kDexTypeClassDefItem,				4, 1, sizeof(ClassDefs),		"class_def_item"},
+	{kDexTypeMapList,					4, 0, 4,						"map_list"},
+	{kDexTypeTypeList,					4, 0, 4,						"type_list"},
+	{kDexTypeAnnotationSetRefList,		4, 0, 4,						"annotation_set_ref_list"},
+	{kDexTypeAnnotationSetItem,			4, 0, 4,						"annotation_set_item"},
+	{kDexTypeClassDataItem,				1, 0, 4,						"class_data_item"},
+	{kDexTypeCodeItem,					4, 0, 16,						"code_item"},
+	{kDexTypeStringDataItem,			1, 0, 2,						"string_data_item"},
+	{kDexTypeDebugInfoItem,				1, 0, 3,						"debug_info_item"},
+	{kDexTypeAnnotationItem,			1, 0, 3,						"annotation_item"},
+	{kDexTypeEncodedArrayItem,			1, 0, 1,						"encoded_array_item"},
+	{kDexTypeAnnotationDirectoryItem,	4, 0, 16,						"annotations_directory_item"},
+};
+
+static int kind_index(u2 type)
+{
+	int i;
+
+	for(i = 0; i < DEX_MAP_KINDS; ++i){
+		if(kinds[i].type == type)
+			return i;
+	}
+	return -1;
+}
+
+const char *dex_map_type_name(u2 type)
+{
+	int k = kind_index(type);
+
+	return k == -1 ? "unknown" : kinds[k].name;
+}
+
+static void map_problem(DexMap *map, StrBuf *report, const char *fmt, ...)
+{
+	char line[PROBLEM_LEN];
+	va_list ap;
+
+	map->valid = 0;
+	if(report == NULL)
+		return ;
+	va_start(ap, fmt);
+	vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+	strbuf_puts(report, line);
+	strbuf_putc(report, '\n');
+}
+
+/*
+ * where the header says an id section is, 0 if type is not one.
+ */
+static int header_section(const DexHeader *header, u2 type, u4 *off, u4 *size)
+{
+	switch(type){
+		case kDexTypeStringIdItem:	*off = header->stringIdsOff;	*size = header->stringIdsSize;	break;
+		case kDexTypeTypeIdItem:	*off = header->typeIdsOff;		*size = header->typeIdsSize;	break;
+		case kDexTypeProtoIdItem:	*off = header->protoIdsOff;		*size = header->protoIdsSize;	break;
+		case kDexTypeFieldIdItem:	*off = header->fieldIdsOff;		*size = header->fieldIdsSize;	break;
+		case kDexTypeMethodIdItem:	*off = header->methodIdsOff;	*size = header->methodIdsSize;	break;
+		case kDexTypeClassDefItem:	*off = header->classDefsOff;	*size = header->classDefsSize;	break;
+		case kDexTypeHeaderItem:	*off = 0;						*size = 1;						break;
+		default:
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * decode and check the map_list of image into map. Every problem found
+ * is appended to report (when not NULL) as one line; returns 0 if there
+ * were none, -1 otherwise. Even then map holds the sections that could
+ * be read, but dex_map_find() only answers for a valid map.
+ */
+int dex_map_parse(DexMap *map, const DexImage *image, StrBuf *report)
+{
+	const DexHeader *header;
+	const DexMapList *list;
+	const DexMapItem *item;
+	const SectionKind *kind;
+	DexSection *section;
+	unsigned long long data_end, end, min_end = 0;
+	u4 file_size, seen = 0, prev_off = 0, i, off, size;
+	int k;
+
+	memset(map, 0, sizeof(*map));
+	map->valid = 1;
+
+	header = (const DexHeader *)dex_image_ptr(image, 0, sizeof(DexHeader), 1);
+	if(header == NULL){
+		map_problem(map, report, "file too short for a header");
+		return -1;
+	}
+	file_size = header->fileSize;
+	if(file_size > image->size){
+		map_problem(map, report, "fileSize %x past the end of the file (%zx)", file_size, image->size);
+		file_size = image->size;
+	}
+	data_end = (unsigned long long)header->dataOff + header->dataSize;
+	if(data_end > file_size)
+		map_problem(map, report, "data %x + %x past fileSize %x", header->dataOff, header->dataSize, file_size);
+
+	if(header->mapOff & 3)
+		map_problem(map, report, "mapOff %x not 4 byte aligned", header->mapOff);
+	list = (const DexMapList *)dex_image_ptr_aligned(image, header->mapOff, 4, sizeof(u4), 1);
+	item = list == NULL ? NULL : (const DexMapItem *)dex_image_ptr(image, (size_t)header->mapOff + sizeof(u4),
+																		sizeof(DexMapItem), list->size);
+	if(item == NULL || (unsigned long long)header->mapOff + sizeof(u4) + (unsigned long long)list->size * sizeof(DexMapItem) > file_size){
+		map_problem(map, report, "map_list at %x out of file bounds", header->mapOff);
+		return -1;
+	}
+
+	for(i = 0; i < list->size; ++i, ++item){
+		k = kind_index(item->type);
+		if(k == -1){
+			map_problem(map, report, "item %u: unknown type %04x", i, item->type);
+			continue;
+		}
+		kind = &kinds[k];
+		if(seen & (1u << k)){
+			map_problem(map, report, "item %u: %s listed twice", i, kind->name);
+			continue;
+		}
+		seen |= 1u << k;
+		off = item->offset;
+
+		if(off & (kind->align - 1))
+			map_problem(map, report, "item %u: %s at %x not %u byte aligned", i, kind->name, off, kind->align);
+		if(i != 0 && off <= prev_off)
+			map_problem(map, report, "item %u: %s at %x not after the previous section at %x", i, kind->name, off, prev_off);
+		else if(off < min_end)
+			map_problem(map, report, "item %u: %s at %x overlaps the previous section, which needs up to %llx",
+							i, kind->name, off, min_end);
+
+		// the least this section can take: exact for the id tables
+		if(item->type == kDexTypeMapList)
+			end = (unsigned long long)off + sizeof(u4) + (unsigned long long)item->size * sizeof(DexMapItem);
+		else
+			end = (unsigned long long)off + (unsigned long long)item->size * kind->min_size;
+		if(end > file_size)
+			map_problem(map, report, "item %u: %s %x + %u items past fileSize %x", i, kind->name, off, item->size, file_size);
+		if(item->type >= kDexTypeMapList && (off < header->dataOff || end > data_end))
+			map_problem(map, report, "item %u: %s at %x outside data %x - %llx", i, kind->name, off, header->dataOff, data_end);
+
+		if(header_section(header, item->type, &off, &size) && (off != item->offset || size != item->size))
+			map_problem(map, report, "item %u: %s %x, %u items does not match the header's %x, %u items",
+							i, kind->name, item->offset, item->size, off, size);
+		if(item->type == kDexTypeMapList && (item->offset != header->mapOff || item->size != 1))
+			map_problem(map, report, "item %u: map_list %x, %u items does not match mapOff %x",
+							i, item->offset, item->size, header->mapOff);
+
+		section = &map->sections[map->cnt++];
+		section->type = item->type;
+		section->cnt = item->size;
+		section->off = item->offset;
+		prev_off = item->offset;
+		min_end = end;
+	}
+
+	// the id tables the header names have to be listed, and the list itself.
+	for(k = 0; k < DEX_MAP_KINDS; ++k){
+		if((seen & (1u << k)) || !header_section(header, kinds[k].type, &off, &size) || size == 0)
+			continue;
+		map_problem(map, report, "%s (%u items at %x) missing from the map", kinds[k].name, size, off);
+	}
+	if(!(seen & (1u << kind_index(kDexTypeMapList))))
+		map_problem(map, report, "map_list missing from the map");
+
+	// a section runs up to the next one; the last to the end of data.
+	for(i = 0; i < map->cnt; ++i){
+		section = &map->sections[i];
+		if(i + 1 < map->cnt)
+			end = map->sections[i + 1].off;
+		else
+			end = section->off < data_end && data_end <= file_size ? data_end : file_size;
+		section->len = end > section->off ? (u4)(end - section->off) : 0;
+	}
+	return map->valid ? 0 : -1;
+}
+
+/*
+ * the section of type, NULL if there is none or the map did not check out.
+ */
+const DexSection *dex_map_find(const DexMap *map, u2 type)
+{
+	u4 i;
+
+	if(map == NULL || !map->valid)
+		return NULL;
+	for(i = 0; i < map->cnt; ++i){
+		if(map->sections[i].type == type)
+			return &map->sections[i];
+	}
+	return NULL;
+}
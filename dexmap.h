@@ -0,0 +1,39 @@
+#ifndef __DEXMAP_H__
+#define __DEXMAP_H__
+
+#include "dex.h"
+#include "deximage.h"
+#include "strbuf.h"
+
+/*
+ * The map_list decoded into a directory of sections, in file order. Each
+ * section knows its item count and the bytes it spans, up to the next
+ * section (or the end of the data area), so a pass over all string data,
+ * class data or code items can walk and prefetch one contiguous range
+ * instead of chasing offsets.
+ *
+ * dex_map_parse() checks the list in one pass: every type known and
+ * listed once, offsets ascending and aligned, fixed size sections not
+ * running into the next one, the id sections matching the header, data
+ * sections inside dataOff/dataSize and everything inside fileSize.
+ */
+#define DEX_MAP_KINDS		18			/* known kDexType* values */
+
+typedef struct {
+	u2	type;					/* kDexType* */
+	u4	cnt;					/* items, as listed */
+	u4	off;
+	u4	len;					/* bytes up to the next section */
+} DexSection;
+
+typedef struct {
+	DexSection	sections[DEX_MAP_KINDS];
+	u4			cnt;
+	int			valid;			/* the list passed every check */
+} DexMap;
+
+extern int dex_map_parse(DexMap *map, const DexImage *image, StrBuf *report);
+extern const DexSection *dex_map_find(const DexMap *map, u2 type);
+extern const char *dex_map_type_name(u2 type);
+
+#endif	/* __DEXMAP_H__ */
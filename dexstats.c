@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "dexstats.h"
+
+int dex_stats_on = 0;
+u8 dex_stats_counters[DEX_STATS];
+
+typedef struct {
+	u8	calls;
+	u8	wall_ns;			/* whole ns, so threads can add them up atomically */
+	u8	cpu_ns;
+} PhaseTotals;
+
+static PhaseTotals phase_stats[DEX_PHASES];
+static struct timespec started;
+
+static const char *const phase_names[DEX_PHASES] = {
+	"open", "verify", "inflate", "class_index", "index_cache", "xref", "hierarchy",
+	"grep", "diff", "annotations", "lines", "header", "map_list", "strings", "methods", "classes", "json", "flush",
+};
+
+static const char *const counter_names[DEX_STATS] = {
+	"files", "mapped_bytes", "read_calls", "read_bytes", "inflated_bytes", "image_accesses",
+	"write_calls", "write_bytes", "mallocs", "malloc_bytes", "arena_bytes", "string_hits", "string_misses",
+	"name_hits", "name_misses", "class_lookups", "class_probes", "index_cache_hits", "index_cache_misses",
+};
+
+static double elapsed(const struct timespec *from, const struct timespec *to)
+{
+	return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+void dex_stats_enable(int on)
+{
+#ifndef READEX_NO_STATS
+	if(on && !dex_stats_on)
+		clock_gettime(CLOCK_MONOTONIC, &started);
+	__atomic_store_n(&dex_stats_on, on != 0, __ATOMIC_RELAXED);
+#endif
+}
+
+/*
+ * zero everything; not meant to race with threads still counting.
+ */
+void dex_stats_reset(void)
+{
+	memset(dex_stats_counters, 0, sizeof(dex_stats_counters));
+	memset(phase_stats, 0, sizeof(phase_stats));
+	clock_gettime(CLOCK_MONOTONIC, &started);
+}
+
+void dex_stats_begin(DexStatsTimer *timer)
+{
+	if(!DEX_STATS_ON){
+		timer->wall.tv_sec = 0;
+		return ;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &timer->wall);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &timer->cpu);
+}
+
+/*
+ * add the time since dex_stats_begin(timer) to phase. A timer begun while
+ * stats were off is dropped.
+ */
+void dex_stats_end(DexStatsTimer *timer, int phase)
+{
+	PhaseTotals *stats = &phase_stats[phase];
+	struct timespec wall, cpu;
+
+	if(!DEX_STATS_ON || timer->wall.tv_sec == 0)
+		return ;
+	clock_gettime(CLOCK_MONOTONIC, &wall);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+	__atomic_fetch_add(&stats->calls, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->wall_ns, (u8)(elapsed(&timer->wall, &wall) * 1e9), __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->cpu_ns, (u8)(elapsed(&timer->cpu, &cpu) * 1e9), __ATOMIC_RELAXED);
+}
+
+void dex_stats_snapshot(DexStats *stats)
+{
+	struct rusage usage;
+	struct timespec now;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	for(i = 0; i < DEX_PHASES; ++i){
+		stats->phases[i].calls = __atomic_load_n(&phase_stats[i].calls, __ATOMIC_RELAXED);
+		stats->phases[i].wall = __atomic_load_n(&phase_stats[i].wall_ns, __ATOMIC_RELAXED) / 1e9;
+		stats->phases[i].cpu = __atomic_load_n(&phase_stats[i].cpu_ns, __ATOMIC_RELAXED) / 1e9;
+	}
+	for(i = 0; i < DEX_STATS; ++i)
+		stats->counters[i] = __atomic_load_n(&dex_stats_counters[i], __ATOMIC_RELAXED);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	stats->wall = started.tv_sec ? elapsed(&started, &now) : 0;
+	if(getrusage(RUSAGE_SELF, &usage) == 0){
+		stats->cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+		stats->peak_rss_kb = usage.ru_maxrss;
+		stats->minor_faults = usage.ru_minflt;
+		stats->major_faults = usage.ru_majflt;
+	}
+}
+
+static void format_rate(StrBuf *out, const char *name, u8 hits, u8 misses)
+{
+	if(hits + misses == 0)
+		return ;
+	strbuf_printf(out, " %-20s %12llu %6.1f%% hits\n", name, (unsigned long long)(hits + misses), hits * 100.0 / (hits + misses));
+}
+
+/*
+ * the stats as text: phases that ran, non zero counters, hit rates.
+ */
+int dex_stats_format(StrBuf *out, const DexStats *stats)
+{
+	const u8 *c = stats->counters;
+	int i;
+
+	strbuf_puts(out, "readex stats:\n");
+	strbuf_printf(out, " %-20s %12s %12s %12s\n", "phase", "calls", "wall ms", "cpu ms");
+	for(i = 0; i < DEX_PHASES; ++i){
+		if(stats->phases[i].calls == 0)
+			continue;
+		strbuf_printf(out, " %-20s %12llu %12.3f %12.3f\n", phase_names[i], (unsigned long long)stats->phases[i].calls,
+						stats->phases[i].wall * 1000.0, stats->phases[i].cpu * 1000.0);
+	}
+	strbuf_printf(out, " %-20s %12s %12.3f %12.3f\n", "total", "", stats->wall * 1000.0, stats->cpu * 1000.0);
+
+	strbuf_printf(out, " %-20s %12s\n", "counter", "value");
+	for(i = 0; i < DEX_STATS; ++i){
+		if(c[i] != 0)
+			strbuf_printf(out, " %-20s %12llu\n", counter_names[i], (unsigned long long)c[i]);
+	}
+	format_rate(out, "string lookups", c[DEX_STAT_STRING_HITS], c[DEX_STAT_STRING_MISSES]);
+	format_rate(out, "name lookups", c[DEX_STAT_NAME_HITS], c[DEX_STAT_NAME_MISSES]);
+	format_rate(out, "index cache", c[DEX_STAT_INDEX_CACHE_HITS], c[DEX_STAT_INDEX_CACHE_MISSES]);
+	if(c[DEX_STAT_CLASS_LOOKUPS] != 0)
+		strbuf_printf(out, " %-20s %12llu %6.2f probes each\n", "class lookups", (unsigned long long)c[DEX_STAT_CLASS_LOOKUPS],
+						(double)c[DEX_STAT_CLASS_PROBES] / c[DEX_STAT_CLASS_LOOKUPS]);
+	strbuf_printf(out, " %-20s %12ld kB\n", "peak rss", stats->peak_rss_kb);
+	return strbuf_printf(out, " %-20s %12ld minor, %ld major\n", "page faults", stats->minor_faults, stats->major_faults);
+}
+
+const char *dex_stats_phase_name(int phase)
+{
+	return phase >= 0 && phase < DEX_PHASES ? phase_names[phase] : NULL;
+}
+
+const char *dex_stats_counter_name(int counter)
+{
+	return counter >= 0 && counter < DEX_STATS ? counter_names[counter] : NULL;
+}
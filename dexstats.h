@@ -0,0 +1,134 @@
+#ifndef __DEXSTATS_H__
+#define __DEXSTATS_H__
+
+#include <time.h>
+#include <stdlib.h>
+#include "dextypes.h"
+#include "strbuf.h"
+
+/*
+ * Process wide run statistics: wall and cpu time per phase, counters for
+ * file access, allocations and the lookup tables, and peak RSS.
+ *
+ * Everything is off until dex_stats_enable(1). While off, a counter update
+ * or a phase timer is one predictable branch on dex_stats_on, and built
+ * with -DREADEX_NO_STATS the updates are compiled out altogether. While on,
+ * counters are bumped with relaxed atomics so any thread may update them;
+ * phase times are summed over the threads that ran the phase, the cpu time
+ * being each thread's own.
+ *
+ * Allocations are counted where the library makes them: its modules call
+ * dex_malloc(), dex_calloc() and dex_realloc() instead of the libc ones.
+ * Allocations made inside libc and zlib are not counted.
+ */
+enum {
+	DEX_PHASE_OPEN,				/* dex_container_open(), verify and inflate included */
+	DEX_PHASE_VERIFY,
+	DEX_PHASE_INFLATE,
+	DEX_PHASE_CLASS_INDEX,
+	DEX_PHASE_INDEX_CACHE,		/* loading or writing an index cache file */
+	DEX_PHASE_XREF,				/* building the cross reference index */
+	DEX_PHASE_HIERARCHY,		/* building the class hierarchy */
+	DEX_PHASE_GREP,				/* searching the string pool */
+	DEX_PHASE_DIFF,				/* joining two containers' tables */
+	DEX_PHASE_ANNOTATIONS,		/* building the annotation index */
+	DEX_PHASE_LINES,			/* building line indexes */
+	DEX_PHASE_HEADER,			/* readex output phases */
+	DEX_PHASE_MAP,
+	DEX_PHASE_STRINGS,
+	DEX_PHASE_METHODS,
+	DEX_PHASE_CLASSES,
+	DEX_PHASE_JSON,
+	DEX_PHASE_FLUSH,			/* buffered output handed to write/writev */
+	DEX_PHASES
+};
+
+enum {
+	DEX_STAT_FILES,				/* images opened from a file or fd */
+	DEX_STAT_MAPPED_BYTES,
+	DEX_STAT_READ_CALLS,		/* read(2), for what cannot be mapped */
+	DEX_STAT_READ_BYTES,
+	DEX_STAT_INFLATED_BYTES,
+	DEX_STAT_IMAGE_ACCESSES,	/* bounds checked dex_image_ptr() calls */
+	DEX_STAT_WRITE_CALLS,
+	DEX_STAT_WRITE_BYTES,
+	DEX_STAT_MALLOCS,			/* malloc, calloc and realloc calls */
+	DEX_STAT_MALLOC_BYTES,
+	DEX_STAT_ARENA_BYTES,		/* chunks malloc'ed by arenas */
+	DEX_STAT_STRING_HITS,		/* string lookups answered without decoding */
+	DEX_STAT_STRING_MISSES,
+	DEX_STAT_NAME_HITS,			/* type and proto names already rendered */
+	DEX_STAT_NAME_MISSES,
+	DEX_STAT_CLASS_LOOKUPS,
+	DEX_STAT_CLASS_PROBES,		/* slots visited by the lookups */
+	DEX_STAT_INDEX_CACHE_HITS,
+	DEX_STAT_INDEX_CACHE_MISSES,
+	DEX_STATS
+};
+
+typedef struct {
+	u8		calls;
+	double	wall;				/* seconds */
+	double	cpu;
+} DexPhaseStats;
+
+typedef struct {
+	DexPhaseStats	phases[DEX_PHASES];
+	u8				counters[DEX_STATS];
+	double			wall;		/* since dex_stats_enable() */
+	double			cpu;		/* of the whole process */
+	long			peak_rss_kb;
+	long			minor_faults;
+	long			major_faults;
+} DexStats;
+
+typedef struct {
+	struct timespec	wall;
+	struct timespec	cpu;
+} DexStatsTimer;
+
+extern int dex_stats_on;
+extern u8 dex_stats_counters[DEX_STATS];
+
+#ifdef READEX_NO_STATS
+#define DEX_STAT_ADD(counter, n)	((void)0)
+#define DEX_STATS_ON				0
+#else
+#define DEX_STATS_ON				__builtin_expect(dex_stats_on, 0)
+#define DEX_STAT_ADD(counter, n)	do{ \
+		if(DEX_STATS_ON) \
+			__atomic_fetch_add(&dex_stats_counters[counter], (u8)(n), __ATOMIC_RELAXED); \
+	}while(0)
+#endif
+
+static inline void *dex_malloc(size_t size)
+{
+	DEX_STAT_ADD(DEX_STAT_MALLOCS, 1);
+	DEX_STAT_ADD(DEX_STAT_MALLOC_BYTES, size);
+	return malloc(size);
+}
+
+static inline void *dex_calloc(size_t nmemb, size_t size)
+{
+	DEX_STAT_ADD(DEX_STAT_MALLOCS, 1);
+	DEX_STAT_ADD(DEX_STAT_MALLOC_BYTES, nmemb * size);
+	return calloc(nmemb, size);
+}
+
+static inline void *dex_realloc(void *ptr, size_t size)
+{
+	DEX_STAT_ADD(DEX_STAT_MALLOCS, 1);
+	DEX_STAT_ADD(DEX_STAT_MALLOC_BYTES, size);
+	return realloc(ptr, size);
+}
+
+extern void dex_stats_enable(int on);
+extern void dex_stats_reset(void);
+extern void dex_stats_begin(DexStatsTimer *timer);
+extern void dex_stats_end(DexStatsTimer *timer, int phase);
+extern void dex_stats_snapshot(DexStats *stats);
+extern int dex_stats_format(StrBuf *out, const DexStats *stats);
+extern const char *dex_stats_phase_name(int phase);
+extern const char *dex_stats_counter_name(int counter);
+
+#endif	/* __DEXSTATS_H__ */
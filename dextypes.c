@@ -1,69 +1,37 @@
-#include <stdio.h>
-#include <stdlib.h>
 #include "dextypes.h"
-#include "utils.h"
 
 /* 
  *The codes in this file are all taken from dalvik's libdex/Leb128.h
  */
 
-int readUnsignedLeb128(FILE *file, u4 *offset)
+int readUnsignedLeb128(const u1 **pStream)
 {
+	const u1 *ptr = *pStream;
+	int result = *(ptr++);
 
-	u1 uleb;
-    int result;
-	if(fseek(file, *offset, SEEK_SET)){
-		fprintf(stderr, "readUnsignedLeb128 - fseek %u failure.\n", *offset);
-		exit(EXIT_FAILURE);
-	}	
-
-	if(get_data(&uleb, *offset, 1, 1, file) == NULL){
-		fprintf(stderr, "readUnsignedLeb128 - get_data uleb failure.\n");
-		exit(EXIT_FAILURE);
-	}
-
-	++(*offset);
-	result = uleb;
-
-    if (result > 0x7f) {
-		if(get_data(&uleb, *offset, 1, 1, file) == NULL){
-			fprintf(stderr, "readUnsignedLeb128 - get_data uleb failure.\n");
-			exit(EXIT_FAILURE);
-		}
-		++(*offset);
-        result = (result & 0x7f) | ((uleb & 0x7f) << 7);
-        if (uleb > 0x7f) {
-			if(get_data(&uleb, *offset, 1, 1, file) == NULL){
-				fprintf(stderr, "readUnsignedLeb128 - get_data uleb failure.\n");
-				exit(EXIT_FAILURE);
-			}
-			++(*offset);
-            result |= (uleb & 0x7f) << 14;
-            if (uleb > 0x7f) {
-				if(get_data(&uleb, *offset, 1, 1, file) == NULL){
-					fprintf(stderr, "readUnsignedLeb128 - get_data uleb failure.\n");
-					exit(EXIT_FAILURE);
+	if(result > 0x7f){
+		int cur = *(ptr++);
+		result = (result & 0x7f) | ((cur & 0x7f) << 7);
+		if(cur > 0x7f){
+			cur = *(ptr++);
+			result |= (cur & 0x7f) << 14;
+			if(cur > 0x7f){
+				cur = *(ptr++);
+				result |= (cur & 0x7f) << 21;
+				if(cur > 0x7f){
+					/*
+					 * Note: We don't check to see if cur is out of
+					 * range here, meaning we tolerate garbage in the
+					 * high four-order bits.
+					 */
+					cur = *(ptr++);
+					result |= cur << 28;
 				}
-				++(*offset);
-                result |= (uleb & 0x7f) << 21;
-                if (uleb > 0x7f) {
-                    /*
-                     * Note: We don't check to see if cur is out of
-                     * range here, meaning we tolerate garbage in the
-                     * high four-order bits.
-                     */
-					if(get_data(&uleb, *offset, 1, 1, file) == NULL){
-						fprintf(stderr, "readUnsignedLeb128 - get_data uleb failure.\n");
-						exit(EXIT_FAILURE);
-					}
-					++(*offset);
-                    result |= uleb << 28;
-                }
-            }
-        }
-    }
-
-    return result;
+			}
+		}
+	}
+	*pStream = ptr;
+	return result;
 }
 
 int readSignedLeb128(const u1 **pStream)
@@ -96,4 +64,169 @@ int readSignedLeb128(const u1 **pStream)
 	}
 	*pStream = ptr;
 	return result;
-}
\ No newline at end of file
+}
+/*
+ * Checked versions of the above, decoding stops at limit. On a truncated
+ * or over-long (more than five bytes) varint *okay is set to 0 and the
+ * stream is left untouched, otherwise *okay is set to 1.
+ */
+int readAndVerifyUnsignedLeb128(const u1 **pStream, const u1 *limit, int *okay)
+{
+	const u1 *ptr = *pStream;
+	u4 result = 0;
+	int shift;
+	int cur;
+
+	for(shift = 0; shift < 35; shift += 7){
+		if(ptr >= limit){
+			*okay = 0;
+			return 0;
+		}
+		cur = *(ptr++);
+		result |= (u4)(cur & 0x7f) << shift;
+		if(cur <= 0x7f){
+			*pStream = ptr;
+			*okay = 1;
+			return (int)result;
+		}
+	}
+
+	*okay = 0;
+	return 0;
+}
+
+int readAndVerifySignedLeb128(const u1 **pStream, const u1 *limit, int *okay)
+{
+	const u1 *ptr = *pStream;
+	u4 result = 0;
+	int shift;
+	int cur;
+
+	for(shift = 0; shift < 35; shift += 7){
+		if(ptr >= limit){
+			*okay = 0;
+			return 0;
+		}
+		cur = *(ptr++);
+		result |= (u4)(cur & 0x7f) << shift;
+		if(cur <= 0x7f){
+			shift += 7;
+			// sign extend from the last bit decoded
+			if(shift < 32 && (cur & 0x40))
+				result |= ~0U << shift;
+			*pStream = ptr;
+			*okay = 1;
+			return (int)result;
+		}
+	}
+
+	*okay = 0;
+	return 0;
+}
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+/*
+ * Decode as many consecutive 1 or 2 byte varints as fit into the 16 bytes
+ * at ptr, into values[]. The continuation bits of the whole window are
+ * gathered with one movemask, so the per-value work has no data dependent
+ * branch. Returns the number of values decoded and advances *pStream past
+ * them; stops early at the first varint longer than two bytes.
+ */
+static int decode_short_leb128_x16(const u1 **pStream, u4 *values, int max)
+{
+	const u1 *ptr = *pStream;
+	u4 cont = (u4)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ptr));
+	int pos = 0;
+	int n = 0;
+	int len;
+
+	// the second byte of a varint must still be inside the window.
+	while(n < max && pos < 15){
+		len = __builtin_ctz(~(cont >> pos)) + 1;
+		if(len > 2)
+			break;
+		values[n++] = (ptr[pos] & 0x7f) | (((ptr[pos+1] & 0x7f) << 7) & -(u4)(len == 2));
+		pos += len;
+	}
+
+	*pStream = ptr + pos;
+	return n;
+}
+#endif
+
+static int read_encoded_member(const u1 **pStream, const u1 *limit, EncodedMember *member,
+								u4 *running, int has_code)
+{
+	int okay;
+
+	*running += readAndVerifyUnsignedLeb128(pStream, limit, &okay);
+	if(!okay)
+		return -1;
+	member->idx = *running;
+	member->access_flags = readAndVerifyUnsignedLeb128(pStream, limit, &okay);
+	if(!okay)
+		return -1;
+	member->code_off = 0;
+	if(has_code){
+		member->code_off = readAndVerifyUnsignedLeb128(pStream, limit, &okay);
+		if(!okay)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Bulk decode count encoded_field (has_code == 0) or encoded_method
+ * (has_code != 0) entries. *idx carries the running field/method index
+ * across calls, so a list can be decoded in several chunks. Returns count,
+ * or -1 if the data is truncated or malformed, in which case neither
+ * *pStream nor *idx are updated.
+ */
+int readEncodedMembers(const u1 **pStream, const u1 *limit, EncodedMember *members,
+						u4 count, u4 *idx, int has_code)
+{
+	const u1 *ptr = *pStream;
+	const u4 width = has_code ? 3 : 2;
+	u4 running = *idx;
+	u4 i = 0;
+#if defined(__SSE2__)
+	const u1 *start;
+	u4 values[16];
+	u4 n, j, whole;
+#endif
+
+	while(i < count){
+#if defined(__SSE2__)
+		// fast path: whole entries of short varints while 16 bytes are readable.
+		if(limit - ptr >= 16){
+			start = ptr;
+			n = decode_short_leb128_x16(&ptr, values, (count - i) < 16 / width ? (count - i) * width : 16);
+			whole = n / width;
+			if(whole * width != n){
+				// rewind over a trailing partial entry, it is decoded next round.
+				ptr = start;
+				for(j = 0; j < whole * width; ++j)
+					ptr += (*ptr & 0x80) ? 2 : 1;
+			}
+			for(j = 0; j < whole; ++j, ++i){
+				running += values[j * width];
+				members[i].idx = running;
+				members[i].access_flags = values[j * width + 1];
+				members[i].code_off = has_code ? values[j * width + 2] : 0;
+			}
+			if(whole != 0)
+				continue;
+		}
+#endif
+		// slow path: one entry with long (or near the end) varints.
+		if(read_encoded_member(&ptr, limit, &members[i], &running, has_code) == -1)
+			return -1;
+		++i;
+	}
+
+	*pStream = ptr;
+	*idx = running;
+	return count;
+}
@@ -7,12 +7,30 @@ typedef uint8_t		u1;
 typedef uint16_t 	u2;
 typedef	uint32_t	u4;
 typedef uint64_t	u8;
+typedef int8_t		s1;
+typedef int16_t		s2;
+typedef int32_t		s4;
+typedef int64_t		s8;
 
-extern int readUnsignedLeb128(FILE *file, u4 *offset);
+/*
+ * one decoded encoded_field / encoded_method entry of a class_data_item,
+ * idx is already the absolute field/method index (diffs accumulated).
+ */
+typedef struct {
+	u4 idx;
+	u4 access_flags;
+	u4 code_off;		// always 0 for fields
+} EncodedMember;
+
+extern int readUnsignedLeb128(const u1 **pStream);
 extern int readSignedLeb128(const u1 **pStream);
+extern int readAndVerifyUnsignedLeb128(const u1 **pStream, const u1 *limit, int *okay);
+extern int readAndVerifySignedLeb128(const u1 **pStream, const u1 *limit, int *okay);
+extern int readEncodedMembers(const u1 **pStream, const u1 *limit, EncodedMember *members,
+								u4 count, u4 *idx, int has_code);
 
 #define	sleb128(s)		readSignedLeb128(s)
 #define uleb128(s)		readUnsignedLeb128(s)
-#define uleb128p1(s)	(readUnsignedLeb128(s) + 1)
+#define uleb128p1(s)	(readUnsignedLeb128(s) - 1)
 
-#endif	/* __DEXTYPES_H__ */
\ No newline at end of file
+#endif	/* __DEXTYPES_H__ */
@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dexxref.h"
+#include "dexstats.h"
+#include "threadpool.h"
+
+#define XREF_CHUNK		64				// classes per pool job
+
+static const char *const kind_names[DEX_REF_KINDS] = {
+	"string", "type", "field", "method",
+};
+
+/*
+ * one reference found while scanning, before it is sorted into the index.
+ */
+typedef struct {
+	u4	target;
+	u4	method;
+	u4	pc;
+	u4	kind;
+} XrefEdge;
+
+/*
+ * the references found in one job's classes, in class order.
+ */
+typedef struct {
+	XrefEdge	*edges;
+	size_t		cnt;
+	size_t		cap;
+	u4			method;			/* the method being scanned */
+	u4			methods;
+	u4			bad;
+	int			failed;			/* out of memory */
+} XrefChunk;
+
+typedef struct {
+	DexContext	*ctx;
+	XrefChunk	*chunks;
+} XrefJob;
+
+u4 dex_ref_count(DexContext *ctx, int kind)
+{
+	switch(kind){
+		case DEX_REF_STRING:
+			return ctx->header->stringIdsSize;
+		case DEX_REF_TYPE:
+			return ctx->header->typeIdsSize;
+		case DEX_REF_FIELD:
+			return ctx->header->fieldIdsSize;
+		case DEX_REF_METHOD:
+			return ctx->header->methodIdsSize;
+	}
+	return 0;
+}
+
+const char *dex_ref_kind_name(int kind)
+{
+	return kind >= 0 && kind < DEX_REF_KINDS ? kind_names[kind] : NULL;
+}
+
+static void add_edge(int kind, u4 idx, u4 pc, void *arg)
+{
+	XrefChunk *chunk = (XrefChunk *)arg;
+	XrefEdge *edges;
+	size_t cap;
+
+	if(chunk->cnt == chunk->cap){
+		cap = chunk->cap ? chunk->cap * 2 : 1024;
+		edges = (XrefEdge *)dex_realloc(chunk->edges, cap * sizeof(XrefEdge));
+		if(edges == NULL){
+			chunk->failed = 1;
+			return ;
+		}
+		chunk->edges = edges;
+		chunk->cap = cap;
+	}
+	chunk->edges[chunk->cnt].target = idx;
+	chunk->edges[chunk->cnt].method = chunk->method;
+	chunk->edges[chunk->cnt].pc = pc;
+	chunk->edges[chunk->cnt].kind = kind;
+	++chunk->cnt;
+}
+
+static int scan_method(DexContext *ctx, u4 class_idx, const EncodedMember *method, void *arg)
+{
+	XrefChunk *chunk = (XrefChunk *)arg;
+
+	if(method->code_off == 0)
+		return 0;
+	chunk->method = method->idx;
+	++chunk->methods;
+	// a bad method keeps what was found up to the bad instruction.
+	if(dex_code_refs(ctx, method->code_off, add_edge, chunk) == -1)
+		++chunk->bad;
+	return 0;
+}
+
+/*
+ * pool job: the references of classes job * XREF_CHUNK and on.
+ */
+static void scan_chunk(size_t job, int worker, void *arg)
+{
+	XrefJob *xj = (XrefJob *)arg;
+	XrefChunk *chunk = &xj->chunks[job];
+	u4 first = job * XREF_CHUNK;
+	u4 last = first + XREF_CHUNK;
+	u4 i;
+
+	if(last > xj->ctx->header->classDefsSize)
+		last = xj->ctx->header->classDefsSize;
+	for(i = first; i < last; ++i){
+		if(dex_class_methods(xj->ctx, i, scan_method, chunk) == -1)
+			++chunk->bad;
+	}
+}
+
+/*
+ * counting sort of every chunk's edges of kind into xref's rows for it.
+ */
+static int build_rows(DexContext *ctx, DexXref *xref, int kind, const XrefChunk *chunks, size_t cnt)
+{
+	const XrefEdge *edge, *end;
+	u4 *offsets;
+	DexXrefSite *sites;
+	u4 size = xref->size[kind];
+	u4 total = 0, i;
+	size_t j;
+
+	offsets = (u4 *)arena_calloc(&ctx->arena, (size_t)size + 1, sizeof(u4));
+	if(offsets == NULL)
+		return -1;
+	for(j = 0; j < cnt; ++j){
+		for(edge = chunks[j].edges, end = edge + chunks[j].cnt; edge < end; ++edge){
+			if(edge->kind == (u4)kind && edge->target < size)
+				++offsets[edge->target + 1];
+		}
+	}
+	for(i = 0; i < size; ++i){
+		offsets[i + 1] += offsets[i];
+		total = offsets[i + 1];
+	}
+
+	sites = (DexXrefSite *)arena_alloc(&ctx->arena, (size_t)(total ? total : 1) * sizeof(DexXrefSite));
+	if(sites == NULL)
+		return -1;
+	// offsets[t] walks up to the start of row t + 1, then they shift back.
+	for(j = 0; j < cnt; ++j){
+		for(edge = chunks[j].edges, end = edge + chunks[j].cnt; edge < end; ++edge){
+			if(edge->kind != (u4)kind || edge->target >= size)
+				continue;
+			sites[offsets[edge->target]].method_idx = edge->method;
+			sites[offsets[edge->target]].pc = edge->pc;
+			++offsets[edge->target];
+		}
+	}
+	for(i = size; i > 0; --i)
+		offsets[i] = offsets[i - 1];
+	offsets[0] = 0;
+
+	xref->offsets[kind] = offsets;
+	xref->sites[kind] = sites;
+	return 0;
+}
+
+/*
+ * the cross reference index of ctx, built on first use with up to threads
+ * threads. Like dex_find_class(), call it before sharing the context.
+ * Returns NULL when out of memory.
+ */
+DexXref *dex_xref_build(DexContext *ctx, int threads)
+{
+	DexStatsTimer timer;
+	DexXref *xref;
+	XrefChunk *chunks;
+	XrefJob xj;
+	size_t cnt, j;
+	int kind, ret = 0;
+
+	if(ctx->xref != NULL)
+		return ctx->xref;
+
+	dex_stats_begin(&timer);
+	cnt = ((size_t)ctx->header->classDefsSize + XREF_CHUNK - 1) / XREF_CHUNK;
+	xref = (DexXref *)arena_calloc(&ctx->arena, 1, sizeof(DexXref));
+	chunks = (XrefChunk *)dex_calloc(cnt ? cnt : 1, sizeof(XrefChunk));
+	if(xref == NULL || chunks == NULL){
+		fprintf(stderr, "dex_xref_build - out of memory.\n");
+		free(chunks);
+		return NULL;
+	}
+
+	xj.ctx = ctx;
+	xj.chunks = chunks;
+	pool_run(threads, cnt, scan_chunk, &xj);
+
+	for(kind = 0; kind < DEX_REF_KINDS; ++kind)
+		xref->size[kind] = dex_ref_count(ctx, kind);
+	for(j = 0; j < cnt; ++j){
+		xref->methods += chunks[j].methods;
+		xref->bad += chunks[j].bad;
+		if(chunks[j].failed)
+			ret = -1;
+	}
+	for(kind = 0; ret == 0 && kind < DEX_REF_KINDS; ++kind)
+		ret = build_rows(ctx, xref, kind, chunks, cnt);
+
+	for(j = 0; j < cnt; ++j)
+		free(chunks[j].edges);
+	free(chunks);
+	dex_stats_end(&timer, DEX_PHASE_XREF);
+	if(ret == -1){
+		fprintf(stderr, "dex_xref_build - out of memory.\n");
+		return NULL;
+	}
+	ctx->xref = xref;
+	return xref;
+}
+
+/*
+ * the sites referring to id idx of kind, *cnt of them.
+ */
+const DexXrefSite *dex_xref_sites(const DexXref *xref, int kind, u4 idx, u4 *cnt)
+{
+	if(kind < 0 || kind >= DEX_REF_KINDS || idx >= xref->size[kind]){
+		*cnt = 0;
+		return NULL;
+	}
+	*cnt = xref->offsets[kind][idx + 1] - xref->offsets[kind][idx];
+	return xref->sites[kind] + xref->offsets[kind][idx];
+}
+
+/*
+ * spec->cls from a descriptor or a java class name.
+ */
+static int set_class(DexRefSpec *spec, const char *cls)
+{
+	size_t len = strlen(cls);
+	int n;
+
+	// arrays and primitives are only taken as descriptors.
+	if(cls[0] == '[' || (len == 1 && strchr("VZBSCIJFD", cls[0]) != NULL)){
+		memcpy(spec->cls, cls, len + 1);
+		spec->cls_len = len;
+		return 0;
+	}
+	if(len == 0 || (n = class_name_to_descriptor(cls, spec->cls, sizeof(spec->cls))) == -1)
+		return -1;
+	spec->cls_len = n;
+	return 0;
+}
+
+/*
+ * parse text naming an id of kind, see DexRefSpec. Returns -1 if it is
+ * not a valid name for that kind.
+ */
+int dex_ref_spec_parse(DexRefSpec *spec, int kind, const char *text)
+{
+	char *member, *sep;
+
+	spec->kind = kind;
+	spec->text = text;
+	spec->cls[0] = '\0';
+	spec->cls_len = 0;
+	spec->name = NULL;
+	spec->name_len = 0;
+	spec->sig = NULL;
+	if(kind == DEX_REF_STRING){
+		spec->name = text;
+		spec->name_len = strlen(text);
+		return 0;
+	}
+	if(strlen(text) >= sizeof(spec->copy))
+		return -1;
+	strcpy(spec->copy, text);
+	if(kind == DEX_REF_TYPE)
+		return set_class(spec, spec->copy);
+	if(kind != DEX_REF_FIELD && kind != DEX_REF_METHOD)
+		return -1;
+
+	if((sep = strstr(spec->copy, "->")) != NULL){
+		*sep = '\0';
+		member = sep + 2;
+	}else{
+		// java style, the signature (which has no dots) goes after the name
+		if((sep = strchr(spec->copy, kind == DEX_REF_METHOD ? '(' : ':')) != NULL)
+			*sep = '\0';
+		member = strrchr(spec->copy, '.');
+		if(sep != NULL)
+			*sep = kind == DEX_REF_METHOD ? '(' : ':';
+		if(member == NULL)
+			return -1;
+		*member++ = '\0';
+	}
+
+	if(kind == DEX_REF_METHOD){
+		sep = strchr(member, '(');
+		spec->name_len = sep != NULL ? (size_t)(sep - member) : strlen(member);
+		spec->sig = sep;
+	}else{
+		if((sep = strchr(member, ':')) != NULL)
+			*sep++ = '\0';
+		spec->name_len = strlen(member);
+		spec->sig = sep;
+	}
+	spec->name = member;
+	if(spec->name_len == 0)
+		return -1;
+	return set_class(spec, spec->copy);
+}
+
+static int view_is(DexContext *ctx, u4 string_idx, const char *str, size_t len)
+{
+	StrView view;
+
+	if(string_pool_view(&ctx->strings, string_idx, &view) == -1)
+		return 0;
+	return view.len == len && memcmp(view.data, str, len) == 0;
+}
+
+static int type_is(DexContext *ctx, u4 type_idx, const char *desc, size_t len)
+{
+	if(type_idx >= ctx->header->typeIdsSize)
+		return 0;
+	return view_is(ctx, ctx->type_ids[type_idx].descriptor_idx, desc, len);
+}
+
+/*
+ * whether proto_idx's descriptor is sig, "(" params ")" return.
+ */
+static int proto_is(DexContext *ctx, u4 proto_idx, const char *sig)
+{
+	const ProtoIds *proto;
+	const u4 *size;
+	const TypeListItem *items;
+	StrView view;
+	u4 i;
+
+	if(proto_idx >= ctx->header->protoIdsSize || *sig++ != '(')
+		return 0;
+	proto = &ctx->proto_ids[proto_idx];
+	if(proto->parameters_off != 0){
+		if((size = (const u4 *)dex_image_ptr_aligned(&ctx->image, proto->parameters_off, 4, sizeof(u4), 1)) == NULL)
+			return 0;
+		items = (const TypeListItem *)dex_image_ptr(&ctx->image, proto->parameters_off + sizeof(u4), sizeof(TypeListItem), *size);
+		if(items == NULL)
+			return 0;
+		for(i = 0; i < *size; ++i){
+			if(items[i].type_idx >= ctx->header->typeIdsSize
+					|| string_pool_view(&ctx->strings, ctx->type_ids[items[i].type_idx].descriptor_idx, &view) == -1
+					|| strncmp(sig, view.data, view.len) != 0)
+				return 0;
+			sig += view.len;
+		}
+	}
+	if(*sig++ != ')')
+		return 0;
+	return type_is(ctx, proto->return_type_idx, sig, strlen(sig));
+}
+
+/*
+ * whether id idx of spec's kind is the one spec names.
+ */
+int dex_ref_spec_match(DexContext *ctx, const DexRefSpec *spec, u4 idx)
+{
+	const MethodIds *method;
+	const FieldIds *field;
+
+	if(idx >= dex_ref_count(ctx, spec->kind))
+		return 0;
+	switch(spec->kind){
+		case DEX_REF_STRING:
+			return view_is(ctx, idx, spec->name, spec->name_len);
+		case DEX_REF_TYPE:
+			return type_is(ctx, idx, spec->cls, spec->cls_len);
+		case DEX_REF_FIELD:
+			field = &ctx->field_ids[idx];
+			return view_is(ctx, field->name_idx, spec->name, spec->name_len)
+					&& type_is(ctx, field->class_idx, spec->cls, spec->cls_len)
+					&& (spec->sig == NULL || type_is(ctx, field->type_idx, spec->sig, strlen(spec->sig)));
+		case DEX_REF_METHOD:
+			method = &ctx->method_ids[idx];
+			return view_is(ctx, method->name_idx, spec->name, spec->name_len)
+					&& type_is(ctx, method->class_idx, spec->cls, spec->cls_len)
+					&& (spec->sig == NULL || proto_is(ctx, method->proto_idx, spec->sig));
+	}
+	return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef __DEXXREF_H__
+#define __DEXXREF_H__
+
+#include "dexfile.h"
+
+/*
+ * Cross references: for every string, type, field and method id, the
+ * methods whose code refers to it and the pc of each referring
+ * instruction. The index is built from one pass over all code items, the
+ * classes split between threads, and kept in compressed sparse row form:
+ * the sites of id i of a kind are sites[offsets[i]] up to, not including,
+ * sites[offsets[i + 1]], in class, method and pc order. It lives in the
+ * context's arena.
+ */
+typedef struct {
+	u4	method_idx;			/* the referring method */
+	u4	pc;					/* of the instruction, in code units */
+} DexXrefSite;
+
+struct DexXref {
+	u4				*offsets[DEX_REF_KINDS];	/* size[kind] + 1 each */
+	DexXrefSite		*sites[DEX_REF_KINDS];
+	u4				size[DEX_REF_KINDS];		/* ids of each kind */
+	u4				methods;					/* method bodies scanned */
+	u4				bad;						/* bad code items or class data, skipped */
+};
+
+#define DEX_SPEC_LEN	1024
+
+/*
+ * what a query names, parsed once and matched against every id of its
+ * kind. Methods are "Lcom/foo/Bar;->baz(I)V" or "com.foo.Bar.baz", the
+ * signature being optional; fields "Lcom/foo/Bar;->count:I" or
+ * "com.foo.Bar.count", the type optional; types a descriptor or a java
+ * name; strings their exact contents.
+ */
+typedef struct {
+	int			kind;						/* DEX_REF_* */
+	const char	*text;						/* as given */
+	char		cls[DEX_SPEC_LEN];			/* class or type descriptor */
+	size_t		cls_len;
+	const char	*name;						/* member name, or the string */
+	size_t		name_len;
+	const char	*sig;						/* "(I)V" or "I", NULL matches any */
+	char		copy[DEX_SPEC_LEN];
+} DexRefSpec;
+
+extern DexXref *dex_xref_build(DexContext *ctx, int threads);
+extern const DexXrefSite *dex_xref_sites(const DexXref *xref, int kind, u4 idx, u4 *cnt);
+extern int dex_ref_spec_parse(DexRefSpec *spec, int kind, const char *text);
+extern int dex_ref_spec_match(DexContext *ctx, const DexRefSpec *spec, u4 idx);
+extern u4 dex_ref_count(DexContext *ctx, int kind);
+extern const char *dex_ref_kind_name(int kind);
+
+/* JSON record (dexjson.c) of one id and its sites */
+extern int dex_json_xref(DexContext *ctx, StrBuf *out, const char *prefix, int kind, u4 idx);
+
+#endif	/* __DEXXREF_H__ */
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "idxcache.h"
+#include "checksum.h"
+#include "dexstats.h"
+
+#define INDEX_MAGIC		"rdxidx\n2"		// the digit is the format version
+#define INDEX_PATH_LEN	4096
+
+/*
+ * file layout: the header, then each table at its offset (4 byte aligned),
+ * then the NUL terminated type names.
+ */
+typedef struct {
+	u1	magic[8];
+	u1	signature[kSHA1DigestLen];		/* of the dex file */
+	u4	checksum;
+	u4	file_size;
+	u4	string_cnt;
+	u4	type_cnt;
+	u4	class_cnt;
+	u4	slot_cnt;						/* power of 2 */
+	u4	strings_off;					/* StringEntry[string_cnt] */
+	u4	types_off;						/* IndexName[type_cnt] */
+	u4	slots_off;						/* ClassSlot[slot_cnt] */
+	u4	summaries_off;					/* DexClassSummary[class_cnt] */
+	u4	names_off;
+	u4	names_size;
+	u4	adler;							/* of everything after the header */
+} IndexHeader;
+
+typedef struct {
+	u4	off;							/* into the names, NO_INDEX for a bad type */
+	u4	len;
+} IndexName;
+
+static int index_path(char *path, size_t size, const char *dir, const DexHeader *header)
+{
+	char *p;
+	int i, n;
+
+	n = snprintf(path, size, "%s/", dir);
+	if(n < 0 || (size_t)n + kSHA1DigestLen * 2 + 16 >= size)
+		return -1;
+	p = path + n;
+	for(i = 0; i < kSHA1DigestLen; ++i)
+		p += sprintf(p, "%02x", header->signature[i]);
+	sprintf(p, "-%08x.idx", header->checksum);
+	return 0;
+}
+
+/*
+ * nmemb items of size bytes at off inside the index, or NULL.
+ */
+static const void *index_table(const DexImage *index, u4 off, size_t size, size_t nmemb)
+{
+	if(off & 3)
+		return NULL;
+	return dex_image_ptr(index, off, size, nmemb);
+}
+
+/*
+ * map the index of ctx's dex from dir and point the string pool, the name
+ * cache and the class index into it. Returns 0 on a hit, -1 if there is no
+ * usable index (nothing in ctx is changed then).
+ */
+int index_cache_load(DexContext *ctx, const char *dir)
+{
+	const DexHeader *header = ctx->header;
+	const IndexHeader *ih;
+	const StringEntry *strings;
+	const IndexName *types;
+	const ClassSlot *slots;
+	const DexClassSummary *summaries;
+	const char *names;
+	DexImage index;
+	char path[INDEX_PATH_LEN];
+	u4 i, empty = 0;
+	int fd;
+
+	if(index_path(path, sizeof(path), dir, header) == -1)
+		return -1;
+	// a missing index is the usual miss, not worth a message
+	if((fd = open(path, O_RDONLY)) == -1)
+		return -1;
+	if(dex_image_open_fd(&index, fd) == -1){
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	ih = (const IndexHeader *)dex_image_ptr(&index, 0, sizeof(IndexHeader), 1);
+	if(ih == NULL || memcmp(ih->magic, INDEX_MAGIC, sizeof(ih->magic)) != 0
+			|| memcmp(ih->signature, header->signature, kSHA1DigestLen) != 0
+			|| ih->checksum != header->checksum || ih->file_size != header->fileSize
+			|| ih->string_cnt != header->stringIdsSize || ih->type_cnt != header->typeIdsSize
+			|| ih->class_cnt != header->classDefsSize || ih->slot_cnt == 0 || (ih->slot_cnt & (ih->slot_cnt - 1))
+			|| ih->adler != adler32_update(ADLER32_INIT, index.base + sizeof(IndexHeader), index.size - sizeof(IndexHeader)))
+		goto stale;
+
+	strings = (const StringEntry *)index_table(&index, ih->strings_off, sizeof(StringEntry), ih->string_cnt);
+	types = (const IndexName *)index_table(&index, ih->types_off, sizeof(IndexName), ih->type_cnt);
+	slots = (const ClassSlot *)index_table(&index, ih->slots_off, sizeof(ClassSlot), ih->slot_cnt);
+	summaries = (const DexClassSummary *)index_table(&index, ih->summaries_off, sizeof(DexClassSummary), ih->class_cnt);
+	names = (const char *)dex_image_ptr(&index, ih->names_off, 1, ih->names_size);
+	if(strings == NULL || types == NULL || slots == NULL || summaries == NULL || names == NULL)
+		goto stale;
+
+	// a damaged index must not send lookups out of bounds or into a loop.
+	for(i = 0; i < ih->type_cnt; ++i){
+		if(types[i].off != NO_INDEX && ((unsigned long long)types[i].off + types[i].len >= ih->names_size
+											|| names[types[i].off + types[i].len] != '\0'))
+			goto stale;
+	}
+	for(i = 0; i < ih->slot_cnt; ++i){
+		if(slots[i].idx == 0)
+			++empty;
+		else if(slots[i].idx > ih->class_cnt)
+			goto stale;
+	}
+	if(empty == 0 || string_pool_preload(&ctx->strings, strings) == -1)
+		goto stale;
+
+	for(i = 0; i < ih->type_cnt; ++i){
+		if(types[i].off != NO_INDEX)
+			name_cache_preset(&ctx->names, NAME_TYPE, i, names + types[i].off, types[i].len);
+	}
+	class_index_free(&ctx->classes);
+	ctx->classes.slots = (ClassSlot *)slots;
+	ctx->classes.mask = ih->slot_cnt - 1;
+	ctx->classes.pool = &ctx->strings;
+	ctx->classes.type_ids = ctx->type_ids;
+	ctx->classes.type_ids_size = header->typeIdsSize;
+	ctx->classes.class_defs = ctx->class_defs;
+	ctx->summaries = summaries;
+	ctx->index = index;
+	return 0;
+
+stale:
+	fprintf(stderr, "index_cache_load - ignoring stale or damaged index '%s'.\n", path);
+	dex_image_close(&index);
+	return -1;
+}
+
+/*
+ * round sb up to a multiple of 4 bytes.
+ */
+static void pad4(StrBuf *sb)
+{
+	static const char zero[4] = {0, 0, 0, 0};
+
+	if(sb->len & 3)
+		strbuf_append(sb, zero, 4 - (sb->len & 3));
+}
+
+/*
+ * work out everything the index holds and write it to dir, through a
+ * temporary file renamed into place so readers never see half of it.
+ */
+int index_cache_store(DexContext *ctx, const char *dir)
+{
+	const DexHeader *header = ctx->header;
+	IndexHeader ih;
+	IndexName *types = NULL;
+	DexClassSummary summary;
+	StrView view;
+	StrBuf data, names;
+	char path[INDEX_PATH_LEN], tmp[INDEX_PATH_LEN];
+	size_t mark;
+	u4 i;
+	int fd, ret = -1;
+
+	if(index_path(path, sizeof(path), dir, header) == -1 || snprintf(tmp, sizeof(tmp), "%s/.idx-XXXXXX", dir) >= (int)sizeof(tmp)){
+		fprintf(stderr, "index_cache_store - cache directory name too long.\n");
+		return -1;
+	}
+	if(ctx->classes.slots == NULL && class_index_build(&ctx->classes, &ctx->arena, &ctx->strings, ctx->type_ids, header->typeIdsSize,
+														ctx->class_defs, header->classDefsSize) == -1){
+		fprintf(stderr, "index_cache_store - build class index failure.\n");
+		return -1;
+	}
+
+	strbuf_init(&data);
+	strbuf_init(&names);
+	types = (IndexName *)dex_malloc(sizeof(IndexName) * (header->typeIdsSize ? header->typeIdsSize : 1));
+	if(types == NULL){
+		fprintf(stderr, "index_cache_store - malloc failure out of memory.\n");
+		goto out;
+	}
+
+	memset(&ih, 0, sizeof(ih));
+	memcpy(ih.magic, INDEX_MAGIC, sizeof(ih.magic));
+	memcpy(ih.signature, header->signature, kSHA1DigestLen);
+	ih.checksum = header->checksum;
+	ih.file_size = header->fileSize;
+	ih.string_cnt = header->stringIdsSize;
+	ih.type_cnt = header->typeIdsSize;
+	ih.class_cnt = header->classDefsSize;
+	ih.slot_cnt = ctx->classes.mask + 1;
+	strbuf_append(&data, (const char *)&ih, sizeof(ih));
+
+	// resolving every string fills in the pool's entries.
+	for(i = 0; i < header->stringIdsSize; ++i)
+		string_pool_view(&ctx->strings, i, &view);
+	ih.strings_off = data.len;
+	strbuf_append(&data, (const char *)ctx->strings.entries, sizeof(StringEntry) * header->stringIdsSize);
+
+	for(i = 0; i < header->typeIdsSize; ++i){
+		mark = names.len;
+		if(dex_format_type(ctx, &names, i) == -1){
+			strbuf_truncate(&names, mark);
+			types[i].off = NO_INDEX;
+			types[i].len = 0;
+			continue;
+		}
+		types[i].off = mark;
+		types[i].len = names.len - mark;
+		strbuf_putc(&names, '\0');
+	}
+	ih.types_off = data.len;
+	strbuf_append(&data, (const char *)types, sizeof(IndexName) * header->typeIdsSize);
+
+	ih.slots_off = data.len;
+	strbuf_append(&data, (const char *)ctx->classes.slots, sizeof(ClassSlot) * ih.slot_cnt);
+
+	ih.summaries_off = data.len;
+	for(i = 0; i < header->classDefsSize; ++i){
+		if(dex_class_summary(ctx, i, &summary) == -1)
+			memset(&summary, 0, sizeof(summary));
+		strbuf_append(&data, (const char *)&summary, sizeof(summary));
+	}
+
+	ih.names_off = data.len;
+	ih.names_size = names.len;
+	strbuf_append(&data, names.data != NULL ? names.data : "", names.len);
+	pad4(&data);
+	if(data.data == NULL || data.len < sizeof(ih) + names.len){
+		fprintf(stderr, "index_cache_store - out of memory.\n");
+		goto out;
+	}
+	ih.adler = adler32_update(ADLER32_INIT, (const u1 *)data.data + sizeof(ih), data.len - sizeof(ih));
+	memcpy(data.data, &ih, sizeof(ih));
+
+	if((fd = mkstemp(tmp)) == -1){
+		fprintf(stderr, "index_cache_store - create '%s' failure: %s.\n", tmp, strerror(errno));
+		goto out;
+	}
+	// mkstemp() leaves it private, other users may share the cache.
+	fchmod(fd, 0644);
+	ret = strbuf_write(&data, fd);
+	if(close(fd) == -1)
+		ret = -1;
+	if(ret == 0 && rename(tmp, path) == -1){
+		fprintf(stderr, "index_cache_store - rename to '%s' failure: %s.\n", path, strerror(errno));
+		ret = -1;
+	}
+	if(ret == -1)
+		unlink(tmp);
+
+out:
+	free(types);
+	strbuf_free(&names);
+	strbuf_free(&data);
+	return ret;
+}
@@ -0,0 +1,20 @@
+#ifndef __IDXCACHE_H__
+#define __IDXCACHE_H__
+
+#include "dexfile.h"
+
+/*
+ * A persistent index of one dex file, in a cache directory, named after
+ * the file's sha1 signature and adler32 checksum. It holds what a run
+ * otherwise works out again every time: the resolved string_ids, the
+ * rendered type names, the class name hash table and a summary of every
+ * class. A later run maps it and points the context's tables into it.
+ *
+ * An index is only written for a file that passed verification. A file
+ * whose header matches an index skips the sha1 check but still gets its
+ * adler32 checked, so one changed in place since is not trusted.
+ */
+extern int index_cache_load(DexContext *ctx, const char *dir);
+extern int index_cache_store(DexContext *ctx, const char *dir);
+
+#endif	/* __IDXCACHE_H__ */
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json.h"
+#include "dexstats.h"
+
+// bytes copied as they are: printable ASCII but the quote and backslash.
+static const unsigned char plain[256] = {
+	[0x20 ... 0x7f] = 1,
+	['"'] = 0,
+	['\\'] = 0,
+};
+
+static int put_unit(StrBuf *out, unsigned int unit)
+{
+	static const char digits[] = "0123456789abcdef";
+	char buf[6];
+
+	buf[0] = '\\';
+	buf[1] = 'u';
+	buf[2] = digits[(unit >> 12) & 0xf];
+	buf[3] = digits[(unit >> 8) & 0xf];
+	buf[4] = digits[(unit >> 4) & 0xf];
+	buf[5] = digits[unit & 0xf];
+	return strbuf_append(out, buf, 6);
+}
+
+static int put_control(StrBuf *out, unsigned char c)
+{
+	switch(c){
+		case '"':	return strbuf_append(out, "\\\"", 2);
+		case '\\':	return strbuf_append(out, "\\\\", 2);
+		case '\n':	return strbuf_append(out, "\\n", 2);
+		case '\r':	return strbuf_append(out, "\\r", 2);
+		case '\t':	return strbuf_append(out, "\\t", 2);
+		case '\b':	return strbuf_append(out, "\\b", 2);
+		case '\f':	return strbuf_append(out, "\\f", 2);
+		default:	return put_unit(out, c);
+	}
+}
+
+/*
+ * str escaped for the inside of a JSON string, without the quotes.
+ */
+int json_put_escaped(StrBuf *out, const char *str, size_t len)
+{
+	const unsigned char *s = (const unsigned char *)str;
+	size_t i = 0, run;
+	unsigned int unit;
+	int ret = 0;
+
+	while(i < len && ret == 0){
+		for(run = i; i < len && plain[s[i]]; ++i)
+			;
+		if(i > run && strbuf_append(out, str + run, i - run) == -1)
+			return -1;
+		if(i == len)
+			break;
+
+		if(s[i] < 0x80){
+			ret = put_control(out, s[i]);
+			++i;
+		}else if((s[i] & 0xe0) == 0xc0 && i + 1 < len && (s[i + 1] & 0xc0) == 0x80){
+			unit = (s[i] & 0x1f) << 6 | (s[i + 1] & 0x3f);
+			// MUTF-8 writes NUL as C0 80
+			ret = unit < 0x80 ? put_unit(out, unit) : strbuf_append(out, str + i, 2);
+			i += 2;
+		}else if((s[i] & 0xf0) == 0xe0 && i + 2 < len && (s[i + 1] & 0xc0) == 0x80 && (s[i + 2] & 0xc0) == 0x80){
+			unit = (s[i] & 0x0f) << 12 | (s[i + 1] & 0x3f) << 6 | (s[i + 2] & 0x3f);
+			// surrogate halves are not UTF-8, JSON pairs the \u escapes up
+			if(unit < 0x800 || (unit >= 0xd800 && unit <= 0xdfff))
+				ret = put_unit(out, unit);
+			else
+				ret = strbuf_append(out, str + i, 3);
+			i += 3;
+		}else{
+			ret = put_unit(out, 0xfffd);
+			++i;
+		}
+	}
+	return ret;
+}
+
+int json_put_string(StrBuf *out, const char *str, size_t len)
+{
+	if(strbuf_putc(out, '"') == -1 || json_put_escaped(out, str, len) == -1)
+		return -1;
+	return strbuf_putc(out, '"');
+}
+
+/*
+ * escape in place what was appended to out since start. Formatted names
+ * rarely need it, so the common case is one scan and no copy.
+ */
+int json_escape_from(StrBuf *out, size_t start)
+{
+	const unsigned char *s = (const unsigned char *)out->data;
+	size_t i, len;
+	char *copy;
+	int ret;
+
+	for(i = start; i < out->len && plain[s[i]]; ++i)
+		;
+	if(i == out->len)
+		return 0;
+
+	len = out->len - i;
+	if((copy = (char *)dex_malloc(len)) == NULL){
+		fprintf(stderr, "json_escape_from - malloc failure out of memory.\n");
+		return -1;
+	}
+	memcpy(copy, out->data + i, len);
+	strbuf_truncate(out, i);
+	ret = json_put_escaped(out, copy, len);
+	free(copy);
+	return ret;
+}
+
+/*
+ * "key": for a key that needs no escaping.
+ */
+int json_put_key(StrBuf *out, const char *key)
+{
+	if(strbuf_putc(out, '"') == -1 || strbuf_puts(out, key) == -1)
+		return -1;
+	return strbuf_append(out, "\":", 2);
+}
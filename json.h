@@ -0,0 +1,19 @@
+#ifndef __JSON_H__
+#define __JSON_H__
+
+#include <stddef.h>
+#include "strbuf.h"
+
+/*
+ * JSON text helpers. Strings are taken as MUTF-8, the encoding of dex
+ * string_data: runs of plain ASCII are copied in bulk, the encoded NUL
+ * (C0 80) and the surrogate halves of supplementary characters become
+ * \u escapes, other valid sequences pass through as UTF-8 and broken
+ * bytes are replaced by U+FFFD, so the output is always valid JSON.
+ */
+extern int json_put_string(StrBuf *out, const char *str, size_t len);
+extern int json_put_escaped(StrBuf *out, const char *str, size_t len);
+extern int json_escape_from(StrBuf *out, size_t start);
+extern int json_put_key(StrBuf *out, const char *key);
+
+#endif	/* __JSON_H__ */
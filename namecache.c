@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "namecache.h"
+#include "dexstats.h"
+
+int name_cache_init(NameCache *cache, Arena *arena, u4 types, u4 protos, u4 fields, u4 methods)
+{
+	memset(cache, 0, sizeof(*cache));
+	cache->arena = arena;
+	cache->size[NAME_TYPE] = types;
+	cache->size[NAME_PROTO] = protos;
+	cache->size[NAME_FIELD] = fields;
+	cache->size[NAME_METHOD] = methods;
+	cache->entries[NAME_TYPE] = (NameEntry *)arena_calloc(arena, types, sizeof(NameEntry));
+	cache->entries[NAME_PROTO] = (NameEntry *)arena_calloc(arena, protos, sizeof(NameEntry));
+	if(cache->entries[NAME_TYPE] == NULL || cache->entries[NAME_PROTO] == NULL){
+		fprintf(stderr, "name_cache_init - out of memory.\n");
+		return -1;
+	}
+	pthread_mutex_init(&cache->lock, NULL);
+	return 0;
+}
+
+/*
+ * the memory stays with the arena.
+ */
+void name_cache_free(NameCache *cache)
+{
+	if(cache == NULL || cache->entries[NAME_TYPE] == NULL)
+		return ;
+	pthread_mutex_destroy(&cache->lock);
+	memset(cache, 0, sizeof(*cache));
+}
+
+/*
+ * the cached name of kind idx and its length, NULL if not rendered yet.
+ */
+const char *name_cache_get(NameCache *cache, int kind, u4 idx, u4 *len)
+{
+	NameEntry *table, *entry;
+	const char *str = NULL;
+
+	if(idx >= cache->size[kind])
+		return NULL;
+	if((table = __atomic_load_n(&cache->entries[kind], __ATOMIC_ACQUIRE)) != NULL){
+		entry = &table[idx];
+		if((str = __atomic_load_n(&entry->str, __ATOMIC_ACQUIRE)) != NULL)
+			*len = entry->len;
+	}
+	DEX_STAT_ADD(str != NULL ? DEX_STAT_NAME_HITS : DEX_STAT_NAME_MISSES, 1);
+	return str;
+}
+
+/*
+ * keep len bytes of str as the name of kind idx. Returns the cached copy,
+ * which is the first one stored if another thread got there before.
+ */
+const char *name_cache_put(NameCache *cache, int kind, u4 idx, const char *str, size_t len)
+{
+	NameEntry *table, *entry;
+	char *copy;
+
+	if(idx >= cache->size[kind])
+		return NULL;
+
+	pthread_mutex_lock(&cache->lock);
+	if(cache->entries[kind] == NULL){
+		if((table = (NameEntry *)arena_calloc(cache->arena, cache->size[kind], sizeof(NameEntry))) == NULL){
+			pthread_mutex_unlock(&cache->lock);
+			return NULL;
+		}
+		__atomic_store_n(&cache->entries[kind], table, __ATOMIC_RELEASE);
+	}
+	entry = &cache->entries[kind][idx];
+	if(entry->str != NULL){
+		pthread_mutex_unlock(&cache->lock);
+		return entry->str;
+	}
+	if((copy = arena_strndup(cache->arena, str, len)) == NULL){
+		pthread_mutex_unlock(&cache->lock);
+		return NULL;
+	}
+	entry->len = len;
+	__atomic_store_n(&entry->str, copy, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&cache->lock);
+	return copy;
+}
+
+/*
+ * use str, which outlives the cache and is NUL terminated, as the name of
+ * kind idx without copying it. Only while the cache is not shared yet.
+ */
+void name_cache_preset(NameCache *cache, int kind, u4 idx, const char *str, u4 len)
+{
+	if(idx >= cache->size[kind])
+		return ;
+	cache->entries[kind][idx].len = len;
+	cache->entries[kind][idx].str = str;
+}
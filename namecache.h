@@ -0,0 +1,48 @@
+#ifndef __NAMECACHE_H__
+#define __NAMECACHE_H__
+
+#include <pthread.h>
+#include "dex.h"
+#include "arena.h"
+
+/*
+ * Rendered names memoized by index: the Java style name of every type_idx
+ * ("java.lang.String[]"), the parameter list of every proto_idx
+ * ("int, java.lang.String") and the field and method references as
+ * instructions show them. The dex is only decoded the first time a name
+ * is asked for, later lookups copy the cached text. The reference tables
+ * are only allocated once the first reference is rendered, so a run that
+ * never disassembles does not pay for them.
+ *
+ * Like the string pool it lives in the arena it is given and may be
+ * shared by several threads: a name is copied into the arena under the
+ * lock and published with a release store, readers take the acquire fast
+ * path.
+ */
+enum {
+	NAME_TYPE	= 0,		/* by type_idx */
+	NAME_PROTO	= 1,		/* by proto_idx */
+	NAME_FIELD	= 2,		/* by field_idx, "class.name:type" */
+	NAME_METHOD	= 3,		/* by method_idx, "class.name(params)return" */
+	NAME_KINDS,
+};
+
+typedef struct {
+	const char	*str;		/* NULL until rendered */
+	u4			len;
+} NameEntry;
+
+typedef struct {
+	NameEntry			*entries[NAME_KINDS];	/* a reference table is NULL until used */
+	u4					size[NAME_KINDS];
+	Arena				*arena;			/* tables and every name */
+	pthread_mutex_t		lock;			/* one thread stores a name */
+} NameCache;
+
+extern int name_cache_init(NameCache *cache, Arena *arena, u4 types, u4 protos, u4 fields, u4 methods);
+extern void name_cache_free(NameCache *cache);
+extern const char *name_cache_get(NameCache *cache, int kind, u4 idx, u4 *len);
+extern const char *name_cache_put(NameCache *cache, int kind, u4 idx, const char *str, size_t len);
+extern void name_cache_preset(NameCache *cache, int kind, u4 idx, const char *str, u4 len);
+
+#endif	/* __NAMECACHE_H__ */
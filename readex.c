@@ -1,1011 +1,1607 @@
 #include <stdio.h>
-#include <sys/stat.h>
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
+#include <errno.h>
 #include <unistd.h>
-#include "dex.h"
-#include "utils.h"
+#include <pthread.h>
+#include <sys/uio.h>
+#include "dexfile.h"
+#include "dexstats.h"
+#include "dexxref.h"
+#include "dexhier.h"
+#include "dexgrep.h"
+#include "dexdiff.h"
+#include "dexanno.h"
+#include "dexdebug.h"
+#include "json.h"
+#include "threadpool.h"
 
 //#define __debug__
 
 #define PROGRAM_NAME	"readex"
 #define PROGRAM_VER		"0.01"
-#define DEX_MAGIC		"dex\n035"
 #define DEX_MAGIC_FMT	"dex\\n035\\0"
 #define BUFFLEN			1024
-#define NO_INDEX		0xFFFFFFFF
+#define CLASS_CHUNK		256
+#define OUTPUT_FLUSH	(1 << 20)		// write stdout out in chunks of about this size
+#define IOV_BATCH		64
+#define MAX_JOBS		1024			// -j beyond this is taken for a typo
+
+enum {
+	VERIFY_CHECK	= 0,		// verify the checksum, then dump
+	VERIFY_NONE		= 1,		// --no-verify
+	VERIFY_ONLY		= 2,		// --verify-only, no dump at all
+};
+
+enum {
+	OPT_NO_VERIFY	= 0x100,	// long only options
+	OPT_VERIFY_ONLY,
+	OPT_CLASS_FILE,
+	OPT_UNORDERED,
+	OPT_FILES_FROM,
+	OPT_CODE,
+	OPT_MAP,
+	OPT_FORMAT,
+	OPT_CACHE_DIR,
+	OPT_STATS,
+	OPT_XREF,
+	OPT_CALLERS,
+	OPT_ACCESSORS,
+	OPT_TYPE_REFS,
+	OPT_STRING_REFS,
+	OPT_HIERARCHY,
+	OPT_SUBCLASSES,
+	OPT_IMPLEMENTORS,
+	OPT_ANCESTORS,
+	OPT_GREP,
+	OPT_GREP_REGEX,
+	OPT_DIFF,
+	OPT_ANNOTATIONS,
+	OPT_ANNOTATED,
+	OPT_LINES,
+	OPT_FIND_LINE,
+};
 
-#define OFFSETOF(type, member)		(size_t)&(((type *)0)->member)
+enum {
+	OUTPUT_TEXT		= 0,
+	OUTPUT_JSON		= 1,		// one array of records
+	OUTPUT_NDJSON	= 2,		// one record per line
+};
+
+/*
+ * text being dumped. The dump functions append to text; when fd is not
+ * -1 the text is written to fd whenever it grows past OUTPUT_FLUSH.
+ */
+typedef struct {
+	StrBuf	text;
+	int		fd;				/* -1: a part of an OrderedOutput */
+} Output;
+
+/*
+ * output produced in parts by several threads and written in part order:
+ * a part is written as soon as every part before it is done.
+ */
+typedef struct {
+	StrBuf	text;
+	int		done;
+} OutputPart;
+
+typedef struct {
+	int				fd;
+	OutputPart		*parts;
+	size_t			cnt;
+	size_t			next;			/* first part not written out yet */
+	int				unordered;		/* write every part as soon as it is done */
+	pthread_mutex_t	lock;			/* guards done, next and fd */
+} OrderedOutput;
+
+typedef struct {
+	DexContext		*ctx;
+	u4				base;			/* number of the first class, for multidex */
+	u4				classes;
+	const char		*prefix;		/* JSON members of every record, NULL for text */
+	OrderedOutput	output;			/* one part per CLASS_CHUNK classes */
+} ClassBatch;
+
+/*
+ * a --find-line query, source:line.
+ */
+typedef struct {
+	const char	*text;
+	char		*source;
+	u4			line;
+} LineQuery;
+
+/*
+ * a --subclasses, --implementors or --ancestors query.
+ */
+typedef struct {
+	int			query;			/* DEX_HIER_* */
+	const char	*name;
+} HierQuery;
 
 static int do_dex_header = 0;
 static int do_string_ids = 0;
 static int do_method_ids = 0;
 static int do_class_defs = 0;
+static int do_code = 0;
+static int do_map = 0;
+static int output_format = OUTPUT_TEXT;
+static const char *cache_dir = NULL;
+static int do_stats = 0;
+static int do_xref = 0;
+static int do_hierarchy = 0;
+static int do_grep = 0;
+static const char *diff_old = NULL;	/* --diff: the file the others are compared to */
+static int do_annotations = 0;
+static int do_lines = 0;
 static int do_help = 0;
-
-static char *class_name = NULL;
-static DexHeader *dex_header = NULL;
-static StringIdItem *str_item = NULL;
-static TypeIdIndex *type_ids = NULL;
-static ProtoIds *proto_ids = NULL;
-static FieldIds *field_ids = NULL;
-static MethodIds *method_ids = NULL;
-static ClassDefs *class_defs = NULL;
-static char **str_ids = NULL;
-static FILE *dex = NULL;
+static int verify_mode = VERIFY_CHECK;
+static int verify_failures = 0;
+
+static char **class_names = NULL;
+static int class_names_cnt = 0;
+static DexRefSpec *xref_queries = NULL;
+static int xref_queries_cnt = 0;
+static HierQuery *hier_queries = NULL;
+static int hier_queries_cnt = 0;
+static DexGrepPattern *grep_patterns = NULL;
+static int grep_patterns_cnt = 0;
+static DexRefSpec *anno_queries = NULL;	/* --annotated types */
+static int anno_queries_cnt = 0;
+static LineQuery *line_queries = NULL;
+static int line_queries_cnt = 0;
+static char **files = NULL;
+static size_t files_cnt = 0;
+static int jobs = 1;
+static int class_jobs = 1;			/* threads for the work inside one file */
+static int unordered_output = 0;
+static OrderedOutput file_output;
 
 static int access_flags_mask = ACC_PUBLIC | ACC_PRIVATE | ACC_PROTECTED | ACC_STATIC | ACC_FINAL 
 								| ACC_SYNCHRONIZED | ACC_SUPER | ACC_VOLATILE | ACC_BRIDGE | ACC_TRANSIENT
 								| ACC_VARARGS | ACC_NATIVE | ACC_INTERFACE | ACC_ABSTRACT | ACC_STRICT
 								| ACC_SYNTHETIC | ACC_ANNOTATION | ACC_ENUM | ACC_CONSTRUCTOR | ACC_DECLARED_SYNCHRONIZED;
 
-static AccessFlags afs[] = {
-	{ACC_PUBLIC, CLASS|FIELD|METHOD, "public"},
-	{ACC_PRIVATE, FIELD|METHOD, "private"},
-	{ACC_PROTECTED, FIELD|METHOD, "protected"},
-	{ACC_STATIC, FIELD|METHOD, "static"},
-	{ACC_FINAL, CLASS|FIELD|METHOD, "final"},
-	{ACC_SYNCHRONIZED, METHOD, "synchronized"},
-	{ACC_SUPER, CLASS, "super"},
-	{ACC_VOLATILE, FIELD, "volatile"},
-	{ACC_BRIDGE, METHOD, "bridge"},
-	{ACC_TRANSIENT, FIELD, "transient"},
-	{ACC_VARARGS, METHOD, "varargs"},
-	{ACC_NATIVE, METHOD, "native"},
-	{ACC_INTERFACE, CLASS, "interface"},
-	{ACC_ABSTRACT, CLASS|METHOD, "abstract"},
-	{ACC_STRICT, METHOD, "strict"},
-	{ACC_SYNTHETIC, FIELD|METHOD, "synthetic"},
-	{ACC_ANNOTATION, CLASS, "annotation"},
-	{ACC_ENUM, CLASS|FIELD, "enum"},
-	{ACC_CONSTRUCTOR, METHOD, "constructor"},
-	{ACC_DECLARED_SYNCHRONIZED, METHOD, "declared synchronized"},
-	{0, 0, 0},
-};
-
-static void usage(void);
-static void print_header_info(DexHeader *dex_header);
-static int check_sha1(void);
-static void process_dex_header(void);
-static char *process_string_items(u4 offset);
-static void free_str_ids(void);
-static void process_string_ids(void);
-static void process_type_ids(void);
-static int process_type(char *buffer, size_t len, u4 idx);
-static int process_method_paras(char *buffer, size_t len, int offset);
-static char *process_method_item(MethodIds *method, int has_class_name);
-static void process_proto_ids(void);
-static char *process_field_item(u4 idx, int has_class_name);
-static void process_field_ids(void);
-static void process_method_ids(int has_class_name);
-static char *_get_class_name(u4 idx);
-static char *get_class_name(ClassDefs *class);
-static char *_get_access_flags(int flags, int type);
-static char *get_access_flags(ClassDefs *class, int type);
-static char *get_super_name(ClassDefs *class);
-static char *get_interfaces(ClassDefs *class);
-static char *process_source_idx(ClassDefs *class);
-static char *process_annotation(ClassDefs *class);
-static char *process_class_data(ClassDefs *class);
-static void process_class_items(ClassDefs *class);
-static void process_class_type(void);
-static void parse_args(int argc, char **argv);
-static void process_file(const char *file);
-
-static void usage(void)
+static void usage(StrBuf *out);
+static void output_check(Output *out);
+static void print_header_info(Output *out, const DexHeader *dex_header);
+static void print_dex_name(Output *out, const char *file, DexContext *ctx);
+static void print_file_name(Output *out, const char *file);
+static void process_string_ids(Output *out, DexContext *ctx);
+static int process_map_list(Output *out, DexContext *ctx);
+static void process_method_ids(Output *out, DexContainer *dc);
+static void finish_item(StrBuf *sb, size_t mark, size_t label_len, int ret);
+static void process_class_items(Output *out, DexContext *ctx, const ClassDefs *class);
+static int write_parts(int fd, OutputPart *parts, size_t cnt);
+static int ordered_init(OrderedOutput *output, int fd, size_t cnt, int unordered);
+static void ordered_free(OrderedOutput *output);
+static void ordered_done(OrderedOutput *output, size_t part);
+static void process_class_chunk(size_t job, int worker, void *arg);
+static int process_class_parallel(Output *out, DexContext *ctx, u4 base, int threads, const char *prefix);
+static void process_class_type(Output *out, DexContainer *dc);
+static size_t record_begin(StrBuf *sb);
+static void record_end(StrBuf *sb, size_t mark, int ret);
+static void record_prefix(StrBuf *prefix, const char *file, DexContext *ctx);
+static int process_json(Output *out, const char *file, DexContainer *dc);
+static int process_verify(Output *out, const char *file);
+static void print_xref_summary(Output *out, DexContext *ctx);
+static void print_xref_sites(Output *out, DexContext *ctx, int kind, u4 idx);
+static int process_xref(Output *out, const char *file, DexContainer *dc);
+static void add_xref_query(int kind, const char *text);
+static void print_hier_node(Output *out, const DexHierarchy *hier, u4 node);
+static void print_hier_summary(Output *out, const DexHierarchy *hier);
+static int process_hierarchy(Output *out, const char *file, DexContainer *dc);
+static void add_hier_query(int query, const char *name);
+static int process_grep(Output *out, const char *file, DexContainer *dc);
+static void add_grep_pattern(const char *text, int regex);
+static void print_diff_summary(Output *out, const DexDiff *diff);
+static int process_diff(Output *out, const char *file);
+static int class_format_flags(void);
+static void print_annotated(Output *out, DexContext *ctx, u4 type_idx);
+static int process_annotated(Output *out, const char *file, DexContainer *dc);
+static void add_anno_query(const char *text);
+static int process_find_line(Output *out, const char *file, DexContainer *dc);
+static void add_line_query(const char *text);
+static void add_class_names(const char *names);
+static void load_class_names(const char *file);
+static void add_file(const char *file);
+static void load_file_list(const char *list);
+static int parse_jobs(const char *text);
+static void parse_args(int argc, char **argv, Output *out);
+static int process_file(Output *out, const char *file);
+static void process_batch_file(size_t job, int worker, void *arg);
+static void process_files(Output *out);
+
+static void usage(StrBuf *out)
 {
-	puts(" Usage: readex -[mCHhs] [-c class_name] dex_file_name");
-	puts(" \t-m, --method                                show all methods' information in dex file.");
-	puts(" \t-C, --Class                                 show all classes' information in dex file.");
-	puts(" \t-c [class name], --class [class name]       show specific class's information in dex file.");
-	puts(" \t-H, --header                                show header information in dex file.");
-	puts(" \t-s, --strings                               show all strings in dex file.");
-	puts(" \t-h, --help                                  show this message.");
+	strbuf_puts(out, " Usage: readex -[mCHhs] [-j N] [-c class_name[,class_name...]] dex_file_name...\n");
+	strbuf_puts(out, " \t-m, --method                                show all methods' information in dex file.\n");
+	strbuf_puts(out, " \t-C, --Class                                 show all classes' information in dex file.\n");
+	strbuf_puts(out, " \t-c [class name], --class [class name]       show specific class's information in dex file.\n");
+	strbuf_puts(out, " \t                                            may be repeated or take a comma separated list.\n");
+	strbuf_puts(out, " \t--class-file [file]                         show the classes named in file, one per line.\n");
+	strbuf_puts(out, " \t--code                                      with the classes, disassemble every method body.\n");
+	strbuf_puts(out, " \t--annotations                               with the classes, show their annotations and the values\n");
+	strbuf_puts(out, " \t                                            of their static fields.\n");
+	strbuf_puts(out, " \t--lines                                     with the classes, show the line table and the local\n");
+	strbuf_puts(out, " \t                                            variables of every method.\n");
+	strbuf_puts(out, " \t-H, --header                                show header information in dex file.\n");
+	strbuf_puts(out, " \t-s, --strings                               show all strings in dex file.\n");
+	strbuf_puts(out, " \t--map                                       show the map_list sections and check them.\n");
+	strbuf_puts(out, " \t--format=text|json|ndjson                   output as text, as a JSON array of records, or as one\n");
+	strbuf_puts(out, " \t                                            JSON record per line.\n");
+	strbuf_puts(out, " \t--cache-dir [dir]                           keep an index of every dex file in dir and reuse it.\n");
+	strbuf_puts(out, " \t--xref                                      index every method, field, type and string reference\n");
+	strbuf_puts(out, " \t                                            in the code and print how many there are.\n");
+	strbuf_puts(out, " \t--callers [method]                          show the methods calling method, as Lcom/foo/Bar;->baz\n");
+	strbuf_puts(out, " \t                                            or com.foo.Bar.baz, optionally with its (I)V signature.\n");
+	strbuf_puts(out, " \t--accessors [field]                         show the methods reading or writing field (Lcom/foo/Bar;->x:I).\n");
+	strbuf_puts(out, " \t--type-refs [type]                          show the methods referring to type.\n");
+	strbuf_puts(out, " \t--string-refs [string]                      show the methods loading string.\n");
+	strbuf_puts(out, " \t--hierarchy                                 show every class with its direct supertypes, supertypes\n");
+	strbuf_puts(out, " \t                                            first, over all dex files of an apk.\n");
+	strbuf_puts(out, " \t--subclasses [class]                        show the classes extending class, directly or not.\n");
+	strbuf_puts(out, " \t--implementors [interface]                  show the classes implementing interface, directly or not.\n");
+	strbuf_puts(out, " \t--ancestors [class]                         show the superclasses and interfaces of class, nearest first.\n");
+	strbuf_puts(out, " \t--grep [pattern]                            show the strings containing pattern; ^pattern, pattern$\n");
+	strbuf_puts(out, " \t                                            and ^pattern$ anchor it. with --xref, also their users.\n");
+	strbuf_puts(out, " \t--grep-regex [regex]                        show the strings matching the extended regular expression.\n");
+	strbuf_puts(out, " \t--diff [old_file] file...                   show the classes, methods and fields added, removed or\n");
+	strbuf_puts(out, " \t                                            changed from old_file to each file.\n");
+	strbuf_puts(out, " \t--annotated [type]                          show the classes, fields, methods and parameters annotated\n");
+	strbuf_puts(out, " \t                                            with type, as @com.foo.Keep or Lcom/foo/Keep;.\n");
+	strbuf_puts(out, " \t--find-line [source:line]                   show the methods line of source file is in, as Main.java:42.\n");
+	strbuf_puts(out, " \t--stats                                     at exit, print time per phase, i/o, allocation and\n");
+	strbuf_puts(out, " \t                                            lookup counters and peak memory to stderr.\n");
+	strbuf_puts(out, " \t-h, --help                                  show this message.\n");
+	strbuf_puts(out, " \t--no-verify                                 skip the checksum and signature verification.\n");
+	strbuf_puts(out, " \t--verify-only                               only verify the checksum and signature of every file.\n");
+	strbuf_puts(out, " \t-j N, --jobs N                              use N threads: one file each, or the classes of a\n");
+	strbuf_puts(out, " \t                                            single file; 0 means one per cpu.\n");
+	strbuf_puts(out, " \t--unordered                                 with -j, print each file as soon as it is done.\n");
+	strbuf_puts(out, " \t--files-from [file]                         also process the paths listed in file ('-' for stdin),\n");
+	strbuf_puts(out, " \t                                            one per line or NUL separated (find -print0).\n");
 }
 
-static int check_sha1(void)
+static void output_check(Output *out)
 {
-	return 0;
-}
-
-static void process_dex_header(void)
-{	
-	uint32_t adler;
-
-	fseek(dex, OFFSETOF(DexHeader, signature), SEEK_SET);
-
-	if(adler32(dex, &adler) != 0){
-		fprintf(stderr, "process_dex_header - get adler32 checksum failure.\n");
-		exit(EXIT_FAILURE);
-	}
-
-	if(check_sha1()){
-		// check sha1 checksum
-	}
-
-	dex_header = (DexHeader *)get_data(NULL, 0, sizeof(DexHeader), 1, dex);
-
-	if(dex_header == NULL){
-		fprintf(stderr, "process_dex_header - get dex header failure.\n");
-		exit(EXIT_FAILURE);
-	}
-
-
-	if(dex_header->checksum != adler){
-		fprintf(stderr, "process_dex_header - adler32 checksum check failure.\n");
-		exit(EXIT_FAILURE);
-	}
-
-	if(strncmp((const char *)(dex_header->magic), DEX_MAGIC, sizeof(DEX_MAGIC)) != 0){
-		fprintf(stderr, "process_dex_header - wrong magic bytes not a dex file\n");
-		exit(EXIT_FAILURE);
-	}
-
-	// print the header info
-	if(do_dex_header)
-		print_header_info(dex_header);
+	if(out->fd != -1 && out->text.len >= OUTPUT_FLUSH)
+		strbuf_write(&out->text, out->fd);
 }
 
-static void print_header_info(DexHeader *dex_header)
+static void print_header_info(Output *output, const DexHeader *dex_header)
 {	
+	StrBuf *out = &output->text;
 	int i;
 	if(dex_header == NULL)
 		return ;
-	puts("Dex Header:");
-	printf(" Magic: ");
+	strbuf_puts(out, "Dex Header:\n");
+	strbuf_printf(out, " Magic: ");
 	for(i = 0; i < sizeof(dex_header->magic); ++i){
-		printf("%2.2x ", dex_header->magic[i]);
+		strbuf_printf(out, "%2.2x ", dex_header->magic[i]);
 	}
-	printf("   (%s)\n", DEX_MAGIC_FMT);
-	printf(" Checksum:                       %08X\n", dex_header->checksum);
-	printf(" Signature:                      ");
+	strbuf_printf(out, "   (%s)\n", DEX_MAGIC_FMT);
+	strbuf_printf(out, " Checksum:                       %08X\n", dex_header->checksum);
+	strbuf_printf(out, " Signature:                      ");
 	for(i = 0; i < kSHA1DigestLen; ++i)
-		printf("%02X", dex_header->signature[i]);
-	printf("\n");
-	printf(" File Size:                 %8X(%d) bytes\n", dex_header->fileSize, dex_header->fileSize);
-	printf(" Header Size:              %8X(%d) bytes\n", dex_header->headerSize, dex_header->headerSize);
+		strbuf_printf(out, "%02X", dex_header->signature[i]);
+	strbuf_printf(out, "\n");
+	strbuf_printf(out, " File Size:                 %8X(%d) bytes\n", dex_header->fileSize, dex_header->fileSize);
+	strbuf_printf(out, " Header Size:              %8X(%d) bytes\n", dex_header->headerSize, dex_header->headerSize);
 	// endian prompt string
-	printf(" Endian Tag:                     %s", dex_header->endianTag == 0x12345678 ? "little endian" : 
+	strbuf_printf(out, " Endian Tag:                     %s", dex_header->endianTag == 0x12345678 ? "little endian" : 
 					 					    dex_header->endianTag == 0x87654321 ? "big endian" :
 										    "unknown endian(invalid endian tag)");
-	printf("(%8X)\n", dex_header->endianTag);
-	printf(" LinkSize:                %8X(%d)\n", dex_header->linkSize, dex_header->linkSize);
-	printf(" Link Offset:             %8X(%d)\n", dex_header->linkOff, dex_header->linkOff);
-	printf(" Map Offset:                %8X(%d)\n", dex_header->mapOff, dex_header->mapOff);
-	printf(" String ID Size:          %8X(%d)\n", dex_header->stringIdsSize, dex_header->stringIdsSize);
-	printf(" String ID Offset:         %8X(%d)\n", dex_header->stringIdsOff, dex_header->stringIdsOff);
-	printf(" Type ID Size:            %8X(%d)\n", dex_header->typeIdsSize, dex_header->typeIdsSize);
-	printf(" Type ID Offset:           %8X(%d)\n", dex_header->typeIdsOff, dex_header->typeIdsOff);
-	printf(" Method Proto Size:       %8X(%d)\n", dex_header->protoIdsSize, dex_header->protoIdsSize);
-	printf(" Method Proto Offset:      %8X(%d)\n", dex_header->protoIdsOff, dex_header->protoIdsOff);
-	printf(" Field ID Size:           %8X(%d)\n", dex_header->fieldIdsSize, dex_header->fieldIdsSize);
-	printf(" Field ID Offset:          %8X(%d)\n", dex_header->fieldIdsOff, dex_header->fieldIdsOff);
-	printf(" Method ID Size:          %8X(%d)\n", dex_header->methodIdsSize, dex_header->methodIdsSize);
-	printf(" Method ID Offset:         %8X(%d)\n", dex_header->methodIdsOff, dex_header->methodIdsOff);
-	printf(" Class Define Size:       %8X(%d)\n", dex_header->classDefsSize, dex_header->classDefsSize);
-	printf(" Class Define Offset:       %8X(%d)\n", dex_header->classDefsOff, dex_header->classDefsOff);
-	printf(" Data Size:                 %8X(%d)\n", dex_header->dataSize, dex_header->dataSize);
-	printf(" Data Offset:               %8X(%d)\n", dex_header->dataOff, dex_header->dataOff);
+	strbuf_printf(out, "(%8X)\n", dex_header->endianTag);
+	strbuf_printf(out, " LinkSize:                %8X(%d)\n", dex_header->linkSize, dex_header->linkSize);
+	strbuf_printf(out, " Link Offset:             %8X(%d)\n", dex_header->linkOff, dex_header->linkOff);
+	strbuf_printf(out, " Map Offset:                %8X(%d)\n", dex_header->mapOff, dex_header->mapOff);
+	strbuf_printf(out, " String ID Size:          %8X(%d)\n", dex_header->stringIdsSize, dex_header->stringIdsSize);
+	strbuf_printf(out, " String ID Offset:         %8X(%d)\n", dex_header->stringIdsOff, dex_header->stringIdsOff);
+	strbuf_printf(out, " Type ID Size:            %8X(%d)\n", dex_header->typeIdsSize, dex_header->typeIdsSize);
+	strbuf_printf(out, " Type ID Offset:           %8X(%d)\n", dex_header->typeIdsOff, dex_header->typeIdsOff);
+	strbuf_printf(out, " Method Proto Size:       %8X(%d)\n", dex_header->protoIdsSize, dex_header->protoIdsSize);
+	strbuf_printf(out, " Method Proto Offset:      %8X(%d)\n", dex_header->protoIdsOff, dex_header->protoIdsOff);
+	strbuf_printf(out, " Field ID Size:           %8X(%d)\n", dex_header->fieldIdsSize, dex_header->fieldIdsSize);
+	strbuf_printf(out, " Field ID Offset:          %8X(%d)\n", dex_header->fieldIdsOff, dex_header->fieldIdsOff);
+	strbuf_printf(out, " Method ID Size:          %8X(%d)\n", dex_header->methodIdsSize, dex_header->methodIdsSize);
+	strbuf_printf(out, " Method ID Offset:         %8X(%d)\n", dex_header->methodIdsOff, dex_header->methodIdsOff);
+	strbuf_printf(out, " Class Define Size:       %8X(%d)\n", dex_header->classDefsSize, dex_header->classDefsSize);
+	strbuf_printf(out, " Class Define Offset:       %8X(%d)\n", dex_header->classDefsOff, dex_header->classDefsOff);
+	strbuf_printf(out, " Data Size:                 %8X(%d)\n", dex_header->dataSize, dex_header->dataSize);
+	strbuf_printf(out, " Data Offset:               %8X(%d)\n", dex_header->dataOff, dex_header->dataOff);
 }
 
-static char *process_string_items(u4 offset)
+/*
+ * the name of a dex inside an apk, before its per-dex tables.
+ */
+static void print_dex_name(Output *out, const char *file, DexContext *ctx)
 {
-	char *buffer, *buffer_back;
-	int i, j;
-	int str_len;
-	int newline = 0;
-
-	if(dex_header == NULL)
-		process_dex_header();
+	if(ctx->entry != NULL)
+		strbuf_printf(&out->text, "Dex File: %s!%s\n", file, ctx->entry);
+}
 
-	str_len = readUnsignedLeb128(dex, &offset);
+/*
+ * the name of an input before its dump, when there is more than one, so
+ * that the dumps can be told apart with or without -j.
+ */
+static void print_file_name(Output *out, const char *file)
+{
+	if(files_cnt > 1)
+		strbuf_printf(&out->text, "File: %s\n", file);
+}
 
-	if(str_len < 0){
-		fprintf(stderr, "process_string_items - invalid string length at %x.\n", offset);
-		return NULL;
-	}
+static void process_string_ids(Output *out, DexContext *ctx)
+{
+	StrBuf *sb = &out->text;
+	u4 i;
+	const char *str;
 
-	// apply 2 times of char space for transforming \n to \\n
-	buffer = (char *)malloc(sizeof(char) * (str_len * 2));
-	if(buffer == NULL){
-		fprintf(stderr, "process_string_items - malloc failure out of memory.\n");
-		return NULL;
+	dex_prefetch_section(ctx, kDexTypeStringDataItem);
+	strbuf_puts(sb, "Strings:\n");
+	for(i = 0; i < ctx->header->stringIdsSize; ++i){
+		str = dex_string(ctx, i);
+		strbuf_printf(sb, " %2d(%8X):       \"%s\"\n", i, ctx->string_ids[i].string_data_off, str == NULL ? "null" : str);
+		output_check(out);
 	}
+}
 
-	if(get_data(buffer, offset, str_len, 1, dex) == NULL){
-		fprintf(stderr, "process_string_items - get string failure.\n");
-		return NULL;
-	}
+/*
+ * the map_list as a section table, then what is wrong with it if anything.
+ */
+static int process_map_list(Output *out, DexContext *ctx)
+{
+	StrBuf *sb = &out->text;
+	StrBuf report;
+	DexMap map;
+	const DexSection *section;
+	const char *line, *next;
+	int ret;
+	u4 i;
 
-	buffer[str_len] = '\0';
+	strbuf_init(&report);
+	ret = dex_map_parse(&map, &ctx->image, &report);
 
-	for(i = 0; i < str_len; ++i){
-		if(buffer[i] == '\n'){
-			newline = 1;
-		}
+	strbuf_printf(sb, "Map List: %u sections at %X\n", map.cnt, ctx->header->mapOff);
+	strbuf_puts(sb, "   offset    items      bytes  type\n");
+	for(i = 0; i < map.cnt; ++i){
+		section = &map.sections[i];
+		strbuf_printf(sb, " %8X %8u %10u  %s\n", section->off, section->cnt, section->len, dex_map_type_name(section->type));
 	}
-
-	if(newline){
-		buffer_back = (char *)malloc(sizeof(char) * str_len * 2);
-		if(buffer_back == NULL){
-			fprintf(stderr, "process_string_items - malloc failure out of memory.\n");
-			free(buffer);
-			return NULL;
-		}
-		for(j = 0, i = 0; i < str_len; ++i, ++j){
-			// just handle the newline character.
-			// skip other invisible character
-			if(buffer[i] == '\n'){
-				buffer_back[j++] = '\\';
-				buffer_back[j] = 'n';
-			}else{
-				buffer_back[j] = buffer[i];
-			}
+	if(ret == 0){
+		strbuf_puts(sb, " map_list: OK\n");
+	}else{
+		strbuf_puts(sb, " map_list: FAILED\n");
+		// one problem per line
+		for(line = report.data; line != NULL && (next = strchr(line, '\n')) != NULL; line = next + 1){
+			strbuf_puts(sb, "  ");
+			strbuf_append(sb, line, next - line + 1);
 		}
-		memcpy(buffer, buffer_back, j);
-		buffer[j] = '\0';
-		free(buffer_back);
 	}
-
-	return buffer;
+	strbuf_free(&report);
+	return ret;
 }
 
-static void free_str_ids(void)
+static void process_method_ids(Output *out, DexContainer *dc)
 {
-	int i;
-	if(str_ids != NULL){
-		if(dex_header == NULL)
-			process_dex_header();
-
-		for(i = 0; i < dex_header->stringIdsSize; ++i){
-			free(str_ids[i]);
+	StrBuf *sb = &out->text;
+	DexContext *ctx;
+	size_t mark;
+	u4 i, j;
+
+	strbuf_puts(sb, "Methods:\n");
+	for(j = 0; j < dc->cnt; ++j){
+		ctx = dc->dexes[j];
+		for(i = 0; i < ctx->header->methodIdsSize; ++i){
+			mark = sb->len;
+			if(dex_format_method(ctx, sb, i, 1) == -1)
+				strbuf_truncate(sb, mark);
+			output_check(out);
 		}
-		free(str_ids);
 	}
 }
 
-static void process_string_ids(void)
+/*
+ * end a " label: value" line started at mark. the line is dropped again
+ * when formatting the value failed or produced nothing.
+ */
+static void finish_item(StrBuf *sb, size_t mark, size_t label_len, int ret)
 {
-	int i;
-	if(dex_header == NULL){
-		process_dex_header();
-	}
+	if(ret == -1 || sb->len == mark + label_len)
+		strbuf_truncate(sb, mark);
+	else
+		strbuf_putc(sb, '\n');
+}
 
-	if(str_ids != NULL){
-		free_str_ids();
-	}
+static void process_class_items(Output *out, DexContext *ctx, const ClassDefs *class)
+{
+	StrBuf *sb = &out->text;
+	const char *src;
+	size_t mark;
 
-	str_ids = (char **)malloc(sizeof(char *) * dex_header->stringIdsSize);
-	if(str_ids == NULL){
-		fprintf(stderr, "process_string_ids - malloc failure out of memory.\n");
-		exit(EXIT_FAILURE);
+	mark = sb->len;
+	strbuf_puts(sb, " name: ");
+	finish_item(sb, mark, 7, dex_format_type(ctx, sb, class->class_idx));
+
+	if((class->access_flags & access_flags_mask) != 0){
+		mark = sb->len;
+		strbuf_puts(sb, " flag: ");
+		finish_item(sb, mark, 7, dex_format_access_flags(sb, class->access_flags, CLASS));
 	}
 
-	if(str_item == NULL){
-		str_item = (StringIdItem *)get_data(NULL, dex_header->stringIdsOff, sizeof(StringIdItem), dex_header->stringIdsSize, dex);
-		if(str_item == NULL){
-			fprintf(stderr, "process_string_ids - get string ids data failure.\n");
-			exit(EXIT_FAILURE);
-		}
+	if(class->superclass_idx != 0){
+		mark = sb->len;
+		strbuf_puts(sb, " super: ");
+		finish_item(sb, mark, 8, dex_format_type(ctx, sb, class->superclass_idx));
 	}
 
-	for(i = 0; i < dex_header->stringIdsSize; ++i)
-		str_ids[i] = process_string_items(str_item[i].string_data_off);
+	mark = sb->len;
+	strbuf_puts(sb, " interface: ");
+	finish_item(sb, mark, 12, dex_format_interfaces(ctx, sb, class));
 
-	if(do_string_ids){
-		puts("Strings:");
-		for(i = 0; i < dex_header->stringIdsSize; ++i){
-			printf(" %2d(%8X):       \"%s\"\n", i, str_item[i].string_data_off, str_ids[i] == NULL ? "null" : str_ids[i]);
-		}
-	}
-}
+	src = dex_class_source(ctx, class);
+	if(src != NULL)
+		strbuf_printf(sb, " source: %s\n", src);
 
-static void process_type_ids(void)
-{
-	if(dex_header == NULL){
-		process_dex_header();
+	// decoded only when asked for, a block dropped again if it is bad.
+	if(do_annotations && class->annotations_off != 0){
+		mark = sb->len;
+		strbuf_puts(sb, " annotations:\n");
+		if(dex_format_annotations(ctx, sb, class - ctx->class_defs) == -1)
+			strbuf_truncate(sb, mark);
 	}
-
-	if(type_ids == NULL){
-		type_ids = (TypeIdIndex *)get_data(NULL, dex_header->typeIdsOff, sizeof(TypeIdIndex), dex_header->typeIdsSize, dex);
-		if(type_ids == NULL){
-			fprintf(stderr, "process_type_ids - get type index items failure.\n");
-			return ;
-		}
+	if(do_annotations && class->static_value_off != 0){
+		mark = sb->len;
+		strbuf_puts(sb, " static values:\n");
+		if(dex_format_static_values(ctx, sb, class - ctx->class_defs) == -1)
+			strbuf_truncate(sb, mark);
 	}
-#if 0
-	if(do_type_ids){
-		if(str_ids == NULL){
-			process_string_ids(dex);
-		}
-		puts("Type Index:");
-		for(i = 0; i < dex_header->typeIdsSize; ++i){
-			printf(" %2d(idx: %4d)        %s\n", i, type_ids[i].descriptor_idx, str_ids[type_ids[i].descriptor_idx]);
-		}
+
+	if(class->class_data_off == 0){
+		strbuf_printf(sb, "class_data_off = %d\n", class->class_data_off);
+		return ;
 	}
-#endif
 
+	// a bad member still prints what was formatted before it.
+	strbuf_puts(sb, " class data: \n");
+	dex_format_class_data(ctx, sb, class, class_format_flags());
 }
 
-static const char *trans_dex_type_name(char sht)
+/*
+ * write cnt parts to fd with as few writev calls as possible.
+ */
+static int write_parts(int fd, OutputPart *parts, size_t cnt)
 {
-	switch(sht){
-		case 'V':
-			return "void";
-			break;
-		case 'Z':
-			return "boolean";
-			break;
-		case 'B':
-			return "byte";
-			break;
-		case 'S':
-			return "short";
-			break;
-		case 'C':
-			return "char";
-			break;
-		case 'I':
-			return "int";
-			break;
-		case 'J':
-			return "long";		// 64bits
-			break;
-		case 'F':
-			return "float";
-			break;
-		case 'D':
-			return "double";	// 64bits
-			break;
-		default:
-			// array
-			// objects
-			// bad characters
-			return NULL;
-			break;
+	struct iovec iov[IOV_BATCH];
+	DexStatsTimer timer;
+	size_t i, j, n;
+	ssize_t written;
+
+	if(cnt == 0)
+		return 0;
+	dex_stats_begin(&timer);
+	for(i = 0; i < cnt; i += n){
+		n = cnt - i < IOV_BATCH ? cnt - i : IOV_BATCH;
+		for(j = 0; j < n; ++j){
+			iov[j].iov_base = parts[i + j].text.data;
+			iov[j].iov_len = parts[i + j].text.len;
+		}
+		// writev may stop early, go on from where it stopped.
+		for(j = 0; j < n; ){
+			written = writev(fd, iov + j, n - j);
+			DEX_STAT_ADD(DEX_STAT_WRITE_CALLS, 1);
+			if(written == -1){
+				if(errno == EINTR)
+					continue;
+				perror("write_parts - writev");
+				dex_stats_end(&timer, DEX_PHASE_FLUSH);
+				return -1;
+			}
+			DEX_STAT_ADD(DEX_STAT_WRITE_BYTES, written);
+			for(; j < n && (size_t)written >= iov[j].iov_len; ++j)
+				written -= iov[j].iov_len;
+			if(j < n){
+				iov[j].iov_base = (char *)iov[j].iov_base + written;
+				iov[j].iov_len -= written;
+			}
+		}
 	}
+	dex_stats_end(&timer, DEX_PHASE_FLUSH);
+	return 0;
 }
 
-static int check_return_idx(MethodIds *method)
+static int ordered_init(OrderedOutput *output, int fd, size_t cnt, int unordered)
 {
-	int idx;	
-	if(method == NULL)
-		return -1;
-
-	if(dex_header == NULL)
-		process_dex_header();
-	if(proto_ids == NULL)
-		process_proto_ids();
-	if(type_ids == NULL)
-		process_type_ids();
-
-	idx = method->proto_idx;
-	if(idx > dex_header->protoIdsSize){
+	output->parts = (OutputPart *)dex_calloc(cnt ? cnt : 1, sizeof(OutputPart));
+	if(output->parts == NULL){
+		fprintf(stderr, "ordered_init - calloc failure out of memory.\n");
 		return -1;
 	}
-
-	idx = proto_ids[idx].return_type_idx;
-	if(idx > dex_header->typeIdsSize){
-		return -1;
-	}
-
-	idx = type_ids[idx].descriptor_idx;
-	if(idx > dex_header->stringIdsSize){
-		return -1;
-	}
-
-	return idx;
+	output->fd = fd;
+	output->cnt = cnt;
+	output->next = 0;
+	output->unordered = unordered;
+	pthread_mutex_init(&output->lock, NULL);
+	return 0;
 }
 
-static int process_type(char *buffer, size_t len, u4 idx)
+static void ordered_free(OrderedOutput *output)
 {
-	// idx is string ids index which contains type strings.
-	const char *type;
-	int i;
-	int cnt = 0;
-	int str_idx = 0;
-	int array_depth = 0;
-
+	size_t i;
 
-	if(str_ids == NULL)
-		process_string_ids();
-
-	if(str_ids[idx][str_idx] == '['){
-		// array
-		do{
-			++array_depth;
-		}while(str_ids[idx][++str_idx] == '[');
-	}
+	for(i = 0; i < output->cnt; ++i)
+		strbuf_free(&output->parts[i].text);
+	free(output->parts);
+	pthread_mutex_destroy(&output->lock);
+}
 
-	if(str_ids[idx][str_idx] == 'L'){
-		// objects
-		cnt += snprintf(buffer, len, "%s", &str_ids[idx][++str_idx]);
-		// remove object's ';' character
-		buffer[--cnt] = '\0';
+/*
+ * mark a part done and write out every finished part that is next in
+ * line, or just this one when the order does not matter.
+ */
+static void ordered_done(OrderedOutput *output, size_t part)
+{
+	size_t first, i;
 
-		// change '/' to '.' for objects
-		for(i = 0; buffer[i] != '\0'; ++i){
-			if(buffer[i] == '/')
-				buffer[i] = '.';
-		}
+	pthread_mutex_lock(&output->lock);
+	output->parts[part].done = 1;
+	if(output->unordered){
+		first = part;
+		i = part + 1;
 	}else{
-		if((type = trans_dex_type_name(str_ids[idx][str_idx])) == NULL){
-			fprintf(stderr, "process_type - bad type character '%c'.\n", str_ids[idx][str_idx]);
-			memset(buffer, 0, len);
-			return -1;
-		}
-		cnt = snprintf(buffer, len, "%s", trans_dex_type_name(str_ids[idx][str_idx]));
-	}
-
-	for(i = 0; i < array_depth; ++i){
-		cnt += snprintf(buffer+cnt, len-cnt, "[]");
-	}
-
-	return cnt;
+		first = output->next;
+		for(i = first; i < output->cnt && output->parts[i].done; ++i)
+			;
+		output->next = i;
+	}
+	write_parts(output->fd, output->parts + first, i - first);
+	for(; first < i; ++first)
+		strbuf_free(&output->parts[first].text);
+	pthread_mutex_unlock(&output->lock);
 }
 
-static int check_name_idx(MethodIds *method)
+/*
+ * pool job: format classes [job * CLASS_CHUNK, (job + 1) * CLASS_CHUNK).
+ */
+static void process_class_chunk(size_t job, int worker, void *arg)
 {
-	int idx;
-	if(method == NULL){
-		return -1;
+	ClassBatch *batch = (ClassBatch *)arg;
+	Output out;
+	size_t mark;
+	u4 i, end;
+
+	strbuf_init(&out.text);
+	out.fd = -1;
+	end = job * CLASS_CHUNK + CLASS_CHUNK;
+	if(end > batch->classes)
+		end = batch->classes;
+	for(i = job * CLASS_CHUNK; i < end; ++i){
+		if(batch->prefix != NULL){
+			mark = record_begin(&out.text);
+			record_end(&out.text, mark, dex_json_class(batch->ctx, &out.text, batch->prefix, i, class_format_flags()));
+			continue;
+		}
+		strbuf_printf(&out.text, "Class %d:\n", batch->base + i);
+		process_class_items(&out, batch->ctx, &batch->ctx->class_defs[i]);
 	}
 
-	if(dex_header == NULL)
-		process_dex_header();
-
-	idx = method->name_idx;
-	if(idx > dex_header->stringIdsSize)
-		return -1;
-	return idx;
+	batch->output.parts[job].text = out.text;
+	ordered_done(&batch->output, job);
 }
 
-static int _get_type_list(char *buffer, size_t len, int offset)
+/*
+ * the whole class list formatted on threads, chunk by chunk, and merged in
+ * class_def order so the text is the same as the serial dump.
+ */
+static int process_class_parallel(Output *out, DexContext *ctx, u4 base, int threads, const char *prefix)
 {
-	int i;
-	int cnt = 0;
-	TypeList tl;
-	if(dex == NULL || buffer == NULL){
-		fprintf(stderr, "_get_type_list - invalid FILE dex and/or buffer parameter.\n");
-		return -1;
-	}
+	ClassBatch batch;
+	size_t chunks;
 
-	if(get_data(&tl.size, offset, sizeof(tl.size), 1, dex) == NULL){
-		fprintf(stderr, "_get_type_list - get type item size failure.\n");
+	// the chunks are written straight to the output's fd.
+	if(out->fd == -1)
 		return -1;
-	}
-
-	if(tl.size == 0)
-		return 0;
-
-	if(type_ids == NULL)
-		process_type_ids();
 
-	tl.type_items = (TypeListItem *)get_data(NULL, offset+sizeof(tl.size), sizeof(TypeListItem), tl.size, dex);
-	if(tl.type_items == NULL){
-		fprintf(stderr, "_get_type_list - get data type list failure.\n");
-		free(tl.type_items);
+	batch.ctx = ctx;
+	batch.base = base;
+	batch.prefix = prefix;
+	batch.classes = ctx->header->classDefsSize;
+	chunks = (batch.classes + CLASS_CHUNK - 1) / CLASS_CHUNK;
+	if(ordered_init(&batch.output, out->fd, chunks, 0) == -1)
 		return -1;
-	}
 
-	for(i = 0; i < tl.size; ++i){
-		cnt += process_type(buffer+cnt, len-cnt, type_ids[tl.type_items[i].type_idx].descriptor_idx);
-		if(i != tl.size -1)
-			cnt += snprintf(buffer+cnt, len-cnt, ", ");
-	}
+	strbuf_write(&out->text, out->fd);
+	pool_run(threads, chunks, process_class_chunk, &batch);
 
-	return cnt;
+	ordered_free(&batch.output);
+	return 0;
 }
 
-static int process_method_paras(char *buffer, size_t len, int offset)
+static void process_class_type(Output *out, DexContainer *dc)
 {
-	int cnt = 0;
-	int ret;
+	DexContext *ctx;
+	u4 base = 0;
+	u4 i, j;
+	int idx;
 
-	if(buffer == NULL){
-		fprintf(stderr, "process_method_paras - invalid buffer parameter.\n");
-		return -1;
+	if(class_names_cnt > 0){
+		// every name is answered from one descriptor -> class_def index per dex.
+		for(i = 0; i < class_names_cnt; ++i){
+			idx = dex_container_find_class(dc, class_names[i], &ctx);
+			if(idx == -1){
+				fprintf(stderr, "process_class_type - not found class '%s'.\n", class_names[i]);
+				continue;
+			}
+			strbuf_printf(&out->text, "%s\n", class_names[i]);
+			process_class_items(out, ctx, &ctx->class_defs[idx]);
+			output_check(out);
+		}
+		return ;
 	}
 
-	cnt += snprintf(buffer+cnt, len-cnt, "(");
-
-	if((ret = _get_type_list(buffer+cnt, len-cnt, offset)) == -1){
-		fprintf(stderr, "process_method_paras - get type list failure.\n");
-		return -1;
+	// the classes of all dex files are numbered as one list.
+	for(j = 0; j < dc->cnt; base += ctx->header->classDefsSize, ++j){
+		ctx = dc->dexes[j];
+		dex_prefetch_section(ctx, kDexTypeClassDataItem);
+		if(do_code)
+			dex_prefetch_section(ctx, kDexTypeCodeItem);
+		if(class_jobs > 1 && process_class_parallel(out, ctx, base, class_jobs, NULL) == 0)
+			continue;
+		for(i = 0; i < ctx->header->classDefsSize; ++i){
+			strbuf_printf(&out->text, "Class %d:\n", base + i);
+			process_class_items(out, ctx, &ctx->class_defs[i]);
+			output_check(out);
+		}
 	}
+}
 
-	cnt += ret;
-	cnt += snprintf(buffer+cnt, len-cnt, ")\n");
+/*
+ * start a record: with --format=json every record but the banner is
+ * preceded by a comma, so records from parallel parts join up. Returns
+ * the mark to drop the record at if it fails.
+ */
+static size_t record_begin(StrBuf *sb)
+{
+	size_t mark = sb->len;
 
-	return cnt;	
+	if(output_format == OUTPUT_JSON)
+		strbuf_append(sb, ",\n", 2);
+	return mark;
 }
 
-static char *process_method_item(MethodIds *method, int has_class_name)
+static void record_end(StrBuf *sb, size_t mark, int ret)
 {
-	int idx;
-	int cnt = 0;
-	static char buffer[BUFFLEN];
-
-	if(method == NULL){
-		fprintf(stderr, "process_method_item - invalid method argument.\n");
-		return NULL;
-	}
+	if(ret == -1)
+		strbuf_truncate(sb, mark);
+	else if(output_format == OUTPUT_NDJSON)
+		strbuf_putc(sb, '\n');
+}
 
-	// process method return type
-	if((idx = check_return_idx(method)) == -1){
-		fprintf(stderr, "process_method_item - invalid method return type index '%d'.\n", method->proto_idx);
-		return NULL;
+/*
+ * "file":"...","dex":"classesN.dex", the members naming where a record
+ * comes from. "dex" is only there for dex files inside an apk.
+ */
+static void record_prefix(StrBuf *prefix, const char *file, DexContext *ctx)
+{
+	strbuf_truncate(prefix, 0);
+	json_put_key(prefix, "file");
+	json_put_string(prefix, file, strlen(file));
+	if(ctx != NULL && ctx->entry != NULL){
+		strbuf_putc(prefix, ',');
+		json_put_key(prefix, "dex");
+		json_put_string(prefix, ctx->entry, strlen(ctx->entry));
 	}
-	cnt = process_type(buffer, BUFFLEN, idx);
+}
 
-	if(has_class_name){
-		if(class_defs == NULL)
-			process_class_type();
-		cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "%s->", get_class_name(&class_defs[method->class_idx]));
+/*
+ * the dump of process_file() as JSON records, each appended as soon as it
+ * is formatted and flushed with the rest of the output.
+ */
+static int process_json(Output *out, const char *file, DexContainer *dc)
+{
+	StrBuf *sb = &out->text;
+	StrBuf prefix;
+	DexContext *ctx;
+	size_t mark;
+	int flags = class_format_flags();
+	int ret = 0;
+	int idx;
+	u4 i, j;
+
+	strbuf_init(&prefix);
+	for(j = 0; j < dc->cnt; ++j){
+		ctx = dc->dexes[j];
+		record_prefix(&prefix, file, ctx);
+		if(do_dex_header){
+			mark = record_begin(sb);
+			record_end(sb, mark, dex_json_header(ctx, sb, prefix.data));
+		}
+		if(do_map){
+			// the map record is complete even when the map is bad
+			mark = record_begin(sb);
+			if(dex_json_map(ctx, sb, prefix.data) == -1)
+				ret = -1;
+			record_end(sb, mark, 0);
+		}
+		if(do_string_ids){
+			dex_prefetch_section(ctx, kDexTypeStringDataItem);
+			for(i = 0; i < ctx->header->stringIdsSize; ++i){
+				mark = record_begin(sb);
+				record_end(sb, mark, dex_json_string(ctx, sb, prefix.data, i));
+				output_check(out);
+			}
+		}
 	}
 
-	// process method name
-	if((idx = check_name_idx(method)) == -1){
-		fprintf(stderr, "process_method_item - invalid method return type index '%d'.\n", method->name_idx);
-		return NULL;
+	if(do_class_defs && class_names_cnt > 0){
+		for(i = 0; i < class_names_cnt; ++i){
+			idx = dex_container_find_class(dc, class_names[i], &ctx);
+			if(idx == -1){
+				fprintf(stderr, "process_json - not found class '%s'.\n", class_names[i]);
+				continue;
+			}
+			record_prefix(&prefix, file, ctx);
+			mark = record_begin(sb);
+			record_end(sb, mark, dex_json_class(ctx, sb, prefix.data, idx, flags));
+			output_check(out);
+		}
+	}else if(do_class_defs){
+		for(j = 0; j < dc->cnt; ++j){
+			ctx = dc->dexes[j];
+			record_prefix(&prefix, file, ctx);
+			dex_prefetch_section(ctx, kDexTypeClassDataItem);
+			if(do_code)
+				dex_prefetch_section(ctx, kDexTypeCodeItem);
+			if(class_jobs > 1 && process_class_parallel(out, ctx, 0, class_jobs, prefix.data) == 0)
+				continue;
+			for(i = 0; i < ctx->header->classDefsSize; ++i){
+				mark = record_begin(sb);
+				record_end(sb, mark, dex_json_class(ctx, sb, prefix.data, i, flags));
+				output_check(out);
+			}
+		}
+	}else if(do_method_ids){
+		for(j = 0; j < dc->cnt; ++j){
+			ctx = dc->dexes[j];
+			record_prefix(&prefix, file, ctx);
+			for(i = 0; i < ctx->header->methodIdsSize; ++i){
+				mark = record_begin(sb);
+				record_end(sb, mark, dex_json_method(ctx, sb, prefix.data, i));
+				output_check(out);
+			}
+		}
 	}
-	if(str_ids == NULL)
-		process_string_ids();
-	cnt += snprintf(buffer+cnt, BUFFLEN-cnt, " %s", str_ids[method->name_idx]);
-
-	// process method parameters
-	// the proto index has been checked.
-	// if parameters_off equal to 0, means no parameter.
-	if(proto_ids == NULL)
-		process_proto_ids();
-	if(proto_ids[method->proto_idx].parameters_off != 0)
-		cnt += process_method_paras(buffer+cnt, BUFFLEN-cnt, proto_ids[method->proto_idx].parameters_off);
-	else
-		cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "()\n");
-
-#ifdef __debug__
-
-	printf("[*] cnt = %d, buffer = %s\n", cnt, buffer);
 
-#endif
+	if(do_xref && process_xref(out, file, dc) == -1)
+		ret = -1;
+	if(do_hierarchy && process_hierarchy(out, file, dc) == -1)
+		ret = -1;
+	if(do_grep && process_grep(out, file, dc) == -1)
+		ret = -1;
+	if(anno_queries_cnt > 0 && process_annotated(out, file, dc) == -1)
+		ret = -1;
+	if(line_queries_cnt > 0 && process_find_line(out, file, dc) == -1)
+		ret = -1;
 
-	return buffer;
+	strbuf_free(&prefix);
+	return ret;
 }
 
-static void process_proto_ids(void)
+/*
+ * how many references --xref found in ctx.
+ */
+static void print_xref_summary(Output *out, DexContext *ctx)
 {
-	if(dex_header == NULL){
-		process_dex_header();
-	}
-
-	if(proto_ids == NULL){
-		proto_ids = (ProtoIds *)get_data(NULL, dex_header->protoIdsOff, sizeof(ProtoIds), dex_header->protoIdsSize, dex);
-		if(proto_ids == NULL){
-			fprintf(stderr, "process_proto_ids - get ProtoIds data failure.\n");
-			return ;
-		}
+	const DexXref *xref = ctx->xref;
+	u4 sites[DEX_REF_KINDS];
+	int kind;
+
+	for(kind = 0; kind < DEX_REF_KINDS; ++kind)
+		sites[kind] = xref->offsets[kind][xref->size[kind]];
+	if(output_format != OUTPUT_TEXT){
+		strbuf_printf(&out->text, ",\"methods\":%u,\"bad\":%u,\"method_refs\":%u,\"field_refs\":%u,\"type_refs\":%u,\"string_refs\":%u}",
+						xref->methods, xref->bad, sites[DEX_REF_METHOD], sites[DEX_REF_FIELD], sites[DEX_REF_TYPE], sites[DEX_REF_STRING]);
+		return ;
 	}
+	strbuf_printf(&out->text, "Xref: %u methods scanned, %u method, %u field, %u type and %u string references",
+					xref->methods, sites[DEX_REF_METHOD], sites[DEX_REF_FIELD], sites[DEX_REF_TYPE], sites[DEX_REF_STRING]);
+	if(xref->bad != 0)
+		strbuf_printf(&out->text, ", %u bad code items skipped", xref->bad);
+	strbuf_putc(&out->text, '\n');
 }
 
-static char *process_field_item(u4 idx, int has_class_name)
+/*
+ * " target: N\n" then "  method @pc" for each site referring to it.
+ */
+static void print_xref_sites(Output *out, DexContext *ctx, int kind, u4 idx)
 {
-	static char buffer[BUFFLEN];
-	int cnt = 0;
-	//skip the class name
-
-	if(dex_header == NULL)
-		process_dex_header();
-	if(type_ids == NULL)
-		process_type_ids();
-
-	// check if the idx is valid
-	if(field_ids[idx].type_idx > dex_header->typeIdsSize){
-		fprintf(stderr, "process_field_item - invalid idx for field's type.\n");
-		return NULL;
+	StrBuf *sb = &out->text;
+	const DexXrefSite *sites;
+	const char *str;
+	size_t mark = sb->len;
+	u4 i, cnt;
+	int ret = -1;
+
+	sites = dex_xref_sites(ctx->xref, kind, idx, &cnt);
+	strbuf_putc(sb, ' ');
+	switch(kind){
+		case DEX_REF_STRING:
+			if((str = dex_string(ctx, idx)) != NULL)
+				ret = strbuf_printf(sb, "\"%s\"", str);
+			break;
+		case DEX_REF_TYPE:
+			ret = dex_format_type(ctx, sb, idx);
+			break;
+		case DEX_REF_FIELD:
+			ret = dex_format_field_ref(ctx, sb, idx);
+			break;
+		case DEX_REF_METHOD:
+			ret = dex_format_method_ref(ctx, sb, idx);
+			break;
 	}
-
-	if(field_ids[idx].name_idx > dex_header->stringIdsSize){
-		fprintf(stderr, "process_field_item - invalid index for field's name.\n");
-		return NULL;
+	if(ret == -1){
+		strbuf_truncate(sb, mark);
+		return ;
+	}
+	if(ctx->entry != NULL)
+		strbuf_printf(sb, " (%s)", ctx->entry);
+	strbuf_printf(sb, ": %u\n", cnt);
+	for(i = 0; i < cnt; ++i){
+		mark = sb->len;
+		strbuf_puts(sb, "  ");
+		if(dex_format_method_ref(ctx, sb, sites[i].method_idx) == -1){
+			strbuf_truncate(sb, mark);
+			continue;
+		}
+		strbuf_puts(sb, " @");
+		strbuf_puthex(sb, sites[i].pc, 4);
+		strbuf_putc(sb, '\n');
+		output_check(out);
 	}
-	// field type
-	cnt += process_type(buffer+cnt, BUFFLEN-cnt, type_ids[field_ids[idx].type_idx].descriptor_idx);
-	// field name
-	snprintf(buffer+cnt, BUFFLEN-cnt, " %s", str_ids[field_ids[idx].name_idx]);
-
-	return buffer;
 }
 
-static void process_field_ids(void)
+/*
+ * --xref and the reference queries: build the index of every dex, then
+ * answer each query from all of them.
+ */
+static int process_xref(Output *out, const char *file, DexContainer *dc)
 {
-	if(dex_header == NULL){
-		process_dex_header();
+	static const char *const titles[DEX_REF_KINDS] = {
+		"Users of string", "Users of type", "Accessors of", "Callers of",
+	};
+	StrBuf *sb = &out->text;
+	StrBuf prefix;
+	DexContext *ctx;
+	const DexRefSpec *spec;
+	size_t mark;
+	u4 i, j, cnt, found;
+	int q, ret = 0;
+
+	strbuf_init(&prefix);
+	for(j = 0; j < dc->cnt; ++j){
+		ctx = dc->dexes[j];
+		if(dex_xref_build(ctx, class_jobs) == NULL){
+			ret = -1;
+			continue;
+		}
+		if(xref_queries_cnt > 0)
+			continue;
+		if(output_format != OUTPUT_TEXT){
+			record_prefix(&prefix, file, ctx);
+			mark = record_begin(sb);
+			strbuf_printf(sb, "{\"kind\":\"xref_index\",%s", prefix.data);
+			print_xref_summary(out, ctx);
+			record_end(sb, mark, 0);
+		}else{
+			print_dex_name(out, file, ctx);
+			print_xref_summary(out, ctx);
+		}
 	}
 
-	if(field_ids == NULL){
-		field_ids = (FieldIds *)get_data(NULL, dex_header->fieldIdsOff, sizeof(FieldIds), dex_header->fieldIdsSize, dex);
-		if(field_ids == NULL){
-			fprintf(stderr, "process_field_ids - get FieldIds data failure.\n");
-			return ;
+	for(q = 0; q < xref_queries_cnt; ++q){
+		spec = &xref_queries[q];
+		if(output_format == OUTPUT_TEXT)
+			strbuf_printf(sb, "%s %s:\n", titles[spec->kind], spec->text);
+		found = 0;
+		for(j = 0; j < dc->cnt; ++j){
+			ctx = dc->dexes[j];
+			if(ctx->xref == NULL)
+				continue;
+			record_prefix(&prefix, file, ctx);
+			cnt = dex_ref_count(ctx, spec->kind);
+			for(i = 0; i < cnt; ++i){
+				if(!dex_ref_spec_match(ctx, spec, i))
+					continue;
+				++found;
+				if(output_format != OUTPUT_TEXT){
+					mark = record_begin(sb);
+					record_end(sb, mark, dex_json_xref(ctx, sb, prefix.data, spec->kind, i));
+				}else{
+					print_xref_sites(out, ctx, spec->kind, i);
+				}
+				output_check(out);
+			}
 		}
+		if(found == 0)
+			fprintf(stderr, "process_xref - nothing in '%s' matches '%s'.\n", file, spec->text);
 	}
-
-#if 0
-	puts("Field:");
-	for(i = 0; i < dex_header->fieldIdsSize; ++i)
-		printf("%s\n", process_field_item(i, 0));
-#endif
+	strbuf_free(&prefix);
+	return ret;
 }
 
-static void process_method_ids(int has_class_name)
+/*
+ * a --callers, --accessors, --type-refs or --string-refs query.
+ */
+static void add_xref_query(int kind, const char *text)
 {
-	int i;
+	DexRefSpec *tmp;
 
-	if(dex_header == NULL){
-		process_dex_header();
-	}
-
-	if(method_ids == NULL){
-		method_ids = (MethodIds *)get_data(NULL, dex_header->methodIdsOff, sizeof(MethodIds), dex_header->methodIdsSize, dex);
-		if(method_ids == NULL){
-			fprintf(stderr, "process_method_ids - get MethodIds data failure.\n");
-			return ;
-		}
+	tmp = (DexRefSpec *)dex_realloc(xref_queries, sizeof(DexRefSpec) * (xref_queries_cnt + 1));
+	if(tmp == NULL){
+		fprintf(stderr, "add_xref_query - realloc failure out of memory.\n");
+		exit(EXIT_FAILURE);
 	}
-	if(do_method_ids){
-		puts("Methods:");
-		for(i = 0; i < dex_header->methodIdsSize; ++i)
-			printf("%s", process_method_item(&method_ids[i], has_class_name));
+	xref_queries = tmp;
+	if(dex_ref_spec_parse(&xref_queries[xref_queries_cnt], kind, text) == -1){
+		fprintf(stderr, "add_xref_query - cannot make out the %s '%s'.\n", dex_ref_kind_name(kind), text);
+		exit(EXIT_FAILURE);
 	}
+	++xref_queries_cnt;
+	do_xref = 1;
 }
 
-static char *_get_class_name(u4 idx)
+/*
+ * " name (entry)", the entry only for a class from an apk, or
+ * " name (not defined)" for a type no dex defines.
+ */
+static void print_hier_node(Output *out, const DexHierarchy *hier, u4 node)
 {
-	// argument idx is the index of type.
-	static char buffer[BUFFLEN];
-	if(type_ids == NULL)
-		process_type_ids();
-	if(str_ids == NULL)
-		process_string_ids();
-	// check if the type is class type.
-	if(str_ids[type_ids[idx].descriptor_idx][0] != 'L'){
-		fprintf(stderr, "_get_class_name - type '%c' is not class type.\n", str_ids[type_ids[idx].descriptor_idx][0]);
-	}
-
-	if(process_type(buffer, BUFFLEN, type_ids[idx].descriptor_idx) != -1)
-		return buffer;
-	return NULL;
+	const DexHierNode *n = &hier->nodes[node];
+
+	strbuf_putc(&out->text, ' ');
+	dex_hierarchy_format(hier, &out->text, node);
+	if(n->class_idx == NO_INDEX)
+		strbuf_puts(&out->text, " (not defined)");
+	else if(n->ctx->entry != NULL)
+		strbuf_printf(&out->text, " (%s)", n->ctx->entry);
 }
 
-static char *get_class_name(ClassDefs *class)
+static void print_hier_summary(Output *out, const DexHierarchy *hier)
 {
+	u4 edges = hier->up_offsets[hier->cnt];
 
-	//process class name
-	// check class name index is invalid or not.
-	if(class == NULL){
-		fprintf(stderr, "get_class_name - invalid ClassDefs parameter.\n");
-		return NULL;
-	}
-
-	if(dex_header == NULL)
-		process_dex_header();
-
-	if(class->class_idx > dex_header->typeIdsSize){
-		fprintf(stderr, "get_class_name - invalid class index %d.\n", class->class_idx);
-		return NULL;
+	if(output_format != OUTPUT_TEXT){
+		strbuf_printf(&out->text, ",\"classes\":%u,\"other_types\":%u,\"edges\":%u,\"duplicates\":%u,\"bad\":%u,\"cyclic\":%u}",
+						hier->defined, hier->cnt - hier->defined, edges, hier->duplicates, hier->bad, hier->cnt - hier->ordered);
+		return ;
 	}
-
-	return _get_class_name(class->class_idx);
+	strbuf_printf(&out->text, "Hierarchy: %u classes, %u other types, %u supertype links",
+					hier->defined, hier->cnt - hier->defined, edges);
+	if(hier->duplicates != 0)
+		strbuf_printf(&out->text, ", %u classes defined again skipped", hier->duplicates);
+	if(hier->bad != 0)
+		strbuf_printf(&out->text, ", %u bad entries skipped", hier->bad);
+	if(hier->ordered != hier->cnt)
+		strbuf_printf(&out->text, ", %u types on a cycle left out", hier->cnt - hier->ordered);
+	strbuf_putc(&out->text, '\n');
 }
 
-static char *_get_access_flags(int flags, int type)
+/*
+ * --hierarchy and the hierarchy queries, over every dex of the file.
+ * --hierarchy lists the classes supertypes first, each with its
+ * superclass and interfaces.
+ */
+static int process_hierarchy(Output *out, const char *file, DexContainer *dc)
 {
-	int i;
-	static char buffer[BUFFLEN];
-	int cnt = 0;
+	static const char *const titles[] = {"Ancestors of", "Subclasses of", "Implementors of"};
+	static const char *const kinds[] = {"ancestor", "subclass", "implementor"};
+	StrBuf *sb = &out->text;
+	StrBuf prefix;
+	const DexHierarchy *hier;
+	const DexHierNode *n;
+	u4 *found;
+	u4 i, j, node, cnt;
+	size_t mark, len;
+	int q;
+
+	if((hier = dex_container_hierarchy(dc)) == NULL)
+		return -1;
 
-	for(i = 0; (afs[i].value != 0) && (flags != 0); ++i){
-		if((flags & afs[i].value) != 0){
-			if((type & afs[i].field) != 0){
-				cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "%s ", afs[i].name);
-			}else{
+	strbuf_init(&prefix);
+	if(hier_queries_cnt == 0){
+		if(output_format != OUTPUT_TEXT){
+			record_prefix(&prefix, file, NULL);
+			mark = record_begin(sb);
+			strbuf_printf(sb, "{\"kind\":\"hierarchy_index\",%s", prefix.data);
+			print_hier_summary(out, hier);
+			record_end(sb, mark, 0);
+		}else{
+			print_hier_summary(out, hier);
+		}
+		for(i = 0; i < hier->ordered; ++i){
+			node = hier->order[i];
+			n = &hier->nodes[node];
+			if(n->class_idx == NO_INDEX)
 				continue;
+			if(output_format != OUTPUT_TEXT){
+				record_prefix(&prefix, file, n->ctx);
+				mark = record_begin(sb);
+				record_end(sb, mark, dex_json_hierarchy(hier, sb, "hierarchy", prefix.data, node));
+			}else{
+				print_hier_node(out, hier, node);
+				for(j = hier->up_offsets[node]; j < hier->up_offsets[node + 1]; ++j){
+					strbuf_puts(sb, j == hier->up_offsets[node] ? " :" : ",");
+					print_hier_node(out, hier, hier->up[j]);
+				}
+				strbuf_putc(sb, '\n');
 			}
-			flags &= ~afs[i].value;
+			output_check(out);
 		}
 	}
 
-	if(flags != 0){
-		fprintf(stderr, "get_access_flags - invalid access flag value.\n");
-		return NULL;
+	for(q = 0; q < hier_queries_cnt; ++q){
+		node = dex_hierarchy_find(hier, hier_queries[q].name);
+		if(node == NO_INDEX){
+			fprintf(stderr, "process_hierarchy - no class '%s' in '%s'.\n", hier_queries[q].name, file);
+			continue;
+		}
+		if((found = dex_hierarchy_query(hier, node, hier_queries[q].query, &cnt)) == NULL)
+			continue;
+		if(output_format == OUTPUT_TEXT)
+			strbuf_printf(sb, "%s %s: %u\n", titles[hier_queries[q].query], hier_queries[q].name, cnt);
+		for(i = 0; i < cnt; ++i){
+			if(output_format != OUTPUT_TEXT){
+				record_prefix(&prefix, file, hier->nodes[found[i]].ctx);
+				len = prefix.len;
+				strbuf_putc(&prefix, ',');
+				json_put_key(&prefix, "of");
+				json_put_string(&prefix, hier_queries[q].name, strlen(hier_queries[q].name));
+				mark = record_begin(sb);
+				record_end(sb, mark, dex_json_hierarchy(hier, sb, kinds[hier_queries[q].query], prefix.data, found[i]));
+				strbuf_truncate(&prefix, len);
+			}else{
+				print_hier_node(out, hier, found[i]);
+				strbuf_putc(sb, '\n');
+			}
+			output_check(out);
+		}
+		free(found);
 	}
-	return buffer;
+	strbuf_free(&prefix);
+	return 0;
 }
 
-static char *get_access_flags(ClassDefs *class, int type)
+static void add_hier_query(int query, const char *name)
 {
-	int flags;
-	if(class == NULL){
-		fprintf(stderr, "get_class_name - invalid ClassDefs parameter.\n");
-		return NULL;
-	}
-
-	flags = class->access_flags;
+	HierQuery *tmp;
 
-	if((flags & access_flags_mask) == 0)
-		return NULL;
-	return _get_access_flags(flags, type);
+	tmp = (HierQuery *)dex_realloc(hier_queries, sizeof(HierQuery) * (hier_queries_cnt + 1));
+	if(tmp == NULL){
+		fprintf(stderr, "add_hier_query - realloc failure out of memory.\n");
+		exit(EXIT_FAILURE);
+	}
+	hier_queries = tmp;
+	hier_queries[hier_queries_cnt].query = query;
+	hier_queries[hier_queries_cnt].name = name;
+	++hier_queries_cnt;
+	do_hierarchy = 1;
 }
 
-static char *get_super_name(ClassDefs *class)
+/*
+ * --grep and --grep-regex over the string pool of every dex: the matching
+ * strings as -s shows them or, when --xref built the index, each with the
+ * methods loading it.
+ */
+static int process_grep(Output *out, const char *file, DexContainer *dc)
 {
-	if(class == NULL){
-		fprintf(stderr, "get_super_name - invalid FILE dex parameter.\n");
-		return NULL;
+	StrBuf *sb = &out->text;
+	StrBuf prefix;
+	DexContext *ctx;
+	const DexGrepPattern *pat;
+	const char *str;
+	u4 *ids;
+	u4 i, j, cnt, found;
+	size_t mark;
+	int p;
+
+	strbuf_init(&prefix);
+	for(p = 0; p < grep_patterns_cnt; ++p){
+		pat = &grep_patterns[p];
+		if(output_format == OUTPUT_TEXT)
+			strbuf_printf(sb, "Strings matching %s:\n", pat->text);
+		found = 0;
+		for(j = 0; j < dc->cnt; ++j){
+			ctx = dc->dexes[j];
+			if((ids = dex_grep(ctx, pat, &cnt)) == NULL)
+				continue;
+			found += cnt;
+			if(output_format != OUTPUT_TEXT){
+				record_prefix(&prefix, file, ctx);
+				strbuf_putc(&prefix, ',');
+				json_put_key(&prefix, "pattern");
+				json_put_string(&prefix, pat->text, strlen(pat->text));
+			}else if(ctx->xref == NULL){
+				print_dex_name(out, file, ctx);
+			}
+			for(i = 0; i < cnt; ++i){
+				if(output_format != OUTPUT_TEXT){
+					mark = record_begin(sb);
+					record_end(sb, mark, ctx->xref != NULL ? dex_json_xref(ctx, sb, prefix.data, DEX_REF_STRING, ids[i])
+															: dex_json_string(ctx, sb, prefix.data, ids[i]));
+				}else if(ctx->xref != NULL){
+					print_xref_sites(out, ctx, DEX_REF_STRING, ids[i]);
+				}else{
+					str = dex_string(ctx, ids[i]);
+					strbuf_printf(sb, " %2d(%8X):       \"%s\"\n", ids[i], ctx->string_ids[ids[i]].string_data_off,
+									str == NULL ? "null" : str);
+				}
+				output_check(out);
+			}
+			free(ids);
+		}
+		if(found == 0)
+			fprintf(stderr, "process_grep - no string in '%s' matches '%s'.\n", file, pat->text);
 	}
-
-	if(class->superclass_idx == 0)
-		return NULL;
-	return _get_class_name(class->superclass_idx);
+	strbuf_free(&prefix);
+	return 0;
 }
 
-static char *get_interfaces(ClassDefs *class)
+static void add_grep_pattern(const char *text, int regex)
 {
-	int i;
-	TypeList tl;
-	int cnt = 0;
-	static char buffer[BUFFLEN];
+	DexGrepPattern *tmp;
 
-	if(dex == NULL || class == NULL){
-		fprintf(stderr, "get_interfaces - invalid FILE dex or/and ClassDefs class parameters.\n");
-		return NULL;
-	}
-
-	if(class->interfaces_off == 0){
-		// no interface
-		return NULL;
+	tmp = (DexGrepPattern *)dex_realloc(grep_patterns, sizeof(DexGrepPattern) * (grep_patterns_cnt + 1));
+	if(tmp == NULL){
+		fprintf(stderr, "add_grep_pattern - realloc failure out of memory.\n");
+		exit(EXIT_FAILURE);
 	}
+	grep_patterns = tmp;
+	if(dex_grep_compile(&grep_patterns[grep_patterns_cnt], text, regex) == -1)
+		exit(EXIT_FAILURE);
+	++grep_patterns_cnt;
+	do_grep = 1;
+}
 
-	if(get_data(&tl.size, class->interfaces_off, sizeof(tl.size), 1, dex) == NULL){
-		fprintf(stderr, "get_interfaces - get interfaces size failure.\n");
-		return NULL;
-	}
+/*
+ * the table counts of a diff: a text block, or the members of the
+ * "diff" record.
+ */
+static void print_diff_summary(Output *out, const DexDiff *diff)
+{
+	static const int tables[] = {
+		DEX_DIFF_CLASSES, DEX_DIFF_METHODS, DEX_DIFF_FIELDS, DEX_DIFF_STRINGS, DEX_DIFF_TYPES, DEX_DIFF_METHOD_IDS,
+	};
+	static const char *const keys[] = {"strings", "types", "method_ids", "classes", "methods", "fields"};
+	static const char *const titles[] = {"strings", "types", "method ids", "classes", "methods", "fields"};
+	StrBuf *sb = &out->text;
+	const u4 *counts;
+	size_t i;
+	int t;
+
+	for(i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i){
+		t = tables[i];
+		counts = diff->counts[t];
+		if(output_format != OUTPUT_TEXT)
+			strbuf_printf(sb, ",\"%s\":{\"added\":%u,\"removed\":%u", keys[t], counts[DEX_DIFF_ADDED], counts[DEX_DIFF_REMOVED]);
+		else
+			strbuf_printf(sb, " %s: %u added, %u removed", titles[t], counts[DEX_DIFF_ADDED], counts[DEX_DIFF_REMOVED]);
+		// the id tables are only counted, what is in both is the same.
+		if(t >= DEX_DIFF_CLASSES)
+			strbuf_printf(sb, output_format != OUTPUT_TEXT ? ",\"changed\":%u" : ", %u changed", counts[DEX_DIFF_CHANGED]);
+		strbuf_putc(sb, output_format != OUTPUT_TEXT ? '}' : '\n');
+		if(output_format == OUTPUT_TEXT && t == DEX_DIFF_FIELDS)
+			strbuf_printf(sb, " code units: %llu -> %llu\n", (unsigned long long)diff->old_units, (unsigned long long)diff->new_units);
+	}
+	if(output_format != OUTPUT_TEXT)
+		strbuf_printf(sb, ",\"old_code_units\":%llu,\"new_code_units\":%llu,\"bad\":%u}",
+						(unsigned long long)diff->old_units, (unsigned long long)diff->new_units, diff->bad);
+	else if(diff->bad != 0)
+		strbuf_printf(sb, " %u bad class data or code items skipped\n", diff->bad);
+}
 
-	if(tl.size == 0){
-		// no interfaces
-		return NULL;
+/*
+ * --diff: what changed from the --diff file to file, the counts, then
+ * every class added, removed or changed, by name.
+ */
+static int process_diff(Output *out, const char *file)
+{
+	StrBuf *sb = &out->text;
+	StrBuf prefix;
+	DexContainer *old_dc, *new_dc;
+	DexDiff *diff;
+	size_t mark;
+	int flags = verify_mode == VERIFY_NONE ? DEX_OPEN_NO_VERIFY : 0;
+	u4 i;
+
+	if((old_dc = dex_container_open_cached(diff_old, flags, class_jobs, cache_dir)) == NULL){
+		fprintf(stderr, "open file '%s' failure.\n", diff_old);
+		return -1;
 	}
-
-	tl.type_items = (TypeListItem *)get_data(NULL, class->interfaces_off+sizeof(tl.size), sizeof(TypeListItem), tl.size, dex);
-
-	if(tl.type_items == NULL){
-		fprintf(stderr, "get_interfaces - get interfaces name failure.\n");
-		return NULL;
+	if((new_dc = dex_container_open_cached(file, flags, class_jobs, cache_dir)) == NULL){
+		fprintf(stderr, "open file '%s' failure.\n", file);
+		dex_container_close(old_dc);
+		return -1;
 	}
-
-	for(i = 0; i < tl.size; ++i){
-		cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "%s", _get_class_name(tl.type_items[i].type_idx));
-		if(i != tl.size - 1)
-			cnt += snprintf(buffer+cnt, BUFFLEN-cnt, ", ");
+	if((diff = dex_diff(old_dc, new_dc)) == NULL){
+		dex_container_close(new_dc);
+		dex_container_close(old_dc);
+		return -1;
 	}
-	return buffer;
-}
 
-static char *process_source_idx(ClassDefs *class)
-{
-	if(class == NULL){
-		fprintf(stderr, "process_source_idx - invalid ClassDefs class argument.\n");
-		return NULL;
+	strbuf_init(&prefix);
+	if(output_format != OUTPUT_TEXT){
+		json_put_key(&prefix, "old");
+		json_put_string(&prefix, diff_old, strlen(diff_old));
+		strbuf_putc(&prefix, ',');
+		json_put_key(&prefix, "file");
+		json_put_string(&prefix, file, strlen(file));
+		mark = record_begin(sb);
+		strbuf_printf(sb, "{\"kind\":\"diff\",%s", prefix.data);
+		print_diff_summary(out, diff);
+		record_end(sb, mark, 0);
+	}else{
+		strbuf_printf(sb, "Diff %s -> %s:\n", diff_old, file);
+		print_diff_summary(out, diff);
 	}
-
-	if(class->source_file_idx == NO_INDEX){
-		return NULL;
+	for(i = 0; i < diff->cnt; ++i){
+		if(output_format != OUTPUT_TEXT){
+			mark = record_begin(sb);
+			record_end(sb, mark, dex_json_diff_class(diff, sb, prefix.data, i));
+		}else{
+			mark = sb->len;
+			if(dex_diff_format_class(diff, sb, i) == -1)
+				strbuf_truncate(sb, mark);
+		}
+		output_check(out);
 	}
-	if(str_ids == NULL)
-		process_string_ids();
+	strbuf_free(&prefix);
 
-	return str_ids[class->source_file_idx];
+	dex_diff_free(diff);
+	dex_container_close(new_dc);
+	dex_container_close(old_dc);
+	return 0;
 }
 
-static char *process_annotation(ClassDefs *class)
+/*
+ * the DEX_FORMAT_* flags dex_json_class() is given.
+ */
+static int class_format_flags(void)
 {
-	return NULL;
+	return (do_code ? DEX_FORMAT_CODE : 0) | (do_annotations ? DEX_FORMAT_ANNOTATIONS : 0) | (do_lines ? DEX_FORMAT_LINES : 0);
 }
 
-static char *process_encode_field(int idx, int flags)
+/*
+ * " type (entry): N\n" then "  target @Type(...)" for each annotation of
+ * type type_idx, from the index.
+ */
+static void print_annotated(Output *out, DexContext *ctx, u4 type_idx)
 {
-	int cnt = 0;
-	static char buffer[BUFFLEN];
-
-	cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "%s", _get_access_flags(flags, FIELD));
-
-	cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "%s;\n", process_field_item(idx, 0));
-
-	return buffer;
-	
+	StrBuf *sb = &out->text;
+	const DexAnnotation *annos;
+	size_t mark = sb->len;
+	u4 i, cnt;
+
+	annos = dex_anno_find(ctx->annotations, type_idx, &cnt);
+	strbuf_putc(sb, ' ');
+	if(dex_format_type(ctx, sb, type_idx) == -1){
+		strbuf_truncate(sb, mark);
+		return ;
+	}
+	if(ctx->entry != NULL)
+		strbuf_printf(sb, " (%s)", ctx->entry);
+	strbuf_printf(sb, ": %u\n", cnt);
+	for(i = 0; i < cnt; ++i){
+		mark = sb->len;
+		strbuf_puts(sb, "  ");
+		if(dex_format_annotation_target(ctx, sb, &annos[i]) == -1 || strbuf_putc(sb, ' ') == -1
+				|| dex_format_annotation(ctx, sb, annos[i].off) == -1){
+			strbuf_truncate(sb, mark);
+			continue;
+		}
+		if(annos[i].visibility != DEX_ANNO_RUNTIME)
+			strbuf_printf(sb, " (%s)", annos[i].visibility <= DEX_ANNO_SYSTEM ? dex_anno_visibility_name(annos[i].visibility) : "?");
+		strbuf_putc(sb, '\n');
+		output_check(out);
+	}
 }
 
-static char *process_encode_method(int idx, int flags, int code_off)
+/*
+ * --annotated: build the annotation index of every dex, then list what
+ * each queried type annotates.
+ */
+static int process_annotated(Output *out, const char *file, DexContainer *dc)
 {
-	int cnt = 0;
-	static char buffer[BUFFLEN];
-	if(method_ids == NULL)
-		process_method_ids(0);
-
-	//char *process_method_item(FILE *dex, MethodIds *method, int has_class_name)
-	cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "%s", _get_access_flags(flags, METHOD));
-
-	cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "%s", process_method_item(&method_ids[idx], 0));
-
-	return buffer;
+	StrBuf *sb = &out->text;
+	StrBuf prefix;
+	DexContext *ctx;
+	const DexRefSpec *spec;
+	const DexAnnotation *annos;
+	size_t mark;
+	u4 i, j, k, cnt, found;
+	int q, ret = 0;
+
+	strbuf_init(&prefix);
+	for(j = 0; j < dc->cnt; ++j){
+		if(dex_anno_index_build(dc->dexes[j]) == NULL)
+			ret = -1;
+	}
+
+	for(q = 0; q < anno_queries_cnt; ++q){
+		spec = &anno_queries[q];
+		if(output_format == OUTPUT_TEXT)
+			strbuf_printf(sb, "Annotated with %s:\n", spec->text);
+		found = 0;
+		for(j = 0; j < dc->cnt; ++j){
+			ctx = dc->dexes[j];
+			if(ctx->annotations == NULL)
+				continue;
+			if(output_format != OUTPUT_TEXT){
+				record_prefix(&prefix, file, ctx);
+				strbuf_putc(&prefix, ',');
+				json_put_key(&prefix, "of");
+				json_put_string(&prefix, spec->text, strlen(spec->text));
+			}
+			for(i = 0; i < ctx->header->typeIdsSize; ++i){
+				if(!dex_ref_spec_match(ctx, spec, i))
+					continue;
+				annos = dex_anno_find(ctx->annotations, i, &cnt);
+				if(cnt == 0)
+					continue;
+				found += cnt;
+				if(output_format == OUTPUT_TEXT){
+					print_annotated(out, ctx, i);
+					continue;
+				}
+				for(k = 0; k < cnt; ++k){
+					mark = record_begin(sb);
+					record_end(sb, mark, dex_json_annotation(ctx, sb, "annotated", prefix.data, &annos[k]));
+					output_check(out);
+				}
+			}
+		}
+		if(found == 0)
+			fprintf(stderr, "process_annotated - nothing in '%s' is annotated with '%s'.\n", file, spec->text);
+	}
+	strbuf_free(&prefix);
+	return ret;
 }
 
-static char *process_class_data(ClassDefs *class)
+/*
+ * an --annotated type, given like --type-refs takes it.
+ */
+static void add_anno_query(const char *text)
 {
-	static char buffer[BUFFLEN];
-	ClassData class_data;
-	unsigned int offset;
-	int idx_diff = 0;
-	int cnt = 0;
-	int access_flags;
-	int code_off;
-	int i;
+	DexRefSpec *tmp;
 
-	if(class == NULL){
-		fprintf(stderr, "process_class_data - invalid ClassDefs class parameter.\n");
-		return NULL;
+	tmp = (DexRefSpec *)dex_realloc(anno_queries, sizeof(DexRefSpec) * (anno_queries_cnt + 1));
+	if(tmp == NULL){
+		fprintf(stderr, "add_anno_query - realloc failure out of memory.\n");
+		exit(EXIT_FAILURE);
 	}
+	anno_queries = tmp;
+	// @com.foo.Keep reads as the annotation it is.
+	if(text[0] == '@')
+		++text;
+	if(dex_ref_spec_parse(&anno_queries[anno_queries_cnt], DEX_REF_TYPE, text) == -1){
+		fprintf(stderr, "add_anno_query - cannot make out the type '%s'.\n", text);
+		exit(EXIT_FAILURE);
+	}
+	++anno_queries_cnt;
+}
 
-	if(class->class_data_off == 0){
-		printf("class_data_off = %d\n", class->class_data_off);
-		// no class data, maybe a marker interface
-		return NULL;
-	}
-
-	offset = class->class_data_off;
-	class_data.static_fields_size = readUnsignedLeb128(dex, &offset);
-	class_data.instance_fields_size = readUnsignedLeb128(dex, &offset);
-	class_data.direct_methods_size = readUnsignedLeb128(dex, &offset);
-	class_data.virtual_methods_size = readUnsignedLeb128(dex, &offset);
-
-#ifdef __debug__
-	printf("static_fields_size = %d, instance_fields_size = %d, "
-			"direct_methods_size = %d, virtual_methods_size = %d\n", 
-			class_data.static_fields_size, class_data.instance_fields_size, 
-			class_data.direct_methods_size, class_data.virtual_methods_size);
-#endif
-
-	// static field
-	if(class_data.static_fields_size != 0){
-		cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "  Static Field:\n");
-		for(i = 0; i < class_data.static_fields_size; ++i){
-			idx_diff += readUnsignedLeb128(dex, &offset);
-			access_flags = readUnsignedLeb128(dex, &offset);
-			cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "    %s", process_encode_field(idx_diff, access_flags));
+/*
+ * --find-line: the methods each source:line query falls in, from the line
+ * index of the classes compiled from that source file.
+ */
+static int process_find_line(Output *out, const char *file, DexContainer *dc)
+{
+	StrBuf *sb = &out->text;
+	StrBuf prefix;
+	const LineQuery *query;
+	DexLineHit *hits;
+	size_t mark;
+	u4 i, j, cnt;
+	int q, ret = 0;
+
+	strbuf_init(&prefix);
+	for(q = 0; q < line_queries_cnt; ++q){
+		query = &line_queries[q];
+		hits = NULL;
+		cnt = 0;
+		for(j = 0; j < dc->cnt; ++j){
+			if(dex_find_line(dc->dexes[j], query->source, query->line, &hits, &cnt) == -1)
+				ret = -1;
+		}
+		if(output_format == OUTPUT_TEXT)
+			strbuf_printf(sb, "Line %s: %u\n", query->text, cnt);
+		for(i = 0; i < cnt; ++i){
+			if(output_format != OUTPUT_TEXT){
+				record_prefix(&prefix, file, hits[i].ctx);
+				strbuf_putc(&prefix, ',');
+				json_put_key(&prefix, "of");
+				json_put_string(&prefix, query->text, strlen(query->text));
+				mark = record_begin(sb);
+				record_end(sb, mark, dex_json_line_hit(&hits[i], sb, prefix.data));
+			}else{
+				mark = sb->len;
+				strbuf_putc(sb, ' ');
+				if(dex_format_method_ref(hits[i].ctx, sb, hits[i].method_idx) == -1){
+					strbuf_truncate(sb, mark);
+					continue;
+				}
+				strbuf_puts(sb, " @");
+				strbuf_puthex(sb, hits[i].pc, 4);
+				if(hits[i].ctx->entry != NULL)
+					strbuf_printf(sb, " (%s)", hits[i].ctx->entry);
+				strbuf_putc(sb, '\n');
+			}
+			output_check(out);
 		}
+		if(cnt == 0)
+			fprintf(stderr, "process_find_line - no method in '%s' has line %s.\n", file, query->text);
+		free(hits);
 	}
+	strbuf_free(&prefix);
+	return ret;
+}
 
-	// instance field
-	if(class_data.instance_fields_size != 0){
-		idx_diff = 0;
-		cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "  Instance Field:\n");
-		for(i = 0; i < class_data.instance_fields_size; ++i){
-			idx_diff += readUnsignedLeb128(dex, &offset);
-			access_flags = readUnsignedLeb128(dex, &offset);
-			cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "    %s", process_encode_field(idx_diff, access_flags));
-		}
+/*
+ * a --find-line query: the source file name, then ':' and the line.
+ */
+static void add_line_query(const char *text)
+{
+	LineQuery *tmp;
+	const char *colon;
+	char *rest;
+	unsigned long line;
+
+	colon = strrchr(text, ':');
+	if(colon == NULL || colon == text || colon[1] == '\0'
+			|| (line = strtoul(colon + 1, &rest, 10)) == 0 || *rest != '\0' || line > 0xFFFFFFFEUL){
+		fprintf(stderr, "add_line_query - expected source:line, got '%s'.\n", text);
+		exit(EXIT_FAILURE);
 	}
+	tmp = (LineQuery *)dex_realloc(line_queries, sizeof(LineQuery) * (line_queries_cnt + 1));
+	if(tmp == NULL || (tmp[line_queries_cnt].source = strndup(text, colon - text)) == NULL){
+		fprintf(stderr, "add_line_query - out of memory.\n");
+		exit(EXIT_FAILURE);
+	}
+	line_queries = tmp;
+	line_queries[line_queries_cnt].text = text;
+	line_queries[line_queries_cnt].line = (u4)line;
+	++line_queries_cnt;
+}
 
-	// direct method
-	if(class_data.direct_methods_size != 0){
-		idx_diff = 0;
-		cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "  Direct Method:\n");
-		for(i = 0; i < class_data.direct_methods_size; ++i){
-			idx_diff += readUnsignedLeb128(dex, &offset);
-			access_flags = readUnsignedLeb128(dex, &offset);
-			code_off = readUnsignedLeb128(dex, &offset);
-			cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "    %s", process_encode_method(idx_diff, access_flags, code_off));
-		}
+static void add_class_names(const char *names)
+{
+	char *copy, *name, *save = NULL;
+	char **tmp;
+
+	copy = strdup(names);
+	if(copy == NULL){
+		fprintf(stderr, "add_class_names - strdup failure out of memory.\n");
+		exit(EXIT_FAILURE);
 	}
 
-	// virtual method
-	if(class_data.virtual_methods_size != 0){
-		idx_diff = 0;
-		cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "  Virtual Method:\n");
-		for(i = 0; i < class_data.direct_methods_size; ++i){
-			idx_diff += readUnsignedLeb128(dex, &offset);
-			access_flags = readUnsignedLeb128(dex, &offset);
-			code_off = readUnsignedLeb128(dex, &offset);
-			cnt += snprintf(buffer+cnt, BUFFLEN-cnt, "    %s", process_encode_method(idx_diff, access_flags, code_off));
+	for(name = strtok_r(copy, ", \t\r\n", &save); name != NULL; name = strtok_r(NULL, ", \t\r\n", &save)){
+		if(name[0] == '#')
+			break;
+		tmp = (char **)dex_realloc(class_names, sizeof(char *) * (class_names_cnt + 1));
+		if(tmp == NULL){
+			fprintf(stderr, "add_class_names - realloc failure out of memory.\n");
+			exit(EXIT_FAILURE);
 		}
+		class_names = tmp;
+		// the names point into copy, which is kept for the whole run.
+		class_names[class_names_cnt++] = name;
 	}
-
-	return buffer;
 }
 
-static void process_class_items(ClassDefs *class)
+static void load_class_names(const char *file)
 {
-	char *name;
-	char *flag;
-	char *super;
-	char *interfaces;
-	char *src;
-	char *class_data;
-	//process class name
-	// check class name index is invalid or not.
-	if(class == NULL){
-		fprintf(stderr, "process_class_items - invalid ClassDefs parameter.\n");
-		return ;
-	}
-	name = get_class_name(class);
-	if(name != NULL)
-		printf(" name: %s\n", name);
+	FILE *fp;
+	char *line = NULL;
+	size_t cap = 0;
 
-	flag = get_access_flags(class, CLASS);
-	if(flag != NULL)
-		printf(" flag: %s\n", flag);
-
-	super = get_super_name(class);
-	if(super != NULL){
-		printf(" super: %s\n", super);
+	fp = strcmp(file, "-") == 0 ? stdin : fopen(file, "r");
+	if(fp == NULL){
+		fprintf(stderr, "load_class_names - open file '%s' failure.\n", file);
+		exit(EXIT_FAILURE);
 	}
 
-	interfaces = get_interfaces(class);
-	if(interfaces != NULL){
-		printf(" interface: %s\n", interfaces);
-	}
-	src = process_source_idx(class);
-	if(src != NULL){
-		printf(" source: %s\n", src);
-	}
+	while(getline(&line, &cap, fp) != -1)
+		add_class_names(line);
 
-	class_data = process_class_data(class);
-	if(class_data != NULL)
-		printf(" class data: \n%s", class_data);
+	free(line);
+	if(fp != stdin)
+		fclose(fp);
 }
 
-static void process_class_type(void)
+static void add_file(const char *file)
 {
-	int i;
-	if(dex_header == NULL){
-		process_dex_header();
+	char **tmp;
+
+	tmp = (char **)dex_realloc(files, sizeof(char *) * (files_cnt + 1));
+	if(tmp == NULL){
+		fprintf(stderr, "add_file - realloc failure out of memory.\n");
+		exit(EXIT_FAILURE);
 	}
+	files = tmp;
+	files[files_cnt++] = (char *)file;
+}
 
-	if(class_defs == NULL){
-		class_defs = (ClassDefs *)get_data(NULL, dex_header->classDefsOff, sizeof(ClassDefs), dex_header->classDefsSize, dex);
-		if(class_defs == NULL){
-			fprintf(stderr, "process_class_type - get ClassDefs data failure.\n");
-			return ;
-		}
+/*
+ * read a list of paths. the list is NUL separated if it contains a NUL
+ * byte at all, otherwise it is one path per line.
+ */
+static void load_file_list(const char *list)
+{
+	FILE *fp;
+	char *data = NULL;
+	size_t len = 0;
+	size_t cap = 0;
+	size_t n;
+	char sep;
+	char *path, *end;
+
+	fp = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+	if(fp == NULL){
+		fprintf(stderr, "load_file_list - open file '%s' failure.\n", list);
+		exit(EXIT_FAILURE);
 	}
 
-	if(do_class_defs){
-		if(class_name != NULL){
-			for(i = 0; i < dex_header->classDefsSize; ++i){
-				if(strcmp(class_name, get_class_name(&class_defs[i])) == 0)
-					break;
-			}
-			if(i == dex_header->classDefsSize){
-				fprintf(stderr, "process_class_type - not found class '%s'.\n", class_name);
-				return ;
-			}
-			process_class_items(&class_defs[i]);
-			class_name = NULL;
-		}else{
-			for(i = 0; i < dex_header->classDefsSize; ++i){
-				printf("Class %d:\n", i);
-				process_class_items(&class_defs[i]);
+	do{
+		if(cap - len < BUFFLEN){
+			cap = cap == 0 ? BUFFLEN * 4 : cap * 2;
+			if((data = (char *)dex_realloc(data, cap + 1)) == NULL){
+				fprintf(stderr, "load_file_list - realloc failure out of memory.\n");
+				exit(EXIT_FAILURE);
 			}
 		}
+		n = fread(data + len, 1, cap - len, fp);
+		len += n;
+	}while(n > 0);
+
+	if(fp != stdin)
+		fclose(fp);
+	if(data == NULL)
+		return ;
+	data[len] = '\0';
+
+	// the paths point into data, which is kept for the whole run.
+	sep = memchr(data, '\0', len) != NULL ? '\0' : '\n';
+	for(path = data; path < data + len; path = end + 1){
+		end = memchr(path, sep, data + len - path);
+		if(end == NULL)
+			end = data + len;
+		*end = '\0';
+		if(sep == '\n' && end > path && end[-1] == '\r')
+			end[-1] = '\0';
+		if(path[0] != '\0')
+			add_file(path);
+	}
+}
+
+/*
+ * the -j argument: a thread count up to MAX_JOBS, 0 for one per cpu.
+ */
+static int parse_jobs(const char *text)
+{
+	char *end;
+	long n;
+
+	errno = 0;
+	n = strtol(text, &end, 10);
+	if(end == text || *end != '\0' || errno != 0 || n < 0 || n > MAX_JOBS){
+		fprintf(stderr, "parse_jobs - expected a thread count from 0 to %d, got '%s'.\n", MAX_JOBS, text);
+		exit(EXIT_FAILURE);
 	}
-#if 0
-	puts("Class:");
-	process_class_items(dex, &class_defs[0]);
-#endif
+	return n == 0 ? pool_default_threads() : (int)n;
 }
 
-static void parse_args(int argc, char **argv)
+static void parse_args(int argc, char **argv, Output *out)
 {
 	int c;
 	static struct option opts[] = {
@@ -1016,9 +1612,36 @@ static void parse_args(int argc, char **argv)
 		{"strings", 0, NULL, 's'},
 		{"help", 0, NULL, 'h'},
 		{"all", 0, NULL, 'a'},
+		{"no-verify", 0, NULL, OPT_NO_VERIFY},
+		{"verify-only", 0, NULL, OPT_VERIFY_ONLY},
+		{"class-file", 1, NULL, OPT_CLASS_FILE},
+		{"jobs", 1, NULL, 'j'},
+		{"unordered", 0, NULL, OPT_UNORDERED},
+		{"files-from", 1, NULL, OPT_FILES_FROM},
+		{"code", 0, NULL, OPT_CODE},
+		{"map", 0, NULL, OPT_MAP},
+		{"format", 1, NULL, OPT_FORMAT},
+		{"cache-dir", 1, NULL, OPT_CACHE_DIR},
+		{"stats", 0, NULL, OPT_STATS},
+		{"xref", 0, NULL, OPT_XREF},
+		{"callers", 1, NULL, OPT_CALLERS},
+		{"accessors", 1, NULL, OPT_ACCESSORS},
+		{"type-refs", 1, NULL, OPT_TYPE_REFS},
+		{"string-refs", 1, NULL, OPT_STRING_REFS},
+		{"hierarchy", 0, NULL, OPT_HIERARCHY},
+		{"subclasses", 1, NULL, OPT_SUBCLASSES},
+		{"implementors", 1, NULL, OPT_IMPLEMENTORS},
+		{"ancestors", 1, NULL, OPT_ANCESTORS},
+		{"grep", 1, NULL, OPT_GREP},
+		{"grep-regex", 1, NULL, OPT_GREP_REGEX},
+		{"diff", 1, NULL, OPT_DIFF},
+		{"annotations", 0, NULL, OPT_ANNOTATIONS},
+		{"annotated", 1, NULL, OPT_ANNOTATED},
+		{"lines", 0, NULL, OPT_LINES},
+		{"find-line", 1, NULL, OPT_FIND_LINE},
 		{0, 0, 0, 0},
 	};	
-	static const char *const short_options = "mc:CHsh";
+	static const char *const short_options = "mc:CHshj:";
 	while((c = getopt_long(argc, argv, short_options, opts, NULL)) != -1){
 		switch(c){
 			case 'm':
@@ -1026,8 +1649,7 @@ static void parse_args(int argc, char **argv)
 				break;
 			case 'c':
 				do_class_defs = 1;
-				class_name = optarg;
-				puts(class_name);
+				add_class_names(optarg);
 				break;
 			case 'C':
 				do_class_defs = 1;
@@ -1046,100 +1668,329 @@ static void parse_args(int argc, char **argv)
 				do_string_ids = 1;
 				do_class_defs = 1;
 				break;
+			case OPT_NO_VERIFY:
+				verify_mode = VERIFY_NONE;
+				break;
+			case OPT_VERIFY_ONLY:
+				verify_mode = VERIFY_ONLY;
+				break;
+			case OPT_CLASS_FILE:
+				do_class_defs = 1;
+				load_class_names(optarg);
+				break;
+			case 'j':
+				jobs = parse_jobs(optarg);
+				break;
+			case OPT_UNORDERED:
+				unordered_output = 1;
+				break;
+			case OPT_FILES_FROM:
+				load_file_list(optarg);
+				break;
+			case OPT_CODE:
+				do_class_defs = 1;
+				do_code = 1;
+				break;
+			case OPT_MAP:
+				do_map = 1;
+				break;
+			case OPT_FORMAT:
+				if(strcmp(optarg, "text") == 0)
+					output_format = OUTPUT_TEXT;
+				else if(strcmp(optarg, "json") == 0)
+					output_format = OUTPUT_JSON;
+				else if(strcmp(optarg, "ndjson") == 0)
+					output_format = OUTPUT_NDJSON;
+				else
+					do_help = 1;
+				break;
+			case OPT_CACHE_DIR:
+				cache_dir = optarg;
+				break;
+			case OPT_STATS:
+				do_stats = 1;
+				break;
+			case OPT_XREF:
+				do_xref = 1;
+				break;
+			case OPT_CALLERS:
+				add_xref_query(DEX_REF_METHOD, optarg);
+				break;
+			case OPT_ACCESSORS:
+				add_xref_query(DEX_REF_FIELD, optarg);
+				break;
+			case OPT_TYPE_REFS:
+				add_xref_query(DEX_REF_TYPE, optarg);
+				break;
+			case OPT_STRING_REFS:
+				add_xref_query(DEX_REF_STRING, optarg);
+				break;
+			case OPT_HIERARCHY:
+				do_hierarchy = 1;
+				break;
+			case OPT_SUBCLASSES:
+				add_hier_query(DEX_HIER_SUBCLASSES, optarg);
+				break;
+			case OPT_IMPLEMENTORS:
+				add_hier_query(DEX_HIER_IMPLEMENTORS, optarg);
+				break;
+			case OPT_ANCESTORS:
+				add_hier_query(DEX_HIER_ANCESTORS, optarg);
+				break;
+			case OPT_GREP:
+				add_grep_pattern(optarg, 0);
+				break;
+			case OPT_GREP_REGEX:
+				add_grep_pattern(optarg, 1);
+				break;
+			case OPT_DIFF:
+				diff_old = optarg;
+				break;
+			case OPT_ANNOTATIONS:
+				do_class_defs = 1;
+				do_annotations = 1;
+				break;
+			case OPT_ANNOTATED:
+				add_anno_query(optarg);
+				break;
+			case OPT_LINES:
+				do_class_defs = 1;
+				do_lines = 1;
+				break;
+			case OPT_FIND_LINE:
+				add_line_query(optarg);
+				break;
 			default:	
 				// get invalid opt will print usage and exit.
 				do_help = 1;
 		}
 	}
 
-	if(optind == 1){
-		// no options
+	if(!(do_dex_header || do_string_ids || do_method_ids || do_class_defs || do_map || do_xref || do_hierarchy || do_grep || anno_queries_cnt > 0 || line_queries_cnt > 0 || diff_old != NULL || do_help)
+			&& verify_mode != VERIFY_ONLY){
+		// nothing to show asked for
 		do_dex_header = 1;
 		do_string_ids = 1;
 		do_class_defs = 1;
 	}
 
-	if(optind >= argc){
-		usage();
+	while(optind < argc)
+		add_file(argv[optind++]);
+
+	if(files_cnt == 0){
+		strbuf_printf(&out->text, "\n=== %s %s ===\n\n", PROGRAM_NAME, PROGRAM_VER);
+		usage(&out->text);
+		strbuf_write(&out->text, out->fd);
 		exit(EXIT_FAILURE);
 	}
 }
 
-static void process_file(const char *file)
+/*
+ * dump one file to out. returns -1 if it could not be opened or failed
+ * verification.
+ */
+static int process_file(Output *out, const char *file)
 {
-	struct stat st;
+	DexStatsTimer timer;
+	DexContainer *dc;
+	DexContext *ctx;
+	int ret = 0;
+	u4 i;
+
 	if(file == NULL)
-		return ;
-	if(stat(file, &st) == -1){
-		fprintf(stderr, "stat file '%s' failure.\n", file);
-		return ;
+		return -1;
+
+	if(verify_mode == VERIFY_ONLY)
+		return process_verify(out, file);
+	if(diff_old != NULL)
+		return process_diff(out, file);
+
+	dc = dex_container_open_cached(file, verify_mode == VERIFY_NONE ? DEX_OPEN_NO_VERIFY : 0, class_jobs, cache_dir);
+	if(dc == NULL){
+		fprintf(stderr, "open file '%s' failure.\n", file);
+		return -1;
 	}
 
-	if(!S_ISREG(st.st_mode)){
-		fprintf(stderr, "%s is not a regular file.\n", file);
-		return ;
+	if(output_format != OUTPUT_TEXT){
+		dex_stats_begin(&timer);
+		ret = process_json(out, file, dc);
+		dex_stats_end(&timer, DEX_PHASE_JSON);
+		dex_container_close(dc);
+		return ret;
 	}
 
-	dex = fopen(file, "rb");
-	if(dex == NULL){
-		perror("open file failre: ");
-		return ;
+	print_file_name(out, file);
+	for(i = 0; i < dc->cnt; ++i){
+		ctx = dc->dexes[i];
+		if(do_dex_header || do_string_ids || do_map)
+			print_dex_name(out, file, ctx);
+		if(do_dex_header){
+			dex_stats_begin(&timer);
+			print_header_info(out, ctx->header);
+			dex_stats_end(&timer, DEX_PHASE_HEADER);
+		}
+		if(do_map){
+			dex_stats_begin(&timer);
+			if(process_map_list(out, ctx) == -1)
+				ret = -1;
+			dex_stats_end(&timer, DEX_PHASE_MAP);
+		}
+		if(do_string_ids){
+			dex_stats_begin(&timer);
+			process_string_ids(out, ctx);
+			dex_stats_end(&timer, DEX_PHASE_STRINGS);
+		}
 	}
 
-	if(do_dex_header)
-		process_dex_header();
+	dex_stats_begin(&timer);
+	if(do_class_defs){
+		process_class_type(out, dc);
+		dex_stats_end(&timer, DEX_PHASE_CLASSES);
+	}else if(do_method_ids){
+		process_method_ids(out, dc);
+		dex_stats_end(&timer, DEX_PHASE_METHODS);
+	}
+
+	if(do_xref && process_xref(out, file, dc) == -1)
+		ret = -1;
+	if(do_hierarchy && process_hierarchy(out, file, dc) == -1)
+		ret = -1;
+	if(do_grep && process_grep(out, file, dc) == -1)
+		ret = -1;
+	if(anno_queries_cnt > 0 && process_annotated(out, file, dc) == -1)
+		ret = -1;
+	if(line_queries_cnt > 0 && process_find_line(out, file, dc) == -1)
+		ret = -1;
+
+	if(do_help)
+		usage(&out->text);
 
-	if(do_string_ids)
-		process_string_ids();
+	dex_container_close(dc);
+	return ret;
+}
 
-	if(do_class_defs){
-		do_method_ids = 0;
-		process_class_type();
+/*
+ * --verify-only: one OK/FAILED line, or record, per dex file.
+ */
+static int process_verify(Output *out, const char *file)
+{
+	StrBuf *sb = &out->text;
+	StrBuf prefix;
+	DexContainer *dc;
+	DexContext *ctx;
+	size_t mark;
+	int ret = 0;
+	int ok;
+	u4 i;
+
+	strbuf_init(&prefix);
+	dc = dex_container_open(file, DEX_OPEN_NO_VERIFY, class_jobs);
+	for(i = 0; dc == NULL || i < dc->cnt; ++i){
+		ctx = dc == NULL ? NULL : dc->dexes[i];
+		ok = ctx != NULL && dex_context_verify(ctx) == 0;
+		if(!ok)
+			ret = -1;
+
+		if(output_format != OUTPUT_TEXT){
+			record_prefix(&prefix, file, ctx);
+			mark = record_begin(sb);
+			strbuf_printf(sb, "{\"kind\":\"verify\",%s,\"ok\":%s}", prefix.data, ok ? "true" : "false");
+			record_end(sb, mark, 0);
+		}else if(ctx != NULL && ctx->entry != NULL){
+			strbuf_printf(sb, "%s!%s: %s\n", file, ctx->entry, ok ? "OK" : "FAILED");
+		}else{
+			strbuf_printf(sb, "%s: %s\n", file, ok ? "OK" : "FAILED");
+		}
+		if(dc == NULL)
+			break;
 	}
+	strbuf_free(&prefix);
+	dex_container_close(dc);
+	return ret;
+}
 
-	if(do_method_ids)
-		process_method_ids(1);
+/*
+ * pool job: dump one file into its own part of the output.
+ */
+static void process_batch_file(size_t job, int worker, void *arg)
+{
+	Output out;
 
-	if(do_help)
-		usage();
+	strbuf_init(&out.text);
+	out.fd = -1;
+	if(process_file(&out, files[job]) == -1)
+		__atomic_fetch_add(&verify_failures, 1, __ATOMIC_RELAXED);
 
-	// process file.
+	file_output.parts[job].text = out.text;
+	ordered_done(&file_output, job);
+}
+
+static void process_files(Output *out)
+{
+	size_t i;
+
+	if(jobs <= 1 || files_cnt == 1){
+		// with a single file the threads go to its classes instead.
+		class_jobs = jobs;
+		for(i = 0; i < files_cnt; ++i){
+			if(process_file(out, files[i]) == -1)
+				++verify_failures;
+		}
+		strbuf_write(&out->text, out->fd);
+		return ;
+	}
+
+	if(ordered_init(&file_output, out->fd, files_cnt, unordered_output) == -1)
+		exit(EXIT_FAILURE);
+
+	// the banner goes first, later writes come from the workers.
+	strbuf_write(&out->text, out->fd);
+	pool_run(jobs, files_cnt, process_batch_file, NULL);
+
+	ordered_free(&file_output);
 }
 
 int main(int argc, char **argv)
 {
-	// print basic program prompt information
-	printf("\n=== %s %s ===\n\n", PROGRAM_NAME, PROGRAM_VER);
+	Output out;
+	StrBuf help;
+	DexStats stats;
 
-	parse_args(argc, argv);
+	strbuf_init(&out.text);
+	out.fd = STDOUT_FILENO;
 
-	while(optind < argc)
-		process_file(argv[optind++]);
+	parse_args(argc, argv, &out);
+	if(do_stats)
+		dex_stats_enable(1);
 
-#if 0
+	// print basic program prompt information; for JSON a first record.
+	if(output_format == OUTPUT_TEXT)
+		strbuf_printf(&out.text, "\n=== %s %s ===\n\n", PROGRAM_NAME, PROGRAM_VER);
+	else
+		strbuf_printf(&out.text, "%s{\"kind\":\"%s\",\"version\":\"%s\"}%s", output_format == OUTPUT_JSON ? "[\n" : "",
+						PROGRAM_NAME, PROGRAM_VER, output_format == OUTPUT_NDJSON ? "\n" : "");
 
-	if(argc < 2){
-		usage();
-		exit(EXIT_FAILURE);
+	process_files(&out);
+	if(do_help && output_format != OUTPUT_TEXT){
+		// keep stdout parseable
+		strbuf_init(&help);
+		usage(&help);
+		strbuf_write(&help, STDERR_FILENO);
+		strbuf_free(&help);
 	}
-
-	dex = fopen(argv[1], "rb");
-	if(dex == NULL){
-		die("open file %s", argv[1]);
+	if(output_format == OUTPUT_JSON){
+		strbuf_puts(&out.text, "\n]\n");
+		strbuf_write(&out.text, out.fd);
 	}
+	strbuf_free(&out.text);
 
-	do_dex_header++;
-	do_string_ids++;
-	do_type_ids++;
-	process_dex_header(dex);
-	process_string_ids(dex);
-	process_type_ids(dex);
-	process_proto_ids(dex);
-	process_method_ids(dex);
-	//process_annotation(dex);
-	process_class_type(dex);
-	process_field_ids(dex);
-#endif
+	if(do_stats){
+		strbuf_init(&help);
+		dex_stats_snapshot(&stats);
+		dex_stats_format(&help, &stats);
+		strbuf_write(&help, STDERR_FILENO);
+		strbuf_free(&help);
+	}
 
-	return 0;
+	return verify_failures == 0 ? 0 : EXIT_FAILURE;
 }
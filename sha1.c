@@ -0,0 +1,299 @@
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "sha1.h"
+
+/*
+ * SHA-1 (FIPS 180-4). The portable block function is used everywhere, on
+ * x86 cpus with the SHA extensions sha1_init() picks one built on
+ * sha1rnds4/sha1nexte/sha1msg1/sha1msg2 instead, and a context keeps the
+ * block function it was set up with.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_SHA_NI		1
+#include <immintrin.h>
+#endif
+
+#define ROL(x, n)		(((x) << (n)) | ((x) >> (32 - (n))))
+
+static inline uint32_t load_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void store_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void sha1_blocks_portable(uint32_t state[5], const uint8_t *data, size_t blocks)
+{
+	uint32_t w[16];
+	uint32_t a, b, c, d, e, t;
+	int i;
+
+	while(blocks-- > 0){
+		for(i = 0; i < 16; ++i)
+			w[i] = load_be32(data + i * 4);
+
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+		e = state[4];
+
+		// the message schedule is kept in a 16 word ring.
+		for(i = 0; i < 80; ++i){
+			if(i >= 16){
+				t = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15];
+				w[i & 15] = ROL(t, 1);
+			}
+			if(i < 20)
+				t = ((b & c) | (~b & d)) + 0x5A827999;
+			else if(i < 40)
+				t = (b ^ c ^ d) + 0x6ED9EBA1;
+			else if(i < 60)
+				t = ((b & c) | (b & d) | (c & d)) + 0x8F1BBCDC;
+			else
+				t = (b ^ c ^ d) + 0xCA62C1D6;
+			t += ROL(a, 5) + e + w[i & 15];
+			e = d;
+			d = c;
+			c = ROL(b, 30);
+			b = a;
+			a = t;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		data += SHA1_BLOCK_LEN;
+	}
+}
+
+#ifdef HAVE_SHA_NI
+
+/*
+ * Four rounds per sha1rnds4. The schedule for rounds 16..79 is produced
+ * four words at a time with sha1msg1, xor and sha1msg2 on a rotation of
+ * four message registers, interleaved with the rounds using them.
+ */
+#define SHA_NI_QUAD(e_in, e_out, m0, m1, m2, m3, f)				\
+	do{															\
+		e_in = _mm_sha1nexte_epu32(e_in, m0);					\
+		e_out = abcd;											\
+		m1 = _mm_sha1msg2_epu32(m1, m0);						\
+		abcd = _mm_sha1rnds4_epu32(abcd, e_in, f);				\
+		m3 = _mm_sha1msg1_epu32(m3, m0);						\
+		m2 = _mm_xor_si128(m2, m0);								\
+	}while(0)
+
+__attribute__((target("sha,ssse3,sse4.1")))
+static void sha1_blocks_shani(uint32_t state[5], const uint8_t *data, size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_save, e0, e0_save, e1;
+	__m128i msg0, msg1, msg2, msg3;
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+	e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+	while(blocks-- > 0){
+		abcd_save = abcd;
+		e0_save = e0;
+
+		// rounds 0-3
+		msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+		e0 = _mm_add_epi32(e0, msg0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		// rounds 4-7
+		msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+		// rounds 8-11
+		msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		// rounds 12-15
+		msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		// rounds 16-67
+		SHA_NI_QUAD(e0, e1, msg0, msg1, msg2, msg3, 0);		// 16-19
+		SHA_NI_QUAD(e1, e0, msg1, msg2, msg3, msg0, 1);		// 20-23
+		SHA_NI_QUAD(e0, e1, msg2, msg3, msg0, msg1, 1);		// 24-27
+		SHA_NI_QUAD(e1, e0, msg3, msg0, msg1, msg2, 1);		// 28-31
+		SHA_NI_QUAD(e0, e1, msg0, msg1, msg2, msg3, 1);		// 32-35
+		SHA_NI_QUAD(e1, e0, msg1, msg2, msg3, msg0, 1);		// 36-39
+		SHA_NI_QUAD(e0, e1, msg2, msg3, msg0, msg1, 2);		// 40-43
+		SHA_NI_QUAD(e1, e0, msg3, msg0, msg1, msg2, 2);		// 44-47
+		SHA_NI_QUAD(e0, e1, msg0, msg1, msg2, msg3, 2);		// 48-51
+		SHA_NI_QUAD(e1, e0, msg1, msg2, msg3, msg0, 2);		// 52-55
+		SHA_NI_QUAD(e0, e1, msg2, msg3, msg0, msg1, 2);		// 56-59
+		SHA_NI_QUAD(e1, e0, msg3, msg0, msg1, msg2, 3);		// 60-63
+		SHA_NI_QUAD(e0, e1, msg0, msg1, msg2, msg3, 3);		// 64-67
+
+		// rounds 68-71
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		// rounds 72-75
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+		// rounds 76-79
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+
+		data += SHA1_BLOCK_LEN;
+	}
+
+	abcd = _mm_shuffle_epi32(abcd, 0x1B);
+	_mm_storeu_si128((__m128i *)state, abcd);
+	state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+#endif	/* HAVE_SHA_NI */
+
+static Sha1Impl impls[3];
+static pthread_once_t impls_once = PTHREAD_ONCE_INIT;
+
+static void sha1_probe(void)
+{
+	int n = 0;
+
+#ifdef HAVE_SHA_NI
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3")){
+		unsigned int eax, ebx, ecx, edx;
+		// CPUID.(EAX=7,ECX=0):EBX bit 29 is SHA.
+		__asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+		if(ebx & (1U << 29)){
+			impls[n].name = "sha-ni";
+			impls[n++].blocks = sha1_blocks_shani;
+		}
+	}
+#endif
+	impls[n].name = "portable";
+	impls[n++].blocks = sha1_blocks_portable;
+	impls[n].name = NULL;
+}
+
+/*
+ * the block functions this cpu can run, probed once however many threads
+ * ask. Best first; the benchmarks and the tests cross check them.
+ */
+const Sha1Impl *sha1_impls(void)
+{
+	pthread_once(&impls_once, sha1_probe);
+	return impls;
+}
+
+const char *sha1_impl_name(void)
+{
+	return sha1_impls()[0].name;
+}
+
+void sha1_init_impl(Sha1Ctx *ctx, const Sha1Impl *impl)
+{
+	ctx->blocks = impl->blocks;
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xEFCDAB89;
+	ctx->state[2] = 0x98BADCFE;
+	ctx->state[3] = 0x10325476;
+	ctx->state[4] = 0xC3D2E1F0;
+	ctx->count = 0;
+}
+
+void sha1_init(Sha1Ctx *ctx)
+{
+	sha1_init_impl(ctx, sha1_impls());
+}
+
+void sha1_update(Sha1Ctx *ctx, const uint8_t *data, size_t len)
+{
+	size_t used = ctx->count % SHA1_BLOCK_LEN;
+	size_t n;
+
+	ctx->count += len;
+
+	if(used != 0){
+		n = SHA1_BLOCK_LEN - used;
+		if(len < n){
+			memcpy(ctx->buffer + used, data, len);
+			return ;
+		}
+		memcpy(ctx->buffer + used, data, n);
+		ctx->blocks(ctx->state, ctx->buffer, 1);
+		data += n;
+		len -= n;
+	}
+
+	n = len / SHA1_BLOCK_LEN;
+	if(n > 0){
+		ctx->blocks(ctx->state, data, n);
+		data += n * SHA1_BLOCK_LEN;
+		len -= n * SHA1_BLOCK_LEN;
+	}
+
+	if(len > 0)
+		memcpy(ctx->buffer, data, len);
+}
+
+void sha1_final(Sha1Ctx *ctx, uint8_t digest[SHA1_DIGEST_LEN])
+{
+	size_t used = ctx->count % SHA1_BLOCK_LEN;
+	uint64_t bits = ctx->count * 8;
+	int i;
+
+	ctx->buffer[used++] = 0x80;
+	if(used > SHA1_BLOCK_LEN - 8){
+		memset(ctx->buffer + used, 0, SHA1_BLOCK_LEN - used);
+		ctx->blocks(ctx->state, ctx->buffer, 1);
+		used = 0;
+	}
+	memset(ctx->buffer + used, 0, SHA1_BLOCK_LEN - 8 - used);
+	store_be32(ctx->buffer + 56, (uint32_t)(bits >> 32));
+	store_be32(ctx->buffer + 60, (uint32_t)bits);
+	ctx->blocks(ctx->state, ctx->buffer, 1);
+
+	for(i = 0; i < 5; ++i)
+		store_be32(digest + i * 4, ctx->state[i]);
+}
+
+void dex_sha1(const uint8_t *data, size_t len, uint8_t digest[SHA1_DIGEST_LEN])
+{
+	Sha1Ctx ctx;
+	sha1_init(&ctx);
+	sha1_update(&ctx, data, len);
+	sha1_final(&ctx, digest);
+}
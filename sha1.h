@@ -0,0 +1,32 @@
+#ifndef __SHA1_H__
+#define __SHA1_H__
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#define SHA1_DIGEST_LEN		20
+#define SHA1_BLOCK_LEN		64
+
+typedef void (*Sha1Blocks)(uint32_t state[5], const uint8_t *data, size_t blocks);
+
+typedef struct {
+	const char *name;
+	Sha1Blocks blocks;
+} Sha1Impl;
+
+typedef struct {
+	Sha1Blocks	blocks;
+	uint32_t	state[5];
+	uint64_t	count;			/* bytes hashed so far */
+	uint8_t		buffer[SHA1_BLOCK_LEN];
+} Sha1Ctx;
+
+extern const Sha1Impl *sha1_impls(void);
+extern const char *sha1_impl_name(void);
+extern void sha1_init(Sha1Ctx *ctx);
+extern void sha1_init_impl(Sha1Ctx *ctx, const Sha1Impl *impl);
+extern void sha1_update(Sha1Ctx *ctx, const uint8_t *data, size_t len);
+extern void sha1_final(Sha1Ctx *ctx, uint8_t digest[SHA1_DIGEST_LEN]);
+extern void dex_sha1(const uint8_t *data, size_t len, uint8_t digest[SHA1_DIGEST_LEN]);
+
+#endif /* __SHA1_H__ */
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include "strbuf.h"
+#include "dexstats.h"
+
+#define STRBUF_MIN		256
+
+void strbuf_init(StrBuf *sb)
+{
+	sb->data = NULL;
+	sb->len = 0;
+	sb->cap = 0;
+}
+
+void strbuf_free(StrBuf *sb)
+{
+	free(sb->data);
+	strbuf_init(sb);
+}
+
+/*
+ * make room for extra more bytes plus the '\0'.
+ */
+int strbuf_reserve(StrBuf *sb, size_t extra)
+{
+	size_t cap;
+	char *data;
+
+	if(sb->cap - sb->len > extra)
+		return 0;
+
+	cap = sb->cap ? sb->cap : STRBUF_MIN;
+	while(cap - sb->len <= extra){
+		if(cap > (size_t)-1 / 2){
+			fprintf(stderr, "strbuf_reserve - size overflow.\n");
+			return -1;
+		}
+		cap *= 2;
+	}
+
+	data = (char *)dex_realloc(sb->data, cap);
+	if(data == NULL){
+		fprintf(stderr, "strbuf_reserve - realloc failure out of memory.\n");
+		return -1;
+	}
+	sb->data = data;
+	sb->cap = cap;
+	return 0;
+}
+
+int strbuf_append(StrBuf *sb, const char *str, size_t len)
+{
+	if(strbuf_reserve(sb, len) == -1)
+		return -1;
+	memcpy(sb->data + sb->len, str, len);
+	sb->len += len;
+	sb->data[sb->len] = '\0';
+	return 0;
+}
+
+int strbuf_puts(StrBuf *sb, const char *str)
+{
+	return strbuf_append(sb, str, strlen(str));
+}
+
+int strbuf_putc(StrBuf *sb, char c)
+{
+	if(strbuf_reserve(sb, 1) == -1)
+		return -1;
+	sb->data[sb->len++] = c;
+	sb->data[sb->len] = '\0';
+	return 0;
+}
+
+/*
+ * value in decimal, without going through printf.
+ */
+int strbuf_putdec(StrBuf *sb, long long value)
+{
+	char digits[24];
+	unsigned long long u = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+	int n = sizeof(digits);
+
+	do{
+		digits[--n] = '0' + u % 10;
+		u /= 10;
+	}while(u != 0);
+	if(value < 0)
+		digits[--n] = '-';
+	return strbuf_append(sb, digits + n, sizeof(digits) - n);
+}
+
+/*
+ * value in lower case hex, zero padded to at least digits digits.
+ */
+int strbuf_puthex(StrBuf *sb, unsigned long long value, int digits)
+{
+	static const char hex[] = "0123456789abcdef";
+	char buf[16];
+	int n = sizeof(buf);
+
+	do{
+		buf[--n] = hex[value & 0xf];
+		value >>= 4;
+	}while(n > 0 && (value != 0 || (int)sizeof(buf) - n < digits));
+	return strbuf_append(sb, buf + n, sizeof(buf) - n);
+}
+
+int strbuf_printf(StrBuf *sb, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if(strbuf_reserve(sb, 0) == -1)
+		return -1;
+
+	// most calls fit in what is left, only the rest format twice.
+	va_start(ap, fmt);
+	n = vsnprintf(sb->data + sb->len, sb->cap - sb->len, fmt, ap);
+	va_end(ap);
+	if(n < 0){
+		sb->data[sb->len] = '\0';
+		return -1;
+	}
+
+	if((size_t)n >= sb->cap - sb->len){
+		if(strbuf_reserve(sb, n) == -1){
+			sb->data[sb->len] = '\0';
+			return -1;
+		}
+		va_start(ap, fmt);
+		vsnprintf(sb->data + sb->len, sb->cap - sb->len, fmt, ap);
+		va_end(ap);
+	}
+	sb->len += n;
+	return 0;
+}
+
+void strbuf_truncate(StrBuf *sb, size_t len)
+{
+	if(len < sb->len){
+		sb->len = len;
+		sb->data[len] = '\0';
+	}
+}
+
+/*
+ * for a caller that formats in place: room for extra bytes (plus the
+ * '\0') at the end of the buffer, or NULL. The bytes written there count
+ * once strbuf_commit() is given the end of them.
+ */
+char *strbuf_tail(StrBuf *sb, size_t extra)
+{
+	if(strbuf_reserve(sb, extra) == -1)
+		return NULL;
+	return sb->data + sb->len;
+}
+
+void strbuf_commit(StrBuf *sb, char *end)
+{
+	sb->len = end - sb->data;
+	*end = '\0';
+}
+
+/*
+ * write the whole buffer to fd and empty it.
+ */
+int strbuf_write(StrBuf *sb, int fd)
+{
+	DexStatsTimer timer;
+	size_t off = 0;
+	ssize_t n;
+
+	if(sb->len == 0)
+		return 0;
+	dex_stats_begin(&timer);
+	while(off < sb->len){
+		n = write(fd, sb->data + off, sb->len - off);
+		DEX_STAT_ADD(DEX_STAT_WRITE_CALLS, 1);
+		if(n == -1){
+			if(errno == EINTR)
+				continue;
+			perror("strbuf_write - write");
+			dex_stats_end(&timer, DEX_PHASE_FLUSH);
+			return -1;
+		}
+		off += n;
+	}
+	DEX_STAT_ADD(DEX_STAT_WRITE_BYTES, off);
+	dex_stats_end(&timer, DEX_PHASE_FLUSH);
+	strbuf_truncate(sb, 0);
+	return 0;
+}
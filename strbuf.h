@@ -0,0 +1,31 @@
+#ifndef __STRBUF_H__
+#define __STRBUF_H__
+
+#include <stddef.h>
+
+/*
+ * Growable string builder. data is always NUL terminated once anything
+ * has been appended; len does not count the '\0'. The append functions
+ * return 0, or -1 when the buffer cannot grow (it is left as it was).
+ */
+typedef struct {
+	char	*data;
+	size_t	len;
+	size_t	cap;
+} StrBuf;
+
+extern void strbuf_init(StrBuf *sb);
+extern void strbuf_free(StrBuf *sb);
+extern int strbuf_reserve(StrBuf *sb, size_t extra);
+extern int strbuf_append(StrBuf *sb, const char *str, size_t len);
+extern int strbuf_puts(StrBuf *sb, const char *str);
+extern int strbuf_putc(StrBuf *sb, char c);
+extern int strbuf_putdec(StrBuf *sb, long long value);
+extern int strbuf_puthex(StrBuf *sb, unsigned long long value, int digits);
+extern int strbuf_printf(StrBuf *sb, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+extern void strbuf_truncate(StrBuf *sb, size_t len);
+extern char *strbuf_tail(StrBuf *sb, size_t extra);
+extern void strbuf_commit(StrBuf *sb, char *end);
+extern int strbuf_write(StrBuf *sb, int fd);
+
+#endif	/* __STRBUF_H__ */
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "strpool.h"
+#include "dexstats.h"
+
+int string_pool_init(StringPool *pool, Arena *arena, const DexImage *image, const StringIdItem *items, u4 size)
+{
+	if(pool == NULL || arena == NULL || image == NULL || (items == NULL && size != 0)){
+		fprintf(stderr, "string_pool_init - invalid parameter.\n");
+		return -1;
+	}
+
+	memset(pool, 0, sizeof(*pool));
+	pool->image = image;
+	pool->items = items;
+	pool->size = size;
+	pool->arena = arena;
+	pool->entries = (StringEntry *)arena_calloc(arena, size, sizeof(StringEntry));
+	pool->printable = (const char **)arena_calloc(arena, size, sizeof(char *));
+	if(pool->entries == NULL || pool->printable == NULL){
+		fprintf(stderr, "string_pool_init - out of memory.\n");
+		return -1;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	return 0;
+}
+
+/*
+ * the memory stays with the arena.
+ */
+void string_pool_free(StringPool *pool)
+{
+	if(pool == NULL || pool->entries == NULL)
+		return ;
+	pthread_mutex_destroy(&pool->lock);
+	memset(pool, 0, sizeof(*pool));
+}
+
+/*
+ * the raw MUTF-8 bytes of string idx, straight from the image.
+ * returns 0 on success, -1 on a bad index or malformed string_data_item.
+ */
+int string_pool_view(StringPool *pool, u4 idx, StrView *view)
+{
+	StringEntry *entry;
+	const u1 *data, *end, *nul;
+	u4 data_off, utf16_len;
+	int okay;
+
+	if(pool == NULL || idx >= pool->size)
+		return -1;
+
+	entry = &pool->entries[idx];
+	data_off = __atomic_load_n(&entry->data_off, __ATOMIC_ACQUIRE);
+	DEX_STAT_ADD(data_off == 0 ? DEX_STAT_STRING_MISSES : DEX_STAT_STRING_HITS, 1);
+	if(data_off == 0){
+		data = (const u1 *)dex_image_ptr(pool->image, pool->items[idx].string_data_off, 1, 1);
+		if(data == NULL){
+			fprintf(stderr, "string_pool_view - invalid string data offset %x.\n", pool->items[idx].string_data_off);
+			return -1;
+		}
+		end = dex_image_end(pool->image);
+		utf16_len = readAndVerifyUnsignedLeb128(&data, end, &okay);
+		if(!okay){
+			fprintf(stderr, "string_pool_view - bad string length at %x.\n", pool->items[idx].string_data_off);
+			return -1;
+		}
+		// the leb128 prefix is the utf-16 length, the MUTF-8 bytes run up to '\0'
+		nul = data < end ? (const u1 *)memchr(data, '\0', end - data) : NULL;
+		if(nul == NULL){
+			fprintf(stderr, "string_pool_view - unterminated string at %x.\n", pool->items[idx].string_data_off);
+			return -1;
+		}
+		// another thread may resolve the same entry, it stores the same values.
+		data_off = data - pool->image->base;
+		__atomic_store_n(&entry->utf16_len, utf16_len, __ATOMIC_RELAXED);
+		__atomic_store_n(&entry->len, (u4)(nul - data), __ATOMIC_RELAXED);
+		__atomic_store_n(&entry->data_off, data_off, __ATOMIC_RELEASE);
+	}
+
+	view->data = (const char *)pool->image->base + data_off;
+	view->len = __atomic_load_n(&entry->len, __ATOMIC_RELAXED);
+	view->utf16_len = __atomic_load_n(&entry->utf16_len, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/*
+ * string idx as a printable C string: '\n' is written as "\\n". When the
+ * string has nothing to escape this points into the image itself.
+ */
+const char *string_pool_get(StringPool *pool, u4 idx)
+{
+	StrView view;
+	const char *nl;
+	const char *str;
+	char *buffer;
+	u4 i, j, newline = 0;
+
+	if(pool == NULL || idx >= pool->size)
+		return NULL;
+	if((str = __atomic_load_n(&pool->printable[idx], __ATOMIC_ACQUIRE)) != NULL){
+		DEX_STAT_ADD(DEX_STAT_STRING_HITS, 1);
+		return str;
+	}
+	if(string_pool_view(pool, idx, &view) == -1)
+		return NULL;
+
+	nl = (const char *)memchr(view.data, '\n', view.len);
+	if(nl == NULL){
+		__atomic_store_n(&pool->printable[idx], view.data, __ATOMIC_RELEASE);
+		return view.data;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	if((str = pool->printable[idx]) != NULL){
+		// escaped by another thread meanwhile
+		pthread_mutex_unlock(&pool->lock);
+		return str;
+	}
+
+	for(i = nl - view.data; i < view.len; ++i){
+		if(view.data[i] == '\n')
+			++newline;
+	}
+
+	// one more char for every '\n' being transformed to "\\n"
+	buffer = (char *)arena_alloc_align(pool->arena, view.len + newline + 1, 1);
+	if(buffer == NULL){
+		pthread_mutex_unlock(&pool->lock);
+		return NULL;
+	}
+	for(j = 0, i = 0; i < view.len; ++i, ++j){
+		// just handle the newline character.
+		// skip other invisible character
+		if(view.data[i] == '\n'){
+			buffer[j++] = '\\';
+			buffer[j] = 'n';
+		}else{
+			buffer[j] = view.data[i];
+		}
+	}
+	buffer[j] = '\0';
+
+	__atomic_store_n(&pool->printable[idx], buffer, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&pool->lock);
+	return buffer;
+}
+
+/*
+ * take over already resolved entries (from an index cache) so lookups skip
+ * the leb128 decoding and the search for the '\0'. Entries that do not end
+ * at a '\0' inside the image are refused as a whole.
+ */
+int string_pool_preload(StringPool *pool, const StringEntry *entries)
+{
+	u4 i;
+
+	for(i = 0; i < pool->size; ++i){
+		if(entries[i].data_off != 0 && ((unsigned long long)entries[i].data_off + entries[i].len >= pool->image->size
+											|| pool->image->base[entries[i].data_off + entries[i].len] != '\0'))
+			return -1;
+	}
+	memcpy(pool->entries, entries, sizeof(StringEntry) * pool->size);
+	return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef __STRPOOL_H__
+#define __STRPOOL_H__
+
+#include <pthread.h>
+#include "dex.h"
+#include "deximage.h"
+#include "arena.h"
+
+/*
+ * A lazily decoded view of the string_ids table. Nothing is read until
+ * a string is asked for; an entry then keeps the offset of its MUTF-8
+ * bytes, their length and its utf-16 length. Strings that need no escaping are returned
+ * straight from the image (string_data is NUL terminated on disk), the
+ * others are escaped once into the arena the pool was given, which also
+ * holds its tables and is what frees them.
+ *
+ * Lookups may run from several threads on one pool: resolved entries are
+ * published with release stores, escaping is done under a lock.
+ */
+typedef struct {
+	const char	*data;		/* MUTF-8 bytes, not counting the '\0' */
+	u4			len;		/* byte length */
+	u4			utf16_len;	/* length in utf-16 code units, as recorded */
+} StrView;
+
+typedef struct {
+	u4	data_off;			/* 0 until resolved, header lives at offset 0 */
+	u4	utf16_len;
+	u4	len;				/* MUTF-8 bytes up to the '\0' */
+} StringEntry;
+
+typedef struct {
+	const DexImage		*image;
+	const StringIdItem	*items;
+	u4					size;
+	StringEntry			*entries;
+	const char			**printable;	/* escaped (or in-image) strings, NULL until asked */
+	Arena				*arena;			/* tables and escaped copies */
+	pthread_mutex_t		lock;			/* one thread escapes a string */
+} StringPool;
+
+extern int string_pool_init(StringPool *pool, Arena *arena, const DexImage *image, const StringIdItem *items, u4 size);
+extern void string_pool_free(StringPool *pool);
+extern int string_pool_view(StringPool *pool, u4 idx, StrView *view);
+extern const char *string_pool_get(StringPool *pool, u4 idx);
+extern int string_pool_preload(StringPool *pool, const StringEntry *entries);
+
+#endif	/* __STRPOOL_H__ */
@@ -0,0 +1,183 @@
+/*
+ * checksum kernels against the scalar code and zlib: every adler32 and
+ * sha1 kernel this cpu can run, over buffers of every length up to a few
+ * blocks, at every alignment, and split into uneven updates. Also the
+ * FIPS 180 sha1 vectors and adler32_sha1_update() against the two run
+ * one after the other.
+ *
+ *   ./checksum_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "../checksum.h"
+
+#define BUF_SIZE		(256 * 1024)
+#define MAX_SHORT		300				// every length up to this, then a few long ones
+#define MAX_ALIGN		64
+
+static uint8_t *buffer;
+static int failures;
+
+static void fail(const char *what, const char *impl, size_t off, size_t len)
+{
+	fprintf(stderr, "checksum_test - %s (%s) differs at offset %zu length %zu.\n", what, impl, off, len);
+	++failures;
+}
+
+static void hex(char *out, const uint8_t digest[SHA1_DIGEST_LEN])
+{
+	int i;
+
+	for(i = 0; i < SHA1_DIGEST_LEN; ++i)
+		sprintf(out + 2 * i, "%02x", digest[i]);
+}
+
+/* the digest of len bytes at data, fed in pieces of step bytes */
+static void sha1_with(const Sha1Impl *impl, const uint8_t *data, size_t len, size_t step, uint8_t digest[SHA1_DIGEST_LEN])
+{
+	Sha1Ctx ctx;
+	size_t n;
+
+	sha1_init_impl(&ctx, impl);
+	for(; len > 0; data += n, len -= n){
+		n = len < step ? len : step;
+		sha1_update(&ctx, data, n);
+	}
+	sha1_final(&ctx, digest);
+}
+
+static void check_adler32(const Adler32Impl *impl, size_t off, size_t len)
+{
+	uint32_t want = (uint32_t)adler32(ADLER32_INIT, buffer + off, len);
+	uint32_t got;
+	size_t half = len / 3;
+
+	if(impl->update(ADLER32_INIT, buffer + off, len) != want)
+		fail("adler32", impl->name, off, len);
+	if(adler32_update_scalar(ADLER32_INIT, buffer + off, len) != want)
+		fail("adler32", "scalar", off, len);
+	got = impl->update(ADLER32_INIT, buffer + off, half);
+	if(impl->update(got, buffer + off + half, len - half) != want)
+		fail("adler32 in two updates", impl->name, off, len);
+}
+
+static void check_sha1(const Sha1Impl *impl, const Sha1Impl *portable, size_t off, size_t len)
+{
+	static const size_t steps[] = {1, 7, 63, 64, 65, 4096};
+	uint8_t want[SHA1_DIGEST_LEN], got[SHA1_DIGEST_LEN];
+	size_t i;
+
+	sha1_with(portable, buffer + off, len, len ? len : 1, want);
+	for(i = 0; i < sizeof(steps) / sizeof(steps[0]); ++i){
+		if(steps[i] < 64 && len > 4 * MAX_SHORT)
+			continue;
+		sha1_with(impl, buffer + off, len, steps[i], got);
+		if(memcmp(got, want, SHA1_DIGEST_LEN) != 0)
+			fail("sha1", impl->name, off, len);
+	}
+}
+
+static void check_vectors(const Sha1Impl *impl)
+{
+	static const struct {
+		const char *text;
+		size_t repeat;
+		const char *digest;
+	} vectors[] = {
+		{"", 1, "da39a3ee5e6b4b0d3255bfef95601890afd80709"},
+		{"abc", 1, "a9993e364706816aba3e25717850c26c9cd0d89d"},
+		{"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1, "84983e441c3bd26ebaae4aa1f95129e5e54670f1"},
+		{"a", 1000000, "34aa973cd4c4daa4f61eeb2bdbad27316534016f"},
+	};
+	uint8_t digest[SHA1_DIGEST_LEN];
+	char text[2 * SHA1_DIGEST_LEN + 1];
+	Sha1Ctx ctx;
+	size_t i, r;
+
+	for(i = 0; i < sizeof(vectors) / sizeof(vectors[0]); ++i){
+		sha1_init_impl(&ctx, impl);
+		for(r = 0; r < vectors[i].repeat; ++r)
+			sha1_update(&ctx, (const uint8_t *)vectors[i].text, strlen(vectors[i].text));
+		sha1_final(&ctx, digest);
+		hex(text, digest);
+		if(strcmp(text, vectors[i].digest) != 0)
+			fail("sha1 test vector", impl->name, i, strlen(vectors[i].text) * vectors[i].repeat);
+	}
+}
+
+/* the fused pass the verifier uses against adler32 and sha1 on their own */
+static void check_fused(size_t off, size_t len)
+{
+	uint8_t want[SHA1_DIGEST_LEN], got[SHA1_DIGEST_LEN];
+	Sha1Ctx ctx;
+
+	sha1_init(&ctx);
+	if(adler32_sha1_update(ADLER32_INIT, &ctx, buffer + off, len) != (uint32_t)adler32(ADLER32_INIT, buffer + off, len))
+		fail("adler32_sha1_update adler32", adler32_impl_name(), off, len);
+	sha1_final(&ctx, got);
+	dex_sha1(buffer + off, len, want);
+	if(memcmp(got, want, SHA1_DIGEST_LEN) != 0)
+		fail("adler32_sha1_update sha1", sha1_impl_name(), off, len);
+}
+
+int main(void)
+{
+	static const size_t long_lens[] = {1023, 4096, 5552, 5553, 65536, 100000, BUF_SIZE - MAX_ALIGN};
+	const Adler32Impl *adlers = adler32_impls();
+	const Sha1Impl *sha1s = sha1_impls();
+	const Sha1Impl *portable;
+	size_t off, len, i;
+	int a, s;
+
+	if((buffer = (uint8_t *)malloc(BUF_SIZE)) == NULL){
+		fprintf(stderr, "checksum_test - malloc failure out of memory.\n");
+		return EXIT_FAILURE;
+	}
+	// mostly high bytes, which is where adler32 sums overflow first
+	srand(1);
+	for(i = 0; i < BUF_SIZE; ++i)
+		buffer[i] = i % 5 == 0 ? 0xff : (uint8_t)rand();
+
+	for(s = 0; sha1s[s].name != NULL; ++s)
+		;
+	portable = &sha1s[s - 1];
+
+	for(a = 0; adlers[a].name != NULL; ++a){
+		printf("adler32 %s\n", adlers[a].name);
+		for(off = 0; off < MAX_ALIGN; ++off){
+			for(len = 0; len <= MAX_SHORT; ++len)
+				check_adler32(&adlers[a], off, len);
+		}
+		for(i = 0; i < sizeof(long_lens) / sizeof(long_lens[0]); ++i){
+			for(off = 0; off < MAX_ALIGN; off += 13)
+				check_adler32(&adlers[a], off, long_lens[i]);
+		}
+	}
+
+	for(s = 0; sha1s[s].name != NULL; ++s){
+		printf("sha1 %s\n", sha1s[s].name);
+		check_vectors(&sha1s[s]);
+		for(off = 0; off < MAX_ALIGN; off += 3){
+			for(len = 0; len <= MAX_SHORT; ++len)
+				check_sha1(&sha1s[s], portable, off, len);
+		}
+		for(i = 0; i < sizeof(long_lens) / sizeof(long_lens[0]); ++i)
+			check_sha1(&sha1s[s], portable, 5, long_lens[i]);
+	}
+
+	for(off = 0; off < 8; ++off){
+		for(len = 0; len <= MAX_SHORT; len += 11)
+			check_fused(off, len);
+		check_fused(off, BUF_SIZE - MAX_ALIGN);
+	}
+
+	free(buffer);
+	if(failures != 0){
+		fprintf(stderr, "checksum_test - %d checks failed.\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("checksums OK\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+#!/bin/sh
+#
+# make test: readex over Hello.dex, classes.dex and small gendex outputs
+# (a dex and a multidex apk), each output compared with its file in
+# test/expected, then malformed inputs, which must fail cleanly with the
+# messages recorded there too. Every expected file ends with the exit
+# status of the run.
+#
+#   sh test/run.sh            from the top directory, after make readex gendex
+#   UPDATE=1 sh test/run.sh   rewrite test/expected from this build
+#
+# Everything is run from test/work with relative paths, so the messages
+# naming a file are the same on every machine.
+
+EXPECTED=../expected
+READEX=../../readex
+GENDEX=../../gendex
+CLASSES=android.support.v7.app.AppCompatViewInflater,android.support.v7.widget.DrawableUtils,android.support.graphics.drawable.AndroidResources
+failed=0
+passed=0
+
+cd "$(dirname "$0")" || exit 1
+rm -rf work
+mkdir -p work expected
+cd work || exit 1
+cp ../../Hello.dex ../../classes.dex .
+
+# name command...: run it, keep stdout, stderr and the exit status
+run()
+{
+	name=$1
+	shift
+	"$@" > "$name.out" 2>&1
+	echo "exit $?" >> "$name.out"
+}
+
+# name command...: run it and compare with test/expected/name.txt
+check()
+{
+	run "$@"
+	compare "$1" "$1"
+}
+
+# name expected: compare name.out with test/expected/expected.txt
+compare()
+{
+	if [ -n "$UPDATE" ]; then
+		cp "$1.out" "$EXPECTED/$2.txt"
+	elif cmp -s "$1.out" "$EXPECTED/$2.txt"; then
+		passed=$((passed + 1))
+		return 0
+	else
+		echo "FAIL $1"
+		diff -u "$EXPECTED/$2.txt" "$1.out" | head -20
+		failed=$((failed + 1))
+		return 1
+	fi
+}
+
+# file offset bytes: overwrite bytes (printf escapes) at offset
+patch()
+{
+	printf "$3" | dd of="$1" bs=1 seek="$2" conv=notrunc 2>/dev/null
+}
+
+# file offset: the little endian u4 at offset
+u4()
+{
+	od -An -tu4 -j "$2" -N 4 "$1" | tr -d ' '
+}
+
+# generated inputs, the same bytes on every run
+$GENDEX -c 12 -m 3 -f 2 -s 80 -p 8 -t 30 -u 10 gen.dex > /dev/null || exit 1
+$GENDEX -c 20 -m 4 -f 2 -s 100 -p 10 -t 40 -u 12 -M 40 gen.apk > /dev/null || exit 1
+
+# Hello.dex
+check hello $READEX Hello.dex
+check hello-all $READEX -m --map -C --code --lines --annotations Hello.dex
+check hello-json $READEX --format=json -H -C --lines --annotations Hello.dex
+
+# classes.dex: switches, try blocks, array data, and the indexes
+check classes-header $READEX -H --map classes.dex
+check classes-code $READEX -c $CLASSES --code --lines --annotations classes.dex
+check classes-ndjson $READEX --format=ndjson -c android.support.v7.widget.DrawableUtils --lines --annotations classes.dex
+check classes-xref $READEX --xref --callers 'Landroid/view/View;->getId' --string-refs http://schemas.android.com/apk/res/android classes.dex
+check classes-hierarchy $READEX --ancestors android.support.v7.widget.ListPopupWindow --subclasses android.support.v4.app.Fragment classes.dex
+check classes-grep $READEX --grep http classes.dex
+check classes-verify $READEX --verify-only classes.dex Hello.dex
+
+# the index cache: written by the first run, used by the second
+mkdir cache
+run classes-cache-write $READEX --cache-dir cache -c $CLASSES --code --lines --annotations classes.dex
+compare classes-cache-write classes-code
+run classes-cache-hit $READEX --cache-dir cache -c $CLASSES --code --lines --annotations classes.dex
+compare classes-cache-hit classes-code
+
+# generated inputs, and the same dumps with -j
+check gen-dex $READEX -C --code gen.dex
+check gen-apk $READEX -H -C --code gen.apk
+check gen-apk-json $READEX --format=json -C gen.apk
+check gen-verify $READEX --verify-only gen.apk gen.dex
+check gen-diff $READEX --diff gen.dex gen.apk
+check multi $READEX -C --code Hello.dex gen.dex gen.apk
+run multi-j $READEX -j 3 -C --code Hello.dex gen.dex gen.apk
+compare multi-j multi
+
+# malformed: code items. Hello.dex has main()'s code_item at 0x148, so
+# its insns_size is at 0x154.
+cp Hello.dex short-insns.dex
+patch short-insns.dex 340 '\006\000\000\000'
+check bad-short-insns $READEX --no-verify -C --code short-insns.dex
+cp Hello.dex long-insns.dex
+patch long-insns.dex 340 '\377\377\377\177'
+check bad-long-insns $READEX --no-verify -C --code long-insns.dex
+head -c 340 Hello.dex > truncated.dex
+check bad-truncated $READEX --no-verify -C --code truncated.dex
+check bad-checksum $READEX -C short-insns.dex
+
+# malformed: the zip central directory. gendex writes no archive comment,
+# so the end record is the last 22 bytes.
+size=$(wc -c < gen.apk)
+cp gen.apk cd-offset.apk
+patch cd-offset.apk $((size - 6)) '\000\377\377\177'
+check bad-cd-offset $READEX -H cd-offset.apk
+cp gen.apk cd-entry.apk
+patch cd-entry.apk "$(u4 gen.apk $((size - 6)))" 'PK\007\010'
+check bad-cd-entry $READEX -H cd-entry.apk
+head -c $((size - 10)) gen.apk > cd-truncated.apk
+check bad-cd-truncated $READEX -H cd-truncated.apk
+
+# malformed: the index cache, damaged after the header (its adler32 no
+# longer matches) and cut short. Both are ignored and rewritten.
+idx=$(ls cache/*.idx)
+patch "$idx" 200 '\125\125\125\125'
+check bad-index $READEX --cache-dir cache -c $CLASSES classes.dex
+head -c 40 "$idx" > cut.idx && mv cut.idx "$idx"
+check bad-index-short $READEX --cache-dir cache -c $CLASSES classes.dex
+run index-rewritten $READEX --cache-dir cache -c $CLASSES --code --lines --annotations classes.dex
+compare index-rewritten classes-code
+
+cd .. && rm -rf work
+if [ -n "$UPDATE" ]; then
+	echo "test/expected updated"
+	exit 0
+fi
+echo "$passed passed, $failed failed"
+[ "$failed" -eq 0 ]
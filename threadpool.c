@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "threadpool.h"
+#include "dexstats.h"
+
+typedef struct {
+	pthread_mutex_t	lock;
+	size_t			head;		/* next job of the owner */
+	size_t			tail;		/* one past the last job, thieves take from here */
+} PoolQueue;
+
+typedef struct {
+	PoolQueue	*queues;
+	int			nthreads;
+	PoolJob		fn;
+	void		*arg;
+} Pool;
+
+typedef struct {
+	Pool		*pool;
+	int			id;
+	pthread_t	thread;
+} PoolWorker;
+
+static int pop_job(PoolQueue *queue, size_t *job)
+{
+	int found = 0;
+
+	pthread_mutex_lock(&queue->lock);
+	if(queue->head < queue->tail){
+		*job = queue->head++;
+		found = 1;
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return found;
+}
+
+/*
+ * move the back half of some other queue into ours. returns 0 once every
+ * queue is empty, jobs are never handed back so the worker can then stop.
+ */
+static int steal_jobs(Pool *pool, int id)
+{
+	PoolQueue *victim, *own = &pool->queues[id];
+	size_t head, tail;
+	int i;
+
+	for(i = 1; i < pool->nthreads; ++i){
+		victim = &pool->queues[(id + i) % pool->nthreads];
+		pthread_mutex_lock(&victim->lock);
+		head = victim->head + (victim->tail - victim->head) / 2;
+		tail = victim->tail;
+		if(head < tail)
+			victim->tail = head;
+		pthread_mutex_unlock(&victim->lock);
+
+		if(head < tail){
+			pthread_mutex_lock(&own->lock);
+			own->head = head;
+			own->tail = tail;
+			pthread_mutex_unlock(&own->lock);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void *worker_main(void *arg)
+{
+	PoolWorker *worker = (PoolWorker *)arg;
+	Pool *pool = worker->pool;
+	size_t job;
+
+	do{
+		while(pop_job(&pool->queues[worker->id], &job))
+			pool->fn(job, worker->id, pool->arg);
+	}while(steal_jobs(pool, worker->id));
+
+	return NULL;
+}
+
+int pool_default_threads(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+
+int pool_run(int nthreads, size_t njobs, PoolJob fn, void *arg)
+{
+	Pool pool;
+	PoolWorker *workers;
+	size_t job;
+	int started;
+	int i;
+
+	if(fn == NULL){
+		fprintf(stderr, "pool_run - invalid job function.\n");
+		return -1;
+	}
+
+	if((size_t)nthreads > njobs)
+		nthreads = (int)njobs;
+	if(nthreads <= 1){
+		for(job = 0; job < njobs; ++job)
+			fn(job, 0, arg);
+		return 0;
+	}
+
+	pool.queues = (PoolQueue *)dex_calloc(nthreads, sizeof(PoolQueue));
+	workers = (PoolWorker *)dex_calloc(nthreads, sizeof(PoolWorker));
+	if(pool.queues == NULL || workers == NULL){
+		fprintf(stderr, "pool_run - calloc failure out of memory.\n");
+		free(pool.queues);
+		free(workers);
+		return -1;
+	}
+	pool.nthreads = nthreads;
+	pool.fn = fn;
+	pool.arg = arg;
+
+	for(i = 0; i < nthreads; ++i){
+		pthread_mutex_init(&pool.queues[i].lock, NULL);
+		pool.queues[i].head = njobs * i / nthreads;
+		pool.queues[i].tail = njobs * (i + 1) / nthreads;
+		workers[i].pool = &pool;
+		workers[i].id = i;
+	}
+
+	// worker 0 is the calling thread.
+	for(started = 1; started < nthreads; ++started){
+		if(pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) != 0){
+			// the workers already running steal whatever was meant for the rest.
+			fprintf(stderr, "pool_run - pthread_create failure, running on %d threads.\n", started);
+			break;
+		}
+	}
+	worker_main(&workers[0]);
+
+	for(i = 1; i < started; ++i)
+		pthread_join(workers[i].thread, NULL);
+
+	for(i = 0; i < nthreads; ++i)
+		pthread_mutex_destroy(&pool.queues[i].lock);
+	free(pool.queues);
+	free(workers);
+	return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <stddef.h>
+
+/*
+ * Run jobs 0 .. njobs-1 on nthreads worker threads. Every worker starts
+ * with an equal slice of the job range and takes jobs from its front;
+ * a worker that runs dry steals the back half of another worker's slice,
+ * so uneven jobs (one huge dex among small ones) still keep all threads
+ * busy. fn gets the job number and the worker number (0 .. nthreads-1),
+ * which can be used to index per-thread state.
+ */
+typedef void (*PoolJob)(size_t job, int worker, void *arg);
+
+extern int pool_run(int nthreads, size_t njobs, PoolJob fn, void *arg);
+extern int pool_default_threads(void);
+
+#endif	/* __THREADPOOL_H__ */
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "ziparchive.h"
+#include "dexstats.h"
+
+#define LOCAL_MAGIC		0x04034b50
+#define CENTRAL_MAGIC	0x02014b50
+#define EOCD_MAGIC		0x06054b50
+
+#define LOCAL_SIZE		30
+#define CENTRAL_SIZE	46
+#define EOCD_SIZE		22
+#define MAX_COMMENT		0xFFFF
+
+#define ZIP64_MARK		0xFFFFFFFF
+
+/* zip fields are little endian and unaligned. */
+static u2 get_u2(const u1 *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static u4 get_u4(const u1 *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (u4)p[3] << 24;
+}
+
+int zip_is_archive(const DexImage *image)
+{
+	const u1 *magic = (const u1 *)dex_image_ptr(image, 0, 4, 1);
+	return magic != NULL && get_u4(magic) == LOCAL_MAGIC;
+}
+
+/*
+ * the end of central directory record is the last thing in the file,
+ * followed only by a comment of up to 64K.
+ */
+static const u1 *find_eocd(const DexImage *image)
+{
+	const u1 *p, *stop;
+
+	if(image->size < EOCD_SIZE)
+		return NULL;
+	p = image->base + image->size - EOCD_SIZE;
+	stop = image->size > EOCD_SIZE + MAX_COMMENT ? p - MAX_COMMENT : image->base;
+	for(; p >= stop; --p){
+		if(get_u4(p) == EOCD_MAGIC && p + EOCD_SIZE + get_u2(p + 20) == image->base + image->size)
+			return p;
+	}
+	return NULL;
+}
+
+int zip_open(ZipArchive *zip, const DexImage *image)
+{
+	const u1 *eocd, *p;
+	u4 cd_size, cd_off;
+	u4 i, cnt;
+	ZipEntry *entry;
+
+	memset(zip, 0, sizeof(*zip));
+	zip->image = image;
+
+	if((eocd = find_eocd(image)) == NULL){
+		fprintf(stderr, "zip_open - end of central directory not found.\n");
+		return -1;
+	}
+	cnt = get_u2(eocd + 10);
+	cd_size = get_u4(eocd + 12);
+	cd_off = get_u4(eocd + 16);
+	if(cd_size == ZIP64_MARK || cd_off == ZIP64_MARK || cnt == 0xFFFF){
+		fprintf(stderr, "zip_open - zip64 archives are not supported.\n");
+		return -1;
+	}
+
+	if((p = (const u1 *)dex_image_ptr(image, cd_off, cd_size, 1)) == NULL){
+		fprintf(stderr, "zip_open - central directory out of file bounds.\n");
+		return -1;
+	}
+
+	zip->entries = (ZipEntry *)dex_calloc(cnt ? cnt : 1, sizeof(ZipEntry));
+	if(zip->entries == NULL){
+		fprintf(stderr, "zip_open - calloc failure out of memory.\n");
+		return -1;
+	}
+
+	for(i = 0; i < cnt; ++i){
+		if((size_t)(image->base + cd_off + cd_size - p) < CENTRAL_SIZE || get_u4(p) != CENTRAL_MAGIC){
+			fprintf(stderr, "zip_open - bad central directory entry %u.\n", i);
+			zip_close(zip);
+			return -1;
+		}
+		entry = &zip->entries[i];
+		entry->method = get_u2(p + 10);
+		entry->crc32 = get_u4(p + 16);
+		entry->comp_size = get_u4(p + 20);
+		entry->uncomp_size = get_u4(p + 24);
+		entry->name_len = get_u2(p + 28);
+		entry->local_off = get_u4(p + 42);
+		entry->name = (const char *)p + CENTRAL_SIZE;
+
+		p += CENTRAL_SIZE + entry->name_len + get_u2(p + 30) + get_u2(p + 32);
+		if(p > image->base + cd_off + cd_size){
+			fprintf(stderr, "zip_open - central directory entry %u out of bounds.\n", i);
+			zip_close(zip);
+			return -1;
+		}
+	}
+	zip->cnt = cnt;
+	return 0;
+}
+
+void zip_close(ZipArchive *zip)
+{
+	if(zip == NULL)
+		return ;
+	free(zip->entries);
+	zip->entries = NULL;
+	zip->cnt = 0;
+}
+
+/*
+ * the entry's (possibly compressed) bytes, comp_size long, or NULL if
+ * the local header or the data do not fit in the archive.
+ */
+const u1 *zip_entry_data(const ZipArchive *zip, const ZipEntry *entry)
+{
+	const u1 *local;
+	size_t off;
+
+	if(entry->comp_size == ZIP64_MARK || entry->uncomp_size == ZIP64_MARK || entry->local_off == ZIP64_MARK){
+		fprintf(stderr, "zip_entry_data - zip64 entries are not supported.\n");
+		return NULL;
+	}
+
+	local = (const u1 *)dex_image_ptr(zip->image, entry->local_off, LOCAL_SIZE, 1);
+	if(local == NULL || get_u4(local) != LOCAL_MAGIC){
+		fprintf(stderr, "zip_entry_data - bad local header at %x.\n", entry->local_off);
+		return NULL;
+	}
+
+	// the local name and extra field lengths may differ from the central ones.
+	off = (size_t)entry->local_off + LOCAL_SIZE + get_u2(local + 26) + get_u2(local + 28);
+	return (const u1 *)dex_image_ptr(zip->image, off, entry->comp_size, 1);
+}
+
+/*
+ * inflate a deflated entry into out, which holds uncomp_size bytes.
+ */
+int zip_inflate(const ZipArchive *zip, const ZipEntry *entry, u1 *out)
+{
+	const u1 *data;
+	DexStatsTimer timer;
+	z_stream zs;
+	int ret;
+
+	if(entry->method != ZIP_DEFLATED){
+		fprintf(stderr, "zip_inflate - unsupported compression method %u.\n", entry->method);
+		return -1;
+	}
+	if((data = zip_entry_data(zip, entry)) == NULL)
+		return -1;
+
+	dex_stats_begin(&timer);
+	memset(&zs, 0, sizeof(zs));
+	// raw deflate stream, no zlib header.
+	if(inflateInit2(&zs, -MAX_WBITS) != Z_OK){
+		fprintf(stderr, "zip_inflate - inflateInit2 failure.\n");
+		return -1;
+	}
+	zs.next_in = (Bytef *)data;
+	zs.avail_in = entry->comp_size;
+	zs.next_out = out;
+	zs.avail_out = entry->uncomp_size;
+	ret = inflate(&zs, Z_FINISH);
+	inflateEnd(&zs);
+	dex_stats_end(&timer, DEX_PHASE_INFLATE);
+	DEX_STAT_ADD(DEX_STAT_INFLATED_BYTES, zs.total_out);
+
+	if(ret != Z_STREAM_END || zs.total_out != entry->uncomp_size){
+		fprintf(stderr, "zip_inflate - corrupt deflate stream (%d).\n", ret);
+		return -1;
+	}
+	return 0;
+}
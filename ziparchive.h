@@ -0,0 +1,39 @@
+#ifndef __ZIPARCHIVE_H__
+#define __ZIPARCHIVE_H__
+
+#include "dextypes.h"
+#include "deximage.h"
+
+/*
+ * Read-only access to the entries of a zip (apk) archive held in a
+ * DexImage. The central directory is walked once; names point into the
+ * image and are not NUL terminated. zip64 archives are not supported.
+ */
+enum {
+	ZIP_STORED		= 0,
+	ZIP_DEFLATED	= 8,
+};
+
+typedef struct {
+	const char	*name;
+	u2			name_len;
+	u2			method;			/* ZIP_STORED or ZIP_DEFLATED */
+	u4			crc32;
+	u4			comp_size;
+	u4			uncomp_size;
+	u4			local_off;		/* offset of the local file header */
+} ZipEntry;
+
+typedef struct {
+	const DexImage	*image;
+	ZipEntry		*entries;
+	u4				cnt;
+} ZipArchive;
+
+extern int zip_is_archive(const DexImage *image);
+extern int zip_open(ZipArchive *zip, const DexImage *image);
+extern void zip_close(ZipArchive *zip);
+extern const u1 *zip_entry_data(const ZipArchive *zip, const ZipEntry *entry);
+extern int zip_inflate(const ZipArchive *zip, const ZipEntry *entry, u1 *out);
+
+#endif	/* __ZIPARCHIVE_H__ */